@@ -10,6 +10,19 @@ javac\
 	-d .\
 	../src/main/java/com/makepad/hello_quest/*.java
 dx --dex --output classes.dex .
+cc -O2 -o generate_font_atlas ../src/tools/generate_font_atlas.c\
+    $(pkg-config --cflags --libs freetype2) -lm
+./generate_font_atlas\
+    ${FONT:-/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf}\
+    font_atlas.c
+cc -O2 -o optimize_mesh ../src/tools/mesh_optimizer.c\
+    ../src/tools/optimize_mesh.c
+cc -O2 -o build_asset_pack ../src/main/cpp/asset_pack.c\
+    ../src/tools/build_asset_pack.c
+./optimize_mesh ../src/main/assets/cube.obj cube.mesh
+./optimize_mesh ../src/main/assets/floor.obj floor.mesh
+mkdir -p assets
+./build_asset_pack assets/hello_quest.pak cube.mesh floor.mesh
 mkdir -p lib/arm64-v8a
 pushd lib/arm64-v8a > /dev/null
 aarch64-linux-android26-clang\
@@ -17,13 +30,16 @@ aarch64-linux-android26-clang\
     -shared\
     -I $NDK_HOME/toolchains/llvm/prebuilt/linux-x86_64/sysroot/usr/include/\
     -I $OVR_HOME/VrApi/Include\
+    -I ../../../src/main/cpp\
     -L $NDK_HOME/platforms/android-26/arch-arm64/usr/lib\
     -L $OVR_HOME/VrApi/Libs/Android/arm64-v8a/Debug\
     -landroid\
     -llog\
+    -lm\
     -lvrapi\
     -o libmain.so\
-   ../../../src/main/cpp/*.c
+   ../../../src/main/cpp/*.c\
+   ../../font_atlas.c
 cp $OVR_HOME/VrApi/Libs/Android/arm64-v8a/Debug/libvrapi.so .
 popd > /dev/null
 aapt\
@@ -35,6 +51,11 @@ aapt\
 aapt add hello_quest.apk classes.dex
 aapt add hello_quest.apk lib/arm64-v8a/libmain.so
 aapt add hello_quest.apk lib/arm64-v8a/libvrapi.so
+# The asset pack is stored uncompressed, and aligned so that
+# AAsset_getBuffer can map it in place.
+aapt add -0 "" hello_quest.apk assets/hello_quest.pak
+zipalign -f 16 hello_quest.apk hello_quest_aligned.apk
+mv hello_quest_aligned.apk hello_quest.apk
 apksigner\
 	sign\
 	-ks ~/.android/debug.keystore\
@@ -20,6 +20,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/resource.h>
 
@@ -47,18 +48,17 @@ static void free_saved_state(struct android_app* android_app) {
 }
 
 int8_t android_app_read_cmd(struct android_app* android_app) {
-    int8_t cmd;
-    if (read(android_app->msgread, &cmd, sizeof(cmd)) == sizeof(cmd)) {
-        switch (cmd) {
-            case APP_CMD_SAVE_STATE:
-                free_saved_state(android_app);
-                break;
-        }
-        return cmd;
-    } else {
-        LOGE("No data on command pipe!");
+    if (!cmd_queue_pop(&android_app->cmdQueue, &android_app->currentCmd)) {
+        return -1;
+    }
+
+    int8_t cmd = android_app->currentCmd.type;
+    switch (cmd) {
+        case APP_CMD_SAVE_STATE:
+            free_saved_state(android_app);
+            break;
     }
-    return -1;
+    return cmd;
 }
 
 static void print_cur_config(struct android_app* android_app) {
@@ -94,7 +94,7 @@ void android_app_pre_exec_cmd(struct android_app* android_app, int8_t cmd) {
             if (android_app->inputQueue != NULL) {
                 AInputQueue_detachLooper(android_app->inputQueue);
             }
-            android_app->inputQueue = android_app->pendingInputQueue;
+            android_app->inputQueue = android_app->currentCmd.payload;
             if (android_app->inputQueue != NULL) {
                 LOGV("Attaching input queue to looper");
                 AInputQueue_attachLooper(android_app->inputQueue,
@@ -108,7 +108,7 @@ void android_app_pre_exec_cmd(struct android_app* android_app, int8_t cmd) {
         case APP_CMD_INIT_WINDOW:
             LOGV("APP_CMD_INIT_WINDOW\n");
             pthread_mutex_lock(&android_app->mutex);
-            android_app->window = android_app->pendingWindow;
+            android_app->window = android_app->currentCmd.payload;
             pthread_cond_broadcast(&android_app->cond);
             pthread_mutex_unlock(&android_app->mutex);
             break;
@@ -122,11 +122,10 @@ void android_app_pre_exec_cmd(struct android_app* android_app, int8_t cmd) {
         case APP_CMD_START:
         case APP_CMD_PAUSE:
         case APP_CMD_STOP:
+            // The main thread doesn't wait for activity state changes, so
+            // there is nobody to wake up here.
             LOGV("activityState=%d\n", cmd);
-            pthread_mutex_lock(&android_app->mutex);
             android_app->activityState = cmd;
-            pthread_cond_broadcast(&android_app->cond);
-            pthread_mutex_unlock(&android_app->mutex);
             break;
 
         case APP_CMD_CONFIG_CHANGED:
@@ -185,24 +184,51 @@ static void android_app_destroy(struct android_app* android_app) {
     // Can't touch android_app object after this.
 }
 
+static int64_t get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 static void process_input(struct android_app* app, struct android_poll_source* source) {
-    AInputEvent* event = NULL;
-    while (AInputQueue_getEvent(app->inputQueue, &event) >= 0) {
-        LOGV("New input event: type=%d\n", AInputEvent_getType(event));
-        if (AInputQueue_preDispatchEvent(app->inputQueue, event)) {
-            continue;
+    int64_t deadline = app->inputTimeBudget > 0 ?
+            get_time_ns() + app->inputTimeBudget : INT64_MAX;
+    int32_t count = 0;
+    for (;;) {
+        // Pull everything that is pending into the batch first, then
+        // dispatch the whole batch.
+        int32_t batchCount = 0;
+        AInputEvent* event = NULL;
+        while (batchCount < ANDROID_APP_INPUT_BATCH_SIZE &&
+                AInputQueue_getEvent(app->inputQueue, &event) >= 0) {
+            LOGV("New input event: type=%d\n", AInputEvent_getType(event));
+            if (AInputQueue_preDispatchEvent(app->inputQueue, event)) {
+                continue;
+            }
+            app->inputEvents[batchCount++] = event;
+        }
+        for (int32_t i = 0; i < batchCount; ++i) {
+            int32_t handled = 0;
+            if (app->onInputEvent != NULL) handled = app->onInputEvent(app, app->inputEvents[i]);
+            AInputQueue_finishEvent(app->inputQueue, app->inputEvents[i], handled);
+        }
+        count += batchCount;
+        if (batchCount < ANDROID_APP_INPUT_BATCH_SIZE || get_time_ns() >= deadline) {
+            break;
         }
-        int32_t handled = 0;
-        if (app->onInputEvent != NULL) handled = app->onInputEvent(app, event);
-        AInputQueue_finishEvent(app->inputQueue, event, handled);
     }
+    app->inputEventCount = count;
 }
 
 static void process_cmd(struct android_app* app, struct android_poll_source* source) {
-    int8_t cmd = android_app_read_cmd(app);
-    android_app_pre_exec_cmd(app, cmd);
-    if (app->onAppCmd != NULL) app->onAppCmd(app, cmd);
-    android_app_post_exec_cmd(app, cmd);
+    // Drain every command that is queued, so a burst of lifecycle changes
+    // costs a single looper wakeup.
+    int8_t cmd;
+    while ((cmd = android_app_read_cmd(app)) >= 0) {
+        android_app_pre_exec_cmd(app, cmd);
+        if (app->onAppCmd != NULL) app->onAppCmd(app, cmd);
+        android_app_post_exec_cmd(app, cmd);
+    }
 }
 
 static void* android_app_entry(void* param) {
@@ -221,7 +247,7 @@ static void* android_app_entry(void* param) {
     android_app->inputPollSource.process = process_input;
 
     ALooper* looper = ALooper_prepare(ALOOPER_PREPARE_ALLOW_NON_CALLBACKS);
-    ALooper_addFd(looper, android_app->msgread, LOOPER_ID_MAIN, ALOOPER_EVENT_INPUT, NULL,
+    ALooper_addFd(looper, android_app->cmdQueue.fd, LOOPER_ID_MAIN, ALOOPER_EVENT_INPUT, NULL,
             &android_app->cmdPollSource);
     android_app->looper = looper;
 
@@ -242,7 +268,14 @@ static void* android_app_entry(void* param) {
 
 static struct android_app* android_app_create(ANativeActivity* activity,
         void* savedState, size_t savedStateSize) {
-    struct android_app* android_app = (struct android_app*)malloc(sizeof(struct android_app));
+    // The command queue keeps its producer and consumer positions on
+    // separate cache lines, so the app must be aligned to one.
+    struct android_app* android_app = NULL;
+    if (posix_memalign((void**)&android_app, _Alignof(struct android_app),
+            sizeof(struct android_app)) != 0) {
+        LOGE("could not allocate android_app");
+        return NULL;
+    }
     memset(android_app, 0, sizeof(struct android_app));
     android_app->activity = activity;
 
@@ -255,13 +288,10 @@ static struct android_app* android_app_create(ANativeActivity* activity,
         memcpy(android_app->savedState, savedState, savedStateSize);
     }
 
-    int msgpipe[2];
-    if (pipe(msgpipe)) {
-        LOGE("could not create pipe: %s", strerror(errno));
+    if (!cmd_queue_create(&android_app->cmdQueue)) {
+        LOGE("could not create eventfd: %s", strerror(errno));
         return NULL;
     }
-    android_app->msgread = msgpipe[0];
-    android_app->msgwrite = msgpipe[1];
 
     pthread_attr_t attr; 
     pthread_attr_init(&attr);
@@ -278,56 +308,74 @@ static struct android_app* android_app_create(ANativeActivity* activity,
     return android_app;
 }
 
-static void android_app_write_cmd(struct android_app* android_app, int8_t cmd) {
-    if (write(android_app->msgwrite, &cmd, sizeof(cmd)) != sizeof(cmd)) {
-        LOGE("Failure writing android_app cmd: %s\n", strerror(errno));
+static void android_app_push_cmd(struct android_app* android_app,
+        const struct cmd* cmd) {
+    while (!cmd_queue_push(&android_app->cmdQueue, cmd)) {
+        // The app thread is behind; lifecycle commands must not be dropped.
+        sched_yield();
     }
 }
 
+static void android_app_write_cmd(struct android_app* android_app, int8_t cmd) {
+    struct cmd app_cmd;
+    memset(&app_cmd, 0, sizeof(app_cmd));
+    app_cmd.type = cmd;
+    android_app_push_cmd(android_app, &app_cmd);
+}
+
 static void android_app_set_input(struct android_app* android_app, AInputQueue* inputQueue) {
+    struct cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = APP_CMD_INPUT_CHANGED;
+    cmd.payload = inputQueue;
+    android_app_push_cmd(android_app, &cmd);
+
+    // The old queue must not be used by the app thread once we return.
     pthread_mutex_lock(&android_app->mutex);
-    android_app->pendingInputQueue = inputQueue;
-    android_app_write_cmd(android_app, APP_CMD_INPUT_CHANGED);
-    while (android_app->inputQueue != android_app->pendingInputQueue) {
+    while (android_app->inputQueue != inputQueue) {
         pthread_cond_wait(&android_app->cond, &android_app->mutex);
     }
     pthread_mutex_unlock(&android_app->mutex);
 }
 
 static void android_app_set_window(struct android_app* android_app, ANativeWindow* window) {
-    pthread_mutex_lock(&android_app->mutex);
+    struct cmd cmd;
+    memset(&cmd, 0, sizeof(cmd));
     if (android_app->pendingWindow != NULL) {
-        android_app_write_cmd(android_app, APP_CMD_TERM_WINDOW);
+        cmd.type = APP_CMD_TERM_WINDOW;
+        cmd.payload = android_app->pendingWindow;
+        android_app_push_cmd(android_app, &cmd);
     }
     android_app->pendingWindow = window;
     if (window != NULL) {
-        android_app_write_cmd(android_app, APP_CMD_INIT_WINDOW);
+        cmd.type = APP_CMD_INIT_WINDOW;
+        cmd.payload = window;
+        android_app_push_cmd(android_app, &cmd);
     }
-    while (android_app->window != android_app->pendingWindow) {
+
+    // The old window must not be used by the app thread once we return.
+    pthread_mutex_lock(&android_app->mutex);
+    while (android_app->window != window) {
         pthread_cond_wait(&android_app->cond, &android_app->mutex);
     }
     pthread_mutex_unlock(&android_app->mutex);
 }
 
 static void android_app_set_activity_state(struct android_app* android_app, int8_t cmd) {
-    pthread_mutex_lock(&android_app->mutex);
+    // Nothing on the main thread depends on the app thread having seen the
+    // new state, so there is no need to wait for it.
     android_app_write_cmd(android_app, cmd);
-    while (android_app->activityState != cmd) {
-        pthread_cond_wait(&android_app->cond, &android_app->mutex);
-    }
-    pthread_mutex_unlock(&android_app->mutex);
 }
 
 static void android_app_free(struct android_app* android_app) {
-    pthread_mutex_lock(&android_app->mutex);
     android_app_write_cmd(android_app, APP_CMD_DESTROY);
+    pthread_mutex_lock(&android_app->mutex);
     while (!android_app->destroyed) {
         pthread_cond_wait(&android_app->cond, &android_app->mutex);
     }
     pthread_mutex_unlock(&android_app->mutex);
 
-    close(android_app->msgread);
-    close(android_app->msgwrite);
+    cmd_queue_destroy(&android_app->cmdQueue);
     pthread_cond_destroy(&android_app->cond);
     pthread_mutex_destroy(&android_app->mutex);
     free(android_app);
@@ -355,7 +403,9 @@ static void* onSaveInstanceState(ANativeActivity* activity, size_t* outLen) {
     LOGV("SaveInstanceState: %p\n", activity);
     pthread_mutex_lock(&android_app->mutex);
     android_app->stateSaved = 0;
+    pthread_mutex_unlock(&android_app->mutex);
     android_app_write_cmd(android_app, APP_CMD_SAVE_STATE);
+    pthread_mutex_lock(&android_app->mutex);
     while (!android_app->stateSaved) {
         pthread_cond_wait(&android_app->cond, &android_app->mutex);
     }
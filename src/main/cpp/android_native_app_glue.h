@@ -21,11 +21,14 @@
 #include <poll.h>
 #include <pthread.h>
 #include <sched.h>
+#include <stdint.h>
 
 #include <android/configuration.h>
 #include <android/looper.h>
 #include <android/native_activity.h>
 
+#include "cmd_queue.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -100,6 +103,12 @@ struct android_poll_source {
     void (*process)(struct android_app* app, struct android_poll_source* source);
 };
 
+/**
+ * Maximum number of input events that are drained from the AInputQueue in
+ * a single looper wakeup.
+ */
+#define ANDROID_APP_INPUT_BATCH_SIZE 64
+
 /**
  * This is the interface for the standard glue code of a threaded
  * application.  In this model, the application's code is running
@@ -161,25 +170,41 @@ struct android_app {
     // destroyed and waiting for the app thread to complete.
     int destroyRequested;
 
+    // Maximum time in nanoseconds that a single looper wakeup may spend
+    // draining the input queue, or 0 for no limit.  Events that don't fit in
+    // the budget stay queued and are handled on the next wakeup.
+    int64_t inputTimeBudget;
+
+    // Number of input events handled during the last input wakeup.
+    int32_t inputEventCount;
+
+    // The command most recently returned by android_app_read_cmd(),
+    // including its payload.  Commands that change the window or the input
+    // queue carry the new object as their payload, so the app thread never
+    // has to look at state owned by the main thread.
+    struct cmd currentCmd;
+
     // -------------------------------------------------
     // Below are "private" implementation of the glue code.
 
     pthread_mutex_t mutex;
     pthread_cond_t cond;
 
-    int msgread;
-    int msgwrite;
+    // Its eventfd wakes the looper when commands are pushed.
+    struct cmd_queue cmdQueue;
 
     pthread_t thread;
 
     struct android_poll_source cmdPollSource;
     struct android_poll_source inputPollSource;
 
+    // Preallocated buffer that input events are drained into.
+    AInputEvent* inputEvents[ANDROID_APP_INPUT_BATCH_SIZE];
+
     int running;
     int stateSaved;
     int destroyed;
     int redrawNeeded;
-    AInputQueue* pendingInputQueue;
     ANativeWindow* pendingWindow;
     ARect pendingContentRect;
 };
@@ -313,7 +338,9 @@ enum {
 
 /**
  * Call when ALooper_pollAll() returns LOOPER_ID_MAIN, reading the next
- * app command message.
+ * app command message.  Returns -1 once the queue has been drained, so all
+ * commands that arrived together can be handled in one batch.  The payload
+ * of the returned command is available in android_app->currentCmd.
  */
 int8_t android_app_read_cmd(struct android_app* android_app);
 
@@ -0,0 +1,234 @@
+#include "animation.h"
+#include "memory.h"
+#include "vec4.h"
+#include <math.h>
+#include <string.h>
+
+// c = a * b. c must not alias a or b.
+static void
+multiply_matrices(float* restrict c, const float* restrict a,
+                  const float* restrict b)
+{
+    vec4 b0 = vec4_load(b + 0);
+    vec4 b1 = vec4_load(b + 4);
+    vec4 b2 = vec4_load(b + 8);
+    vec4 b3 = vec4_load(b + 12);
+    for (int i = 0; i < 4; ++i) {
+        vec4 c_row = vec4_mul(b0, vec4_splat(a[4 * i + 0]));
+        c_row = vec4_madd(c_row, b1, vec4_splat(a[4 * i + 1]));
+        c_row = vec4_madd(c_row, b2, vec4_splat(a[4 * i + 2]));
+        c_row = vec4_madd(c_row, b3, vec4_splat(a[4 * i + 3]));
+        vec4_store(c + 4 * i, c_row);
+    }
+}
+
+static void
+pose_to_matrix(const struct joint_pose* pose, float* matrix)
+{
+    float x = pose->rotation[0];
+    float y = pose->rotation[1];
+    float z = pose->rotation[2];
+    float w = pose->rotation[3];
+    matrix[0] = 1.0 - 2.0 * (y * y + z * z);
+    matrix[1] = 2.0 * (x * y - w * z);
+    matrix[2] = 2.0 * (x * z + w * y);
+    matrix[3] = pose->translation[0];
+    matrix[4] = 2.0 * (x * y + w * z);
+    matrix[5] = 1.0 - 2.0 * (x * x + z * z);
+    matrix[6] = 2.0 * (y * z - w * x);
+    matrix[7] = pose->translation[1];
+    matrix[8] = 2.0 * (x * z - w * y);
+    matrix[9] = 2.0 * (y * z + w * x);
+    matrix[10] = 1.0 - 2.0 * (x * x + y * y);
+    matrix[11] = pose->translation[2];
+    matrix[12] = 0.0;
+    matrix[13] = 0.0;
+    matrix[14] = 0.0;
+    matrix[15] = 1.0;
+}
+
+void
+animation_clip_create(struct animation_clip* clip, int joint_count,
+                      int frame_count, float frame_rate)
+{
+    clip->joint_count = joint_count;
+    clip->frame_count = frame_count;
+    clip->frame_rate = frame_rate;
+    clip->poses =
+        memory_alloc(frame_count * joint_count * sizeof(struct joint_pose));
+}
+
+void
+animation_clip_destroy(struct animation_clip* clip)
+{
+    memory_free(clip->poses);
+}
+
+struct joint_pose*
+animation_clip_get_frame(struct animation_clip* clip, int frame)
+{
+    return &clip->poses[frame * clip->joint_count];
+}
+
+// Where a layer is between two frames of its clip.
+struct layer_sample
+{
+    const struct joint_pose* poses_0;
+    const struct joint_pose* poses_1;
+    vec4 t;
+    // Normalized over all layers.
+    float weight;
+};
+
+void
+animation_sample(const struct skeleton* skeleton,
+                 const struct animation_layer* layers, int layer_count,
+                 float (*palette)[16])
+{
+    struct layer_sample samples[MAX_ANIMATION_LAYERS];
+    float total_weight = 0.0;
+    for (int i = 0; i < layer_count; ++i) {
+        total_weight += layers[i].weight;
+    }
+    for (int i = 0; i < layer_count; ++i) {
+        const struct animation_clip* clip = layers[i].clip;
+        float frame = fmodf(layers[i].time * clip->frame_rate,
+                            clip->frame_count);
+        if (frame < 0.0) {
+            frame += clip->frame_count;
+        }
+        int frame_0 = (int)frame % clip->frame_count;
+        int frame_1 = (frame_0 + 1) % clip->frame_count;
+        samples[i].poses_0 = &clip->poses[frame_0 * clip->joint_count];
+        samples[i].poses_1 = &clip->poses[frame_1 * clip->joint_count];
+        samples[i].t = vec4_splat(frame - (int)frame);
+        samples[i].weight = layers[i].weight / total_weight;
+    }
+
+    // Model matrices of the joints, so that children can build on their
+    // parents.
+    float model_matrices[MAX_JOINTS][16] __attribute__((aligned(16)));
+    for (int joint = 0; joint < skeleton->joint_count; ++joint) {
+        vec4 rotation = vec4_splat(0.0);
+        vec4 translation = vec4_splat(0.0);
+        vec4 first_rotation = vec4_splat(0.0);
+        for (int i = 0; i < layer_count; ++i) {
+            const struct layer_sample* sample = &samples[i];
+            vec4 rotation_0 = vec4_load(sample->poses_0[joint].rotation);
+            vec4 rotation_1 = vec4_load(sample->poses_1[joint].rotation);
+            // q and -q are the same rotation, so take the one that is
+            // closer, both between frames and between layers.
+            if (vec4_dot(rotation_0, rotation_1) < 0.0) {
+                rotation_1 = vec4_mul(rotation_1, vec4_splat(-1.0));
+            }
+            vec4 layer_rotation = vec4_madd(
+                rotation_0, vec4_sub(rotation_1, rotation_0), sample->t);
+            float rotation_weight = sample->weight;
+            if (i == 0) {
+                first_rotation = layer_rotation;
+            } else if (vec4_dot(layer_rotation, first_rotation) < 0.0) {
+                rotation_weight = -rotation_weight;
+            }
+            rotation = vec4_madd(rotation, layer_rotation,
+                                 vec4_splat(rotation_weight));
+            vec4 translation_0 = vec4_load(sample->poses_0[joint].translation);
+            vec4 translation_1 = vec4_load(sample->poses_1[joint].translation);
+            vec4 layer_translation =
+                vec4_madd(translation_0,
+                          vec4_sub(translation_1, translation_0), sample->t);
+            translation = vec4_madd(translation, layer_translation,
+                                    vec4_splat(sample->weight));
+        }
+        rotation = vec4_mul(
+            rotation, vec4_splat(1.0 / sqrtf(vec4_dot(rotation, rotation))));
+
+        struct joint_pose pose;
+        vec4_store(pose.rotation, rotation);
+        vec4_store(pose.translation, translation);
+        int parent = skeleton->parents[joint];
+        if (parent < 0) {
+            pose_to_matrix(&pose, model_matrices[joint]);
+        } else {
+            float local_matrix[16] __attribute__((aligned(16)));
+            pose_to_matrix(&pose, local_matrix);
+            multiply_matrices(model_matrices[joint], model_matrices[parent],
+                              local_matrix);
+        }
+        multiply_matrices(palette[joint], model_matrices[joint],
+                          skeleton->inverse_bind_matrices[joint]);
+    }
+}
+
+void
+skeleton_set_bind_pose(struct skeleton* skeleton,
+                       const struct joint_pose* bind_pose)
+{
+    float model_matrices[MAX_JOINTS][16] __attribute__((aligned(16)));
+    for (int joint = 0; joint < skeleton->joint_count; ++joint) {
+        int parent = skeleton->parents[joint];
+        if (parent < 0) {
+            pose_to_matrix(&bind_pose[joint], model_matrices[joint]);
+        } else {
+            float local_matrix[16] __attribute__((aligned(16)));
+            pose_to_matrix(&bind_pose[joint], local_matrix);
+            multiply_matrices(model_matrices[joint], model_matrices[parent],
+                              local_matrix);
+        }
+
+        // The matrices are rigid, so the inverse is the transposed rotation
+        // and the translation rotated back and negated.
+        const float* m = model_matrices[joint];
+        float* inverse = skeleton->inverse_bind_matrices[joint];
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                inverse[4 * i + j] = m[4 * j + i];
+            }
+            inverse[4 * i + 3] = -(m[0 + i] * m[3] + m[4 + i] * m[7] +
+                                   m[8 + i] * m[11]);
+        }
+        inverse[12] = 0.0;
+        inverse[13] = 0.0;
+        inverse[14] = 0.0;
+        inverse[15] = 1.0;
+    }
+}
+
+void
+skin_vertices(const struct skinned_vertex* vertices, int vertex_count,
+              int joint_count, const float (*palette)[16],
+              struct vertex* output)
+{
+    // Transposed, so that a position is transformed by adding up the
+    // columns scaled by its coordinates.
+    float columns[MAX_JOINTS][16] __attribute__((aligned(16)));
+    for (int joint = 0; joint < joint_count; ++joint) {
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                columns[joint][4 * j + i] = palette[joint][4 * i + j];
+            }
+        }
+    }
+
+    for (int i = 0; i < vertex_count; ++i) {
+        const struct skinned_vertex* vertex = &vertices[i];
+        vec4 x = vec4_splat(vertex->position[0]);
+        vec4 y = vec4_splat(vertex->position[1]);
+        vec4 z = vec4_splat(vertex->position[2]);
+        vec4 position = vec4_splat(0.0);
+        for (int j = 0; j < 4; ++j) {
+            uint8_t weight = vertex->joint_weights[j];
+            if (weight == 0) {
+                continue;
+            }
+            const float* column = columns[vertex->joint_indices[j]];
+            vec4 transformed = vec4_load(column + 12);
+            transformed = vec4_madd(transformed, vec4_load(column + 0), x);
+            transformed = vec4_madd(transformed, vec4_load(column + 4), y);
+            transformed = vec4_madd(transformed, vec4_load(column + 8), z);
+            position =
+                vec4_madd(position, transformed, vec4_splat(weight / 255.0));
+        }
+        vec4_store_unaligned(output[i].position, position);
+        memcpy(output[i].color, vertex->color, sizeof(output[i].color));
+    }
+}
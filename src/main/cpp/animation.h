@@ -0,0 +1,103 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "mesh.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Skeletal animation. A clip stores the local pose of every joint at a fixed
+// frame rate. Sampling blends up to MAX_ANIMATION_LAYERS clips, each at its
+// own time and weight, and turns the result into a palette of skinning
+// matrices, one per joint, that take a vertex from the bind pose to its
+// animated position in model space. Poses are blended with normalized
+// linear interpolation, a quaternion and a translation each fitting in one
+// vector register.
+//
+// Skinning can then happen on the GPU, from the palette, or on the CPU with
+// skin_vertices, for vertices that are streamed to the GPU every frame.
+//
+// Matrices are 16 floats, row-major with column vectors, the same layout as
+// ovrMatrix4f.
+
+enum
+{
+    MAX_JOINTS = 64,
+    MAX_ANIMATION_LAYERS = 4,
+};
+
+struct joint_pose
+{
+    // A unit quaternion, x, y, z, w.
+    float rotation[4];
+    // The last component is padding.
+    float translation[4];
+} __attribute__((aligned(16)));
+
+struct skeleton
+{
+    int joint_count;
+    // A joint's parent always comes before it. Roots have a parent of -1.
+    int parents[MAX_JOINTS];
+    // From model space to the space of each joint, in the bind pose.
+    float inverse_bind_matrices[MAX_JOINTS][16] __attribute__((aligned(16)));
+};
+
+struct animation_clip
+{
+    int joint_count;
+    int frame_count;
+    // Frames per second. Clips loop, so the last frame blends into the
+    // first.
+    float frame_rate;
+    // frame_count poses per joint, frame by frame.
+    struct joint_pose* poses;
+};
+
+void animation_clip_create(struct animation_clip* clip, int joint_count,
+                           int frame_count, float frame_rate);
+
+void animation_clip_destroy(struct animation_clip* clip);
+
+struct joint_pose* animation_clip_get_frame(struct animation_clip* clip,
+                                            int frame);
+
+struct animation_layer
+{
+    const struct animation_clip* clip;
+    // In seconds. Wraps around the length of the clip.
+    float time;
+    // Relative to the other layers. Weights don't need to add up to 1, but
+    // at least one must be positive.
+    float weight;
+};
+
+// Samples and blends layer_count layers, at most MAX_ANIMATION_LAYERS, whose
+// clips all have the skeleton's joint count, and writes a skinning matrix
+// for every joint to palette, which must be aligned to 16 bytes. Safe to
+// call from several threads at once.
+void animation_sample(const struct skeleton* skeleton,
+                      const struct animation_layer* layers, int layer_count,
+                      float (*palette)[16]);
+
+// Sets inverse_bind_matrices from the model matrices of the joints in the
+// bind pose.
+void skeleton_set_bind_pose(struct skeleton* skeleton,
+                            const struct joint_pose* bind_pose);
+
+struct skinned_vertex
+{
+    float position[4];
+    float color[4];
+    uint8_t joint_indices[4];
+    // Add up to 255.
+    uint8_t joint_weights[4];
+};
+
+// Blends the palette matrices of each vertex's joints, transforms its
+// position with the result, and writes it with its color to output, which
+// doesn't need to be aligned. palette must be aligned to 16 bytes.
+void skin_vertices(const struct skinned_vertex* vertices, int vertex_count,
+                   int joint_count, const float (*palette)[16],
+                   struct vertex* output);
+
+#endif // ANIMATION_H
@@ -0,0 +1,112 @@
+#include "asset_pack.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint32_t
+asset_pack_hash(const char* name, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool
+asset_pack_init(struct asset_pack* pack, const void* data, size_t size)
+{
+    if ((uintptr_t)data % ASSET_PACK_ALIGNMENT != 0 ||
+        size < sizeof(struct asset_pack_header)) {
+        return false;
+    }
+    const struct asset_pack_header* header = data;
+    // The slots are only checked as a whole here, so that opening a pack
+    // doesn't touch its table. Each entry is checked when it is found.
+    uint32_t slot_count = header->slot_count;
+    if (header->magic != ASSET_PACK_MAGIC || slot_count == 0 ||
+        (slot_count & (slot_count - 1)) != 0 ||
+        header->slots_offset % sizeof(uint32_t) != 0 ||
+        header->slots_offset > size ||
+        (size - header->slots_offset) / sizeof(struct asset_pack_entry) <
+            slot_count) {
+        return false;
+    }
+    pack->data = data;
+    pack->size = size;
+    pack->header = header;
+    pack->slots = (const struct asset_pack_entry*)((const char*)data +
+                                                   header->slots_offset);
+    pack->mapping = NULL;
+    pack->mapping_size = 0;
+    return true;
+}
+
+bool
+asset_pack_map_file(struct asset_pack* pack, const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    // The mapping stays valid after the file is closed. It starts on a page
+    // boundary, so it is aligned enough for the pack.
+    size_t size = st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    if (!asset_pack_init(pack, mapping, size)) {
+        munmap(mapping, size);
+        return false;
+    }
+    pack->mapping = mapping;
+    pack->mapping_size = size;
+    return true;
+}
+
+void
+asset_pack_unmap_file(struct asset_pack* pack)
+{
+    munmap(pack->mapping, pack->mapping_size);
+}
+
+const void*
+asset_pack_find(const struct asset_pack* pack, const char* name,
+                size_t* size)
+{
+    size_t name_size = strlen(name);
+    uint32_t hash = asset_pack_hash(name, name_size);
+    uint32_t mask = pack->header->slot_count - 1;
+    // A valid table always has an empty slot, but a corrupt one might not,
+    // so the probe stops after visiting every slot.
+    for (uint32_t i = 0; i <= mask; ++i) {
+        const struct asset_pack_entry* entry =
+            &pack->slots[(hash + i) & mask];
+        if (entry->name_size == 0) {
+            return NULL;
+        }
+        if (entry->hash != hash || entry->name_size != name_size ||
+            entry->name_offset > pack->size ||
+            pack->size - entry->name_offset < name_size ||
+            memcmp(pack->data + entry->name_offset, name, name_size) != 0) {
+            continue;
+        }
+        if (entry->data_offset > pack->size ||
+            pack->size - entry->data_offset < entry->data_size) {
+            return NULL;
+        }
+        *size = entry->data_size;
+        return pack->data + entry->data_offset;
+    }
+    return NULL;
+}
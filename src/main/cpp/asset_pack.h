@@ -0,0 +1,78 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Layout of the asset packs written by build_asset_pack in src/tools. A
+// pack is a single uncompressed blob, meant to be mapped into memory and
+// used in place: finding an asset returns a pointer into the pack, without
+// reading or copying anything else.
+//
+// The pack starts with a header, followed by a hash table of entries, the
+// names of the assets, and their data. The table uses open addressing with
+// linear probing, and is at most half full. Every asset's data is aligned to
+// ASSET_PACK_ALIGNMENT bytes from the start of the pack, so as long as the
+// pack itself is mapped at that alignment, so is every asset.
+
+#define ASSET_PACK_MAGIC 0x4B434150 // "PACK"
+
+enum
+{
+    ASSET_PACK_ALIGNMENT = 16,
+};
+
+struct asset_pack_header
+{
+    uint32_t magic;
+    uint32_t entry_count;
+    // A power of two.
+    uint32_t slot_count;
+    // Byte offset of the table from the start of the pack.
+    uint32_t slots_offset;
+};
+
+struct asset_pack_entry
+{
+    // asset_pack_hash of the name.
+    uint32_t hash;
+    // Byte offsets from the start of the pack, and sizes in bytes. The name
+    // isn't null-terminated. A name size of 0 marks an empty slot.
+    uint32_t name_offset;
+    uint32_t name_size;
+    uint32_t data_offset;
+    uint32_t data_size;
+};
+
+struct asset_pack
+{
+    const char* data;
+    size_t size;
+    const struct asset_pack_header* header;
+    const struct asset_pack_entry* slots;
+    // Set by asset_pack_map_file, for asset_pack_unmap_file.
+    void* mapping;
+    size_t mapping_size;
+};
+
+// FNV-1a of the size bytes of name.
+uint32_t asset_pack_hash(const char* name, size_t size);
+
+// Reads the header of the pack in data, which must stay valid for as long
+// as the pack is used. Returns false if data isn't a pack, or isn't aligned
+// to ASSET_PACK_ALIGNMENT.
+bool asset_pack_init(struct asset_pack* pack, const void* data, size_t size);
+
+// Maps the file at path into memory, read-only, and reads the pack in it.
+// Returns false if the file can't be mapped or isn't a pack.
+bool asset_pack_map_file(struct asset_pack* pack, const char* path);
+
+void asset_pack_unmap_file(struct asset_pack* pack);
+
+// Returns a pointer to the data of the asset called name, and stores its
+// size in size, or returns NULL if the pack has no such asset.
+const void* asset_pack_find(const struct asset_pack* pack, const char* name,
+                            size_t* size);
+
+#endif // ASSET_PACK_H
@@ -0,0 +1,91 @@
+#include "cmd_queue.h"
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+bool
+cmd_queue_create(struct cmd_queue* queue)
+{
+    for (uint32_t i = 0; i < CMD_QUEUE_SIZE; ++i) {
+        queue->cells[i].sequence = i;
+    }
+    queue->tail = 0;
+    queue->head = 0;
+    queue->signaled = 0;
+    queue->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    return queue->fd >= 0;
+}
+
+void
+cmd_queue_destroy(struct cmd_queue* queue)
+{
+    close(queue->fd);
+}
+
+bool
+cmd_queue_push(struct cmd_queue* queue, const struct cmd* cmd)
+{
+    uint32_t position = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        struct cmd_queue_cell* cell =
+            &queue->cells[position & (CMD_QUEUE_SIZE - 1)];
+        uint32_t sequence =
+            __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        int32_t difference = (int32_t)(sequence - position);
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n(&queue->tail, &position,
+                                            position + 1, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                cell->cmd = *cmd;
+                __atomic_store_n(&cell->sequence, position + 1,
+                                 __ATOMIC_SEQ_CST);
+                break;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+    if (__atomic_exchange_n(&queue->signaled, 1, __ATOMIC_SEQ_CST) == 0) {
+        // The counter is only written while signaled is clear, so it can't
+        // overflow, and the write can't fail.
+        uint64_t count = 1;
+        ssize_t result = write(queue->fd, &count, sizeof(count));
+        (void)result;
+    }
+    return true;
+}
+
+static bool
+try_pop(struct cmd_queue* queue, struct cmd* cmd)
+{
+    uint32_t position = queue->head;
+    struct cmd_queue_cell* cell =
+        &queue->cells[position & (CMD_QUEUE_SIZE - 1)];
+    if (__atomic_load_n(&cell->sequence, __ATOMIC_SEQ_CST) != position + 1) {
+        return false;
+    }
+    *cmd = cell->cmd;
+    __atomic_store_n(&cell->sequence, position + CMD_QUEUE_SIZE,
+                     __ATOMIC_RELEASE);
+    queue->head = position + 1;
+    return true;
+}
+
+bool
+cmd_queue_pop(struct cmd_queue* queue, struct cmd* cmd)
+{
+    if (try_pop(queue, cmd)) {
+        return true;
+    }
+    // Reset the eventfd before clearing signaled, so that a producer that
+    // pushes after this point always signals again, then look once more
+    // for commands pushed while signaled was still set. If the eventfd was
+    // already reset, the read fails with EAGAIN, which is fine.
+    uint64_t count;
+    ssize_t result = read(queue->fd, &count, sizeof(count));
+    (void)result;
+    __atomic_store_n(&queue->signaled, 0, __ATOMIC_SEQ_CST);
+    return try_pop(queue, cmd);
+}
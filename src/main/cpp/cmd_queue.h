@@ -0,0 +1,60 @@
+#ifndef CMD_QUEUE_H
+#define CMD_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bounded lock-free queue of commands, with any number of producers and a
+// single consumer. Each cell carries a sequence number that tells producers
+// and the consumer whether the cell is free or holds a command for the
+// current lap. An eventfd wakes the consumer, and is only written when the
+// queue goes from drained to non-empty, so a burst of commands costs a
+// single write.
+
+enum
+{
+    // Must be a power of two.
+    CMD_QUEUE_SIZE = 64,
+};
+
+struct cmd
+{
+    int8_t type;
+    // The object the command applies to, if any, such as a new window.
+    void* payload;
+};
+
+struct cmd_queue_cell
+{
+    uint32_t sequence;
+    struct cmd cmd;
+};
+
+struct cmd_queue
+{
+    struct cmd_queue_cell cells[CMD_QUEUE_SIZE];
+    // Next position to write, shared by all producers.
+    uint32_t tail __attribute__((aligned(64)));
+    // Next position to read, only touched by the consumer.
+    uint32_t head __attribute__((aligned(64)));
+    // Non-zero while the eventfd has been signaled and not yet drained.
+    uint32_t signaled;
+    // Readable while the queue may hold commands. Poll it from the
+    // consumer.
+    int fd;
+};
+
+// Returns false if the eventfd can't be created.
+bool cmd_queue_create(struct cmd_queue* queue);
+
+void cmd_queue_destroy(struct cmd_queue* queue);
+
+// Can be called from any thread. Returns false if the queue is full.
+bool cmd_queue_push(struct cmd_queue* queue, const struct cmd* cmd);
+
+// Must only be called from the consumer. Returns false once the queue is
+// drained, after resetting the eventfd, so that the next push signals it
+// again.
+bool cmd_queue_pop(struct cmd_queue* queue, struct cmd* cmd);
+
+#endif // CMD_QUEUE_H
@@ -0,0 +1,175 @@
+#include "command_buffer.h"
+#include <GLES3/gl3.h>
+#include <android/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+static const char* TAG = "command_buffer";
+
+static const GLenum PRIMITIVE_MODES[] = {
+    GL_TRIANGLES, GL_LINES,
+};
+
+static const GLenum INDEX_TYPES[] = {
+    GL_UNSIGNED_SHORT, GL_UNSIGNED_INT,
+};
+
+void
+command_buffer_create(struct command_buffer* buffer, struct arena* arena,
+                      size_t capacity)
+{
+    buffer->commands = arena_alloc(arena, capacity, 16);
+    buffer->capacity = capacity;
+    buffer->size = 0;
+    buffer->command_count = 0;
+}
+
+static void*
+command_buffer_push(struct command_buffer* buffer, enum command_type type,
+                    size_t size)
+{
+    // Keep every command 4-byte aligned.
+    size = (size + 3) & ~(size_t)3;
+    if (buffer->size + size > buffer->capacity) {
+        error("can't record command: %zu of %zu bytes in use", buffer->size,
+              buffer->capacity);
+        exit(EXIT_FAILURE);
+    }
+    struct command_header* header =
+        (struct command_header*)(buffer->commands + buffer->size);
+    header->type = type;
+    header->size = size;
+    buffer->size += size;
+    buffer->command_count++;
+    return header;
+}
+
+void
+command_buffer_bind_program(struct command_buffer* buffer, uint32_t program)
+{
+    struct command_bind_program* command = command_buffer_push(
+        buffer, COMMAND_TYPE_BIND_PROGRAM, sizeof(*command));
+    command->program = program;
+}
+
+void
+command_buffer_bind_vertex_array(struct command_buffer* buffer,
+                                 uint32_t vertex_array)
+{
+    struct command_bind_vertex_array* command = command_buffer_push(
+        buffer, COMMAND_TYPE_BIND_VERTEX_ARRAY, sizeof(*command));
+    command->vertex_array = vertex_array;
+}
+
+void
+command_buffer_set_uniform_matrix4(struct command_buffer* buffer,
+                                   int32_t location, const float* value)
+{
+    struct command_set_uniform_matrix4* command = command_buffer_push(
+        buffer, COMMAND_TYPE_SET_UNIFORM_MATRIX4, sizeof(*command));
+    command->location = location;
+    memcpy(command->value, value, sizeof(command->value));
+}
+
+void
+command_buffer_set_uniform_vector4(struct command_buffer* buffer,
+                                   int32_t location, const float* value)
+{
+    struct command_set_uniform_vector4* command = command_buffer_push(
+        buffer, COMMAND_TYPE_SET_UNIFORM_VECTOR4, sizeof(*command));
+    command->location = location;
+    memcpy(command->value, value, sizeof(command->value));
+}
+
+void
+command_buffer_draw_elements(struct command_buffer* buffer,
+                             enum primitive primitive,
+                             enum index_type index_type, int32_t count,
+                             uint32_t offset, int32_t instance_count)
+{
+    struct command_draw_elements* command = command_buffer_push(
+        buffer, COMMAND_TYPE_DRAW_ELEMENTS, sizeof(*command));
+    command->primitive = primitive;
+    command->index_type = index_type;
+    command->count = count;
+    command->offset = offset;
+    command->instance_count = instance_count;
+}
+
+void
+command_buffer_draw_arrays(struct command_buffer* buffer,
+                           enum primitive primitive, int32_t first,
+                           int32_t count)
+{
+    struct command_draw_arrays* command =
+        command_buffer_push(buffer, COMMAND_TYPE_DRAW_ARRAYS, sizeof(*command));
+    command->primitive = primitive;
+    command->first = first;
+    command->count = count;
+}
+
+void
+command_buffer_execute(const struct command_buffer* buffer)
+{
+    const char* current = buffer->commands;
+    const char* end = buffer->commands + buffer->size;
+    while (current != end) {
+        const struct command_header* header =
+            (const struct command_header*)current;
+        switch (header->type) {
+            case COMMAND_TYPE_BIND_PROGRAM: {
+                const struct command_bind_program* command =
+                    (const struct command_bind_program*)header;
+                glUseProgram(command->program);
+                break;
+            }
+            case COMMAND_TYPE_BIND_VERTEX_ARRAY: {
+                const struct command_bind_vertex_array* command =
+                    (const struct command_bind_vertex_array*)header;
+                glBindVertexArray(command->vertex_array);
+                break;
+            }
+            case COMMAND_TYPE_SET_UNIFORM_MATRIX4: {
+                const struct command_set_uniform_matrix4* command =
+                    (const struct command_set_uniform_matrix4*)header;
+                glUniformMatrix4fv(command->location, 1, GL_FALSE,
+                                   command->value);
+                break;
+            }
+            case COMMAND_TYPE_SET_UNIFORM_VECTOR4: {
+                const struct command_set_uniform_vector4* command =
+                    (const struct command_set_uniform_vector4*)header;
+                glUniform4fv(command->location, 1, command->value);
+                break;
+            }
+            case COMMAND_TYPE_DRAW_ELEMENTS: {
+                const struct command_draw_elements* command =
+                    (const struct command_draw_elements*)header;
+                const GLvoid* offset = (const GLvoid*)(size_t)command->offset;
+                if (command->instance_count > 1) {
+                    glDrawElementsInstanced(
+                        PRIMITIVE_MODES[command->primitive], command->count,
+                        INDEX_TYPES[command->index_type], offset,
+                        command->instance_count);
+                } else {
+                    glDrawElements(PRIMITIVE_MODES[command->primitive],
+                                   command->count,
+                                   INDEX_TYPES[command->index_type], offset);
+                }
+                break;
+            }
+            case COMMAND_TYPE_DRAW_ARRAYS: {
+                const struct command_draw_arrays* command =
+                    (const struct command_draw_arrays*)header;
+                glDrawArrays(PRIMITIVE_MODES[command->primitive],
+                             command->first, command->count);
+                break;
+            }
+            default:
+                abort();
+        }
+        current += header->size;
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include "memory.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Commands are plain structs packed back to back into a byte buffer. Each
+// starts with a header that holds its type and its size in bytes, so the
+// buffer can be walked without knowing every command type. Handles and
+// uniform locations are resolved when recording, so replaying a buffer is a
+// single pass with no lookups.
+
+enum command_type
+{
+    COMMAND_TYPE_BIND_PROGRAM,
+    COMMAND_TYPE_BIND_VERTEX_ARRAY,
+    COMMAND_TYPE_SET_UNIFORM_MATRIX4,
+    COMMAND_TYPE_SET_UNIFORM_VECTOR4,
+    COMMAND_TYPE_DRAW_ELEMENTS,
+    COMMAND_TYPE_DRAW_ARRAYS,
+};
+
+enum primitive
+{
+    PRIMITIVE_TRIANGLES,
+    PRIMITIVE_LINES,
+};
+
+enum index_type
+{
+    INDEX_TYPE_UINT16,
+    INDEX_TYPE_UINT32,
+};
+
+struct command_header
+{
+    uint16_t type;
+    uint16_t size;
+};
+
+struct command_bind_program
+{
+    struct command_header header;
+    uint32_t program;
+};
+
+struct command_bind_vertex_array
+{
+    struct command_header header;
+    uint32_t vertex_array;
+};
+
+struct command_set_uniform_matrix4
+{
+    struct command_header header;
+    int32_t location;
+    float value[16];
+};
+
+struct command_set_uniform_vector4
+{
+    struct command_header header;
+    int32_t location;
+    float value[4];
+};
+
+struct command_draw_elements
+{
+    struct command_header header;
+    uint8_t primitive;
+    uint8_t index_type;
+    int32_t count;
+    uint32_t offset;
+    int32_t instance_count;
+};
+
+struct command_draw_arrays
+{
+    struct command_header header;
+    uint8_t primitive;
+    int32_t first;
+    int32_t count;
+};
+
+struct command_buffer
+{
+    char* commands;
+    size_t capacity;
+    size_t size;
+    int command_count;
+};
+
+// The memory for the commands comes from arena, so a command buffer lives
+// until the arena is reset. Arenas aren't thread-safe, so create the
+// buffers for all workers up front, then record into them in parallel.
+void command_buffer_create(struct command_buffer* buffer, struct arena* arena,
+                           size_t capacity);
+
+void command_buffer_bind_program(struct command_buffer* buffer,
+                                 uint32_t program);
+
+void command_buffer_bind_vertex_array(struct command_buffer* buffer,
+                                      uint32_t vertex_array);
+
+// value is a column-major 4x4 matrix.
+void command_buffer_set_uniform_matrix4(struct command_buffer* buffer,
+                                        int32_t location, const float* value);
+
+void command_buffer_set_uniform_vector4(struct command_buffer* buffer,
+                                        int32_t location, const float* value);
+
+void command_buffer_draw_elements(struct command_buffer* buffer,
+                                  enum primitive primitive,
+                                  enum index_type index_type, int32_t count,
+                                  uint32_t offset, int32_t instance_count);
+
+void command_buffer_draw_arrays(struct command_buffer* buffer,
+                                enum primitive primitive, int32_t first,
+                                int32_t count);
+
+// Replays the commands in buffer. Must be called on the thread that owns the
+// GL context.
+void command_buffer_execute(const struct command_buffer* buffer);
+
+#endif // COMMAND_BUFFER_H
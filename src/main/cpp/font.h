@@ -0,0 +1,63 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Layout of the font atlases written by generate_font_atlas in src/tools.
+// An atlas holds a signed distance field for each glyph, with 8 bits per
+// texel, in which 0.5 is on the outline and larger values are inside.
+// Because the distance field is interpolated, glyphs stay sharp at any
+// size. The atlas also holds a block of solid texels, so that rectangles
+// can be drawn in the same batch as text.
+
+#define FONT_MAGIC 0x544E4F46 // "FONT"
+
+enum
+{
+    // The atlas holds the printable ASCII characters.
+    FONT_FIRST_CHARACTER = 32,
+    FONT_CHARACTER_COUNT = 95,
+};
+
+// Sizes and offsets are in atlas texels, with y pointing down in the atlas
+// and up for the bearing.
+struct font_glyph
+{
+    uint16_t x;
+    uint16_t y;
+    // Includes the padding around the outline that the distance field
+    // spans. Empty glyphs, such as the space, have a width of 0.
+    uint16_t width;
+    uint16_t height;
+    // From the pen position on the baseline to the top left corner.
+    float bearing_x;
+    float bearing_y;
+    float advance;
+};
+
+struct font_header
+{
+    uint32_t magic;
+    uint32_t atlas_width;
+    uint32_t atlas_height;
+    // Size of the em square that the glyphs were rendered at.
+    float size;
+    // Distance from the outline, in texels, at which the distance field
+    // reaches 0 or 1.
+    float distance_range;
+    float ascender;
+    float line_height;
+    // Center of the solid block.
+    float solid_x;
+    float solid_y;
+    struct font_glyph glyphs[FONT_CHARACTER_COUNT];
+    // Byte offset of the texels from the start of the data, row by row.
+    uint32_t texels_offset;
+};
+
+// Defined in the source file that generate_font_atlas writes at build time.
+extern const uint8_t FONT_DATA[];
+extern const size_t FONT_DATA_SIZE;
+
+#endif // FONT_H
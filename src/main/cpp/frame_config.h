@@ -0,0 +1,83 @@
+#ifndef FRAME_CONFIG_H
+#define FRAME_CONFIG_H
+
+#include "VrApi.h"
+#include "command_buffer.h"
+#include <GLES3/gl3.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Sizes and rates of the app's frame loop. They live here, rather than in
+// hello_quest.c, so that the tools in src/tools that run the frame on the
+// build machine run it with the same ones.
+
+enum
+{
+    CHARACTER_COUNT = 8,
+    // Characters sampled and skinned by each job.
+    CHARACTERS_PER_JOB = 8,
+    LIGHT_COUNT = 32,
+    HUD_LINE_COUNT = 4,
+    // Uploads are handed over in batches of this many.
+    UPLOAD_BATCH_SIZE = 16,
+};
+
+// The simulation runs at a fixed rate below any display rate, and frames
+// interpolate between its steps. After a stall, it runs at most
+// MAX_SIMULATION_STEPS to catch up.
+static const double SIMULATION_STEP = 1.0 / 30.0;
+static const int MAX_SIMULATION_STEPS = 4;
+
+// Frames the GPU may lag behind the CPU. Resources written by the CPU every
+// frame need this many copies.
+static const int GPU_FRAMES_IN_FLIGHT = 2;
+
+// Number of frames after which the frame loop is expected to no longer
+// allocate from the heap. Per-frame data must come from the frame arena.
+static const uint64_t STEADY_STATE_FRAME_INDEX = 16;
+
+// Frames over which the stats on the HUD are averaged. The HUD is only
+// rendered again when they change.
+static const int FRAME_STATS_INTERVAL = 72;
+
+// Draws are recorded in chunks of this many, each into its own command
+// buffer, so that the chunks can be recorded on different workers.
+static const int DRAWS_PER_COMMAND_BUFFER = 256;
+static const size_t EYE_COMMAND_BUFFER_CAPACITY = 1024;
+
+static const size_t STREAM_BUFFER_REGION_SIZE = 1024 * 1024;
+static const size_t TEXTURE_UPLOAD_BUDGET = 1024 * 1024;
+static const size_t TEXTURE_MEMORY_CAP = 256 * 1024 * 1024;
+
+static const GLsizei HUD_WIDTH = 512;
+static const GLsizei HUD_HEIGHT = 128;
+static const float HUD_TEXT_SIZE = 24.0;
+static const float HUD_MARGIN = 8.0;
+static const uint32_t HUD_TEXT_COLOR = 0xFFFFFFFF;
+static const uint32_t HUD_BACKGROUND_COLOR = 0x000000B0;
+
+// The most bytes that record_draws records for draw_count draws, if every
+// draw binds its vertex array.
+static inline size_t
+get_draws_capacity(int draw_count)
+{
+    return draw_count * (sizeof(struct command_bind_vertex_array) +
+                         sizeof(struct command_set_uniform_matrix4) +
+                         sizeof(struct command_draw_elements));
+}
+
+// The most bytes that a frame allocates from the frame arena when it draws
+// object_count objects: the command buffers of the chunks, their triangle
+// counts and the eyes' command buffers, each padded for alignment.
+static inline size_t
+get_frame_arena_capacity(int object_count)
+{
+    int chunk_count = (object_count + DRAWS_PER_COMMAND_BUFFER - 1) /
+                      DRAWS_PER_COMMAND_BUFFER;
+    return get_draws_capacity(object_count) +
+           chunk_count * (sizeof(struct command_buffer) + sizeof(uint64_t) +
+                          16) +
+           VRAPI_FRAME_LAYER_EYE_MAX * (EYE_COMMAND_BUFFER_CAPACITY + 16) + 64;
+}
+
+#endif // FRAME_CONFIG_H
@@ -0,0 +1,105 @@
+#include "governor.h"
+
+// Frames per decision: half a second at 72 Hz.
+static const int WINDOW_FRAME_COUNT = 36;
+// A level is raised if the average time over a window is above this
+// fraction of the frame budget, or if more than 1 in MAX_OVER_BUDGET_RATIO
+// frames went over budget.
+static const double RAISE_THRESHOLD = 0.85;
+static const int MAX_OVER_BUDGET_RATIO = 10;
+// A level is lowered if the average time is below this fraction of the
+// frame budget for LOWER_WINDOW_COUNT consecutive windows. One level step
+// changes the clock by less than the gap between the thresholds, so a
+// lowered level doesn't immediately get raised again.
+static const double LOWER_THRESHOLD = 0.6;
+static const int LOWER_WINDOW_COUNT = 4;
+
+static void
+start_window(struct clock_governor* governor)
+{
+    governor->frame_count = 0;
+    for (enum clock clock = CLOCK_BEGIN; clock != CLOCK_END; ++clock) {
+        governor->known_counts[clock] = 0;
+        governor->total_times[clock] = 0.0;
+        governor->over_budget_counts[clock] = 0;
+    }
+}
+
+void
+clock_governor_create(struct clock_governor* governor, double frame_budget,
+                      int min_level, int max_level, int cpu_level,
+                      int gpu_level)
+{
+    governor->frame_budget = frame_budget;
+    governor->min_level = min_level;
+    governor->max_level = max_level;
+    governor->levels[CLOCK_CPU] = cpu_level;
+    governor->levels[CLOCK_GPU] = gpu_level;
+    for (enum clock clock = CLOCK_BEGIN; clock != CLOCK_END; ++clock) {
+        governor->low_window_counts[clock] = 0;
+        governor->average_times[clock] = -1.0;
+    }
+    start_window(governor);
+}
+
+static bool
+end_window(struct clock_governor* governor, enum clock clock)
+{
+    int known_count = governor->known_counts[clock];
+    if (known_count == 0) {
+        governor->average_times[clock] = -1.0;
+        governor->low_window_counts[clock] = 0;
+        return false;
+    }
+    double average_time = governor->total_times[clock] / known_count;
+    governor->average_times[clock] = average_time;
+    int* level = &governor->levels[clock];
+    if (average_time > RAISE_THRESHOLD * governor->frame_budget ||
+        governor->over_budget_counts[clock] * MAX_OVER_BUDGET_RATIO >
+            known_count) {
+        governor->low_window_counts[clock] = 0;
+        if (*level < governor->max_level) {
+            ++*level;
+            return true;
+        }
+        return false;
+    }
+    if (average_time < LOWER_THRESHOLD * governor->frame_budget) {
+        ++governor->low_window_counts[clock];
+        if (governor->low_window_counts[clock] >= LOWER_WINDOW_COUNT &&
+            *level > governor->min_level) {
+            governor->low_window_counts[clock] = 0;
+            --*level;
+            return true;
+        }
+        return false;
+    }
+    governor->low_window_counts[clock] = 0;
+    return false;
+}
+
+bool
+clock_governor_add_frame(struct clock_governor* governor, double cpu_time,
+                         double gpu_time)
+{
+    const double times[CLOCK_END] = { cpu_time, gpu_time };
+    for (enum clock clock = CLOCK_BEGIN; clock != CLOCK_END; ++clock) {
+        if (times[clock] < 0.0) {
+            continue;
+        }
+        ++governor->known_counts[clock];
+        governor->total_times[clock] += times[clock];
+        if (times[clock] > governor->frame_budget) {
+            ++governor->over_budget_counts[clock];
+        }
+    }
+    if (++governor->frame_count < WINDOW_FRAME_COUNT) {
+        return false;
+    }
+    bool changed = false;
+    for (enum clock clock = CLOCK_BEGIN; clock != CLOCK_END; ++clock) {
+        changed |= end_window(governor, clock);
+    }
+    start_window(governor);
+    return changed;
+}
@@ -0,0 +1,49 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <stdbool.h>
+
+// Chooses CPU and GPU clock levels from measured frame times. A level is
+// raised as soon as a window of frames gets too close to the frame budget,
+// but only lowered after several consecutive windows with plenty of
+// headroom, so that the levels don't oscillate around a threshold.
+
+enum clock
+{
+    CLOCK_BEGIN,
+    CLOCK_CPU = CLOCK_BEGIN,
+    CLOCK_GPU,
+    CLOCK_END,
+};
+
+struct clock_governor
+{
+    // In seconds.
+    double frame_budget;
+    int min_level;
+    int max_level;
+    int levels[CLOCK_END];
+    // Frames in the current window.
+    int frame_count;
+    // Frames in the current window for which each time was known.
+    int known_counts[CLOCK_END];
+    double total_times[CLOCK_END];
+    int over_budget_counts[CLOCK_END];
+    // Consecutive windows in which each time was low enough to lower its
+    // level.
+    int low_window_counts[CLOCK_END];
+    // Average times over the last complete window, in seconds, or -1.0 if
+    // they were unknown.
+    double average_times[CLOCK_END];
+};
+
+void clock_governor_create(struct clock_governor* governor,
+                           double frame_budget, int min_level, int max_level,
+                           int cpu_level, int gpu_level);
+
+// Times are in seconds, or negative if unknown. Returns true if either level
+// changed.
+bool clock_governor_add_frame(struct clock_governor* governor,
+                              double cpu_time, double gpu_time);
+
+#endif // GOVERNOR_H
@@ -0,0 +1,182 @@
+#include "gpu_sync.h"
+#include <android/log.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+static const char* TAG = "gpu_sync";
+
+// glClientWaitSync takes a finite timeout, so blocking waits are done in
+// steps of this many nanoseconds.
+static const GLuint64 WAIT_TIMEOUT_NS = 1000000000;
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void
+gpu_sync_create(struct gpu_sync* sync, int max_frames_in_flight)
+{
+    if (max_frames_in_flight < 1 ||
+        max_frames_in_flight > MAX_FRAMES_IN_FLIGHT) {
+        error("can't allow %d frames in flight", max_frames_in_flight);
+        exit(EXIT_FAILURE);
+    }
+    sync->max_frames_in_flight = max_frames_in_flight;
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        sync->fences[i] = NULL;
+        sync->fence_frame_indices[i] = 0;
+    }
+    sync->frame_index = 0;
+    sync->completed_frame_index = 0;
+    sync->first_deletion = 0;
+    sync->deletion_count = 0;
+    sync->stats.wait_time = 0.0;
+    sync->stats.deletion_count = 0;
+}
+
+static void
+delete_object(enum gpu_object_type type, GLuint name)
+{
+    switch (type) {
+        case GPU_OBJECT_BUFFER:
+            glDeleteBuffers(1, &name);
+            break;
+        case GPU_OBJECT_TEXTURE:
+            glDeleteTextures(1, &name);
+            break;
+        case GPU_OBJECT_VERTEX_ARRAY:
+            glDeleteVertexArrays(1, &name);
+            break;
+        case GPU_OBJECT_FRAMEBUFFER:
+            glDeleteFramebuffers(1, &name);
+            break;
+        case GPU_OBJECT_RENDERBUFFER:
+            glDeleteRenderbuffers(1, &name);
+            break;
+        case GPU_OBJECT_PROGRAM:
+            glDeleteProgram(name);
+            break;
+    }
+}
+
+// Frees every deferred object that was deleted in a frame up to
+// completed_frame_index.
+static void
+free_deletions(struct gpu_sync* sync, uint64_t completed_frame_index)
+{
+    while (sync->deletion_count > 0) {
+        const struct deferred_deletion* deletion =
+            &sync->deletions[sync->first_deletion];
+        if (deletion->frame_index > completed_frame_index) {
+            break;
+        }
+        delete_object(deletion->type, deletion->name);
+        sync->first_deletion =
+            (sync->first_deletion + 1) % MAX_DEFERRED_DELETIONS;
+        --sync->deletion_count;
+        ++sync->stats.deletion_count;
+    }
+}
+
+void
+gpu_sync_destroy(struct gpu_sync* sync)
+{
+    glFinish();
+    for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+        if (sync->fences[i] != NULL) {
+            glDeleteSync(sync->fences[i]);
+            sync->fences[i] = NULL;
+        }
+    }
+    free_deletions(sync, UINT64_MAX);
+}
+
+// Returns false if the frame hasn't finished within timeout nanoseconds.
+// A frame without a fence counts as finished.
+static bool
+wait_for_frame(struct gpu_sync* sync, uint64_t frame_index, GLuint64 timeout)
+{
+    int slot = frame_index % MAX_FRAMES_IN_FLIGHT;
+    GLsync fence = sync->fences[slot];
+    if (fence != NULL && sync->fence_frame_indices[slot] == frame_index) {
+        GLenum result =
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+        if (result == GL_WAIT_FAILED) {
+            error("can't wait for fence of frame %llu",
+                  (unsigned long long)frame_index);
+            exit(EXIT_FAILURE);
+        }
+        if (result == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+        glDeleteSync(fence);
+        sync->fences[slot] = NULL;
+    }
+    if (frame_index > sync->completed_frame_index) {
+        sync->completed_frame_index = frame_index;
+    }
+    return true;
+}
+
+void
+gpu_sync_begin_frame(struct gpu_sync* sync, uint64_t frame_index)
+{
+    sync->frame_index = frame_index;
+    sync->stats.wait_time = 0.0;
+    sync->stats.deletion_count = 0;
+
+    // Fences signal in order, so wait for the frames in order.
+    uint64_t max_frames_in_flight = sync->max_frames_in_flight;
+    if (frame_index > max_frames_in_flight) {
+        uint64_t oldest_frame_index = frame_index - max_frames_in_flight;
+        double start_time = get_time();
+        for (uint64_t i = sync->completed_frame_index + 1;
+             i <= oldest_frame_index; ++i) {
+            while (!wait_for_frame(sync, i, WAIT_TIMEOUT_NS)) {
+            }
+        }
+        sync->stats.wait_time = get_time() - start_time;
+    }
+    // Later frames may already have finished too, which frees their
+    // deletions sooner.
+    for (uint64_t i = sync->completed_frame_index + 1; i < frame_index; ++i) {
+        if (!wait_for_frame(sync, i, 0)) {
+            break;
+        }
+    }
+    free_deletions(sync, sync->completed_frame_index);
+}
+
+void
+gpu_sync_end_frame(struct gpu_sync* sync)
+{
+    int slot = sync->frame_index % MAX_FRAMES_IN_FLIGHT;
+    sync->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    sync->fence_frame_indices[slot] = sync->frame_index;
+    glFlush();
+}
+
+void
+gpu_sync_delete(struct gpu_sync* sync, enum gpu_object_type type,
+                GLuint name)
+{
+    if (sync->deletion_count == MAX_DEFERRED_DELETIONS) {
+        error("can't defer deletion: all %d deletions in use",
+              MAX_DEFERRED_DELETIONS);
+        exit(EXIT_FAILURE);
+    }
+    struct deferred_deletion* deletion =
+        &sync->deletions[(sync->first_deletion + sync->deletion_count) %
+                         MAX_DEFERRED_DELETIONS];
+    deletion->type = type;
+    deletion->name = name;
+    deletion->frame_index = sync->frame_index;
+    ++sync->deletion_count;
+}
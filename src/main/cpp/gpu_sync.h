@@ -0,0 +1,76 @@
+#ifndef GPU_SYNC_H
+#define GPU_SYNC_H
+
+#include <GLES3/gl3.h>
+#include <stdint.h>
+
+// Limits how many frames the GPU can lag behind the CPU, with a ring of
+// fences indexed by frame index. Once gpu_sync_begin_frame returns for
+// frame n, the GPU has finished frame n - max_frames_in_flight, so anything
+// that frame used can be overwritten or freed. Objects deleted with
+// gpu_sync_delete are only freed once the GPU has finished the frame they
+// were deleted in.
+
+enum
+{
+    MAX_FRAMES_IN_FLIGHT = 4,
+    MAX_DEFERRED_DELETIONS = 256,
+};
+
+enum gpu_object_type
+{
+    GPU_OBJECT_BUFFER,
+    GPU_OBJECT_TEXTURE,
+    GPU_OBJECT_VERTEX_ARRAY,
+    GPU_OBJECT_FRAMEBUFFER,
+    GPU_OBJECT_RENDERBUFFER,
+    GPU_OBJECT_PROGRAM,
+};
+
+struct deferred_deletion
+{
+    enum gpu_object_type type;
+    GLuint name;
+    uint64_t frame_index;
+};
+
+struct gpu_sync_stats
+{
+    // Seconds that gpu_sync_begin_frame waited for the GPU during the last
+    // frame.
+    double wait_time;
+    // Objects freed during the last frame.
+    int deletion_count;
+};
+
+struct gpu_sync
+{
+    int max_frames_in_flight;
+    GLsync fences[MAX_FRAMES_IN_FLIGHT];
+    uint64_t fence_frame_indices[MAX_FRAMES_IN_FLIGHT];
+    uint64_t frame_index;
+    // Every frame up to this one has finished on the GPU.
+    uint64_t completed_frame_index;
+    // A ring of deletions, in the order they were deferred.
+    struct deferred_deletion deletions[MAX_DEFERRED_DELETIONS];
+    int first_deletion;
+    int deletion_count;
+    struct gpu_sync_stats stats;
+};
+
+// max_frames_in_flight must be between 1 and MAX_FRAMES_IN_FLIGHT.
+void gpu_sync_create(struct gpu_sync* sync, int max_frames_in_flight);
+
+// Waits for the GPU to finish every frame, and frees every deferred object.
+void gpu_sync_destroy(struct gpu_sync* sync);
+
+// frame_index must increase by 1 every frame, starting at 1.
+void gpu_sync_begin_frame(struct gpu_sync* sync, uint64_t frame_index);
+
+// Inserts the fence for the current frame and flushes.
+void gpu_sync_end_frame(struct gpu_sync* sync);
+
+void gpu_sync_delete(struct gpu_sync* sync, enum gpu_object_type type,
+                     GLuint name);
+
+#endif // GPU_SYNC_H
@@ -2,24 +2,62 @@
 #include "VrApi_Helpers.h"
 #include "VrApi_Input.h"
 #include "VrApi_SystemUtils.h"
+#include "animation.h"
 #include "android_native_app_glue.h"
+#include "asset_pack.h"
+#include "command_buffer.h"
+#include "font.h"
+#include "frame_config.h"
+#include "governor.h"
+#include "gpu_sync.h"
+#include "job.h"
+#include "layer.h"
+#include "light_clusters.h"
+#include "loader.h"
+#include "memory.h"
+#include "mesh.h"
+#include "pipeline.h"
+#include "pose_channel.h"
+#include "shadow_cache.h"
+#include "simulation.h"
+#include "stream_buffer.h"
+#include "text.h"
+#include "texture.h"
+#include "transform.h"
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
-#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+#include <GLES3/gl31.h>
+#include <android/asset_manager.h>
 #include <android/log.h>
 #include <android/window.h>
+#include <math.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
 
 #ifndef NDEBUG
 #define info(...) __android_log_print(ANDROID_LOG_VERBOSE, TAG, __VA_ARGS__)
+#else
+#define info(...) ((void)0)
 #endif // NDEBUG
 
 static const char* TAG = "hello_quest";
 
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
 static const char*
 egl_get_error_string(EGLint error)
 {
@@ -81,6 +119,7 @@ gl_get_framebuffer_status_string(GLenum status)
 struct egl
 {
     EGLDisplay display;
+    EGLConfig config;
     EGLContext context;
     EGLSurface surface;
 };
@@ -111,12 +150,7 @@ egl_create(struct egl* egl)
     }
 
     info("allocate EGL configs");
-    EGLConfig* configs = malloc(num_configs * sizeof(EGLConfig));
-    if (configs == NULL) {
-        error("cant allocate EGL configs: %s",
-              egl_get_error_string(eglGetError()));
-        exit(EXIT_FAILURE);
-    }
+    EGLConfig* configs = memory_alloc(num_configs * sizeof(EGLConfig));
 
     info("get EGL configs");
     if (eglGetConfigs(egl->display, configs, num_configs, &num_configs) ==
@@ -189,8 +223,10 @@ egl_create(struct egl* egl)
         exit(EXIT_FAILURE);
     }
 
+    egl->config = found_config;
+
     info("free EGL configs");
-    free(configs);
+    memory_free(configs);
 
     info("create EGL context");
     static const EGLint CONTEXT_ATTRIBS[] = { EGL_CONTEXT_CLIENT_VERSION, 3,
@@ -240,6 +276,17 @@ egl_destroy(struct egl* egl)
     eglTerminate(egl->display);
 }
 
+// Each framebuffer gets its depth renderbuffer and framebuffer handles from
+// a pool with one object per swap chain, big enough for the longest swap
+// chain we support.
+enum
+{
+    MAX_SWAP_CHAIN_LENGTH = 4,
+};
+
+static const GLenum EYE_COLOR_FORMAT = GL_RGBA8;
+static const GLenum EYE_DEPTH_FORMAT = GL_DEPTH_COMPONENT24;
+
 struct framebuffer
 {
     int swap_chain_index;
@@ -252,8 +299,8 @@ struct framebuffer
 };
 
 static void
-framebuffer_create(struct framebuffer* framebuffer, GLsizei width,
-                   GLsizei height)
+framebuffer_create(struct framebuffer* framebuffer, struct pool* handle_pool,
+                   GLsizei width, GLsizei height)
 {
     framebuffer->swap_chain_index = 0;
     framebuffer->width = width;
@@ -261,7 +308,7 @@ framebuffer_create(struct framebuffer* framebuffer, GLsizei width,
 
     info("create color texture swap chain");
     framebuffer->color_texture_swap_chain = vrapi_CreateTextureSwapChain3(
-        VRAPI_TEXTURE_TYPE_2D, GL_RGBA8, width, height, 1, 3);
+        VRAPI_TEXTURE_TYPE_2D, EYE_COLOR_FORMAT, width, height, 1, 3);
     if (framebuffer->color_texture_swap_chain == NULL) {
         error("can't create color texture swap chain");
         exit(EXIT_FAILURE);
@@ -269,22 +316,17 @@ framebuffer_create(struct framebuffer* framebuffer, GLsizei width,
 
     framebuffer->swap_chain_length =
         vrapi_GetTextureSwapChainLength(framebuffer->color_texture_swap_chain);
-
-    info("allocate depth renderbuffers");
-    framebuffer->depth_renderbuffers =
-        malloc(framebuffer->swap_chain_length * sizeof(GLuint));
-    if (framebuffer->depth_renderbuffers == NULL) {
-        error("can't allocate depth renderbuffers");
+    if (framebuffer->swap_chain_length > MAX_SWAP_CHAIN_LENGTH) {
+        error("can't handle color texture swap chain of length %d",
+              framebuffer->swap_chain_length);
         exit(EXIT_FAILURE);
     }
 
+    info("allocate depth renderbuffers");
+    framebuffer->depth_renderbuffers = pool_alloc(handle_pool);
+
     info("allocate framebuffers");
-    framebuffer->framebuffers =
-        malloc(framebuffer->swap_chain_length * sizeof(GLuint));
-    if (framebuffer->framebuffers == NULL) {
-        error("can't allocate framebuffers");
-        exit(EXIT_FAILURE);
-    }
+    framebuffer->framebuffers = pool_alloc(handle_pool);
 
     glGenRenderbuffers(framebuffer->swap_chain_length,
                        framebuffer->depth_renderbuffers);
@@ -304,7 +346,7 @@ framebuffer_create(struct framebuffer* framebuffer, GLsizei width,
         info("create depth renderbuffer %d", i);
         glBindRenderbuffer(GL_RENDERBUFFER,
                            framebuffer->depth_renderbuffers[i]);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width,
+        glRenderbufferStorage(GL_RENDERBUFFER, EYE_DEPTH_FORMAT, width,
                               height);
         glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
@@ -326,7 +368,7 @@ framebuffer_create(struct framebuffer* framebuffer, GLsizei width,
 }
 
 static void
-framebuffer_destroy(struct framebuffer* framebuffer)
+framebuffer_destroy(struct framebuffer* framebuffer, struct pool* handle_pool)
 {
     info("destroy framebuffers");
     glDeleteFramebuffers(framebuffer->swap_chain_length,
@@ -337,10 +379,10 @@ framebuffer_destroy(struct framebuffer* framebuffer)
                           framebuffer->depth_renderbuffers);
 
     info("free framebuffers");
-    free(framebuffer->framebuffers);
+    pool_free(handle_pool, framebuffer->framebuffers);
 
     info("free depth renderbuffers");
-    free(framebuffer->depth_renderbuffers);
+    pool_free(handle_pool, framebuffer->depth_renderbuffers);
 
     info("destroy color texture swap chain");
     vrapi_DestroyTextureSwapChain(framebuffer->color_texture_swap_chain);
@@ -351,6 +393,9 @@ enum attrib
     ATTRIB_BEGIN,
     ATTRIB_POSITION = ATTRIB_BEGIN,
     ATTRIB_COLOR,
+    ATTRIB_JOINT_INDICES,
+    ATTRIB_JOINT_WEIGHTS,
+    ATTRIB_TEX_COORD,
     ATTRIB_END,
 };
 
@@ -360,6 +405,16 @@ enum uniform
     UNIFORM_MODEL_MATRIX = UNIFORM_BEGIN,
     UNIFORM_VIEW_MATRIX,
     UNIFORM_PROJECTION_MATRIX,
+    UNIFORM_VISIBLE_OFFSET,
+    UNIFORM_VIEW_MATRICES,
+    UNIFORM_PROJECTION_MATRICES,
+    UNIFORM_COLOR,
+    UNIFORM_FOG_COLOR,
+    UNIFORM_FOG_RANGE,
+    UNIFORM_VIEWPORT_SIZE,
+    UNIFORM_CLUSTER_PARAMS,
+    UNIFORM_SHADOW_MATRIX,
+    UNIFORM_SHADOW_ATLAS,
     UNIFORM_END,
 };
 
@@ -370,86 +425,338 @@ struct program
 };
 
 static const char* ATTRIB_NAMES[ATTRIB_END] = {
-    "aPosition", "aColor",
+    "aPosition",
+    "aColor",
+    "aJointIndices",
+    "aJointWeights",
+    "aTexCoord",
 };
 
 static const char* UNIFORM_NAMES[UNIFORM_END] = {
-    "uModelMatrix", "uViewMatrix", "uProjectionMatrix",
+    "uModelMatrix",   "uViewMatrix",         "uProjectionMatrix",
+    "uVisibleOffset", "uViewMatrices",       "uProjectionMatrices",
+    "uColor",         "uFogColor",           "uFogRange",
+    "uViewportSize",  "uClusterParams",      "uShadowMatrix",
+    "uShadowAtlas",
+};
+
+// Every shader is built from one source, specialized at compile time by
+// defining a macro for each of the features in its variant's key. Only the
+// variants listed in SHADER_MANIFEST are compiled.
+enum shader_feature
+{
+    // Each instance looks up its object in the list of visible objects that
+    // CULL_SHADER wrote, instead of using a model matrix per draw.
+    SHADER_FEATURE_INSTANCING = 1 << 0,
+    // Renders both eyes at once with GL_OVR_multiview2.
+    SHADER_FEATURE_MULTIVIEW = 1 << 1,
+    // Takes the color from the vertices instead of from uColor.
+    SHADER_FEATURE_VERTEX_COLOR = 1 << 2,
+    // Blends up to 4 joint matrices per vertex, from the palette in the
+    // uniform buffer bound to JOINT_PALETTE_BINDING.
+    SHADER_FEATURE_SKINNING = 1 << 3,
+    // Fades to uFogColor with the distance from the eye.
+    SHADER_FEATURE_FOG = 1 << 4,
+    // Lights the surface with the point lights in the clusters of the
+    // shader storage buffers bound to LIGHTS_BINDING and CLUSTERS_BINDING.
+    SHADER_FEATURE_LIGHTING = 1 << 5,
+    // Darkens the surface where the shadow atlas, bound to
+    // SHADOW_ATLAS_TEXTURE_UNIT, has a caster in front of it.
+    SHADER_FEATURE_SHADOWS = 1 << 6,
+};
+
+enum
+{
+    SHADER_FEATURE_COUNT = 7,
+    SHADER_VARIANT_COUNT = 1 << SHADER_FEATURE_COUNT,
+    JOINT_PALETTE_BINDING = 0,
+    // Unit 0 is left to the textures that are bound as they are drawn.
+    SHADOW_ATLAS_TEXTURE_UNIT = 1,
+};
+
+static const char* SHADER_FEATURE_NAMES[SHADER_FEATURE_COUNT] = {
+    "INSTANCING", "MULTIVIEW", "VERTEX_COLOR", "SKINNING",
+    "FOG",        "LIGHTING",  "SHADOWS",
+};
+
+// The variants the renderer draws with. Every other variant is pruned. The
+// ones without SHADOWS render the shadow casters into the shadow atlas.
+static const uint32_t SHADER_MANIFEST[] = {
+    SHADER_FEATURE_VERTEX_COLOR,
+    SHADER_FEATURE_SKINNING | SHADER_FEATURE_VERTEX_COLOR,
+    SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_SHADOWS,
+    SHADER_FEATURE_INSTANCING | SHADER_FEATURE_VERTEX_COLOR |
+        SHADER_FEATURE_SHADOWS,
+    SHADER_FEATURE_SKINNING | SHADER_FEATURE_VERTEX_COLOR |
+        SHADER_FEATURE_SHADOWS,
+    SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_LIGHTING |
+        SHADER_FEATURE_SHADOWS,
+    SHADER_FEATURE_INSTANCING | SHADER_FEATURE_VERTEX_COLOR |
+        SHADER_FEATURE_LIGHTING | SHADER_FEATURE_SHADOWS,
+    SHADER_FEATURE_SKINNING | SHADER_FEATURE_VERTEX_COLOR |
+        SHADER_FEATURE_LIGHTING | SHADER_FEATURE_SHADOWS,
 };
 
 static const char VERTEX_SHADER[] =
-    "#version 300 es\n"
+    "#ifdef MULTIVIEW\n"
+    "#extension GL_OVR_multiview2 : require\n"
+    "layout(num_views = 2) in;\n"
+    "#endif\n"
     "\n"
     "in vec3 aPosition;\n"
+    "#ifdef VERTEX_COLOR\n"
     "in vec3 aColor;\n"
+    "#else\n"
+    "uniform vec4 uColor;\n"
+    "#endif\n"
+    "#ifdef SKINNING\n"
+    "in vec4 aJointIndices;\n"
+    "in vec4 aJointWeights;\n"
+    "// Row-major, like the matrices animation_sample writes.\n"
+    "layout(std140, row_major) uniform JointPalette\n"
+    "{\n"
+    "	mat4 uJointMatrices[MAX_JOINTS];\n"
+    "};\n"
+    "#endif\n"
+    "#ifdef INSTANCING\n"
+    "struct Object\n"
+    "{\n"
+    "	vec4 positionScale;\n"
+    "	uvec4 geometryLod;\n"
+    "};\n"
+    "layout(std430, binding = 0) readonly buffer Objects\n"
+    "{\n"
+    "	Object objects[];\n"
+    "};\n"
+    "layout(std430, binding = 2) readonly buffer Visible\n"
+    "{\n"
+    "	uint visible[];\n"
+    "};\n"
+    "uniform uint uVisibleOffset;\n"
+    "#else\n"
     "uniform mat4 uModelMatrix;\n"
+    "#endif\n"
+    "#ifdef MULTIVIEW\n"
+    "uniform mat4 uViewMatrices[2];\n"
+    "uniform mat4 uProjectionMatrices[2];\n"
+    "#define VIEW_MATRIX uViewMatrices[gl_ViewID_OVR]\n"
+    "#define PROJECTION_MATRIX uProjectionMatrices[gl_ViewID_OVR]\n"
+    "#else\n"
     "uniform mat4 uViewMatrix;\n"
     "uniform mat4 uProjectionMatrix;\n"
+    "#define VIEW_MATRIX uViewMatrix\n"
+    "#define PROJECTION_MATRIX uProjectionMatrix\n"
+    "#endif\n"
     "\n"
     "out vec3 vColor;\n"
+    "#ifdef FOG\n"
+    "out float vViewDistance;\n"
+    "#endif\n"
+    "#ifdef LIGHTING\n"
+    "out vec3 vWorldPosition;\n"
+    "out float vViewDepth;\n"
+    "#endif\n"
+    "#ifdef SHADOWS\n"
+    "// From world space to the texture coordinates and depth of the shadow\n"
+    "// atlas.\n"
+    "uniform mat4 uShadowMatrix;\n"
+    "out vec3 vShadowPosition;\n"
+    "#endif\n"
     "void main()\n"
     "{\n"
-    "	gl_Position = uProjectionMatrix * ( uViewMatrix * ( uModelMatrix * vec4( "
-    "aPosition * 0.1, 1.0 ) ) );\n"
+    "	vec4 position = vec4(aPosition, 1.0);\n"
+    "#ifdef SKINNING\n"
+    "	mat4 jointMatrix =\n"
+    "		uJointMatrices[int(aJointIndices.x)] * aJointWeights.x +\n"
+    "		uJointMatrices[int(aJointIndices.y)] * aJointWeights.y +\n"
+    "		uJointMatrices[int(aJointIndices.z)] * aJointWeights.z +\n"
+    "		uJointMatrices[int(aJointIndices.w)] * aJointWeights.w;\n"
+    "	position = jointMatrix * position;\n"
+    "#endif\n"
+    "#ifdef INSTANCING\n"
+    "	vec4 positionScale = objects[visible[uVisibleOffset + "
+    "uint(gl_InstanceID)]].positionScale;\n"
+    "	position = vec4(positionScale.xyz + position.xyz * positionScale.w, "
+    "1.0);\n"
+    "#else\n"
+    "	position = uModelMatrix * position;\n"
+    "#endif\n"
+    "	vec4 viewPosition = VIEW_MATRIX * position;\n"
+    "	gl_Position = PROJECTION_MATRIX * viewPosition;\n"
+    "#ifdef VERTEX_COLOR\n"
     "	vColor = aColor;\n"
+    "#else\n"
+    "	vColor = uColor.rgb;\n"
+    "#endif\n"
+    "#ifdef FOG\n"
+    "	vViewDistance = length(viewPosition.xyz);\n"
+    "#endif\n"
+    "#ifdef LIGHTING\n"
+    "	vWorldPosition = position.xyz;\n"
+    "	vViewDepth = -viewPosition.z;\n"
+    "#endif\n"
+    "#ifdef SHADOWS\n"
+    "	vShadowPosition = (uShadowMatrix * position).xyz;\n"
+    "#endif\n"
     "}\n";
 
-static const char FRAGMENT_SHADER[] = "#version 300 es\n"
-                                      "\n"
-                                      "in lowp vec3 vColor;\n"
-                                      "out lowp vec4 outColor;\n"
-                                      "void main()\n"
-                                      "{\n"
-                                      "	outColor = vec4(vColor, 1.0);\n"
-                                      "}\n";
+static const char FRAGMENT_SHADER[] =
+    "in lowp vec3 vColor;\n"
+    "#ifdef FOG\n"
+    "in highp float vViewDistance;\n"
+    "uniform lowp vec4 uFogColor;\n"
+    "// Distances at which the fog starts and becomes opaque.\n"
+    "uniform highp vec2 uFogRange;\n"
+    "#endif\n"
+    "#ifdef LIGHTING\n"
+    "in highp vec3 vWorldPosition;\n"
+    "in highp float vViewDepth;\n"
+    "struct Light\n"
+    "{\n"
+    "	highp vec4 positionRadius;\n"
+    "	mediump vec4 color;\n"
+    "};\n"
+    "layout(std430, binding = 3) readonly buffer Lights\n"
+    "{\n"
+    "	Light lights[];\n"
+    "};\n"
+    "// The offset and count of each cluster's lights in lightIndices.\n"
+    "layout(std430, binding = 4) readonly buffer Clusters\n"
+    "{\n"
+    "	highp uvec2 clusters[CLUSTER_COUNT];\n"
+    "	highp uint lightIndices[];\n"
+    "};\n"
+    "// Tiles per pixel, then the scale and bias that take the log2 of the\n"
+    "// view depth to a slice.\n"
+    "uniform highp vec4 uClusterParams;\n"
+    "const mediump float AMBIENT = 0.3;\n"
+    "#endif\n"
+    "#ifdef SHADOWS\n"
+    "in highp vec3 vShadowPosition;\n"
+    "uniform highp sampler2DShadow uShadowAtlas;\n"
+    "// Keeps surfaces from shadowing themselves where their depth in the\n"
+    "// atlas is rounded.\n"
+    "const highp float SHADOW_BIAS = 0.002;\n"
+    "const lowp float SHADOW_DARKNESS = 0.5;\n"
+    "#endif\n"
+    "out lowp vec4 outColor;\n"
+    "void main()\n"
+    "{\n"
+    "	lowp vec3 color = vColor;\n"
+    "#ifdef LIGHTING\n"
+    "	// The vertices have no normals, so the surface is shaded flat, with\n"
+    "	// the normal of each triangle.\n"
+    "	highp vec3 normal =\n"
+    "		normalize(cross(dFdx(vWorldPosition), dFdy(vWorldPosition)));\n"
+    "	highp uvec2 tile = min(uvec2(gl_FragCoord.xy * uClusterParams.xy),\n"
+    "		uvec2(CLUSTER_GRID_WIDTH - 1, CLUSTER_GRID_HEIGHT - 1));\n"
+    "	highp uint slice = uint(clamp(log2(vViewDepth) * uClusterParams.z +\n"
+    "		uClusterParams.w, 0.0, float(CLUSTER_GRID_DEPTH - 1)));\n"
+    "	highp uvec2 cluster = clusters[(slice * uint(CLUSTER_GRID_HEIGHT) +\n"
+    "		tile.y) * uint(CLUSTER_GRID_WIDTH) + tile.x];\n"
+    "	mediump vec3 lighting = vec3(AMBIENT);\n"
+    "	for (highp uint i = 0u; i < cluster.y; ++i) {\n"
+    "		Light light = lights[lightIndices[cluster.x + i]];\n"
+    "		highp vec3 toLight = light.positionRadius.xyz - vWorldPosition;\n"
+    "		highp float distanceSquared = dot(toLight, toLight);\n"
+    "		highp float radius = light.positionRadius.w;\n"
+    "		// Fades out smoothly to 0 at the radius, where the light's\n"
+    "		// clusters may end.\n"
+    "		mediump float falloff =\n"
+    "			max(1.0 - distanceSquared / (radius * radius), 0.0);\n"
+    "		mediump float diffuse =\n"
+    "			max(dot(normal, toLight) * inversesqrt(distanceSquared), 0.0);\n"
+    "		lighting += light.color.rgb * (falloff * falloff * diffuse);\n"
+    "	}\n"
+    "	color = min(color * lighting, 1.0);\n"
+    "#endif\n"
+    "#ifdef SHADOWS\n"
+    "	// The comparison is filtered over the 2x2 nearest texels.\n"
+    "	lowp float lit = texture(uShadowAtlas,\n"
+    "		vec3(vShadowPosition.xy, vShadowPosition.z - SHADOW_BIAS));\n"
+    "	color *= mix(1.0 - SHADOW_DARKNESS, 1.0, lit);\n"
+    "#endif\n"
+    "#ifdef FOG\n"
+    "	lowp float fog = clamp((vViewDistance - uFogRange.x) / (uFogRange.y - "
+    "uFogRange.x), 0.0, 1.0);\n"
+    "	color = mix(color, uFogColor.rgb, fog);\n"
+    "#endif\n"
+    "	outColor = vec4(color, 1.0);\n"
+    "}\n";
 
 static GLuint
-compile_shader(GLenum type, const char* string)
+compile_shader(GLenum type, const char* header, const char* string)
 {
     GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &string, NULL);
+    const char* strings[] = { header, string };
+    glShaderSource(shader, 2, strings, NULL);
     glCompileShader(shader);
     GLint status = 0;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
     if (status == GL_FALSE) {
         GLint length = 0;
         glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
-        char* log = malloc(length);
+        char* log = memory_alloc(length);
         glGetShaderInfoLog(shader, length, NULL, log);
         error("can't compile shader: %s", log);
+        memory_free(log);
         exit(EXIT_FAILURE);
     }
     return shader;
 }
 
 static void
-program_create(struct program* program)
+link_program(GLuint program)
+{
+    glLinkProgram(program);
+    GLint status = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        char* log = memory_alloc(length);
+        glGetProgramInfoLog(program, length, NULL, log);
+        error("can't link program: %s", log);
+        memory_free(log);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// header is prepended to both shaders, and must start with the #version
+// directive.
+static void
+program_create(struct program* program, const char* header,
+               const char* vertex_shader_string,
+               const char* fragment_shader_string)
 {
     program->program = glCreateProgram();
-    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, VERTEX_SHADER);
+    GLuint vertex_shader =
+        compile_shader(GL_VERTEX_SHADER, header, vertex_shader_string);
     glAttachShader(program->program, vertex_shader);
     GLuint fragment_shader =
-        compile_shader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+        compile_shader(GL_FRAGMENT_SHADER, header, fragment_shader_string);
     glAttachShader(program->program, fragment_shader);
     for (enum attrib attrib = ATTRIB_BEGIN; attrib != ATTRIB_END; ++attrib) {
         glBindAttribLocation(program->program, attrib, ATTRIB_NAMES[attrib]);
     }
-    glLinkProgram(program->program);
-    GLint status = 0;
-    glGetProgramiv(program->program, GL_LINK_STATUS, &status);
-    if (status == GL_FALSE) {
-        GLint length = 0;
-        glGetProgramiv(program->program, GL_INFO_LOG_LENGTH, &length);
-        char* log = malloc(length);
-        glGetProgramInfoLog(program->program, length, NULL, log);
-        error("can't link program: %s", log);
-        exit(EXIT_FAILURE);
-    }
+    link_program(program->program);
     for (enum uniform uniform = UNIFORM_BEGIN; uniform != UNIFORM_END;
          ++uniform) {
         program->uniform_locations[uniform] =
             glGetUniformLocation(program->program, UNIFORM_NAMES[uniform]);
     }
+    GLuint joint_palette_index =
+        glGetUniformBlockIndex(program->program, "JointPalette");
+    if (joint_palette_index != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program->program, joint_palette_index,
+                              JOINT_PALETTE_BINDING);
+    }
+    if (program->uniform_locations[UNIFORM_SHADOW_ATLAS] != -1) {
+        glUseProgram(program->program);
+        glUniform1i(program->uniform_locations[UNIFORM_SHADOW_ATLAS],
+                    SHADOW_ATLAS_TEXTURE_UNIT);
+        glUseProgram(0);
+    }
 }
 
 static void
@@ -458,77 +765,422 @@ program_destroy(struct program* program)
     glDeleteProgram(program->program);
 }
 
-struct attrib_pointer
+struct shader_variants
+{
+    struct program programs[SHADER_VARIANT_COUNT];
+    bool compiled[SHADER_VARIANT_COUNT];
+    int compiled_count;
+};
+
+// Compiles the variants in SHADER_MANIFEST whose features are all in
+// supported_features.
+static void
+shader_variants_create(struct shader_variants* variants,
+                       uint32_t supported_features)
+{
+    variants->compiled_count = 0;
+    for (int key = 0; key < SHADER_VARIANT_COUNT; ++key) {
+        variants->compiled[key] = false;
+    }
+    double total_time = 0.0;
+    for (size_t i = 0; i < sizeof(SHADER_MANIFEST) / sizeof(uint32_t); ++i) {
+        uint32_t key = SHADER_MANIFEST[i];
+        if ((key & ~supported_features) != 0 || variants->compiled[key]) {
+            continue;
+        }
+        // Shader storage buffers need GLSL ES 3.10.
+        char header[512];
+        int length = snprintf(
+            header, sizeof(header), "#version %s\n",
+            key & (SHADER_FEATURE_INSTANCING | SHADER_FEATURE_LIGHTING)
+                ? "310 es"
+                : "300 es");
+        for (int feature = 0; feature < SHADER_FEATURE_COUNT; ++feature) {
+            if (key & (1 << feature)) {
+                length += snprintf(header + length, sizeof(header) - length,
+                                   "#define %s 1\n",
+                                   SHADER_FEATURE_NAMES[feature]);
+            }
+        }
+        snprintf(header + length, sizeof(header) - length,
+                 "#define MAX_JOINTS %d\n"
+                 "#define CLUSTER_GRID_WIDTH %d\n"
+                 "#define CLUSTER_GRID_HEIGHT %d\n"
+                 "#define CLUSTER_GRID_DEPTH %d\n"
+                 "#define CLUSTER_COUNT %d\n",
+                 MAX_JOINTS, CLUSTER_GRID_WIDTH, CLUSTER_GRID_HEIGHT,
+                 CLUSTER_GRID_DEPTH, CLUSTER_COUNT);
+
+        double start_time = get_time();
+        program_create(&variants->programs[key], header, VERTEX_SHADER,
+                       FRAGMENT_SHADER);
+        double time = get_time() - start_time;
+        info("compiled shader variant %#x in %.2f ms", key, time * 1000.0);
+        total_time += time;
+        variants->compiled[key] = true;
+        ++variants->compiled_count;
+    }
+    info("compiled %d of %d shader variants in %.2f ms",
+         variants->compiled_count, SHADER_VARIANT_COUNT, total_time * 1000.0);
+}
+
+static void
+shader_variants_destroy(struct shader_variants* variants)
+{
+    for (int key = 0; key < SHADER_VARIANT_COUNT; ++key) {
+        if (variants->compiled[key]) {
+            program_destroy(&variants->programs[key]);
+        }
+    }
+}
+
+static const struct program*
+shader_variants_get(const struct shader_variants* variants, uint32_t key)
 {
-    GLint size;
-    GLenum type;
-    GLboolean normalized;
-    GLsizei stride;
-    const GLvoid* pointer;
+    if (!variants->compiled[key]) {
+        error("can't find shader variant %#x: not in the shader manifest or "
+              "not supported",
+              key);
+        exit(EXIT_FAILURE);
+    }
+    return &variants->programs[key];
+}
+
+// The lenses only show an ellipse around the optical axis of each eye, so
+// the corners of the eye buffer are never seen. Drawing a mask over them
+// into depth at the near plane, before anything else, makes early depth
+// testing reject every fragment there.
+static const char HIDDEN_AREA_VERTEX_SHADER[] =
+    "in vec2 aPosition;\n"
+    "void main()\n"
+    "{\n"
+    "	gl_Position = vec4(aPosition, -1.0, 1.0);\n"
+    "}\n";
+
+static const char HIDDEN_AREA_FRAGMENT_SHADER[] = "void main()\n"
+                                                  "{\n"
+                                                  "}\n";
+
+// Draws text batches. Positions are in pixels from the top left corner.
+static const char TEXT_VERTEX_SHADER[] =
+    "in vec2 aPosition;\n"
+    "in vec2 aTexCoord;\n"
+    "in vec4 aColor;\n"
+    "uniform vec2 uViewportSize;\n"
+    "\n"
+    "out vec2 vTexCoord;\n"
+    "out vec4 vColor;\n"
+    "void main()\n"
+    "{\n"
+    "	vec2 position = aPosition / uViewportSize * 2.0 - 1.0;\n"
+    "	gl_Position = vec4(position.x, -position.y, 0.0, 1.0);\n"
+    "	vTexCoord = aTexCoord;\n"
+    "	vColor = aColor;\n"
+    "}\n";
+
+// The distance field is 0.5 on the outline. Smoothing over the width of a
+// pixel in distance units antialiases the edge at any scale.
+static const char TEXT_FRAGMENT_SHADER[] =
+    "uniform mediump sampler2D uAtlas;\n"
+    "in mediump vec2 vTexCoord;\n"
+    "in lowp vec4 vColor;\n"
+    "out lowp vec4 outColor;\n"
+    "void main()\n"
+    "{\n"
+    "	mediump float distance = texture(uAtlas, vTexCoord).r;\n"
+    "	mediump float width = fwidth(distance);\n"
+    "	lowp float alpha = smoothstep(0.5 - width, 0.5 + width, distance);\n"
+    "	outColor = vec4(vColor.rgb, vColor.a * alpha);\n"
+    "}\n";
+
+static const struct vertex_layout TEXT_VERTEX_LAYOUT = {
+    3,
+    {
+        { ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(struct text_vertex),
+          offsetof(struct text_vertex, position) },
+        { ATTRIB_TEX_COORD, 2, GL_FLOAT, GL_FALSE,
+          sizeof(struct text_vertex),
+          offsetof(struct text_vertex, tex_coord) },
+        { ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+          sizeof(struct text_vertex), offsetof(struct text_vertex, color) },
+    },
 };
 
-struct vertex
+// Tangent of the largest angle from the optical axis, horizontally and
+// vertically, that the lens shows. Slightly conservative, so the mask never
+// covers anything visible.
+static const float LENS_VISIBLE_TAN_ANGLE = 1.15;
+
+enum
 {
-    float position[4];
-    float color[4];
+    // Must be a multiple of 8, so that the outer edge of the mask goes
+    // through the corners of the viewport.
+    HIDDEN_AREA_SEGMENTS = 32,
+    HIDDEN_AREA_VERTEX_COUNT = 2 * (HIDDEN_AREA_SEGMENTS + 1),
+    // The hidden pixel count is estimated from this many samples along each
+    // axis.
+    HIDDEN_AREA_SAMPLE_COUNT = 256,
 };
 
-struct geometry
+static const struct vertex_layout HIDDEN_AREA_VERTEX_LAYOUT = {
+    1,
+    { { ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), 0 } },
+};
+
+struct hidden_area
 {
     GLuint vertex_array;
     GLuint vertex_buffer;
-    GLuint index_buffer;
+    // The mask is rebuilt when the projection changes.
+    ovrMatrix4f projection_matrix;
+    bool valid;
+    // Estimated number of pixels that the mask covers.
+    uint64_t hidden_pixel_count;
+};
+
+static void
+hidden_area_create(struct hidden_area* hidden_area)
+{
+    glGenVertexArrays(1, &hidden_area->vertex_array);
+    glBindVertexArray(hidden_area->vertex_array);
+    glGenBuffers(1, &hidden_area->vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, hidden_area->vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, HIDDEN_AREA_VERTEX_COUNT * 2 * sizeof(float),
+                 NULL, GL_STATIC_DRAW);
+    vertex_layout_apply(&HIDDEN_AREA_VERTEX_LAYOUT);
+    glBindVertexArray(0);
+    hidden_area->valid = false;
+    hidden_area->hidden_pixel_count = 0;
+}
+
+static void
+hidden_area_destroy(struct hidden_area* hidden_area)
+{
+    glDeleteBuffers(1, &hidden_area->vertex_buffer);
+    glDeleteVertexArrays(1, &hidden_area->vertex_array);
+}
+
+// Builds a triangle strip between the ellipse that the lens shows and a
+// square well outside the viewport, both in normalized device coordinates.
+static void
+hidden_area_update(struct hidden_area* hidden_area,
+                   const ovrMatrix4f* projection_matrix, GLsizei width,
+                   GLsizei height)
+{
+    if (hidden_area->valid &&
+        memcmp(&hidden_area->projection_matrix, projection_matrix,
+               sizeof(*projection_matrix)) == 0) {
+        return;
+    }
+    hidden_area->projection_matrix = *projection_matrix;
+    hidden_area->valid = true;
+
+    // Where the optical axis, and a point at LENS_VISIBLE_TAN_ANGLE from it,
+    // end up after projection.
+    const ovrVector4f axis = ovrVector4f_MultiplyMatrix4f(
+        projection_matrix, &(ovrVector4f){ 0.0, 0.0, -1.0, 1.0 });
+    float center_x = axis.x / axis.w;
+    float center_y = axis.y / axis.w;
+    float radius_x = projection_matrix->M[0][0] * LENS_VISIBLE_TAN_ANGLE;
+    float radius_y = projection_matrix->M[1][1] * LENS_VISIBLE_TAN_ANGLE;
+
+    float vertices[HIDDEN_AREA_VERTEX_COUNT][2];
+    for (int i = 0; i <= HIDDEN_AREA_SEGMENTS; ++i) {
+        float angle = 2.0 * M_PI * i / HIDDEN_AREA_SEGMENTS;
+        float c = cosf(angle);
+        float s = sinf(angle);
+        vertices[2 * i][0] = center_x + radius_x * c;
+        vertices[2 * i][1] = center_y + radius_y * s;
+        float outer_scale = (2.0 + fabsf(center_x) + fabsf(center_y)) /
+                            fmaxf(fabsf(c), fabsf(s));
+        vertices[2 * i + 1][0] = center_x + outer_scale * c;
+        vertices[2 * i + 1][1] = center_y + outer_scale * s;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, hidden_area->vertex_buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    int hidden_sample_count = 0;
+    for (int y = 0; y < HIDDEN_AREA_SAMPLE_COUNT; ++y) {
+        float dy = (2.0 * (y + 0.5) / HIDDEN_AREA_SAMPLE_COUNT - 1.0 -
+                    center_y) /
+                   radius_y;
+        for (int x = 0; x < HIDDEN_AREA_SAMPLE_COUNT; ++x) {
+            float dx = (2.0 * (x + 0.5) / HIDDEN_AREA_SAMPLE_COUNT - 1.0 -
+                        center_x) /
+                       radius_x;
+            if (dx * dx + dy * dy > 1.0) {
+                ++hidden_sample_count;
+            }
+        }
+    }
+    hidden_area->hidden_pixel_count =
+        (uint64_t)width * height * hidden_sample_count /
+        (HIDDEN_AREA_SAMPLE_COUNT * HIDDEN_AREA_SAMPLE_COUNT);
+    info("hidden area mask covers %.1f%% of the eye buffer",
+         100.0 * hidden_sample_count /
+             (HIDDEN_AREA_SAMPLE_COUNT * HIDDEN_AREA_SAMPLE_COUNT));
+}
+
+// Expects the depth buffer to have just been cleared. pipeline must write
+// depth only, without culling, and always pass the depth test.
+static void
+hidden_area_draw(const struct hidden_area* hidden_area,
+                 struct pipeline_state* pipeline_state,
+                 const struct pipeline* pipeline)
+{
+    pipeline_state_apply(pipeline_state, pipeline);
+    glBindVertexArray(hidden_area->vertex_array);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, HIDDEN_AREA_VERTEX_COUNT);
+    glBindVertexArray(0);
+}
+
+enum
+{
+    MAX_LODS = 4,
 };
 
-static const struct attrib_pointer ATTRIB_POINTERS[ATTRIB_END] = {
-    { 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-      (const GLvoid*)offsetof(struct vertex, position) },
-    { 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
-      (const GLvoid*)offsetof(struct vertex, color) },
+// A range of indices that draws the geometry at some level of detail. error
+// is the largest distance, in model space, between this level and the full
+// detail surface.
+struct lod
+{
+    GLsizei first_index;
+    GLsizei index_count;
+    float error;
 };
 
-static const struct vertex VERTICES[] = {
-    { { -1.0, +1.0, -1.0 }, { 1.0, 0.0, 1.0 } },
-    { { +1.0, +1.0, -1.0 }, { 0.0, 1.0, 0.0 } },
-    { { +1.0, +1.0, +1.0 }, { 0.0, 0.0, 1.0 } },
-    { { -1.0, +1.0, +1.0 }, { 1.0, 0.0, 0.0 } },
-    { { -1.0, -1.0, -1.0 }, { 0.0, 0.0, 1.0 } },
-    { { -1.0, -1.0, +1.0 }, { 0.0, 1.0, 0.0 } },
-    { { +1.0, -1.0, +1.0 }, { 1.0, 0.0, 1.0 } },
-    { { +1.0, -1.0, -1.0 }, { 1.0, 0.0, 0.0 } },
+// The buffers are uploaded by the loader thread. Until both of them have
+// been handed over, the vertex array is 0 and the geometry isn't drawn.
+struct geometry
+{
+    GLuint vertex_array;
+    GLuint vertex_buffer;
+    GLuint index_buffer;
+    uint64_t vertex_upload_id;
+    uint64_t index_upload_id;
+    // A copy of the vertices and indices, freed once both are uploaded, or
+    // NULL if they are uploaded in place.
+    void* data;
+    double upload_start_time;
+    enum index_type index_type;
+    // Radius of the bounding sphere around the origin, in model space.
+    float radius;
+    // From finest to coarsest.
+    int lod_count;
+    struct lod lods[MAX_LODS];
 };
 
-static const unsigned short INDICES[] = {
-    0, 2, 1, 2, 0, 3,
-    4, 6, 5, 6, 4, 7,
-    2, 6, 7, 7, 1, 2,
-    0, 4, 5, 5, 3, 0,
-    3, 5, 6, 6, 2, 3,
-    0, 1, 7, 7, 4, 0,
+static const struct vertex_layout VERTEX_LAYOUT = {
+    2,
+    {
+        { ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
+          offsetof(struct vertex, position) },
+        { ATTRIB_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(struct vertex),
+          offsetof(struct vertex, color) },
+    },
 };
 
-static const GLsizei NUM_INDICES = sizeof(INDICES) / sizeof(INDICES[0]);
+// Sets up geometry and starts uploading its vertices and indices as-is, so
+// they should already be in the order produced by the offline mesh
+// optimizer. Each LOD is a range of the indices. They aren't copied, so they
+// must stay valid until the upload finishes.
+static void
+geometry_create_in_place(struct geometry* geometry, struct loader* loader,
+                         const struct vertex* vertices, GLsizei vertex_count,
+                         const void* indices, enum index_type index_type,
+                         GLsizei index_count, const struct lod* lods,
+                         int lod_count)
+{
+    geometry->index_type = index_type;
+    geometry->radius = 0.0;
+    for (int i = 0; i < vertex_count; ++i) {
+        const float* position = vertices[i].position;
+        float radius = sqrtf(position[0] * position[0] +
+                             position[1] * position[1] +
+                             position[2] * position[2]);
+        if (radius > geometry->radius) {
+            geometry->radius = radius;
+        }
+    }
+    geometry->lod_count = lod_count;
+    for (int i = 0; i < lod_count; ++i) {
+        geometry->lods[i] = lods[i];
+    }
+
+    size_t vertex_size = vertex_count * sizeof(struct vertex);
+    size_t index_size =
+        index_count * (index_type == INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                                       : sizeof(uint32_t));
+    geometry->data = NULL;
+    geometry->vertex_array = 0;
+    geometry->vertex_buffer = 0;
+    geometry->index_buffer = 0;
+    geometry->upload_start_time = get_time();
+    geometry->vertex_upload_id =
+        loader_upload_buffer(loader, GL_ARRAY_BUFFER, vertices, vertex_size);
+    geometry->index_upload_id = loader_upload_buffer(
+        loader, GL_ELEMENT_ARRAY_BUFFER, indices, index_size);
+}
+
+// Like geometry_create_in_place, but the vertices and indices are copied, so
+// they can be freed once this returns.
+static void
+geometry_create(struct geometry* geometry, struct loader* loader,
+                const struct vertex* vertices, GLsizei vertex_count,
+                const void* indices, enum index_type index_type,
+                GLsizei index_count, const struct lod* lods, int lod_count)
+{
+    size_t vertex_size = vertex_count * sizeof(struct vertex);
+    size_t index_size =
+        index_count * (index_type == INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                                       : sizeof(uint32_t));
+    void* data = memory_alloc(vertex_size + index_size);
+    memcpy(data, vertices, vertex_size);
+    memcpy((char*)data + vertex_size, indices, index_size);
+    geometry_create_in_place(geometry, loader, data, vertex_count,
+                             (char*)data + vertex_size, index_type,
+                             index_count, lods, lod_count);
+    geometry->data = data;
+}
 
+// Uploads the mesh file called name in the asset pack straight from the
+// pack, as a single LOD. The pack must stay open until the upload finishes.
 static void
-geometry_create(struct geometry* geometry)
+geometry_create_from_pack(struct geometry* geometry, struct loader* loader,
+                          const struct asset_pack* asset_pack,
+                          const char* name)
 {
-    glGenVertexArrays(1, &geometry->vertex_array);
-    glBindVertexArray(geometry->vertex_array);
-    glGenBuffers(1, &geometry->vertex_buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertex_buffer);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(VERTICES), VERTICES, GL_STATIC_DRAW);
-    for (enum attrib attrib = ATTRIB_BEGIN; attrib != ATTRIB_END; ++attrib) {
-        struct attrib_pointer attrib_pointer = ATTRIB_POINTERS[attrib];
-        glEnableVertexAttribArray(attrib);
-        glVertexAttribPointer(attrib, attrib_pointer.size, attrib_pointer.type,
-                              attrib_pointer.normalized, attrib_pointer.stride,
-                              attrib_pointer.pointer);
+    double start_time = get_time();
+    size_t size;
+    const char* data = asset_pack_find(asset_pack, name, &size);
+    if (data == NULL) {
+        error("can't find %s in asset pack", name);
+        exit(EXIT_FAILURE);
     }
-    glGenBuffers(1, &geometry->index_buffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->index_buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(INDICES), INDICES,
-                 GL_STATIC_DRAW);
-    glBindVertexArray(0);
+    const struct mesh_header* header = (const struct mesh_header*)data;
+    if (size < sizeof(*header) || header->magic != MESH_MAGIC ||
+        (header->index_size != 2 && header->index_size != 4) ||
+        header->vertices_offset % sizeof(float) != 0 ||
+        header->vertices_offset > size ||
+        (size - header->vertices_offset) / sizeof(struct vertex) <
+            header->vertex_count ||
+        header->indices_offset % header->index_size != 0 ||
+        header->indices_offset > size ||
+        (size - header->indices_offset) / header->index_size <
+            header->index_count) {
+        error("%s isn't a valid mesh", name);
+        exit(EXIT_FAILURE);
+    }
+    struct lod lod = { 0, header->index_count, 0.0 };
+    geometry_create_in_place(
+        geometry, loader,
+        (const struct vertex*)(data + header->vertices_offset),
+        header->vertex_count, data + header->indices_offset,
+        header->index_size == 2 ? INDEX_TYPE_UINT16 : INDEX_TYPE_UINT32,
+        header->index_count, &lod, 1);
+    info("found %s in asset pack in %.3f ms", name,
+         (get_time() - start_time) * 1000.0);
 }
 
 static void
@@ -536,126 +1188,2853 @@ geometry_destroy(struct geometry* geometry)
 {
     glDeleteBuffers(1, &geometry->index_buffer);
     glDeleteBuffers(1, &geometry->vertex_buffer);
-    glDeleteVertexArrays(1, &geometry->vertex_array);
+    if (geometry->vertex_array != 0) {
+        glDeleteVertexArrays(1, &geometry->vertex_array);
+    }
+    if (geometry->data != NULL) {
+        memory_free(geometry->data);
+    }
 }
 
-struct renderer
-{
-    struct framebuffer framebuffers[VRAPI_FRAME_LAYER_EYE_MAX];
-    struct program program;
-    struct geometry geometry;
-};
-
+// Takes over the buffer from upload, if it belongs to the geometry. Once
+// both buffers are in, creates the vertex array, which can't be shared
+// with the loader's context.
 static void
-renderer_create(struct renderer* renderer, GLsizei width, GLsizei height)
+geometry_finish_upload(struct geometry* geometry,
+                       const struct upload* upload)
 {
-    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
-        framebuffer_create(&renderer->framebuffers[i], width, height);
+    if (geometry->vertex_array != 0) {
+        return;
+    }
+    if (upload->id == geometry->vertex_upload_id) {
+        geometry->vertex_buffer = upload->name;
+    } else if (upload->id == geometry->index_upload_id) {
+        geometry->index_buffer = upload->name;
+    } else {
+        return;
+    }
+    if (geometry->vertex_buffer == 0 || geometry->index_buffer == 0) {
+        return;
+    }
+    glGenVertexArrays(1, &geometry->vertex_array);
+    glBindVertexArray(geometry->vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, geometry->vertex_buffer);
+    vertex_layout_apply(&VERTEX_LAYOUT);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->index_buffer);
+    glBindVertexArray(0);
+    if (geometry->data != NULL) {
+        memory_free(geometry->data);
+        geometry->data = NULL;
     }
-    program_create(&renderer->program);
-    geometry_create(&renderer->geometry);
+    info("uploaded geometry in %.2f ms",
+         (get_time() - geometry->upload_start_time) * 1000.0);
 }
 
+// Number of segments around the equator for each sphere LOD, from finest to
+// coarsest. Each LOD has half as many rings as segments.
+static const int SPHERE_LOD_SEGMENTS[MAX_LODS] = { 48, 24, 12, 6 };
+
 static void
-renderer_destroy(struct renderer* renderer)
+geometry_create_sphere(struct geometry* geometry, struct loader* loader)
 {
-    geometry_destroy(&renderer->geometry);
-    program_destroy(&renderer->program);
-    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
-        framebuffer_destroy(&renderer->framebuffers[i]);
+    GLsizei vertex_count = 0;
+    GLsizei index_count = 0;
+    for (int i = 0; i < MAX_LODS; ++i) {
+        int segments = SPHERE_LOD_SEGMENTS[i];
+        int rings = segments / 2;
+        vertex_count += (rings + 1) * (segments + 1);
+        index_count += rings * segments * 6;
+    }
+    struct vertex* vertices = memory_alloc(vertex_count * sizeof(*vertices));
+    uint16_t* indices = memory_alloc(index_count * sizeof(*indices));
+
+    struct lod lods[MAX_LODS];
+    GLsizei vertex_index = 0;
+    GLsizei index_index = 0;
+    for (int i = 0; i < MAX_LODS; ++i) {
+        int segments = SPHERE_LOD_SEGMENTS[i];
+        int rings = segments / 2;
+        GLsizei first_vertex = vertex_index;
+        for (int ring = 0; ring <= rings; ++ring) {
+            float theta = M_PI * ring / rings;
+            for (int segment = 0; segment <= segments; ++segment) {
+                float phi = 2.0 * M_PI * segment / segments;
+                struct vertex* vertex = &vertices[vertex_index++];
+                vertex->position[0] = sinf(theta) * cosf(phi);
+                vertex->position[1] = cosf(theta);
+                vertex->position[2] = sinf(theta) * sinf(phi);
+                vertex->position[3] = 1.0;
+                for (int j = 0; j < 3; ++j) {
+                    vertex->color[j] = 0.5 + 0.5 * vertex->position[j];
+                }
+                vertex->color[3] = 1.0;
+            }
+        }
+        lods[i].first_index = index_index;
+        for (int ring = 0; ring < rings; ++ring) {
+            for (int segment = 0; segment < segments; ++segment) {
+                uint16_t a = first_vertex + ring * (segments + 1) + segment;
+                uint16_t b = a + segments + 1;
+                indices[index_index++] = a;
+                indices[index_index++] = a + 1;
+                indices[index_index++] = b;
+                indices[index_index++] = a + 1;
+                indices[index_index++] = b + 1;
+                indices[index_index++] = b;
+            }
+        }
+        lods[i].index_count = index_index - lods[i].first_index;
+        // The chord between two segments is closest to the center halfway.
+        lods[i].error = 1.0 - cosf(M_PI / segments);
     }
+
+    geometry_create(geometry, loader, vertices, vertex_count, indices,
+                    INDEX_TYPE_UINT16, index_count, lods, MAX_LODS);
+    memory_free(indices);
+    memory_free(vertices);
 }
 
-static ovrLayerProjection2
-renderer_render_frame(struct renderer* renderer, ovrTracking2* tracking)
+// Skinned characters, tentacles that sway and curl, blending between the two
+// clips. Each one's joint palette is sampled on the job system every frame,
+// and then either uploaded for the vertex shader to skin with, or used to
+// skin the vertices on the CPU, which are then streamed.
+enum skinning_mode
 {
-    ovrMatrix4f model_matrix = ovrMatrix4f_CreateTranslation(0.0, 0.0, -1.0);
-    model_matrix = ovrMatrix4f_Transpose(&model_matrix);
-
-    ovrLayerProjection2 layer = vrapi_DefaultLayerProjection2();
-    layer.Header.Flags |=
-        VRAPI_FRAME_LAYER_FLAG_CHROMATIC_ABERRATION_CORRECTION;
-    layer.HeadPose = tracking->HeadPose;
+    SKINNING_MODE_BEGIN,
+    SKINNING_MODE_GPU = SKINNING_MODE_BEGIN,
+    SKINNING_MODE_CPU,
+    SKINNING_MODE_END,
+};
 
-    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
-        ovrMatrix4f view_matrix =
-            ovrMatrix4f_Transpose(&tracking->Eye[i].ViewMatrix);
-        ovrMatrix4f projection_matrix =
-            ovrMatrix4f_Transpose(&tracking->Eye[i].ProjectionMatrix);
+static const char* SKINNING_MODE_NAMES[SKINNING_MODE_END] = {
+    "gpu",
+    "cpu",
+};
 
-        struct framebuffer* framebuffer = &renderer->framebuffers[i];
-        layer.Textures[i].ColorSwapChain =
-            framebuffer->color_texture_swap_chain;
-        layer.Textures[i].SwapChainIndex = framebuffer->swap_chain_index;
-        layer.Textures[i].TexCoordsFromTanAngles =
-            ovrMatrix4f_TanAngleMatrixFromProjection(
-                &tracking->Eye[i].ProjectionMatrix);
+enum character_clip
+{
+    CHARACTER_CLIP_BEGIN,
+    CHARACTER_CLIP_SWAY = CHARACTER_CLIP_BEGIN,
+    CHARACTER_CLIP_CURL,
+    CHARACTER_CLIP_END,
+};
 
-        glBindFramebuffer(
-            GL_DRAW_FRAMEBUFFER,
-            framebuffer->framebuffers[framebuffer->swap_chain_index]);
+enum
+{
+    TENTACLE_JOINT_COUNT = 8,
+    TENTACLE_RINGS_PER_JOINT = 4,
+    TENTACLE_SEGMENTS = 8,
+    TENTACLE_CLIP_FRAME_COUNT = 32,
+};
 
-        glEnable(GL_CULL_FACE);
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_SCISSOR_TEST);
-        glViewport(0, 0, framebuffer->width, framebuffer->height);
-        glScissor(0, 0, framebuffer->width, framebuffer->height);
-        glClearColor(0.0, 0.0, 0.0, 0.0);
+// In meters.
+static const float TENTACLE_LENGTH = 0.4;
+static const float TENTACLE_RADIUS = 0.03;
+static const float TENTACLE_CLIP_FRAME_RATE = 16.0;
+// Largest angle of each joint in radians, and phase difference between one
+// joint and the next, for the sway clip.
+static const float TENTACLE_SWAY_ANGLE = 0.25;
+static const float TENTACLE_SWAY_PHASE = 0.6;
+static const float TENTACLE_CURL_ANGLE = 0.3;
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glUseProgram(renderer->program.program);
-        glUniformMatrix4fv(
-            renderer->program.uniform_locations[UNIFORM_MODEL_MATRIX], 1,
-            GL_FALSE, (const GLfloat*)&model_matrix);
-        glUniformMatrix4fv(
-            renderer->program.uniform_locations[UNIFORM_VIEW_MATRIX], 1,
-            GL_FALSE, (const GLfloat*)&view_matrix);
-        glUniformMatrix4fv(
-            renderer->program.uniform_locations[UNIFORM_PROJECTION_MATRIX], 1,
-            GL_FALSE, (const GLfloat*)&projection_matrix);
-        glBindVertexArray(renderer->geometry.vertex_array);
-        glDrawElements(GL_TRIANGLES, NUM_INDICES, GL_UNSIGNED_SHORT, NULL);
-        glBindVertexArray(0);
-        glUseProgram(0);
+static const struct vertex_layout SKINNED_VERTEX_LAYOUT = {
+    4,
+    {
+        { ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE,
+          sizeof(struct skinned_vertex),
+          offsetof(struct skinned_vertex, position) },
+        { ATTRIB_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(struct skinned_vertex),
+          offsetof(struct skinned_vertex, color) },
+        { ATTRIB_JOINT_INDICES, 4, GL_UNSIGNED_BYTE, GL_FALSE,
+          sizeof(struct skinned_vertex),
+          offsetof(struct skinned_vertex, joint_indices) },
+        { ATTRIB_JOINT_WEIGHTS, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+          sizeof(struct skinned_vertex),
+          offsetof(struct skinned_vertex, joint_weights) },
+    },
+};
 
-        glClearColor(0.0, 0.0, 0.0, 1.0);
-        glScissor(0, 0, 1, framebuffer->height);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glScissor(framebuffer->width - 1, 0, 1, framebuffer->height);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glScissor(0, 0, framebuffer->width, 1);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glScissor(0, framebuffer->height - 1, framebuffer->width, 1);
-        glClear(GL_COLOR_BUFFER_BIT);
+struct character_model
+{
+    struct skeleton skeleton;
+    struct animation_clip clips[CHARACTER_CLIP_END];
+    int vertex_count;
+    // Kept on the CPU for CPU skinning.
+    struct skinned_vertex* vertices;
+    GLsizei index_count;
+    GLuint vertex_buffer;
+    GLuint index_buffer;
+    // Reads the skinned vertices from vertex_buffer, for GPU skinning. For
+    // CPU skinning, the other vertex array only has the index buffer bound,
+    // since the vertices are somewhere else in the stream buffer every
+    // frame.
+    GLuint vertex_arrays[SKINNING_MODE_END];
+    // Range of the stream buffer that each character needs per frame, for
+    // its palette or its skinned vertices.
+    size_t stream_sizes[SKINNING_MODE_END];
+    size_t stream_alignments[SKINNING_MODE_END];
+};
 
-        static const GLenum ATTACHMENTS[] = { GL_DEPTH_ATTACHMENT };
-        static const GLsizei NUM_ATTACHMENTS =
-            sizeof(ATTACHMENTS) / sizeof(ATTACHMENTS[0]);
-        glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, NUM_ATTACHMENTS,
-                                ATTACHMENTS);
-        glFlush();
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+static struct joint_pose
+tentacle_joint_pose(int joint, float angle, float x, float z)
+{
+    struct joint_pose pose;
+    // Rotates by angle around the axis (x, 0, z).
+    float s = sinf(0.5 * angle);
+    pose.rotation[0] = x * s;
+    pose.rotation[1] = 0.0;
+    pose.rotation[2] = z * s;
+    pose.rotation[3] = cosf(0.5 * angle);
+    pose.translation[0] = 0.0;
+    pose.translation[1] =
+        joint == 0 ? 0.0 : TENTACLE_LENGTH / TENTACLE_JOINT_COUNT;
+    pose.translation[2] = 0.0;
+    pose.translation[3] = 0.0;
+    return pose;
+}
 
-        framebuffer->swap_chain_index = (framebuffer->swap_chain_index + 1) %
-                                        framebuffer->swap_chain_length;
+static void
+character_model_create_clips(struct character_model* model)
+{
+    for (enum character_clip clip = CHARACTER_CLIP_BEGIN;
+         clip != CHARACTER_CLIP_END; ++clip) {
+        animation_clip_create(&model->clips[clip], TENTACLE_JOINT_COUNT,
+                              TENTACLE_CLIP_FRAME_COUNT,
+                              TENTACLE_CLIP_FRAME_RATE);
+    }
+    for (int frame = 0; frame < TENTACLE_CLIP_FRAME_COUNT; ++frame) {
+        float phase = 2.0 * M_PI * frame / TENTACLE_CLIP_FRAME_COUNT;
+        struct joint_pose* sway_poses =
+            animation_clip_get_frame(&model->clips[CHARACTER_CLIP_SWAY], frame);
+        struct joint_pose* curl_poses =
+            animation_clip_get_frame(&model->clips[CHARACTER_CLIP_CURL], frame);
+        for (int joint = 0; joint < TENTACLE_JOINT_COUNT; ++joint) {
+            // A wave that travels up the tentacle.
+            float sway_angle = TENTACLE_SWAY_ANGLE *
+                               sinf(phase - TENTACLE_SWAY_PHASE * joint);
+            sway_poses[joint] =
+                tentacle_joint_pose(joint, sway_angle, 0.0, 1.0);
+            // Every joint bends the same way at once.
+            float curl_angle = TENTACLE_CURL_ANGLE * sinf(phase);
+            curl_poses[joint] =
+                tentacle_joint_pose(joint, curl_angle, 1.0, 0.0);
+        }
     }
-    return layer;
 }
 
-struct app
+// A tube along y, tapering towards the tip. Each vertex follows the two
+// joints closest to it.
+static void
+character_model_create_mesh(struct character_model* model)
 {
-    ovrJava* java;
-    struct egl egl;
-    struct renderer renderer;
+    const int ring_count =
+        TENTACLE_JOINT_COUNT * TENTACLE_RINGS_PER_JOINT + 1;
+    model->vertex_count = ring_count * TENTACLE_SEGMENTS + 1;
+    model->vertices =
+        memory_alloc(model->vertex_count * sizeof(struct skinned_vertex));
+    const float joint_length = TENTACLE_LENGTH / TENTACLE_JOINT_COUNT;
+    // The ring after the last is the tip, a single vertex.
+    for (int ring = 0; ring <= ring_count; ++ring) {
+        int height_ring = ring < ring_count ? ring : ring_count - 1;
+        float height = TENTACLE_LENGTH * height_ring / (ring_count - 1);
+        // Puts a vertex halfway between two joints at equal weights.
+        float joint_position = height / joint_length - 0.5;
+        int joint = (int)floorf(joint_position);
+        float t = joint_position - joint;
+        if (joint < 0) {
+            joint = 0;
+            t = 0.0;
+        } else if (joint >= TENTACLE_JOINT_COUNT - 1) {
+            joint = TENTACLE_JOINT_COUNT - 1;
+            t = 0.0;
+        }
+        uint8_t weight = lroundf(255.0 * (1.0 - t));
+        float radius = TENTACLE_RADIUS * (1.0 - 0.7 * height / TENTACLE_LENGTH);
+        int segment_count = ring < ring_count ? TENTACLE_SEGMENTS : 1;
+        for (int segment = 0; segment < segment_count; ++segment) {
+            float phi = 2.0 * M_PI * segment / TENTACLE_SEGMENTS;
+            struct skinned_vertex* vertex =
+                &model->vertices[ring * TENTACLE_SEGMENTS + segment];
+            if (ring < ring_count) {
+                vertex->position[0] = radius * cosf(phi);
+                vertex->position[1] = height;
+                vertex->position[2] = radius * sinf(phi);
+            } else {
+                vertex->position[0] = 0.0;
+                vertex->position[1] = TENTACLE_LENGTH + radius;
+                vertex->position[2] = 0.0;
+            }
+            vertex->position[3] = 1.0;
+            // Stripes, one per joint, getting brighter towards the tip.
+            float brightness = 0.4 + 0.6 * height / TENTACLE_LENGTH;
+            float stripe = (int)(height / joint_length) % 2 == 0 ? 1.0 : 0.7;
+            vertex->color[0] = 0.2 * brightness * stripe;
+            vertex->color[1] = 0.8 * brightness * stripe;
+            vertex->color[2] = 0.7 * brightness * stripe;
+            vertex->color[3] = 1.0;
+            vertex->joint_indices[0] = joint;
+            vertex->joint_indices[1] =
+                joint + 1 < TENTACLE_JOINT_COUNT ? joint + 1 : joint;
+            vertex->joint_indices[2] = 0;
+            vertex->joint_indices[3] = 0;
+            vertex->joint_weights[0] = weight;
+            vertex->joint_weights[1] = 255 - weight;
+            vertex->joint_weights[2] = 0;
+            vertex->joint_weights[3] = 0;
+        }
+    }
+
+    // Two triangles between each pair of rings per segment, and a fan
+    // around the tip.
+    model->index_count = 6 * (ring_count - 1) * TENTACLE_SEGMENTS +
+                         3 * TENTACLE_SEGMENTS;
+    uint16_t* indices = memory_alloc(model->index_count * sizeof(uint16_t));
+    int index = 0;
+    for (int ring = 0; ring < ring_count; ++ring) {
+        for (int segment = 0; segment < TENTACLE_SEGMENTS; ++segment) {
+            int next_segment = (segment + 1) % TENTACLE_SEGMENTS;
+            uint16_t a = ring * TENTACLE_SEGMENTS + segment;
+            uint16_t b = ring * TENTACLE_SEGMENTS + next_segment;
+            if (ring == ring_count - 1) {
+                uint16_t tip = ring_count * TENTACLE_SEGMENTS;
+                indices[index++] = a;
+                indices[index++] = tip;
+                indices[index++] = b;
+                continue;
+            }
+            uint16_t c = a + TENTACLE_SEGMENTS;
+            uint16_t d = b + TENTACLE_SEGMENTS;
+            indices[index++] = a;
+            indices[index++] = c;
+            indices[index++] = b;
+            indices[index++] = b;
+            indices[index++] = c;
+            indices[index++] = d;
+        }
+    }
+
+    glGenBuffers(1, &model->vertex_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, model->vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER,
+                 model->vertex_count * sizeof(struct skinned_vertex),
+                 model->vertices, GL_STATIC_DRAW);
+    glGenBuffers(1, &model->index_buffer);
+    glGenVertexArrays(SKINNING_MODE_END, model->vertex_arrays);
+    glBindVertexArray(model->vertex_arrays[SKINNING_MODE_GPU]);
+    vertex_layout_apply(&SKINNED_VERTEX_LAYOUT);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 model->index_count * sizeof(uint16_t), indices,
+                 GL_STATIC_DRAW);
+    glBindVertexArray(model->vertex_arrays[SKINNING_MODE_CPU]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->index_buffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    memory_free(indices);
+}
+
+static void
+character_model_create(struct character_model* model)
+{
+    struct skeleton* skeleton = &model->skeleton;
+    skeleton->joint_count = TENTACLE_JOINT_COUNT;
+    struct joint_pose bind_pose[TENTACLE_JOINT_COUNT];
+    for (int joint = 0; joint < TENTACLE_JOINT_COUNT; ++joint) {
+        skeleton->parents[joint] = joint - 1;
+        bind_pose[joint] = tentacle_joint_pose(joint, 0.0, 1.0, 0.0);
+    }
+    skeleton_set_bind_pose(skeleton, bind_pose);
+    character_model_create_clips(model);
+    character_model_create_mesh(model);
+
+    // The shader declares the whole palette, so the whole palette is bound,
+    // even if the skeleton has fewer joints.
+    GLint uniform_buffer_alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,
+                  &uniform_buffer_alignment);
+    size_t palette_size = MAX_JOINTS * sizeof(float[16]);
+    model->stream_alignments[SKINNING_MODE_GPU] = uniform_buffer_alignment;
+    model->stream_sizes[SKINNING_MODE_GPU] =
+        (palette_size + uniform_buffer_alignment - 1) /
+        uniform_buffer_alignment * uniform_buffer_alignment;
+    model->stream_alignments[SKINNING_MODE_CPU] = sizeof(float[4]);
+    model->stream_sizes[SKINNING_MODE_CPU] =
+        model->vertex_count * sizeof(struct vertex);
+}
+
+static void
+character_model_destroy(struct character_model* model)
+{
+    glDeleteVertexArrays(SKINNING_MODE_END, model->vertex_arrays);
+    glDeleteBuffers(1, &model->index_buffer);
+    glDeleteBuffers(1, &model->vertex_buffer);
+    memory_free(model->vertices);
+    for (enum character_clip clip = CHARACTER_CLIP_BEGIN;
+         clip != CHARACTER_CLIP_END; ++clip) {
+        animation_clip_destroy(&model->clips[clip]);
+    }
+}
+
+struct character
+{
+    float position[3];
+    // Offsets the clips, so that the characters don't move in lockstep.
+    float time_offset;
+    // Radians per second at which the weights of the clips swing from one
+    // to the other.
+    float blend_rate;
+};
+
+struct animate_characters_data
+{
+    const struct character_model* model;
+    const struct character* characters;
+    enum skinning_mode mode;
+    double time;
+    // Mapped stream buffer memory, with stream_sizes[mode] bytes for each
+    // character.
+    char* stream_data;
+};
+
+static void
+animate_characters(void* data, int begin, int end)
+{
+    const struct animate_characters_data* animate_characters_data = data;
+    const struct character_model* model = animate_characters_data->model;
+    enum skinning_mode mode = animate_characters_data->mode;
+    size_t stream_size = model->stream_sizes[mode];
+    float palette[MAX_JOINTS][16] __attribute__((aligned(16)));
+    for (int i = begin; i < end; ++i) {
+        const struct character* character =
+            &animate_characters_data->characters[i];
+        // Display times are too large to keep their fraction in a float.
+        double time = animate_characters_data->time + character->time_offset;
+        float blend = 0.5 + 0.5 * sin(fmod(character->blend_rate * time,
+                                           2.0 * M_PI));
+        struct animation_layer layers[CHARACTER_CLIP_END];
+        for (enum character_clip clip = CHARACTER_CLIP_BEGIN;
+             clip != CHARACTER_CLIP_END; ++clip) {
+            const struct animation_clip* animation_clip = &model->clips[clip];
+            layers[clip].clip = animation_clip;
+            layers[clip].time =
+                fmod(time, animation_clip->frame_count /
+                               animation_clip->frame_rate);
+        }
+        layers[CHARACTER_CLIP_SWAY].weight = 1.0 - blend;
+        layers[CHARACTER_CLIP_CURL].weight = blend;
+        animation_sample(&model->skeleton, layers, CHARACTER_CLIP_END,
+                         palette);
+
+        char* stream_data = animate_characters_data->stream_data +
+                            i * stream_size;
+        if (mode == SKINNING_MODE_GPU) {
+            memcpy(stream_data, palette,
+                   model->skeleton.joint_count * sizeof(float[16]));
+        } else {
+            skin_vertices(model->vertices, model->vertex_count,
+                          model->skeleton.joint_count,
+                          (const float(*)[16])palette,
+                          (struct vertex*)stream_data);
+        }
+    }
+}
+
+// Samples the palettes of count characters at time, in seconds, and writes
+// what mode draws them from into stream_buffer. Returns the offset of the
+// first character in the stream buffer. The others follow it at
+// stream_sizes[mode] bytes from each other.
+static size_t
+characters_animate(const struct character_model* model,
+                   const struct character* characters, int count,
+                   enum skinning_mode mode, double time,
+                   struct stream_buffer* stream_buffer,
+                   struct job_system* job_system)
+{
+    size_t offset = 0;
+    struct animate_characters_data animate_characters_data;
+    animate_characters_data.model = model;
+    animate_characters_data.characters = characters;
+    animate_characters_data.mode = mode;
+    animate_characters_data.time = time;
+    animate_characters_data.stream_data =
+        stream_buffer_map(stream_buffer, count * model->stream_sizes[mode],
+                          model->stream_alignments[mode], &offset);
+    job_parallel_for(job_system, 0, count, CHARACTERS_PER_JOB,
+                     animate_characters, &animate_characters_data);
+    stream_buffer_unmap(stream_buffer);
+    return offset;
+}
+
+// Expects pipeline, whose program's view and projection matrices are set,
+// to be applied. Returns the number of triangles drawn.
+static uint64_t
+characters_draw(const struct character_model* model,
+                const struct character* characters, int count,
+                enum skinning_mode mode, const struct program* program,
+                const struct stream_buffer* stream_buffer, size_t offset)
+{
+    glBindVertexArray(model->vertex_arrays[mode]);
+    if (mode == SKINNING_MODE_CPU) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream_buffer->buffer);
+    }
+    size_t stream_size = model->stream_sizes[mode];
+    for (int i = 0; i < count; ++i) {
+        const struct character* character = &characters[i];
+        ovrMatrix4f model_matrix = ovrMatrix4f_CreateTranslation(
+            character->position[0], character->position[1],
+            character->position[2]);
+        model_matrix = ovrMatrix4f_Transpose(&model_matrix);
+        glUniformMatrix4fv(program->uniform_locations[UNIFORM_MODEL_MATRIX],
+                           1, GL_FALSE, (const float*)&model_matrix);
+        size_t character_offset = offset + i * stream_size;
+        if (mode == SKINNING_MODE_GPU) {
+            glBindBufferRange(GL_UNIFORM_BUFFER, JOINT_PALETTE_BINDING,
+                              stream_buffer->buffer, character_offset,
+                              stream_size);
+        } else {
+            vertex_layout_apply_at(&VERTEX_LAYOUT, character_offset);
+        }
+        glDrawElements(GL_TRIANGLES, model->index_count, GL_UNSIGNED_SHORT,
+                       NULL);
+    }
+    if (mode == SKINNING_MODE_GPU) {
+        glBindBufferBase(GL_UNIFORM_BUFFER, JOINT_PALETTE_BINDING, 0);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glBindVertexArray(0);
+    return (uint64_t)count * model->index_count / 3;
+}
+
+enum geometry_id
+{
+    GEOMETRY_BEGIN,
+    GEOMETRY_CUBE = GEOMETRY_BEGIN,
+    GEOMETRY_SPHERE,
+    GEOMETRY_FLOOR,
+    GEOMETRY_END,
+};
+
+struct object
+{
+    enum geometry_id geometry;
+    // Node in the renderer's transform hierarchy.
+    int node;
+    ovrVector3f position;
+    float scale;
+    // LOD drawn in the previous frame.
+    int lod;
+    // Body in the renderer's simulation that moves the object, or -1 if the
+    // object doesn't move.
+    int body;
+    // Caster in the renderer's shadow cache, or -1 if the object casts no
+    // shadow.
+    int caster;
+};
+
+// Scale from model space, in which the geometries are about 2 units across,
+// to meters. Baked into the model matrices and object scales.
+static const float MODEL_SCALE = 0.1;
+
+static ovrMatrix4f
+object_get_local_matrix(const struct object* object)
+{
+    ovrMatrix4f translation_matrix = ovrMatrix4f_CreateTranslation(
+        object->position.x, object->position.y, object->position.z);
+    float scale = MODEL_SCALE * object->scale;
+    ovrMatrix4f scale_matrix = ovrMatrix4f_CreateScale(scale, scale, scale);
+    return ovrMatrix4f_Multiply(&translation_matrix, &scale_matrix);
+}
+
+// An object switches to a coarser LOD once that LOD's error, projected to
+// the eye buffer, is below LOD_ERROR_THRESHOLD pixels. It only switches back
+// to a finer LOD once the error of its current LOD goes above
+// LOD_ERROR_THRESHOLD * LOD_HYSTERESIS pixels, so that objects near the
+// threshold don't flicker between LODs.
+static const float LOD_ERROR_THRESHOLD = 1.0;
+static const float LOD_HYSTERESIS = 1.25;
+
+// Culls every object against both eye frusta, selects its LOD in the same
+// way as select_lods, and appends the visible objects to the instances of
+// the indirect draw command for their geometry and LOD.
+static const char CULL_SHADER[] =
+    "layout(local_size_x = 64) in;\n"
+    "struct Object\n"
+    "{\n"
+    "	vec4 positionScale;\n"
+    "	uvec4 geometryLod;\n"
+    "};\n"
+    "struct Command\n"
+    "{\n"
+    "	uint count;\n"
+    "	uint instanceCount;\n"
+    "	uint firstIndex;\n"
+    "	uint baseVertex;\n"
+    "	uint reserved;\n"
+    "};\n"
+    "layout(std430, binding = 0) buffer Objects\n"
+    "{\n"
+    "	Object objects[];\n"
+    "};\n"
+    "layout(std430, binding = 1) buffer Commands\n"
+    "{\n"
+    "	Command commands[];\n"
+    "};\n"
+    "layout(std430, binding = 2) writeonly buffer Visible\n"
+    "{\n"
+    "	uint visible[];\n"
+    "};\n"
+    "uniform uint uObjectCount;\n"
+    "uniform vec4 uFrustumPlanes[10];\n"
+    "uniform vec4 uEyePositions[2];\n"
+    "uniform vec2 uGeometries[GEOMETRY_COUNT];\n"
+    "uniform float uLodErrors[GEOMETRY_COUNT * MAX_LODS];\n"
+    "uniform uint uVisibleOffsets[GEOMETRY_COUNT * MAX_LODS];\n"
+    "uniform vec2 uLodThresholds;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "	uint index = gl_GlobalInvocationID.x;\n"
+    "	if (index >= uObjectCount) {\n"
+    "		return;\n"
+    "	}\n"
+    "	Object object = objects[index];\n"
+    "	uint geometry = object.geometryLod.x;\n"
+    "	vec3 center = object.positionScale.xyz;\n"
+    "	float scale = object.positionScale.w;\n"
+    "	float radius = uGeometries[geometry].x * scale;\n"
+    "\n"
+    "	bool isVisible = false;\n"
+    "	float maxErrorScale = 0.0;\n"
+    "	for (int eye = 0; eye < 2; ++eye) {\n"
+    "		bool isInside = true;\n"
+    "		for (int plane = 0; plane < 5; ++plane) {\n"
+    "			vec4 p = uFrustumPlanes[eye * 5 + plane];\n"
+    "			if (dot(p.xyz, center) + p.w < -radius) {\n"
+    "				isInside = false;\n"
+    "			}\n"
+    "		}\n"
+    "		isVisible = isVisible || isInside;\n"
+    "		float distance = max(length(center - uEyePositions[eye].xyz) - "
+    "radius, 0.01);\n"
+    "		maxErrorScale = max(maxErrorScale, uEyePositions[eye].w * scale / "
+    "distance);\n"
+    "	}\n"
+    "\n"
+    "	uint lodCount = uint(uGeometries[geometry].y);\n"
+    "	uint firstCommand = geometry * uint(MAX_LODS);\n"
+    "	uint lod = min(object.geometryLod.y, lodCount - 1u);\n"
+    "	while (lod > 0u && uLodErrors[firstCommand + lod] * maxErrorScale > "
+    "uLodThresholds.y) {\n"
+    "		--lod;\n"
+    "	}\n"
+    "	while (lod + 1u < lodCount && uLodErrors[firstCommand + lod + 1u] * "
+    "maxErrorScale < uLodThresholds.x) {\n"
+    "		++lod;\n"
+    "	}\n"
+    "	objects[index].geometryLod.y = lod;\n"
+    "\n"
+    "	if (isVisible) {\n"
+    "		uint command = firstCommand + lod;\n"
+    "		uint slot = atomicAdd(commands[command].instanceCount, 1u);\n"
+    "		visible[uVisibleOffsets[command] + slot] = index;\n"
+    "	}\n"
+    "}\n";
+
+enum
+{
+    CULL_GROUP_SIZE = 64,
+    // One indirect draw command for every LOD of every geometry.
+    MAX_DRAW_COMMANDS = GEOMETRY_END * MAX_LODS,
+};
+
+// Must match the layout of DrawElementsIndirectCommand.
+struct draw_command
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLuint base_vertex;
+    GLuint reserved;
+};
+
+// Must match the layout of Object in CULL_SHADER.
+struct gpu_object
+{
+    float position_scale[4];
+    GLuint geometry_lod[4];
+};
+
+// GPU-driven rendering. The objects live in a shader storage buffer, and a
+// compute pass fills in the indirect draw commands, so the CPU does no work
+// per object. Only used if the vertex stage can read shader storage
+// buffers; otherwise the renderer falls back to select_lods and
+// record_draws.
+struct gpu_culling
+{
+    bool supported;
+    struct program program;
+    GLuint cull_program;
+    GLint object_count_location;
+    GLint frustum_planes_location;
+    GLint eye_positions_location;
+    GLuint object_buffer;
+    GLuint command_buffer;
+    GLuint visible_buffer;
+    int object_count;
+    // The instance counts are only known on the GPU, so every frame copies
+    // the commands into the readback buffer of its frame in flight, which is
+    // mapped once gpu_sync has seen the GPU finish that frame.
+    struct gpu_sync* gpu_sync;
+    GLuint readback_buffers[MAX_FRAMES_IN_FLIGHT];
+    // Frame whose commands are in each readback buffer, or 0 if none.
+    uint64_t readback_frame_indices[MAX_FRAMES_IN_FLIGHT];
+    // Commands with an instance count of 0, uploaded at the start of every
+    // frame.
+    struct draw_command commands[MAX_DRAW_COMMANDS];
+    // Index of the first visible object of each command.
+    GLuint visible_offsets[MAX_DRAW_COMMANDS];
+};
+
+static void
+gpu_culling_create(struct gpu_culling* gpu_culling, struct gpu_sync* gpu_sync,
+                   const struct geometry* geometries,
+                   const struct object* objects, int object_count)
+{
+    GLint major_version = 0;
+    GLint minor_version = 0;
+    GLint max_vertex_shader_storage_blocks = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major_version);
+    glGetIntegerv(GL_MINOR_VERSION, &minor_version);
+    if (major_version > 3 || (major_version == 3 && minor_version >= 1)) {
+        glGetIntegerv(GL_MAX_VERTEX_SHADER_STORAGE_BLOCKS,
+                      &max_vertex_shader_storage_blocks);
+    }
+    gpu_culling->supported = max_vertex_shader_storage_blocks >= 2;
+    if (!gpu_culling->supported) {
+        info("GPU culling not supported, culling on the CPU");
+        return;
+    }
+
+    gpu_culling->cull_program = glCreateProgram();
+    char header[128];
+    snprintf(header, sizeof(header),
+             "#version 310 es\n"
+             "#define GEOMETRY_COUNT %d\n"
+             "#define MAX_LODS %d\n",
+             GEOMETRY_END, MAX_LODS);
+    GLuint cull_shader = compile_shader(GL_COMPUTE_SHADER, header, CULL_SHADER);
+    glAttachShader(gpu_culling->cull_program, cull_shader);
+    link_program(gpu_culling->cull_program);
+    gpu_culling->object_count_location =
+        glGetUniformLocation(gpu_culling->cull_program, "uObjectCount");
+    gpu_culling->frustum_planes_location =
+        glGetUniformLocation(gpu_culling->cull_program, "uFrustumPlanes");
+    gpu_culling->eye_positions_location =
+        glGetUniformLocation(gpu_culling->cull_program, "uEyePositions");
+
+    int geometry_object_counts[GEOMETRY_END] = { 0 };
+    struct gpu_object* gpu_objects =
+        memory_alloc(object_count * sizeof(*gpu_objects));
+    for (int i = 0; i < object_count; ++i) {
+        const struct object* object = &objects[i];
+        gpu_objects[i].position_scale[0] = object->position.x;
+        gpu_objects[i].position_scale[1] = object->position.y;
+        gpu_objects[i].position_scale[2] = object->position.z;
+        gpu_objects[i].position_scale[3] = MODEL_SCALE * object->scale;
+        gpu_objects[i].geometry_lod[0] = object->geometry;
+        gpu_objects[i].geometry_lod[1] = object->lod;
+        gpu_objects[i].geometry_lod[2] = 0;
+        gpu_objects[i].geometry_lod[3] = 0;
+        ++geometry_object_counts[object->geometry];
+    }
+    gpu_culling->object_count = object_count;
+    glGenBuffers(1, &gpu_culling->object_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_culling->object_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 object_count * sizeof(*gpu_objects), gpu_objects,
+                 GL_STATIC_DRAW);
+    memory_free(gpu_objects);
+
+    // Every object of a geometry could be visible at any of its LODs, so
+    // each command gets room for all of them.
+    float geometry_uniforms[GEOMETRY_END][2];
+    float lod_errors[MAX_DRAW_COMMANDS];
+    GLuint visible_count = 0;
+    for (enum geometry_id geometry = GEOMETRY_BEGIN; geometry != GEOMETRY_END;
+         ++geometry) {
+        const struct geometry* g = &geometries[geometry];
+        geometry_uniforms[geometry][0] = g->radius;
+        geometry_uniforms[geometry][1] = g->lod_count;
+        for (int lod = 0; lod < MAX_LODS; ++lod) {
+            int command = geometry * MAX_LODS + lod;
+            struct draw_command* draw_command = &gpu_culling->commands[command];
+            draw_command->count = 0;
+            draw_command->first_index = 0;
+            lod_errors[command] = 0.0;
+            if (lod < g->lod_count) {
+                draw_command->count = g->lods[lod].index_count;
+                draw_command->first_index = g->lods[lod].first_index;
+                lod_errors[command] = g->lods[lod].error;
+            }
+            draw_command->instance_count = 0;
+            draw_command->base_vertex = 0;
+            draw_command->reserved = 0;
+            gpu_culling->visible_offsets[command] = visible_count;
+            if (lod < g->lod_count) {
+                visible_count += geometry_object_counts[geometry];
+            }
+        }
+    }
+    glGenBuffers(1, &gpu_culling->command_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_culling->command_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(gpu_culling->commands),
+                 NULL, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &gpu_culling->visible_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_culling->visible_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,
+                 (visible_count > 0 ? visible_count : 1) * sizeof(GLuint),
+                 NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    gpu_culling->gpu_sync = gpu_sync;
+    glGenBuffers(gpu_sync->max_frames_in_flight,
+                 gpu_culling->readback_buffers);
+    for (int i = 0; i < gpu_sync->max_frames_in_flight; ++i) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, gpu_culling->readback_buffers[i]);
+        glBufferData(GL_COPY_WRITE_BUFFER, sizeof(gpu_culling->commands),
+                     NULL, GL_STREAM_READ);
+        gpu_culling->readback_frame_indices[i] = 0;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    GLuint program = gpu_culling->cull_program;
+    glUseProgram(program);
+    glUniform2fv(glGetUniformLocation(program, "uGeometries"), GEOMETRY_END,
+                 &geometry_uniforms[0][0]);
+    glUniform1fv(glGetUniformLocation(program, "uLodErrors"),
+                 MAX_DRAW_COMMANDS, lod_errors);
+    glUniform1uiv(glGetUniformLocation(program, "uVisibleOffsets"),
+                  MAX_DRAW_COMMANDS, gpu_culling->visible_offsets);
+    glUniform2f(glGetUniformLocation(program, "uLodThresholds"),
+                LOD_ERROR_THRESHOLD, LOD_ERROR_THRESHOLD * LOD_HYSTERESIS);
+    glUseProgram(0);
+}
+
+// Uploads the position of an object that moved. The object buffer may still
+// be read by frames in flight, so this is only meant for a few objects.
+static void
+gpu_culling_update_object(struct gpu_culling* gpu_culling, int index,
+                          const struct object* object)
+{
+    if (!gpu_culling->supported) {
+        return;
+    }
+    const float position[3] = { object->position.x, object->position.y,
+                                object->position.z };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_culling->object_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                    index * sizeof(struct gpu_object) +
+                        offsetof(struct gpu_object, position_scale),
+                    sizeof(position), position);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+static void
+gpu_culling_destroy(struct gpu_culling* gpu_culling)
+{
+    if (!gpu_culling->supported) {
+        return;
+    }
+    glDeleteBuffers(gpu_culling->gpu_sync->max_frames_in_flight,
+                    gpu_culling->readback_buffers);
+    glDeleteBuffers(1, &gpu_culling->visible_buffer);
+    glDeleteBuffers(1, &gpu_culling->command_buffer);
+    glDeleteBuffers(1, &gpu_culling->object_buffer);
+    glDeleteProgram(gpu_culling->cull_program);
+}
+
+// Extracts the left, right, bottom, top and near planes from a projection
+// matrix times a view matrix. The projection is infinite, so there is no far
+// plane.
+static void
+get_frustum_planes(const ovrMatrix4f* matrix, float planes[5][4])
+{
+    for (int i = 0; i < 5; ++i) {
+        int row = i / 2;
+        float sign = i % 2 == 0 ? 1.0 : -1.0;
+        for (int j = 0; j < 4; ++j) {
+            planes[i][j] = matrix->M[3][j] + sign * matrix->M[row][j];
+        }
+        float length = sqrtf(planes[i][0] * planes[i][0] +
+                             planes[i][1] * planes[i][1] +
+                             planes[i][2] * planes[i][2]);
+        for (int j = 0; j < 4; ++j) {
+            planes[i][j] /= length;
+        }
+    }
+}
+
+// Returns the triangles drawn for both eyes by the latest frame that the GPU
+// has finished, or 0 if it hasn't finished any yet. gpu_sync_begin_frame has
+// at least waited for the last frame that used the current frame's readback
+// buffer, so this must be called before gpu_culling_dispatch overwrites it.
+static uint64_t
+gpu_culling_read_triangle_count(struct gpu_culling* gpu_culling,
+                                const struct geometry* geometries)
+{
+    const struct gpu_sync* gpu_sync = gpu_culling->gpu_sync;
+    int slot = -1;
+    for (int i = 0; i < gpu_sync->max_frames_in_flight; ++i) {
+        uint64_t frame_index = gpu_culling->readback_frame_indices[i];
+        if (frame_index != 0 &&
+            frame_index <= gpu_sync->completed_frame_index &&
+            (slot < 0 ||
+             frame_index > gpu_culling->readback_frame_indices[slot])) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        return 0;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, gpu_culling->readback_buffers[slot]);
+    const struct draw_command* commands =
+        glMapBufferRange(GL_COPY_READ_BUFFER, 0, sizeof(gpu_culling->commands),
+                         GL_MAP_READ_BIT);
+    uint64_t triangle_count = 0;
+    if (commands != NULL) {
+        // gpu_culling_draw skips the geometries that aren't loaded yet.
+        for (enum geometry_id geometry = GEOMETRY_BEGIN;
+             geometry != GEOMETRY_END; ++geometry) {
+            if (geometries[geometry].vertex_array == 0) {
+                continue;
+            }
+            for (int lod = 0; lod < geometries[geometry].lod_count; ++lod) {
+                const struct draw_command* command =
+                    &commands[geometry * MAX_LODS + lod];
+                triangle_count +=
+                    (uint64_t)command->count / 3 * command->instance_count;
+            }
+        }
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return VRAPI_FRAME_LAYER_EYE_MAX * triangle_count;
+}
+
+// eye_positions and error_scales are as in select_lods_data.
+static void
+gpu_culling_dispatch(struct gpu_culling* gpu_culling,
+                     const ovrTracking2* tracking,
+                     const ovrVector3f* eye_positions,
+                     const float* error_scales)
+{
+    float frustum_planes[VRAPI_FRAME_LAYER_EYE_MAX][5][4];
+    float eye_uniforms[VRAPI_FRAME_LAYER_EYE_MAX][4];
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        ovrMatrix4f view_projection_matrix =
+            ovrMatrix4f_Multiply(&tracking->Eye[i].ProjectionMatrix,
+                                 &tracking->Eye[i].ViewMatrix);
+        get_frustum_planes(&view_projection_matrix, frustum_planes[i]);
+        eye_uniforms[i][0] = eye_positions[i].x;
+        eye_uniforms[i][1] = eye_positions[i].y;
+        eye_uniforms[i][2] = eye_positions[i].z;
+        eye_uniforms[i][3] = error_scales[i];
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gpu_culling->command_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(gpu_culling->commands),
+                    gpu_culling->commands);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gpu_culling->object_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gpu_culling->command_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gpu_culling->visible_buffer);
+
+    glUseProgram(gpu_culling->cull_program);
+    glUniform1ui(gpu_culling->object_count_location, gpu_culling->object_count);
+    glUniform4fv(gpu_culling->frustum_planes_location,
+                 VRAPI_FRAME_LAYER_EYE_MAX * 5, &frustum_planes[0][0][0]);
+    glUniform4fv(gpu_culling->eye_positions_location,
+                 VRAPI_FRAME_LAYER_EYE_MAX, &eye_uniforms[0][0]);
+    glDispatchCompute(
+        (gpu_culling->object_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1,
+        1);
+    glUseProgram(0);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT |
+                    GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    const struct gpu_sync* gpu_sync = gpu_culling->gpu_sync;
+    int slot = gpu_sync->frame_index % gpu_sync->max_frames_in_flight;
+    glBindBuffer(GL_COPY_READ_BUFFER, gpu_culling->command_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, gpu_culling->readback_buffers[slot]);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        sizeof(gpu_culling->commands));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    gpu_culling->readback_frame_indices[slot] = gpu_sync->frame_index;
+}
+
+// Expects program, an instancing shader variant, to be bound, with its view
+// and projection matrices set.
+static void
+gpu_culling_draw(const struct gpu_culling* gpu_culling,
+                 const struct program* program,
+                 const struct geometry* geometries)
+{
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gpu_culling->command_buffer);
+    for (enum geometry_id geometry = GEOMETRY_BEGIN; geometry != GEOMETRY_END;
+         ++geometry) {
+        const struct geometry* g = &geometries[geometry];
+        if (g->vertex_array == 0) {
+            continue;
+        }
+        glBindVertexArray(g->vertex_array);
+        GLenum index_type = g->index_type == INDEX_TYPE_UINT16
+                                ? GL_UNSIGNED_SHORT
+                                : GL_UNSIGNED_INT;
+        for (int lod = 0; lod < g->lod_count; ++lod) {
+            int command = geometry * MAX_LODS + lod;
+            glUniform1ui(program->uniform_locations[UNIFORM_VISIBLE_OFFSET],
+                         gpu_culling->visible_offsets[command]);
+            glDrawElementsIndirect(
+                GL_TRIANGLES, index_type,
+                (const GLvoid*)(command * sizeof(struct draw_command)));
+        }
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+// Point lights circling the scene, shaded with clustered forward lighting.
+// Every frame, the lights are binned into the clusters of each eye on the
+// job system, and the lights and clusters are streamed to the shader
+// storage buffers that the LIGHTING shader variants read.
+enum
+{
+    LIGHTS_BINDING = 3,
+    CLUSTERS_BINDING = 4,
+};
+
+// Lights further away than this are still shaded, but all share the last
+// slice of the clusters.
+static const float LIGHT_CLUSTER_FAR = 20.0;
+static const float LIGHT_RADIUS = 0.75;
+static const float LIGHT_INTENSITY = 1.5;
+static const float LIGHT_ORBIT_RADIUS = 1.2;
+static const float LIGHT_ORBIT_RADIUS_STEP = 0.3;
+static const float LIGHT_HEIGHT = -0.5;
+static const float LIGHT_HEIGHT_STEP = 0.25;
+// Radians per second.
+static const float LIGHT_ORBIT_SPEED = 0.3;
+
+struct lighting_stats
+{
+    // Time spent binning the lights of both eyes, summed over the threads
+    // that binned them.
+    double bin_time;
+    int index_count;
+};
+
+struct lighting
+{
+    bool supported;
+    GLint storage_buffer_alignment;
+    struct point_light lights[LIGHT_COUNT];
+    struct cluster_frustum frustums[VRAPI_FRAME_LAYER_EYE_MAX];
+    struct light_clusters light_clusters[VRAPI_FRAME_LAYER_EYE_MAX];
+    double bin_times[VRAPI_FRAME_LAYER_EYE_MAX];
+    // Where the current frame's lights and clusters are in the stream
+    // buffer.
+    size_t light_offset;
+    size_t cluster_offsets[VRAPI_FRAME_LAYER_EYE_MAX];
+    size_t cluster_sizes[VRAPI_FRAME_LAYER_EYE_MAX];
+    // Holds empty clusters. Bound when drawing without updating the lights
+    // first, as the benchmarks do, so that the shaders never read from an
+    // unbound buffer.
+    GLuint unlit_buffer;
+    struct lighting_stats stats;
+};
+
+static void
+lighting_create(struct lighting* lighting)
+{
+    GLint major_version = 0;
+    GLint minor_version = 0;
+    GLint max_fragment_shader_storage_blocks = 0;
+    GLint max_combined_shader_storage_blocks = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major_version);
+    glGetIntegerv(GL_MINOR_VERSION, &minor_version);
+    if (major_version > 3 || (major_version == 3 && minor_version >= 1)) {
+        glGetIntegerv(GL_MAX_FRAGMENT_SHADER_STORAGE_BLOCKS,
+                      &max_fragment_shader_storage_blocks);
+        glGetIntegerv(GL_MAX_COMBINED_SHADER_STORAGE_BLOCKS,
+                      &max_combined_shader_storage_blocks);
+    }
+    // The instancing variants read two more blocks in the vertex shader.
+    lighting->supported = max_fragment_shader_storage_blocks >= 2 &&
+                          max_combined_shader_storage_blocks >= 4;
+    lighting->stats.bin_time = 0.0;
+    lighting->stats.index_count = 0;
+    if (!lighting->supported) {
+        info("clustered lighting not supported, drawing without lights");
+        return;
+    }
+
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,
+                  &lighting->storage_buffer_alignment);
+    for (int i = 0; i < LIGHT_COUNT; ++i) {
+        struct point_light* light = &lighting->lights[i];
+        light->position_radius[3] = LIGHT_RADIUS;
+        // Spreads the colors around the hue circle.
+        float hue = 2.0 * M_PI * i / LIGHT_COUNT;
+        for (int j = 0; j < 3; ++j) {
+            light->color[j] =
+                LIGHT_INTENSITY *
+                (0.5 + 0.5 * cosf(hue - 2.0 * M_PI * j / 3.0));
+        }
+        light->color[3] = 0.0;
+    }
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        light_clusters_create(&lighting->light_clusters[i], LIGHT_COUNT);
+    }
+
+    size_t cluster_size = CLUSTER_COUNT * sizeof(struct cluster);
+    void* unlit_data = memory_alloc(cluster_size);
+    memset(unlit_data, 0, cluster_size);
+    glGenBuffers(1, &lighting->unlit_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lighting->unlit_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, cluster_size, unlit_data,
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    memory_free(unlit_data);
+}
+
+static void
+lighting_destroy(struct lighting* lighting)
+{
+    if (!lighting->supported) {
+        return;
+    }
+    glDeleteBuffers(1, &lighting->unlit_buffer);
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        light_clusters_destroy(&lighting->light_clusters[i]);
+    }
+}
+
+static void
+bin_lights(void* data, int begin, int end)
+{
+    struct lighting* lighting = data;
+    for (int eye = begin; eye < end; ++eye) {
+        double start_time = get_time();
+        light_clusters_bin(&lighting->light_clusters[eye],
+                           &lighting->frustums[eye], lighting->lights,
+                           LIGHT_COUNT);
+        lighting->bin_times[eye] = get_time() - start_time;
+    }
+}
+
+// Moves the lights to where they are at time, in seconds, bins them into
+// the clusters of each eye, and writes the lights and clusters into
+// stream_buffer.
+static void
+lighting_update(struct lighting* lighting, const ovrTracking2* tracking,
+                double time, struct stream_buffer* stream_buffer,
+                struct job_system* job_system)
+{
+    for (int i = 0; i < LIGHT_COUNT; ++i) {
+        float* position = lighting->lights[i].position_radius;
+        // Alternate lights circle in opposite directions, on orbits of
+        // different sizes and heights. Display times are too large to keep
+        // their fraction in a float.
+        float direction = i % 2 == 0 ? 1.0 : -1.0;
+        float angle =
+            2.0 * M_PI * i / LIGHT_COUNT +
+            direction * fmod(LIGHT_ORBIT_SPEED * time, 2.0 * M_PI);
+        float orbit_radius =
+            LIGHT_ORBIT_RADIUS + LIGHT_ORBIT_RADIUS_STEP * (i % 3);
+        position[0] = orbit_radius * sinf(angle);
+        position[1] = LIGHT_HEIGHT + LIGHT_HEIGHT_STEP * (i % 4);
+        position[2] = -orbit_radius * cosf(angle);
+    }
+
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        cluster_frustum_init(&lighting->frustums[i],
+                             (const float*)&tracking->Eye[i].ViewMatrix,
+                             (const float*)&tracking->Eye[i].ProjectionMatrix,
+                             LIGHT_CLUSTER_FAR);
+    }
+    job_parallel_for(job_system, 0, VRAPI_FRAME_LAYER_EYE_MAX, 1, bin_lights,
+                     lighting);
+
+    void* data = stream_buffer_map(stream_buffer, sizeof(lighting->lights),
+                                   lighting->storage_buffer_alignment,
+                                   &lighting->light_offset);
+    memcpy(data, lighting->lights, sizeof(lighting->lights));
+    stream_buffer_unmap(stream_buffer);
+    lighting->stats.bin_time = 0.0;
+    lighting->stats.index_count = 0;
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        const struct light_clusters* light_clusters =
+            &lighting->light_clusters[i];
+        lighting->cluster_sizes[i] = light_clusters_get_size(light_clusters);
+        data = stream_buffer_map(stream_buffer, lighting->cluster_sizes[i],
+                                 lighting->storage_buffer_alignment,
+                                 &lighting->cluster_offsets[i]);
+        light_clusters_write(light_clusters, data);
+        stream_buffer_unmap(stream_buffer);
+        lighting->stats.bin_time += lighting->bin_times[i];
+        lighting->stats.index_count += light_clusters->index_count;
+    }
+}
+
+// Binds the lights and the clusters of eye, which lighting_update wrote
+// into stream_buffer this frame.
+static void
+lighting_bind(const struct lighting* lighting, int eye,
+              const struct stream_buffer* stream_buffer)
+{
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHTS_BINDING,
+                      stream_buffer->buffer, lighting->light_offset,
+                      sizeof(lighting->lights));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTERS_BINDING,
+                      stream_buffer->buffer, lighting->cluster_offsets[eye],
+                      lighting->cluster_sizes[eye]);
+}
+
+static void
+lighting_bind_unlit(const struct lighting* lighting)
+{
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHTS_BINDING,
+                      lighting->unlit_buffer, 0, sizeof(struct point_light));
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTERS_BINDING,
+                      lighting->unlit_buffer, 0,
+                      CLUSTER_COUNT * sizeof(struct cluster));
+}
+
+// What the LIGHTING shader variants need to find a fragment's cluster in
+// eye, whose framebuffer is width x height: the number of tiles per pixel,
+// then the slice scale and bias.
+static void
+lighting_get_cluster_params(const struct lighting* lighting, int eye,
+                            GLsizei width, GLsizei height, float* params)
+{
+    params[0] = (float)CLUSTER_GRID_WIDTH / width;
+    params[1] = (float)CLUSTER_GRID_HEIGHT / height;
+    params[2] = lighting->frustums[eye].slice_scale;
+    params[3] = lighting->frustums[eye].slice_bias;
+}
+
+// A directional light, the sun, casts shadows from the objects and the
+// characters onto the scene. Its shadow map is cached in a depth texture,
+// the shadow atlas, across frames: static casters are rendered into it
+// once, and each frame only the cells of the atlas that a caster moved
+// into or out of are cleared and rendered again, with the casters that
+// overlap them. The casters move with the nodes of the renderer's transform
+// hierarchy, so a node that the update recomputes moves its caster.
+static const GLsizei SHADOW_ATLAS_SIZE = 2048;
+static const GLenum SHADOW_ATLAS_FORMAT = GL_DEPTH_COMPONENT16;
+// Points from the sun into the scene.
+static const float SUN_DIRECTION[3] = { 0.3, -1.0, -0.2 };
+// The atlas covers a box around SHADOW_CENTER, SHADOW_EXTENT meters across
+// and SHADOW_DEPTH_RANGE meters deep along the sun's direction.
+static const float SHADOW_CENTER[3] = { 0.0, -0.6, -1.0 };
+static const float SHADOW_EXTENT = 8.0;
+static const float SHADOW_DEPTH_RANGE = 10.0;
+// Shadows are too soft to show the finer LODs.
+static const int SHADOW_CASTER_LOD = 1;
+
+struct shadow_stats
+{
+    int rect_count;
+    int draw_count;
+    uint64_t texel_count;
+};
+
+struct shadows
+{
+    GLuint atlas;
+    GLuint framebuffer;
+    // From world space to the sun's view space and clip space, and to the
+    // texture coordinates and depth of the atlas.
+    ovrMatrix4f view_matrix;
+    ovrMatrix4f projection_matrix;
+    ovrMatrix4f atlas_matrix;
+    struct shadow_cache cache;
+    // Caster of each node in the renderer's transform hierarchy, or -1.
+    int* node_casters;
+    // Radius of each caster's bounding sphere, before its node's scale.
+    float* caster_radii;
+    // The characters' casters follow each other. The characters are
+    // animated, so they are rendered again every frame.
+    int first_character_caster;
+    int character_count;
+    struct shadow_rect rects[SHADOW_CELL_COUNT];
+    // The programs and pipelines the casters are rendered with.
+    const struct program* object_program;
+    const struct pipeline* object_pipeline;
+    const struct program* character_programs[SKINNING_MODE_END];
+    const struct pipeline* character_pipelines[SKINNING_MODE_END];
+    struct shadow_stats stats;
+};
+
+static void
+shadows_create(struct shadows* shadows, int node_capacity,
+               int caster_capacity)
+{
+    glGenTextures(1, &shadows->atlas);
+    glBindTexture(GL_TEXTURE_2D, shadows->atlas);
+    glTexStorage2D(GL_TEXTURE_2D, 1, SHADOW_ATLAS_FORMAT, SHADOW_ATLAS_SIZE,
+                   SHADOW_ATLAS_SIZE);
+    // Linear filtering of a comparison filters the results of the 4 nearest
+    // texels in hardware.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE,
+                    GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &shadows->framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadows->framebuffer);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                           GL_TEXTURE_2D, shadows->atlas, 0);
+    static const GLenum DRAW_BUFFERS[] = { GL_NONE };
+    glDrawBuffers(1, DRAW_BUFFERS);
+    GLenum status = glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        error("can't create shadow framebuffer: %s",
+              gl_get_framebuffer_status_string(status));
+        exit(EXIT_FAILURE);
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+    // The sun looks down its direction from the near side of the box, with
+    // its right vector level: forward cross the world's up, which is +y.
+    // SUN_DIRECTION must not be vertical.
+    float length = sqrtf(SUN_DIRECTION[0] * SUN_DIRECTION[0] +
+                         SUN_DIRECTION[1] * SUN_DIRECTION[1] +
+                         SUN_DIRECTION[2] * SUN_DIRECTION[2]);
+    float forward[3];
+    for (int i = 0; i < 3; ++i) {
+        forward[i] = SUN_DIRECTION[i] / length;
+    }
+    float right[3] = { -forward[2], 0.0, forward[0] };
+    length = sqrtf(right[0] * right[0] + right[2] * right[2]);
+    right[0] /= length;
+    right[2] /= length;
+    float up[3] = { right[1] * forward[2] - right[2] * forward[1],
+                    right[2] * forward[0] - right[0] * forward[2],
+                    right[0] * forward[1] - right[1] * forward[0] };
+    float eye[3];
+    for (int i = 0; i < 3; ++i) {
+        eye[i] = SHADOW_CENTER[i] - 0.5 * SHADOW_DEPTH_RANGE * forward[i];
+    }
+    const float* axes[3] = { right, up, forward };
+    shadows->view_matrix = ovrMatrix4f_CreateIdentity();
+    for (int i = 0; i < 3; ++i) {
+        float sign = i == 2 ? -1.0 : 1.0;
+        for (int j = 0; j < 3; ++j) {
+            shadows->view_matrix.M[i][j] = sign * axes[i][j];
+        }
+        shadows->view_matrix.M[i][3] =
+            -sign * (axes[i][0] * eye[0] + axes[i][1] * eye[1] +
+                     axes[i][2] * eye[2]);
+    }
+    // Orthographic, from 0 to SHADOW_DEPTH_RANGE in front of the sun.
+    ovrMatrix4f projection_matrix = ovrMatrix4f_CreateIdentity();
+    projection_matrix.M[0][0] = 2.0 / SHADOW_EXTENT;
+    projection_matrix.M[1][1] = 2.0 / SHADOW_EXTENT;
+    projection_matrix.M[2][2] = -2.0 / SHADOW_DEPTH_RANGE;
+    projection_matrix.M[2][3] = -1.0;
+    shadows->projection_matrix = projection_matrix;
+    ovrMatrix4f view_projection_matrix =
+        ovrMatrix4f_Multiply(&projection_matrix, &shadows->view_matrix);
+    // From clip space, -1 to 1, to the atlas, 0 to 1.
+    ovrMatrix4f bias_matrix = ovrMatrix4f_CreateIdentity();
+    for (int i = 0; i < 3; ++i) {
+        bias_matrix.M[i][i] = 0.5;
+        bias_matrix.M[i][3] = 0.5;
+    }
+    shadows->atlas_matrix =
+        ovrMatrix4f_Multiply(&bias_matrix, &view_projection_matrix);
+
+    shadow_cache_create(&shadows->cache, caster_capacity);
+    shadows->node_casters = memory_alloc(node_capacity * sizeof(int));
+    for (int i = 0; i < node_capacity; ++i) {
+        shadows->node_casters[i] = -1;
+    }
+    shadows->caster_radii = memory_alloc(caster_capacity * sizeof(float));
+    shadows->first_character_caster = 0;
+    shadows->character_count = 0;
+    shadows->stats.rect_count = 0;
+    shadows->stats.draw_count = 0;
+    shadows->stats.texel_count = 0;
+}
+
+static void
+shadows_destroy(struct shadows* shadows)
+{
+    memory_free(shadows->caster_radii);
+    memory_free(shadows->node_casters);
+    shadow_cache_destroy(&shadows->cache);
+    glDeleteFramebuffers(1, &shadows->framebuffer);
+    glDeleteTextures(1, &shadows->atlas);
+}
+
+// Bounds in the atlas of a sphere at center, in world space. The projection
+// is orthographic, so the sphere's extent doesn't depend on its depth.
+static void
+shadows_get_bounds(const struct shadows* shadows, const float* center,
+                   float radius, float* bounds)
+{
+    const ovrMatrix4f* m = &shadows->atlas_matrix;
+    float extent = radius / SHADOW_EXTENT;
+    for (int i = 0; i < 2; ++i) {
+        float coordinate = m->M[i][0] * center[0] + m->M[i][1] * center[1] +
+                           m->M[i][2] * center[2] + m->M[i][3];
+        bounds[i] = coordinate - extent;
+        bounds[2 + i] = coordinate + extent;
+    }
+}
+
+// Adds a caster with a bounding sphere of radius at center, in world space.
+// If node isn't -1, the caster moves with it, and radius is scaled like
+// the node's world matrix, which must currently scale it by scale.
+static int
+shadows_add_caster(struct shadows* shadows, int node, const float* center,
+                   float radius, float scale)
+{
+    float bounds[4];
+    shadows_get_bounds(shadows, center, radius * scale, bounds);
+    int caster = shadow_cache_add_caster(&shadows->cache, bounds);
+    if (caster < 0) {
+        error("can't add shadow caster: cache full");
+        exit(EXIT_FAILURE);
+    }
+    shadows->caster_radii[caster] = radius;
+    if (node >= 0) {
+        shadows->node_casters[node] = caster;
+    }
+    return caster;
+}
+
+// The characters don't move, so their casters have no node.
+static void
+shadows_add_characters(struct shadows* shadows,
+                       const struct character* characters, int count)
+{
+    // The tentacles sway and curl around their base, but never further
+    // than their length from it.
+    float radius = TENTACLE_LENGTH + TENTACLE_RADIUS;
+    for (int i = 0; i < count; ++i) {
+        int caster = shadows_add_caster(shadows, -1, characters[i].position,
+                                        radius, 1.0);
+        if (i == 0) {
+            shadows->first_character_caster = caster;
+        }
+    }
+    shadows->character_count = count;
+}
+
+// Moves the casters of the nodes that the last update of transforms
+// recomputed, and marks the characters dirty.
+static void
+shadows_update(struct shadows* shadows,
+               const struct transform_hierarchy* transforms)
+{
+    int count = 0;
+    const int* nodes =
+        transform_hierarchy_get_updated_nodes(transforms, &count);
+    for (int i = 0; i < count; ++i) {
+        int caster = shadows->node_casters[nodes[i]];
+        if (caster < 0) {
+            continue;
+        }
+        const float* m =
+            transform_hierarchy_get_world_matrix(transforms, nodes[i]);
+        float center[3] = { m[3], m[7], m[11] };
+        float scale = sqrtf(m[0] * m[0] + m[4] * m[4] + m[8] * m[8]);
+        float bounds[4];
+        shadows_get_bounds(shadows, center,
+                           shadows->caster_radii[caster] * scale, bounds);
+        shadow_cache_move_caster(&shadows->cache, caster, bounds);
+    }
+    for (int i = 0; i < shadows->character_count; ++i) {
+        shadow_cache_mark_dirty(
+            &shadows->cache,
+            shadows->cache.caster_bounds[shadows->first_character_caster + i]);
+    }
+}
+
+// Binds the atlas for the SHADOWS shader variants to sample.
+static void
+shadows_bind(const struct shadows* shadows)
+{
+    glActiveTexture(GL_TEXTURE0 + SHADOW_ATLAS_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, shadows->atlas);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+struct renderer_stats
+{
+    uint64_t triangle_count;
+    // Eye buffer pixels covered by the hidden area masks.
+    uint64_t hidden_pixel_count;
+    int simulation_step_count;
+    int simulation_skipped_step_count;
+    struct lighting_stats lighting;
+    struct shadow_stats shadow;
+};
+
+struct renderer
+{
+    struct gpu_sync gpu_sync;
+    struct arena frame_arena;
+    struct pool handle_pool;
+    struct framebuffer framebuffers[VRAPI_FRAME_LAYER_EYE_MAX];
+    struct shader_variants shader_variants;
+    // The shader variant the objects are drawn with, and its pipeline.
+    const struct program* program;
+    struct program hidden_area_program;
+    struct hidden_area hidden_areas[VRAPI_FRAME_LAYER_EYE_MAX];
+    struct pipeline_cache pipeline_cache;
+    struct pipeline_state pipeline_state;
+    const struct pipeline* pipeline;
+    const struct pipeline* hidden_area_pipeline;
+    struct loader* loader;
+    // For geometry that changes every frame.
+    struct stream_buffer stream_buffer;
+    struct geometry geometries[GEOMETRY_END];
+    int object_count;
+    struct object* objects;
+    // Moves the objects that have a body.
+    struct simulation simulation;
+    struct character_model character_model;
+    struct character characters[CHARACTER_COUNT];
+    // The programs and pipelines the characters are drawn with, for each
+    // skinning mode.
+    const struct program* character_programs[SKINNING_MODE_END];
+    const struct pipeline* character_pipelines[SKINNING_MODE_END];
+    struct lighting lighting;
+    struct shadows shadows;
+    // The root is the scene, and every object is a child of it.
+    struct transform_hierarchy transforms;
+    int scene_node;
+    struct gpu_culling gpu_culling;
+    struct layer_manager layer_manager;
+    struct texture_manager texture_manager;
+    // The HUD is a layer, so it is only rendered again when its lines
+    // change.
+    struct font font;
+    struct program text_program;
+    const struct pipeline* text_pipeline;
+    struct text_batch hud_text;
+    int hud_layer;
+    char hud_lines[HUD_LINE_COUNT][MAX_TEXT_LENGTH];
+    // Counters for the last frame.
+    struct renderer_stats stats;
+};
+
+static const GLenum HUD_COLOR_FORMAT = GL_RGBA8;
+
+static void
+render_hud(void* data, GLsizei width, GLsizei height)
+{
+    struct renderer* renderer = data;
+    // Applied first, so that the clear isn't clipped by a scissor test
+    // left on by the eye buffers.
+    pipeline_state_apply(&renderer->pipeline_state, renderer->text_pipeline);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUniform2f(
+        renderer->text_program.uniform_locations[UNIFORM_VIEWPORT_SIZE],
+        width, height);
+
+    struct text_batch* batch = &renderer->hud_text;
+    text_batch_begin(batch);
+    text_batch_add_rect(batch, 0.0, 0.0, width, height, HUD_BACKGROUND_COLOR);
+    float line_height =
+        renderer->font.header.line_height * HUD_TEXT_SIZE /
+        renderer->font.header.size;
+    for (int i = 0; i < HUD_LINE_COUNT; ++i) {
+        text_batch_add_text(batch, renderer->hud_lines[i], HUD_MARGIN,
+                            HUD_MARGIN + i * line_height, HUD_TEXT_SIZE,
+                            HUD_TEXT_COLOR);
+    }
+    text_batch_draw(batch, &renderer->stream_buffer, &TEXT_VERTEX_LAYOUT);
+}
+
+// Set to false to measure how many fragments the hidden area masks save.
+static const bool HIDDEN_AREA_MASK = true;
+
+// If non-zero, a grid of STRESS_SCENE_SIZE x STRESS_SCENE_SIZE spheres is
+// added around the cube, to make the cost of many objects visible.
+static const int STRESS_SCENE_SIZE = 0;
+static const float STRESS_SCENE_SPACING = 0.5;
+
+// Set to false to render the whole shadow atlas again every frame, to
+// measure what caching it saves.
+static const bool SHADOW_CACHE = true;
+// The floor is 6 m across, under the cube and the characters.
+static const float FLOOR_SCALE = 30.0;
+
+// How the characters are skinned. Either way, their palettes are sampled on
+// the CPU.
+static const enum skinning_mode SKINNING_MODE = SKINNING_MODE_GPU;
+// The characters stand on an arc around the viewer.
+static const float CHARACTER_ARC_RADIUS = 1.5;
+static const float CHARACTER_ARC_ANGLE = M_PI / 3.0;
+static const float CHARACTER_HEIGHT = -0.6;
+
+// If true, the renderer measures both skinning modes for each number of
+// characters in SKINNING_BENCHMARK_COUNTS, and logs the results, when it
+// starts.
+static const bool SKINNING_BENCHMARK = false;
+static const int SKINNING_BENCHMARK_FRAME_COUNT = 64;
+static const int SKINNING_BENCHMARK_COUNTS[] = { 10, 50, 100, 250, 500 };
+
+// The cube bobs up and down around its position on a spring.
+static const float CUBE_STIFFNESS = 4.0;
+static const float CUBE_VELOCITY = 0.2;
+
+// If true, the renderer compares ways to stream geometry when it is
+// created, and logs the results.
+static const bool STREAMING_BENCHMARK = false;
+static const int STREAMING_BENCHMARK_FRAME_COUNT = 64;
+static const size_t STREAMING_BENCHMARK_MIN_SIZE = 1024;
+static const size_t STREAMING_BENCHMARK_MAX_SIZE = 4 * 1024 * 1024;
+
+enum streaming_method
+{
+    STREAMING_METHOD_BEGIN,
+    STREAMING_METHOD_STREAM_BUFFER = STREAMING_METHOD_BEGIN,
+    STREAMING_METHOD_ORPHAN,
+    STREAMING_METHOD_SUB_DATA,
+    STREAMING_METHOD_END,
+};
+
+static const char* STREAMING_METHOD_NAMES[STREAMING_METHOD_END] = {
+    "stream buffer",
+    "glBufferData orphaning",
+    "glBufferSubData",
+};
+
+// Each frame writes size bytes of 2D positions and draws them as triangles,
+// so the GPU is still reading the data when later frames write theirs.
+// program must take aPosition as a vec2.
+static void
+benchmark_streaming_method(const struct program* program,
+                           enum streaming_method method, const void* data,
+                           size_t size)
+{
+    struct gpu_sync gpu_sync;
+    gpu_sync_create(&gpu_sync, GPU_FRAMES_IN_FLIGHT);
+    struct stream_buffer stream_buffer;
+    GLuint buffer = 0;
+    if (method == STREAMING_METHOD_STREAM_BUFFER) {
+        stream_buffer_create(&stream_buffer, &gpu_sync, size);
+        buffer = stream_buffer.buffer;
+    } else {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+    GLuint vertex_array = 0;
+    glGenVertexArrays(1, &vertex_array);
+    glBindVertexArray(vertex_array);
+    glUseProgram(program->program);
+    glEnableVertexAttribArray(ATTRIB_POSITION);
+    GLsizei vertex_count = size / (2 * sizeof(float)) / 3 * 3;
+    glFinish();
+
+    double start_time = get_time();
+    double cpu_time = 0.0;
+    for (int frame = 1; frame <= STREAMING_BENCHMARK_FRAME_COUNT; ++frame) {
+        gpu_sync_begin_frame(&gpu_sync, frame);
+        double frame_start_time = get_time();
+        size_t offset = 0;
+        switch (method) {
+            case STREAMING_METHOD_STREAM_BUFFER:
+                stream_buffer_begin_frame(&stream_buffer);
+                memcpy(stream_buffer_map(&stream_buffer, size, sizeof(float),
+                                         &offset),
+                       data, size);
+                stream_buffer_unmap(&stream_buffer);
+                glBindBuffer(GL_ARRAY_BUFFER, buffer);
+                break;
+            case STREAMING_METHOD_ORPHAN:
+                glBindBuffer(GL_ARRAY_BUFFER, buffer);
+                glBufferData(GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
+                break;
+            case STREAMING_METHOD_SUB_DATA:
+                glBindBuffer(GL_ARRAY_BUFFER, buffer);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+                break;
+            case STREAMING_METHOD_END:
+                abort();
+        }
+        glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, 0,
+                              (const GLvoid*)offset);
+        glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+        cpu_time += get_time() - frame_start_time;
+        gpu_sync_end_frame(&gpu_sync);
+    }
+    glFinish();
+    double time = get_time() - start_time;
+    info("%s, %zu bytes per frame: %.3f ms cpu, %.3f ms total per frame",
+         STREAMING_METHOD_NAMES[method], size,
+         cpu_time * 1000.0 / STREAMING_BENCHMARK_FRAME_COUNT,
+         time * 1000.0 / STREAMING_BENCHMARK_FRAME_COUNT);
+
+    glUseProgram(0);
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (method == STREAMING_METHOD_STREAM_BUFFER) {
+        stream_buffer_destroy(&stream_buffer);
+    } else {
+        glDeleteBuffers(1, &buffer);
+    }
+    gpu_sync_destroy(&gpu_sync);
+}
+
+// All positions are zero, so the triangles are degenerate and nothing is
+// rasterized, but every vertex is still fetched.
+static void
+benchmark_streaming(const struct program* program)
+{
+    void* data = memory_alloc(STREAMING_BENCHMARK_MAX_SIZE);
+    memset(data, 0, STREAMING_BENCHMARK_MAX_SIZE);
+    for (enum streaming_method method = STREAMING_METHOD_BEGIN;
+         method != STREAMING_METHOD_END; ++method) {
+        for (size_t size = STREAMING_BENCHMARK_MIN_SIZE;
+             size <= STREAMING_BENCHMARK_MAX_SIZE; size *= 4) {
+            benchmark_streaming_method(program, method, data, size);
+        }
+    }
+    memory_free(data);
+}
+
+// The asset pack must stay open until the renderer is destroyed.
+static void
+renderer_create(struct renderer* renderer, struct loader* loader,
+                const struct asset_pack* asset_pack, GLsizei width,
+                GLsizei height)
+{
+    gpu_sync_create(&renderer->gpu_sync, GPU_FRAMES_IN_FLIGHT);
+    pool_create(&renderer->handle_pool, MAX_SWAP_CHAIN_LENGTH * sizeof(GLuint),
+                2 * VRAPI_FRAME_LAYER_EYE_MAX);
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        framebuffer_create(&renderer->framebuffers[i], &renderer->handle_pool,
+                           width, height);
+    }
+    program_create(&renderer->hidden_area_program, "#version 300 es\n",
+                   HIDDEN_AREA_VERTEX_SHADER, HIDDEN_AREA_FRAGMENT_SHADER);
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        hidden_area_create(&renderer->hidden_areas[i]);
+    }
+    if (STREAMING_BENCHMARK) {
+        benchmark_streaming(&renderer->hidden_area_program);
+    }
+    stream_buffer_create(&renderer->stream_buffer, &renderer->gpu_sync,
+                         STREAM_BUFFER_REGION_SIZE);
+    program_create(&renderer->text_program, "#version 300 es\n",
+                   TEXT_VERTEX_SHADER, TEXT_FRAGMENT_SHADER);
+    font_create(&renderer->font, FONT_DATA, FONT_DATA_SIZE);
+    text_batch_create(&renderer->hud_text, &renderer->font);
+    for (int i = 0; i < HUD_LINE_COUNT; ++i) {
+        renderer->hud_lines[i][0] = '\0';
+    }
+    renderer->loader = loader;
+    geometry_create_from_pack(&renderer->geometries[GEOMETRY_CUBE], loader,
+                              asset_pack, "cube.mesh");
+    geometry_create_sphere(&renderer->geometries[GEOMETRY_SPHERE], loader);
+    geometry_create_from_pack(&renderer->geometries[GEOMETRY_FLOOR], loader,
+                              asset_pack, "floor.mesh");
+
+    renderer->object_count = 2 + STRESS_SCENE_SIZE * STRESS_SCENE_SIZE;
+    renderer->objects =
+        memory_alloc(renderer->object_count * sizeof(struct object));
+    arena_create(&renderer->frame_arena,
+                 get_frame_arena_capacity(renderer->object_count));
+    simulation_create(&renderer->simulation, 1, SIMULATION_STEP,
+                      MAX_SIMULATION_STEPS);
+    struct object* object = &renderer->objects[0];
+    object->geometry = GEOMETRY_CUBE;
+    object->position = (ovrVector3f){ 0.0, 0.0, -1.0 };
+    object->scale = 1.0;
+    object->lod = 0;
+    struct body cube_body;
+    cube_body.position[0] = object->position.x;
+    cube_body.position[1] = object->position.y;
+    cube_body.position[2] = object->position.z;
+    cube_body.velocity[0] = 0.0;
+    cube_body.velocity[1] = CUBE_VELOCITY;
+    cube_body.velocity[2] = 0.0;
+    memcpy(cube_body.anchor, cube_body.position, sizeof(cube_body.anchor));
+    cube_body.stiffness = CUBE_STIFFNESS;
+    object->body = simulation_add_body(&renderer->simulation, &cube_body);
+    object = &renderer->objects[1];
+    object->geometry = GEOMETRY_FLOOR;
+    object->position = (ovrVector3f){ 0.0, CHARACTER_HEIGHT, -1.0 };
+    object->scale = FLOOR_SCALE;
+    object->lod = 0;
+    object->body = -1;
+    for (int z = 0; z < STRESS_SCENE_SIZE; ++z) {
+        for (int x = 0; x < STRESS_SCENE_SIZE; ++x) {
+            object = &renderer->objects[2 + z * STRESS_SCENE_SIZE + x];
+            object->geometry = GEOMETRY_SPHERE;
+            object->position = (ovrVector3f){
+                (x - 0.5 * (STRESS_SCENE_SIZE - 1)) * STRESS_SCENE_SPACING,
+                -0.5, -(z + 1) * STRESS_SCENE_SPACING
+            };
+            object->scale = 1.0;
+            object->lod = 0;
+            object->body = -1;
+        }
+    }
+    transform_hierarchy_create(&renderer->transforms,
+                               1 + renderer->object_count);
+    ovrMatrix4f identity_matrix = ovrMatrix4f_CreateIdentity();
+    renderer->scene_node = transform_hierarchy_add_node(
+        &renderer->transforms, -1, (const float*)&identity_matrix);
+    for (int i = 0; i < renderer->object_count; ++i) {
+        object = &renderer->objects[i];
+        ovrMatrix4f local_matrix = object_get_local_matrix(object);
+        object->node =
+            transform_hierarchy_add_node(&renderer->transforms,
+                                         renderer->scene_node,
+                                         (const float*)&local_matrix);
+    }
+    gpu_culling_create(&renderer->gpu_culling, &renderer->gpu_sync,
+                       renderer->geometries, renderer->objects,
+                       renderer->object_count);
+
+    lighting_create(&renderer->lighting);
+
+    // Comparison samplers and depth textures are core in OpenGL ES 3.0, so
+    // shadows are always supported.
+    uint32_t supported_features = SHADER_FEATURE_VERTEX_COLOR |
+                                  SHADER_FEATURE_SKINNING |
+                                  SHADER_FEATURE_SHADOWS;
+    uint32_t key = SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_SHADOWS;
+    if (renderer->gpu_culling.supported) {
+        supported_features |= SHADER_FEATURE_INSTANCING;
+        key |= SHADER_FEATURE_INSTANCING;
+    }
+    uint32_t lighting_key = 0;
+    if (renderer->lighting.supported) {
+        supported_features |= SHADER_FEATURE_LIGHTING;
+        lighting_key = SHADER_FEATURE_LIGHTING;
+    }
+    shader_variants_create(&renderer->shader_variants, supported_features);
+    renderer->program =
+        shader_variants_get(&renderer->shader_variants, key | lighting_key);
+    renderer->character_programs[SKINNING_MODE_GPU] = shader_variants_get(
+        &renderer->shader_variants, SHADER_FEATURE_SKINNING |
+                                        SHADER_FEATURE_VERTEX_COLOR |
+                                        SHADER_FEATURE_SHADOWS | lighting_key);
+    renderer->character_programs[SKINNING_MODE_CPU] = shader_variants_get(
+        &renderer->shader_variants,
+        SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_SHADOWS | lighting_key);
+    struct shadows* shadows = &renderer->shadows;
+    shadows->object_program = shader_variants_get(
+        &renderer->shader_variants, SHADER_FEATURE_VERTEX_COLOR);
+    shadows->character_programs[SKINNING_MODE_GPU] = shader_variants_get(
+        &renderer->shader_variants,
+        SHADER_FEATURE_SKINNING | SHADER_FEATURE_VERTEX_COLOR);
+    shadows->character_programs[SKINNING_MODE_CPU] = shadows->object_program;
+
+    character_model_create(&renderer->character_model);
+    for (int i = 0; i < CHARACTER_COUNT; ++i) {
+        struct character* character = &renderer->characters[i];
+        float angle =
+            CHARACTER_ARC_ANGLE * (2.0 * i / (CHARACTER_COUNT - 1) - 1.0);
+        character->position[0] = CHARACTER_ARC_RADIUS * sinf(angle);
+        character->position[1] = CHARACTER_HEIGHT;
+        character->position[2] = -CHARACTER_ARC_RADIUS * cosf(angle);
+        character->time_offset = 0.37 * i;
+        character->blend_rate = 0.5 + 0.1 * i;
+    }
+
+    // Every object but the floor casts a shadow, and so does every
+    // character.
+    shadows_create(shadows, 1 + renderer->object_count,
+                   renderer->object_count - 1 + CHARACTER_COUNT);
+    for (int i = 0; i < renderer->object_count; ++i) {
+        object = &renderer->objects[i];
+        object->caster = -1;
+        if (object->geometry == GEOMETRY_FLOOR) {
+            continue;
+        }
+        const float center[3] = { object->position.x, object->position.y,
+                                  object->position.z };
+        object->caster = shadows_add_caster(
+            shadows, object->node, center,
+            renderer->geometries[object->geometry].radius,
+            MODEL_SCALE * object->scale);
+    }
+    shadows_add_characters(shadows, renderer->characters, CHARACTER_COUNT);
+
+    // Every pipeline is created here, so none is created during a frame.
+    pipeline_cache_create(&renderer->pipeline_cache);
+    struct pipeline_desc desc;
+    pipeline_desc_init(&desc);
+    desc.program = renderer->program->program;
+    desc.vertex_layout = VERTEX_LAYOUT;
+    desc.scissor_test = true;
+    desc.color_format = EYE_COLOR_FORMAT;
+    desc.depth_format = EYE_DEPTH_FORMAT;
+    renderer->pipeline =
+        pipeline_cache_get_pipeline(&renderer->pipeline_cache, &desc);
+    pipeline_desc_init(&desc);
+    desc.program = renderer->hidden_area_program.program;
+    desc.vertex_layout = HIDDEN_AREA_VERTEX_LAYOUT;
+    desc.cull_mode = CULL_MODE_NONE;
+    desc.depth_func = GL_ALWAYS;
+    desc.color_write = false;
+    desc.scissor_test = true;
+    desc.color_format = EYE_COLOR_FORMAT;
+    desc.depth_format = EYE_DEPTH_FORMAT;
+    renderer->hidden_area_pipeline =
+        pipeline_cache_get_pipeline(&renderer->pipeline_cache, &desc);
+    for (enum skinning_mode mode = SKINNING_MODE_BEGIN;
+         mode != SKINNING_MODE_END; ++mode) {
+        pipeline_desc_init(&desc);
+        desc.program = renderer->character_programs[mode]->program;
+        desc.vertex_layout = mode == SKINNING_MODE_GPU ? SKINNED_VERTEX_LAYOUT
+                                                       : VERTEX_LAYOUT;
+        desc.scissor_test = true;
+        desc.color_format = EYE_COLOR_FORMAT;
+        desc.depth_format = EYE_DEPTH_FORMAT;
+        renderer->character_pipelines[mode] =
+            pipeline_cache_get_pipeline(&renderer->pipeline_cache, &desc);
+    }
+    // The shadow casters render their back faces, so that the front faces
+    // of lit surfaces are never compared against their own depth.
+    pipeline_desc_init(&desc);
+    desc.program = shadows->object_program->program;
+    desc.vertex_layout = VERTEX_LAYOUT;
+    desc.cull_mode = CULL_MODE_FRONT;
+    desc.color_write = false;
+    desc.scissor_test = true;
+    desc.depth_format = SHADOW_ATLAS_FORMAT;
+    shadows->object_pipeline =
+        pipeline_cache_get_pipeline(&renderer->pipeline_cache, &desc);
+    for (enum skinning_mode mode = SKINNING_MODE_BEGIN;
+         mode != SKINNING_MODE_END; ++mode) {
+        desc.program = shadows->character_programs[mode]->program;
+        desc.vertex_layout = mode == SKINNING_MODE_GPU ? SKINNED_VERTEX_LAYOUT
+                                                       : VERTEX_LAYOUT;
+        shadows->character_pipelines[mode] =
+            pipeline_cache_get_pipeline(&renderer->pipeline_cache, &desc);
+    }
+    pipeline_desc_init(&desc);
+    desc.program = renderer->text_program.program;
+    desc.vertex_layout = TEXT_VERTEX_LAYOUT;
+    desc.cull_mode = CULL_MODE_NONE;
+    desc.depth_test = false;
+    desc.depth_write = false;
+    desc.blend_mode = BLEND_MODE_ALPHA;
+    desc.color_format = HUD_COLOR_FORMAT;
+    renderer->text_pipeline =
+        pipeline_cache_get_pipeline(&renderer->pipeline_cache, &desc);
+    pipeline_cache_lock(&renderer->pipeline_cache);
+    pipeline_state_reset(&renderer->pipeline_state);
+
+    renderer->stats.triangle_count = 0;
+    renderer->stats.hidden_pixel_count = 0;
+    renderer->stats.simulation_step_count = 0;
+    renderer->stats.simulation_skipped_step_count = 0;
+    renderer->stats.lighting = renderer->lighting.stats;
+    renderer->stats.shadow = shadows->stats;
+    layer_manager_create(&renderer->layer_manager);
+    renderer->hud_layer = layer_manager_add_layer(
+        &renderer->layer_manager, LAYER_TYPE_QUAD, HUD_WIDTH, HUD_HEIGHT,
+        render_hud, renderer);
+    // The unit square is 2 units across, so this makes the HUD 0.5 m wide.
+    ovrMatrix4f hud_translation_matrix =
+        ovrMatrix4f_CreateTranslation(0.0, -0.4, -1.0);
+    ovrMatrix4f hud_scale_matrix = ovrMatrix4f_CreateScale(
+        0.25, 0.25 * HUD_HEIGHT / HUD_WIDTH, 1.0);
+    ovrMatrix4f hud_matrix =
+        ovrMatrix4f_Multiply(&hud_translation_matrix, &hud_scale_matrix);
+    layer_manager_set_model_matrix(&renderer->layer_manager,
+                                   renderer->hud_layer, &hud_matrix);
+    texture_manager_create(&renderer->texture_manager, &renderer->gpu_sync,
+                           TEXTURE_UPLOAD_BUDGET, TEXTURE_MEMORY_CAP);
+}
+
+static void
+renderer_destroy(struct renderer* renderer)
+{
+    texture_manager_destroy(&renderer->texture_manager);
+    layer_manager_destroy(&renderer->layer_manager);
+    pipeline_cache_destroy(&renderer->pipeline_cache);
+    shadows_destroy(&renderer->shadows);
+    lighting_destroy(&renderer->lighting);
+    gpu_culling_destroy(&renderer->gpu_culling);
+    transform_hierarchy_destroy(&renderer->transforms);
+    character_model_destroy(&renderer->character_model);
+    simulation_destroy(&renderer->simulation);
+    memory_free(renderer->objects);
+    for (enum geometry_id geometry = GEOMETRY_BEGIN; geometry != GEOMETRY_END;
+         ++geometry) {
+        geometry_destroy(&renderer->geometries[geometry]);
+    }
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        hidden_area_destroy(&renderer->hidden_areas[i]);
+    }
+    text_batch_destroy(&renderer->hud_text);
+    font_destroy(&renderer->font);
+    program_destroy(&renderer->text_program);
+    stream_buffer_destroy(&renderer->stream_buffer);
+    program_destroy(&renderer->hidden_area_program);
+    shader_variants_destroy(&renderer->shader_variants);
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        framebuffer_destroy(&renderer->framebuffers[i], &renderer->handle_pool);
+    }
+    pool_destroy(&renderer->handle_pool);
+    arena_destroy(&renderer->frame_arena);
+    gpu_sync_destroy(&renderer->gpu_sync);
+}
+
+// Animates and draws count characters, spread out in front of the camera,
+// every frame, first with GPU and then with CPU skinning. The surface is
+// tiny, so the time is in sampling, skinning and vertex work, not in
+// shading.
+static void
+benchmark_skinning(struct renderer* renderer, struct job_system* job_system)
+{
+    const struct character_model* model = &renderer->character_model;
+    int max_count = 0;
+    for (size_t i = 0; i < sizeof(SKINNING_BENCHMARK_COUNTS) / sizeof(int);
+         ++i) {
+        if (SKINNING_BENCHMARK_COUNTS[i] > max_count) {
+            max_count = SKINNING_BENCHMARK_COUNTS[i];
+        }
+    }
+    struct character* characters =
+        memory_alloc(max_count * sizeof(struct character));
+    for (int i = 0; i < max_count; ++i) {
+        struct character* character = &characters[i];
+        character->position[0] = 0.2 * (i % 25 - 12);
+        character->position[1] = -0.2;
+        character->position[2] = -1.0 - 0.2 * (i / 25);
+        character->time_offset = 0.37 * i;
+        character->blend_rate = 0.5 + 0.01 * i;
+    }
+    ovrMatrix4f view_matrix = ovrMatrix4f_CreateIdentity();
+    ovrMatrix4f projection_matrix =
+        ovrMatrix4f_CreateProjectionFov(90.0, 90.0, 0.0, 0.0, 0.1, 0.0);
+    projection_matrix = ovrMatrix4f_Transpose(&projection_matrix);
+    if (renderer->lighting.supported) {
+        lighting_bind_unlit(&renderer->lighting);
+    }
+    // Whatever it holds, so that the shaders never sample an unbound
+    // texture.
+    shadows_bind(&renderer->shadows);
+
+    for (enum skinning_mode mode = SKINNING_MODE_BEGIN;
+         mode != SKINNING_MODE_END; ++mode) {
+        const struct program* program = renderer->character_programs[mode];
+        for (size_t i = 0;
+             i < sizeof(SKINNING_BENCHMARK_COUNTS) / sizeof(int); ++i) {
+            int count = SKINNING_BENCHMARK_COUNTS[i];
+            struct gpu_sync gpu_sync;
+            gpu_sync_create(&gpu_sync, GPU_FRAMES_IN_FLIGHT);
+            struct stream_buffer stream_buffer;
+            stream_buffer_create(&stream_buffer, &gpu_sync,
+                                 count * model->stream_sizes[mode] +
+                                     model->stream_alignments[mode]);
+            pipeline_state_reset(&renderer->pipeline_state);
+            glFinish();
+
+            double start_time = get_time();
+            double cpu_time = 0.0;
+            for (int frame = 1; frame <= SKINNING_BENCHMARK_FRAME_COUNT;
+                 ++frame) {
+                gpu_sync_begin_frame(&gpu_sync, frame);
+                double frame_start_time = get_time();
+                stream_buffer_begin_frame(&stream_buffer);
+                size_t offset = characters_animate(
+                    model, characters, count, mode, frame / 72.0,
+                    &stream_buffer, job_system);
+                pipeline_state_apply(&renderer->pipeline_state,
+                                     renderer->character_pipelines[mode]);
+                glUniformMatrix4fv(
+                    program->uniform_locations[UNIFORM_VIEW_MATRIX], 1,
+                    GL_FALSE, (const float*)&view_matrix);
+                glUniformMatrix4fv(
+                    program->uniform_locations[UNIFORM_PROJECTION_MATRIX], 1,
+                    GL_FALSE, (const float*)&projection_matrix);
+                characters_draw(model, characters, count, mode, program,
+                                &stream_buffer, offset);
+                cpu_time += get_time() - frame_start_time;
+                gpu_sync_end_frame(&gpu_sync);
+            }
+            glFinish();
+            double time = get_time() - start_time;
+            info("%s skinning, %d characters: %.3f ms cpu, %.3f ms total per "
+                 "frame",
+                 SKINNING_MODE_NAMES[mode], count,
+                 cpu_time * 1000.0 / SKINNING_BENCHMARK_FRAME_COUNT,
+                 time * 1000.0 / SKINNING_BENCHMARK_FRAME_COUNT);
+
+            stream_buffer_destroy(&stream_buffer);
+            gpu_sync_destroy(&gpu_sync);
+        }
+    }
+    pipeline_state_reset(&renderer->pipeline_state);
+    memory_free(characters);
+}
+
+struct select_lods_data
+{
+    struct renderer* renderer;
+    ovrVector3f eye_positions[VRAPI_FRAME_LAYER_EYE_MAX];
+    // Pixels per unit of error at unit distance.
+    float error_scales[VRAPI_FRAME_LAYER_EYE_MAX];
+};
+
+static void
+select_lods(void* data, int begin, int end)
+{
+    const struct select_lods_data* select_lods_data = data;
+    struct renderer* renderer = select_lods_data->renderer;
+    for (int i = begin; i < end; ++i) {
+        struct object* object = &renderer->objects[i];
+        const struct geometry* geometry =
+            &renderer->geometries[object->geometry];
+        float scale = MODEL_SCALE * object->scale;
+
+        // Both eyes must see the same LOD, so use the eye that needs the
+        // most detail.
+        float max_error_scale = 0.0;
+        for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; ++eye) {
+            const ovrVector3f* eye_position =
+                &select_lods_data->eye_positions[eye];
+            float dx = object->position.x - eye_position->x;
+            float dy = object->position.y - eye_position->y;
+            float dz = object->position.z - eye_position->z;
+            float distance = sqrtf(dx * dx + dy * dy + dz * dz) -
+                             geometry->radius * scale;
+            if (distance < 0.01) {
+                distance = 0.01;
+            }
+            float error_scale =
+                select_lods_data->error_scales[eye] * scale / distance;
+            if (error_scale > max_error_scale) {
+                max_error_scale = error_scale;
+            }
+        }
+
+        int lod = object->lod;
+        if (lod >= geometry->lod_count) {
+            lod = geometry->lod_count - 1;
+        }
+        while (lod > 0 && geometry->lods[lod].error * max_error_scale >
+                              LOD_ERROR_THRESHOLD * LOD_HYSTERESIS) {
+            --lod;
+        }
+        while (lod + 1 < geometry->lod_count &&
+               geometry->lods[lod + 1].error * max_error_scale <
+                   LOD_ERROR_THRESHOLD) {
+            ++lod;
+        }
+        object->lod = lod;
+    }
+}
+
+struct record_draws_data
+{
+    const struct renderer* renderer;
+    struct command_buffer* command_buffers;
+    // Triangles drawn by each command buffer.
+    uint64_t* triangle_counts;
+};
+
+static void
+record_draws(void* data, int begin, int end)
+{
+    const struct record_draws_data* record_draws_data = data;
+    const struct renderer* renderer = record_draws_data->renderer;
+    for (int chunk = begin; chunk < end; ++chunk) {
+        struct command_buffer* command_buffer =
+            &record_draws_data->command_buffers[chunk];
+        int first_draw = chunk * DRAWS_PER_COMMAND_BUFFER;
+        int last_draw = first_draw + DRAWS_PER_COMMAND_BUFFER;
+        if (last_draw > renderer->object_count) {
+            last_draw = renderer->object_count;
+        }
+        enum geometry_id bound_geometry = GEOMETRY_END;
+        uint64_t triangle_count = 0;
+        for (int i = first_draw; i < last_draw; ++i) {
+            const struct object* object = &renderer->objects[i];
+            const struct geometry* geometry =
+                &renderer->geometries[object->geometry];
+            if (geometry->vertex_array == 0) {
+                continue;
+            }
+            if (object->geometry != bound_geometry) {
+                command_buffer_bind_vertex_array(command_buffer,
+                                                 geometry->vertex_array);
+                bound_geometry = object->geometry;
+            }
+            ovrMatrix4f model_matrix;
+            memcpy(&model_matrix,
+                   transform_hierarchy_get_world_matrix(&renderer->transforms,
+                                                        object->node),
+                   sizeof(model_matrix));
+            model_matrix = ovrMatrix4f_Transpose(&model_matrix);
+            command_buffer_set_uniform_matrix4(
+                command_buffer,
+                renderer->program->uniform_locations[UNIFORM_MODEL_MATRIX],
+                (const float*)&model_matrix);
+            const struct lod* lod = &geometry->lods[object->lod];
+            size_t index_size = geometry->index_type == INDEX_TYPE_UINT16
+                                    ? sizeof(uint16_t)
+                                    : sizeof(uint32_t);
+            command_buffer_draw_elements(command_buffer, PRIMITIVE_TRIANGLES,
+                                         geometry->index_type,
+                                         lod->index_count,
+                                         lod->first_index * index_size, 1);
+            triangle_count += lod->index_count / 3;
+        }
+        record_draws_data->triangle_counts[chunk] = triangle_count;
+    }
+}
+
+static void
+renderer_finish_uploads(struct renderer* renderer)
+{
+    struct upload uploads[UPLOAD_BATCH_SIZE];
+    int count = 0;
+    do {
+        count = loader_poll(renderer->loader, uploads, UPLOAD_BATCH_SIZE);
+        for (int i = 0; i < count; ++i) {
+            for (enum geometry_id geometry = GEOMETRY_BEGIN;
+                 geometry != GEOMETRY_END; ++geometry) {
+                geometry_finish_upload(&renderer->geometries[geometry],
+                                       &uploads[i]);
+            }
+        }
+    } while (count == UPLOAD_BATCH_SIZE);
+}
+
+// Advances the simulation to the display time, and moves every object that
+// has a body to its position interpolated to that time.
+static void
+renderer_update_simulation(struct renderer* renderer, double display_time)
+{
+    struct simulation* simulation = &renderer->simulation;
+    struct simulation_stats previous_stats = simulation->stats;
+    simulation_advance(simulation, display_time);
+    renderer->stats.simulation_step_count =
+        simulation->stats.step_count - previous_stats.step_count;
+    renderer->stats.simulation_skipped_step_count =
+        simulation->stats.skipped_step_count -
+        previous_stats.skipped_step_count;
+
+    for (int i = 0; i < renderer->object_count; ++i) {
+        struct object* object = &renderer->objects[i];
+        if (object->body < 0) {
+            continue;
+        }
+        float position[3];
+        simulation_get_position(simulation, object->body, display_time,
+                                position);
+        object->position = (ovrVector3f){ position[0], position[1],
+                                          position[2] };
+        ovrMatrix4f local_matrix = object_get_local_matrix(object);
+        transform_hierarchy_set_local_matrix(&renderer->transforms,
+                                             object->node,
+                                             (const float*)&local_matrix);
+        gpu_culling_update_object(&renderer->gpu_culling, i, object);
+    }
+}
+
+// Renders the dirty rectangles of the shadow atlas again: clears each one,
+// then renders the casters that overlap it. character_offset is where
+// characters_animate wrote the characters this frame.
+static void
+renderer_render_shadows(struct renderer* renderer, size_t character_offset)
+{
+    struct shadows* shadows = &renderer->shadows;
+    int rect_count =
+        shadow_cache_take_dirty_rects(&shadows->cache, shadows->rects);
+    shadows->stats.rect_count = rect_count;
+    shadows->stats.draw_count = 0;
+    shadows->stats.texel_count = 0;
+    if (rect_count == 0) {
+        return;
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadows->framebuffer);
+    glViewport(0, 0, SHADOW_ATLAS_SIZE, SHADOW_ATLAS_SIZE);
+    ovrMatrix4f view_matrix = ovrMatrix4f_Transpose(&shadows->view_matrix);
+    ovrMatrix4f projection_matrix =
+        ovrMatrix4f_Transpose(&shadows->projection_matrix);
+    const struct program* programs[] = {
+        shadows->object_program,
+        shadows->character_programs[SKINNING_MODE],
+    };
+    const struct pipeline* pipelines[] = {
+        shadows->object_pipeline,
+        shadows->character_pipelines[SKINNING_MODE],
+    };
+    for (int i = 0; i < 2; ++i) {
+        pipeline_state_apply(&renderer->pipeline_state, pipelines[i]);
+        glUniformMatrix4fv(programs[i]->uniform_locations[UNIFORM_VIEW_MATRIX],
+                           1, GL_FALSE, (const float*)&view_matrix);
+        glUniformMatrix4fv(
+            programs[i]->uniform_locations[UNIFORM_PROJECTION_MATRIX], 1,
+            GL_FALSE, (const float*)&projection_matrix);
+    }
+
+    const struct character_model* model = &renderer->character_model;
+    size_t stream_size = model->stream_sizes[SKINNING_MODE];
+    GLsizei cell_size = SHADOW_ATLAS_SIZE / SHADOW_CELL_GRID_SIZE;
+    for (int i = 0; i < rect_count; ++i) {
+        const struct shadow_rect* rect = &shadows->rects[i];
+        pipeline_state_apply(&renderer->pipeline_state, pipelines[0]);
+        glScissor(rect->x * cell_size, rect->y * cell_size,
+                  rect->width * cell_size, rect->height * cell_size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        shadows->stats.texel_count +=
+            (uint64_t)rect->width * rect->height * cell_size * cell_size;
+
+        for (int j = 0; j < renderer->object_count; ++j) {
+            const struct object* object = &renderer->objects[j];
+            const struct geometry* geometry =
+                &renderer->geometries[object->geometry];
+            if (object->caster < 0 || geometry->vertex_array == 0 ||
+                !shadow_cache_caster_overlaps(&shadows->cache, object->caster,
+                                              rect)) {
+                continue;
+            }
+            glBindVertexArray(geometry->vertex_array);
+            ovrMatrix4f model_matrix;
+            memcpy(&model_matrix,
+                   transform_hierarchy_get_world_matrix(&renderer->transforms,
+                                                        object->node),
+                   sizeof(model_matrix));
+            model_matrix = ovrMatrix4f_Transpose(&model_matrix);
+            glUniformMatrix4fv(
+                programs[0]->uniform_locations[UNIFORM_MODEL_MATRIX], 1,
+                GL_FALSE, (const float*)&model_matrix);
+            int lod_index = SHADOW_CASTER_LOD < geometry->lod_count
+                                ? SHADOW_CASTER_LOD
+                                : geometry->lod_count - 1;
+            const struct lod* lod = &geometry->lods[lod_index];
+            size_t index_size = geometry->index_type == INDEX_TYPE_UINT16
+                                    ? sizeof(uint16_t)
+                                    : sizeof(uint32_t);
+            glDrawElements(GL_TRIANGLES, lod->index_count,
+                           geometry->index_type == INDEX_TYPE_UINT16
+                               ? GL_UNSIGNED_SHORT
+                               : GL_UNSIGNED_INT,
+                           (const GLvoid*)(lod->first_index * index_size));
+            ++shadows->stats.draw_count;
+        }
+        glBindVertexArray(0);
+
+        pipeline_state_apply(&renderer->pipeline_state, pipelines[1]);
+        for (int j = 0; j < shadows->character_count; ++j) {
+            if (!shadow_cache_caster_overlaps(
+                    &shadows->cache, shadows->first_character_caster + j,
+                    rect)) {
+                continue;
+            }
+            characters_draw(model, &renderer->characters[j], 1,
+                            SKINNING_MODE, programs[1],
+                            &renderer->stream_buffer,
+                            character_offset + j * stream_size);
+            ++shadows->stats.draw_count;
+        }
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+}
+
+static ovrLayerProjection2
+renderer_render_frame(struct renderer* renderer, struct job_system* job_system,
+                      ovrTracking2* tracking, double display_time)
+{
+    renderer_finish_uploads(renderer);
+    stream_buffer_begin_frame(&renderer->stream_buffer);
+    texture_manager_update(&renderer->texture_manager);
+    transform_hierarchy_update(&renderer->transforms);
+    shadows_update(&renderer->shadows, &renderer->transforms);
+    if (!SHADOW_CACHE) {
+        shadow_cache_invalidate(&renderer->shadows.cache);
+    }
+
+    struct select_lods_data select_lods_data;
+    select_lods_data.renderer = renderer;
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        ovrMatrix4f eye_matrix =
+            ovrMatrix4f_Inverse(&tracking->Eye[i].ViewMatrix);
+        select_lods_data.eye_positions[i] = (ovrVector3f){
+            eye_matrix.M[0][3], eye_matrix.M[1][3], eye_matrix.M[2][3]
+        };
+        select_lods_data.error_scales[i] =
+            tracking->Eye[i].ProjectionMatrix.M[0][0] * 0.5 *
+            renderer->framebuffers[i].width;
+    }
+
+    struct gpu_culling* gpu_culling = &renderer->gpu_culling;
+    struct record_draws_data record_draws_data;
+    int command_buffer_count = 0;
+    renderer->stats.triangle_count = 0;
+    renderer->stats.hidden_pixel_count = 0;
+    if (gpu_culling->supported) {
+        // The instance counts are only known on the GPU, so this counts the
+        // triangles of an earlier frame that it has finished.
+        renderer->stats.triangle_count = gpu_culling_read_triangle_count(
+            gpu_culling, renderer->geometries);
+        gpu_culling_dispatch(gpu_culling, tracking,
+                             select_lods_data.eye_positions,
+                             select_lods_data.error_scales);
+    } else {
+        job_parallel_for(job_system, 0, renderer->object_count,
+                         DRAWS_PER_COMMAND_BUFFER, select_lods,
+                         &select_lods_data);
+
+        // The draws don't depend on the eye, so record them once and replay
+        // them for both eyes.
+        record_draws_data.renderer = renderer;
+        command_buffer_count =
+            (renderer->object_count + DRAWS_PER_COMMAND_BUFFER - 1) /
+            DRAWS_PER_COMMAND_BUFFER;
+        record_draws_data.command_buffers =
+            arena_alloc(&renderer->frame_arena,
+                        command_buffer_count * sizeof(struct command_buffer),
+                        sizeof(void*));
+        record_draws_data.triangle_counts = arena_alloc(
+            &renderer->frame_arena, command_buffer_count * sizeof(uint64_t),
+            sizeof(uint64_t));
+        for (int i = 0; i < command_buffer_count; ++i) {
+            int draw_count =
+                renderer->object_count - i * DRAWS_PER_COMMAND_BUFFER;
+            if (draw_count > DRAWS_PER_COMMAND_BUFFER) {
+                draw_count = DRAWS_PER_COMMAND_BUFFER;
+            }
+            command_buffer_create(&record_draws_data.command_buffers[i],
+                                  &renderer->frame_arena,
+                                  get_draws_capacity(draw_count));
+        }
+        job_parallel_for(job_system, 0, command_buffer_count, 1, record_draws,
+                         &record_draws_data);
+        for (int i = 0; i < command_buffer_count; ++i) {
+            renderer->stats.triangle_count +=
+                VRAPI_FRAME_LAYER_EYE_MAX *
+                record_draws_data.triangle_counts[i];
+        }
+    }
+    size_t character_offset = characters_animate(
+        &renderer->character_model, renderer->characters, CHARACTER_COUNT,
+        SKINNING_MODE, display_time, &renderer->stream_buffer, job_system);
+    struct lighting* lighting = &renderer->lighting;
+    if (lighting->supported) {
+        lighting_update(lighting, tracking, display_time,
+                        &renderer->stream_buffer, job_system);
+    }
+    renderer->stats.lighting = lighting->stats;
+    // The texture manager and the culling pass change GL state behind the
+    // pipeline state's back.
+    pipeline_state_reset(&renderer->pipeline_state);
+    renderer_render_shadows(renderer, character_offset);
+    renderer->stats.shadow = renderer->shadows.stats;
+    shadows_bind(&renderer->shadows);
+    const struct program* program = renderer->program;
+    const struct pipeline* pipeline = renderer->pipeline;
+    const struct program* character_program =
+        renderer->character_programs[SKINNING_MODE];
+    ovrMatrix4f shadow_matrix =
+        ovrMatrix4f_Transpose(&renderer->shadows.atlas_matrix);
+
+    ovrLayerProjection2 layer = vrapi_DefaultLayerProjection2();
+    layer.Header.Flags |=
+        VRAPI_FRAME_LAYER_FLAG_CHROMATIC_ABERRATION_CORRECTION;
+    layer.HeadPose = tracking->HeadPose;
+
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        ovrMatrix4f view_matrix =
+            ovrMatrix4f_Transpose(&tracking->Eye[i].ViewMatrix);
+        ovrMatrix4f projection_matrix =
+            ovrMatrix4f_Transpose(&tracking->Eye[i].ProjectionMatrix);
+
+        struct command_buffer eye_command_buffer;
+        command_buffer_create(&eye_command_buffer, &renderer->frame_arena,
+                              EYE_COMMAND_BUFFER_CAPACITY);
+        command_buffer_set_uniform_matrix4(
+            &eye_command_buffer,
+            program->uniform_locations[UNIFORM_VIEW_MATRIX],
+            (const float*)&view_matrix);
+        command_buffer_set_uniform_matrix4(
+            &eye_command_buffer,
+            program->uniform_locations[UNIFORM_PROJECTION_MATRIX],
+            (const float*)&projection_matrix);
+        command_buffer_set_uniform_matrix4(
+            &eye_command_buffer,
+            program->uniform_locations[UNIFORM_SHADOW_MATRIX],
+            (const float*)&shadow_matrix);
+
+        struct framebuffer* framebuffer = &renderer->framebuffers[i];
+        float cluster_params[4] = { 0.0 };
+        if (lighting->supported) {
+            lighting_get_cluster_params(lighting, i, framebuffer->width,
+                                        framebuffer->height, cluster_params);
+            command_buffer_set_uniform_vector4(
+                &eye_command_buffer,
+                program->uniform_locations[UNIFORM_CLUSTER_PARAMS],
+                cluster_params);
+            lighting_bind(lighting, i, &renderer->stream_buffer);
+        }
+        layer.Textures[i].ColorSwapChain =
+            framebuffer->color_texture_swap_chain;
+        layer.Textures[i].SwapChainIndex = framebuffer->swap_chain_index;
+        layer.Textures[i].TexCoordsFromTanAngles =
+            ovrMatrix4f_TanAngleMatrixFromProjection(
+                &tracking->Eye[i].ProjectionMatrix);
+
+        glBindFramebuffer(
+            GL_DRAW_FRAMEBUFFER,
+            framebuffer->framebuffers[framebuffer->swap_chain_index]);
+
+        pipeline_state_apply(&renderer->pipeline_state, pipeline);
+        glViewport(0, 0, framebuffer->width, framebuffer->height);
+        glScissor(0, 0, framebuffer->width, framebuffer->height);
+        glClearColor(0.0, 0.0, 0.0, 0.0);
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (HIDDEN_AREA_MASK) {
+            struct hidden_area* hidden_area = &renderer->hidden_areas[i];
+            hidden_area_update(hidden_area, &tracking->Eye[i].ProjectionMatrix,
+                               framebuffer->width, framebuffer->height);
+            hidden_area_draw(hidden_area, &renderer->pipeline_state,
+                             renderer->hidden_area_pipeline);
+            renderer->stats.hidden_pixel_count +=
+                hidden_area->hidden_pixel_count;
+        }
+        pipeline_state_apply(&renderer->pipeline_state, pipeline);
+        command_buffer_execute(&eye_command_buffer);
+        if (gpu_culling->supported) {
+            gpu_culling_draw(gpu_culling, program, renderer->geometries);
+        }
+        for (int j = 0; j < command_buffer_count; ++j) {
+            command_buffer_execute(&record_draws_data.command_buffers[j]);
+        }
+        glBindVertexArray(0);
+        pipeline_state_apply(&renderer->pipeline_state,
+                             renderer->character_pipelines[SKINNING_MODE]);
+        glUniformMatrix4fv(
+            character_program->uniform_locations[UNIFORM_VIEW_MATRIX], 1,
+            GL_FALSE, (const float*)&view_matrix);
+        glUniformMatrix4fv(
+            character_program->uniform_locations[UNIFORM_PROJECTION_MATRIX],
+            1, GL_FALSE, (const float*)&projection_matrix);
+        glUniform4fv(
+            character_program->uniform_locations[UNIFORM_CLUSTER_PARAMS], 1,
+            cluster_params);
+        glUniformMatrix4fv(
+            character_program->uniform_locations[UNIFORM_SHADOW_MATRIX], 1,
+            GL_FALSE, (const float*)&shadow_matrix);
+        renderer->stats.triangle_count += characters_draw(
+            &renderer->character_model, renderer->characters, CHARACTER_COUNT,
+            SKINNING_MODE, character_program, &renderer->stream_buffer,
+            character_offset);
+
+        glClearColor(0.0, 0.0, 0.0, 1.0);
+        glScissor(0, 0, 1, framebuffer->height);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glScissor(framebuffer->width - 1, 0, 1, framebuffer->height);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glScissor(0, 0, framebuffer->width, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glScissor(0, framebuffer->height - 1, framebuffer->width, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        static const GLenum ATTACHMENTS[] = { GL_DEPTH_ATTACHMENT };
+        static const GLsizei NUM_ATTACHMENTS =
+            sizeof(ATTACHMENTS) / sizeof(ATTACHMENTS[0]);
+        glInvalidateFramebuffer(GL_DRAW_FRAMEBUFFER, NUM_ATTACHMENTS,
+                                ATTACHMENTS);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+        framebuffer->swap_chain_index = (framebuffer->swap_chain_index + 1) %
+                                        framebuffer->swap_chain_length;
+    }
+    return layer;
+}
+
+struct frame_stats
+{
+    int frame_count;
+    int looper_iterations;
+    int max_looper_iterations;
+    int input_events;
+    uint64_t pixels_rendered;
+    uint64_t pixels_reused;
+    uint64_t eye_pixels;
+    uint64_t eye_pixels_hidden;
+    uint64_t triangle_count;
+    int simulation_step_count;
+    int simulation_skipped_step_count;
+    double light_bin_time;
+    uint64_t light_index_count;
+    int shadow_rect_count;
+    uint64_t shadow_draw_count;
+    uint64_t shadow_texel_count;
+    double cpu_time;
+    double gpu_wait_time;
+    double max_gpu_wait_time;
+    int gpu_deletion_count;
+};
+
+static void
+frame_stats_reset(struct frame_stats* stats)
+{
+    stats->frame_count = 0;
+    stats->looper_iterations = 0;
+    stats->max_looper_iterations = 0;
+    stats->input_events = 0;
+    stats->pixels_rendered = 0;
+    stats->pixels_reused = 0;
+    stats->eye_pixels = 0;
+    stats->eye_pixels_hidden = 0;
+    stats->triangle_count = 0;
+    stats->simulation_step_count = 0;
+    stats->simulation_skipped_step_count = 0;
+    stats->light_bin_time = 0.0;
+    stats->light_index_count = 0;
+    stats->shadow_rect_count = 0;
+    stats->shadow_draw_count = 0;
+    stats->shadow_texel_count = 0;
+    stats->cpu_time = 0.0;
+    stats->gpu_wait_time = 0.0;
+    stats->max_gpu_wait_time = 0.0;
+    stats->gpu_deletion_count = 0;
+}
+
+static void
+frame_stats_add_looper_iterations(struct frame_stats* stats,
+                                  int looper_iterations, int input_events)
+{
+    stats->looper_iterations += looper_iterations;
+    if (looper_iterations > stats->max_looper_iterations) {
+        stats->max_looper_iterations = looper_iterations;
+    }
+    stats->input_events += input_events;
+}
+
+static void
+frame_stats_add_gpu_sync(struct frame_stats* stats,
+                         const struct gpu_sync_stats* gpu_sync_stats)
+{
+    stats->gpu_wait_time += gpu_sync_stats->wait_time;
+    if (gpu_sync_stats->wait_time > stats->max_gpu_wait_time) {
+        stats->max_gpu_wait_time = gpu_sync_stats->wait_time;
+    }
+    stats->gpu_deletion_count += gpu_sync_stats->deletion_count;
+}
+
+// Shows the averages of the last interval on the HUD.
+static void
+renderer_update_hud(struct renderer* renderer, const struct frame_stats* stats)
+{
+    snprintf(renderer->hud_lines[0], MAX_TEXT_LENGTH, "cpu %.2f ms/frame",
+             stats->cpu_time * 1000.0 / stats->frame_count);
+    snprintf(renderer->hud_lines[1], MAX_TEXT_LENGTH,
+             "gpu wait %.2f ms/frame (max %.2f ms)",
+             stats->gpu_wait_time * 1000.0 / stats->frame_count,
+             stats->max_gpu_wait_time * 1000.0);
+    snprintf(renderer->hud_lines[2], MAX_TEXT_LENGTH, "triangles %.0f/frame",
+             (double)stats->triangle_count / stats->frame_count);
+    snprintf(renderer->hud_lines[3], MAX_TEXT_LENGTH,
+             "eye pixels shaded %.0f/frame",
+             (double)(stats->eye_pixels - stats->eye_pixels_hidden) /
+                 stats->frame_count);
+    layer_manager_invalidate(&renderer->layer_manager, renderer->hud_layer);
+}
+
+static void
+frame_stats_end_frame(struct frame_stats* stats, struct renderer* renderer)
+{
+    stats->frame_count++;
+    if (stats->frame_count == FRAME_STATS_INTERVAL) {
+        renderer_update_hud(renderer, stats);
+        info("frame stats: looper iterations %.2f/frame (max %d), input "
+             "events %.2f/frame",
+             (double)stats->looper_iterations / stats->frame_count,
+             stats->max_looper_iterations,
+             (double)stats->input_events / stats->frame_count);
+        info("frame stats: pixels rendered %.0f/frame, reused %.0f/frame",
+             (double)stats->pixels_rendered / stats->frame_count,
+             (double)stats->pixels_reused / stats->frame_count);
+        info("frame stats: eye pixels shaded %.0f/frame with hidden area "
+             "mask, %.0f/frame without",
+             (double)(stats->eye_pixels - stats->eye_pixels_hidden) /
+                 stats->frame_count,
+             (double)stats->eye_pixels / stats->frame_count);
+        info("frame stats: triangles %.0f/frame, cpu time %.2f ms/frame",
+             (double)stats->triangle_count / stats->frame_count,
+             stats->cpu_time * 1000.0 / stats->frame_count);
+        info("frame stats: gpu wait %.2f ms/frame (max %.2f ms), deferred "
+             "deletions %d",
+             stats->gpu_wait_time * 1000.0 / stats->frame_count,
+             stats->max_gpu_wait_time * 1000.0, stats->gpu_deletion_count);
+        info("frame stats: simulation steps %.2f/frame, skipped %d",
+             (double)stats->simulation_step_count / stats->frame_count,
+             stats->simulation_skipped_step_count);
+        info("frame stats: light binning %.3f ms/frame, light indices "
+             "%.0f/frame",
+             stats->light_bin_time * 1000.0 / stats->frame_count,
+             (double)stats->light_index_count / stats->frame_count);
+        info("frame stats: shadow pass %.2f rects/frame, %.1f draws/frame, "
+             "%.0f texels/frame (%s)",
+             (double)stats->shadow_rect_count / stats->frame_count,
+             (double)stats->shadow_draw_count / stats->frame_count,
+             (double)stats->shadow_texel_count / stats->frame_count,
+             SHADOW_CACHE ? "cached" : "full refresh");
+        frame_stats_reset(stats);
+    }
+}
+
+enum
+{
+    GPU_TIMER_QUERY_COUNT = 4,
+};
+
+// Measures the GPU time of each frame with GL_EXT_disjoint_timer_query. The
+// results only become available a few frames later, so the queries are
+// kept in a ring.
+struct gpu_timer
+{
+    bool supported;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_object_ui64v;
+    GLuint queries[GPU_TIMER_QUERY_COUNT];
+    // Index of the query for the next frame.
+    int next_query;
+    // Queries that have ended but whose result hasn't been read yet.
+    int pending_count;
+    bool active;
+};
+
+static void
+gpu_timer_create(struct gpu_timer* timer)
+{
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    timer->get_query_object_ui64v =
+        (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress(
+            "glGetQueryObjectui64vEXT");
+    timer->supported =
+        extensions != NULL &&
+        strstr(extensions, "GL_EXT_disjoint_timer_query") != NULL &&
+        timer->get_query_object_ui64v != NULL;
+    timer->next_query = 0;
+    timer->pending_count = 0;
+    timer->active = false;
+    if (!timer->supported) {
+        info("GPU timer queries not supported");
+        return;
+    }
+    glGenQueries(GPU_TIMER_QUERY_COUNT, timer->queries);
+}
+
+static void
+gpu_timer_destroy(struct gpu_timer* timer)
+{
+    if (timer->supported) {
+        glDeleteQueries(GPU_TIMER_QUERY_COUNT, timer->queries);
+    }
+}
+
+static void
+gpu_timer_begin(struct gpu_timer* timer)
+{
+    // If every query is still pending, this frame isn't timed.
+    if (!timer->supported || timer->pending_count == GPU_TIMER_QUERY_COUNT) {
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED_EXT, timer->queries[timer->next_query]);
+    timer->active = true;
+}
+
+static void
+gpu_timer_end(struct gpu_timer* timer)
+{
+    if (!timer->active) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED_EXT);
+    timer->next_query = (timer->next_query + 1) % GPU_TIMER_QUERY_COUNT;
+    ++timer->pending_count;
+    timer->active = false;
+}
+
+// Returns the GPU time in seconds of the most recent frame whose result has
+// become available since the last call, or -1.0 if there is none.
+static double
+gpu_timer_read(struct gpu_timer* timer)
+{
+    double time = -1.0;
+    while (timer->pending_count > 0) {
+        GLuint query = timer->queries[(timer->next_query -
+                                       timer->pending_count +
+                                       GPU_TIMER_QUERY_COUNT) %
+                                      GPU_TIMER_QUERY_COUNT];
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 elapsed = 0;
+        timer->get_query_object_ui64v(query, GL_QUERY_RESULT, &elapsed);
+        --timer->pending_count;
+        time = elapsed * 1e-9;
+    }
+    // A disjoint event, such as a clock change, makes the results
+    // meaningless.
+    GLint disjoint = GL_FALSE;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    return disjoint ? -1.0 : time;
+}
+
+struct app
+{
+    ovrJava* java;
+    // Stored uncompressed and aligned in the APK, so its buffer is mapped
+    // straight from the APK rather than read into memory.
+    AAsset* asset_pack_asset;
+    struct asset_pack asset_pack;
+    struct job_system job_system;
+    struct egl egl;
+    struct loader loader;
+    struct renderer renderer;
     bool resumed;
     ANativeWindow* window;
     ovrMobile* ovr;
     bool back_button_down_previous_frame;
     uint64_t frame_index;
+    struct frame_stats frame_stats;
+    struct gpu_timer gpu_timer;
+    struct clock_governor clock_governor;
+    // Predicted poses of each frame, for threads other than the frame loop.
+    struct pose_channel pose_channel;
 };
 
+// Clock levels when the app starts. From then on, the clock governor picks
+// them between MIN_CLOCK_LEVEL and MAX_CLOCK_LEVEL.
 static const int CPU_LEVEL = 2;
 static const int GPU_LEVEL = 3;
+static const int MIN_CLOCK_LEVEL = 0;
+static const int MAX_CLOCK_LEVEL = 4;
+static const int64_t INPUT_TIME_BUDGET_NS = 1000000;
+
+// 0 means one worker per big core.
+static const int JOB_WORKER_COUNT = 0;
 
 static void
 app_on_cmd(struct android_app* android_app, int32_t cmd)
@@ -712,7 +4091,9 @@ app_update_vr_mode(struct app* app)
                 exit(EXIT_FAILURE);
             }
 
-            vrapi_SetClockLevels(app->ovr, CPU_LEVEL, GPU_LEVEL);
+            vrapi_SetClockLevels(app->ovr,
+                                 app->clock_governor.levels[CLOCK_CPU],
+                                 app->clock_governor.levels[CLOCK_GPU]);
         }
     } else {
         if (app->ovr != NULL) {
@@ -755,27 +4136,126 @@ app_handle_input(struct app* app)
 }
 
 static void
-app_create(struct app* app, ovrJava* java)
+pose_from_ovr(struct pose* pose, const ovrPosef* ovr_pose)
+{
+    pose->orientation[0] = ovr_pose->Orientation.x;
+    pose->orientation[1] = ovr_pose->Orientation.y;
+    pose->orientation[2] = ovr_pose->Orientation.z;
+    pose->orientation[3] = ovr_pose->Orientation.w;
+    pose->position[0] = ovr_pose->Position.x;
+    pose->position[1] = ovr_pose->Position.y;
+    pose->position[2] = ovr_pose->Position.z;
+}
+
+// Publishes the poses predicted for this frame, so that other threads can
+// read them without calling into VrApi.
+static void
+app_publish_poses(struct app* app, double display_time,
+                  const ovrTracking2* tracking)
+{
+    struct pose_snapshot snapshot;
+    snapshot.frame_index = app->frame_index;
+    snapshot.time = display_time;
+    pose_from_ovr(&snapshot.head, &tracking->HeadPose.Pose);
+    for (int i = 0; i < POSE_EYE_COUNT; ++i) {
+        // The eyes are only offset from the head, not rotated.
+        ovrMatrix4f eye_matrix =
+            ovrMatrix4f_Inverse(&tracking->Eye[i].ViewMatrix);
+        struct pose* eye = &snapshot.eyes[i];
+        *eye = snapshot.head;
+        eye->position[0] = eye_matrix.M[0][3];
+        eye->position[1] = eye_matrix.M[1][3];
+        eye->position[2] = eye_matrix.M[2][3];
+    }
+
+    snapshot.controller_mask = 0;
+    int controller_count = 0;
+    int i = 0;
+    ovrInputCapabilityHeader capability;
+    while (controller_count < MAX_CONTROLLERS &&
+           vrapi_EnumerateInputDevices(app->ovr, i, &capability) >= 0) {
+        ovrTracking controller_tracking;
+        if (capability.Type == ovrControllerType_TrackedRemote &&
+            vrapi_GetInputTrackingState(app->ovr, capability.DeviceID,
+                                        display_time,
+                                        &controller_tracking) == ovrSuccess) {
+            pose_from_ovr(&snapshot.controllers[controller_count],
+                          &controller_tracking.HeadPose.Pose);
+            snapshot.controller_mask |= 1u << controller_count;
+            ++controller_count;
+        }
+        ++i;
+    }
+    pose_channel_publish(&app->pose_channel, &snapshot);
+}
+
+static const char* const ASSET_PACK_NAME = "hello_quest.pak";
+
+static void
+app_open_asset_pack(struct app* app, AAssetManager* asset_manager)
+{
+    double start_time = get_time();
+    app->asset_pack_asset =
+        AAssetManager_open(asset_manager, ASSET_PACK_NAME, AASSET_MODE_BUFFER);
+    if (app->asset_pack_asset == NULL) {
+        error("can't open %s", ASSET_PACK_NAME);
+        exit(EXIT_FAILURE);
+    }
+    const void* data = AAsset_getBuffer(app->asset_pack_asset);
+    if (data == NULL ||
+        !asset_pack_init(&app->asset_pack, data,
+                         AAsset_getLength(app->asset_pack_asset))) {
+        error("can't read %s", ASSET_PACK_NAME);
+        exit(EXIT_FAILURE);
+    }
+    info("opened %s with %u assets in %.3f ms", ASSET_PACK_NAME,
+         app->asset_pack.header->entry_count,
+         (get_time() - start_time) * 1000.0);
+}
+
+static void
+app_create(struct app* app, ovrJava* java, AAssetManager* asset_manager)
 {
     app->java = java;
+    app_open_asset_pack(app, asset_manager);
+    job_system_create(&app->job_system, JOB_WORKER_COUNT, true);
     egl_create(&app->egl);
-    renderer_create(&app->renderer,
+    loader_create(&app->loader, app->egl.display, app->egl.config,
+                  app->egl.context);
+    renderer_create(&app->renderer, &app->loader, &app->asset_pack,
                     vrapi_GetSystemPropertyInt(
                         java, VRAPI_SYS_PROP_SUGGESTED_EYE_TEXTURE_WIDTH),
                     vrapi_GetSystemPropertyInt(
                         java, VRAPI_SYS_PROP_SUGGESTED_EYE_TEXTURE_HEIGHT));
+    if (SKINNING_BENCHMARK) {
+        benchmark_skinning(&app->renderer, &app->job_system);
+    }
     app->resumed = false;
     app->window = NULL;
     app->ovr = NULL;
     app->back_button_down_previous_frame = false;
     app->frame_index = 0;
+    frame_stats_reset(&app->frame_stats);
+    gpu_timer_create(&app->gpu_timer);
+    float refresh_rate =
+        vrapi_GetSystemPropertyFloat(java, VRAPI_SYS_PROP_DISPLAY_REFRESH_RATE);
+    clock_governor_create(&app->clock_governor, 1.0 / refresh_rate,
+                          MIN_CLOCK_LEVEL, MAX_CLOCK_LEVEL, CPU_LEVEL,
+                          GPU_LEVEL);
+    pose_channel_create(&app->pose_channel);
 }
 
 static void
 app_destroy(struct app* app)
 {
-    egl_destroy(&app->egl);
+    gpu_timer_destroy(&app->gpu_timer);
+    // The loader may still be reading geometry data that the renderer
+    // frees, or that is in the asset pack, and both need the EGL context.
+    loader_destroy(&app->loader);
     renderer_destroy(&app->renderer);
+    egl_destroy(&app->egl);
+    job_system_destroy(&app->job_system);
+    AAsset_close(app->asset_pack_asset);
 }
 
 void
@@ -798,24 +4278,35 @@ android_main(struct android_app* android_app)
     }
 
     struct app app;
-    app_create(&app, &java);
+    app_create(&app, &java, android_app->activity->assetManager);
 
     android_app->userData = &app;
     android_app->onAppCmd = app_on_cmd;
+    android_app->inputTimeBudget = INPUT_TIME_BUDGET_NS;
     while (!android_app->destroyRequested) {
+        int looper_iterations = 0;
+        int input_events = 0;
         for (;;) {
             int events = 0;
             struct android_poll_source* source = NULL;
-            if (ALooper_pollAll(
-                    android_app->destroyRequested || app.ovr != NULL ? 0 : -1,
-                    NULL, &events, (void**)&source) < 0) {
+            int id = ALooper_pollAll(
+                android_app->destroyRequested || app.ovr != NULL ? 0 : -1,
+                NULL, &events, (void**)&source);
+            if (id < 0) {
                 break;
             }
+            ++looper_iterations;
             if (source != NULL) {
                 source->process(android_app, source);
             }
 
-            app_update_vr_mode(&app);
+            // Only lifecycle commands can change whether we should be in vr
+            // mode, so input wakeups don't need to check.
+            if (id == LOOPER_ID_INPUT) {
+                input_events += android_app->inputEventCount;
+            } else {
+                app_update_vr_mode(&app);
+            }
         }
 
         app_handle_input(&app);
@@ -823,22 +4314,103 @@ android_main(struct android_app* android_app)
         if (app.ovr == NULL) {
             continue;
         }
+        const double frame_start_time = get_time();
+        frame_stats_add_looper_iterations(&app.frame_stats, looper_iterations,
+                                          input_events);
+#ifndef NDEBUG
+        // This only sees memory_alloc. test_frame_allocations in src/tools
+        // also catches raw malloc calls in the modules the frame uses, but
+        // neither sees the GL driver or VrApi.
+        struct memory_stats memory_stats;
+        memory_get_stats(&memory_stats);
+        const uint64_t alloc_count = memory_stats.alloc_count;
+#endif // NDEBUG
         app.frame_index++;
         const double display_time =
             vrapi_GetPredictedDisplayTime(app.ovr, app.frame_index);
         ovrTracking2 tracking =
             vrapi_GetPredictedTracking2(app.ovr, display_time);
+        app_publish_poses(&app, display_time, &tracking);
+        renderer_update_simulation(&app.renderer, display_time);
+        gpu_sync_begin_frame(&app.renderer.gpu_sync, app.frame_index);
+        gpu_timer_begin(&app.gpu_timer);
         const ovrLayerProjection2 layer =
-            renderer_render_frame(&app.renderer, &tracking);
-        const ovrLayerHeader2* layers[] = { &layer.Header };
+            renderer_render_frame(&app.renderer, &app.job_system, &tracking,
+                                  display_time);
+        const ovrLayerHeader2* layers[1 + MAX_LAYERS] = { &layer.Header };
+        int layer_count =
+            1 + layer_manager_update(&app.renderer.layer_manager, &tracking,
+                                     &layers[1]);
+        gpu_timer_end(&app.gpu_timer);
+        gpu_sync_end_frame(&app.renderer.gpu_sync);
         ovrSubmitFrameDescription2 frame;
         frame.Flags = 0;
         frame.SwapInterval = 1;
         frame.FrameIndex = app.frame_index;
         frame.DisplayTime = display_time;
-        frame.LayerCount = 1;
+        frame.LayerCount = layer_count;
         frame.Layers = layers;
+        // vrapi_SubmitFrame2 blocks to throttle the frame rate, so don't
+        // count it as CPU time.
+        const double cpu_time = get_time() - frame_start_time;
+        app.frame_stats.cpu_time += cpu_time;
         vrapi_SubmitFrame2(app.ovr, &frame);
+        arena_reset(&app.renderer.frame_arena);
+
+        for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+            uint64_t eye_pixels = (uint64_t)app.renderer.framebuffers[i].width *
+                                  app.renderer.framebuffers[i].height;
+            app.frame_stats.pixels_rendered += eye_pixels;
+            app.frame_stats.eye_pixels += eye_pixels;
+        }
+        app.frame_stats.eye_pixels_hidden +=
+            app.renderer.stats.hidden_pixel_count;
+        app.frame_stats.pixels_rendered +=
+            app.renderer.layer_manager.stats.pixels_rendered;
+        app.frame_stats.pixels_reused +=
+            app.renderer.layer_manager.stats.pixels_reused;
+        app.frame_stats.triangle_count += app.renderer.stats.triangle_count;
+        app.frame_stats.simulation_step_count +=
+            app.renderer.stats.simulation_step_count;
+        app.frame_stats.simulation_skipped_step_count +=
+            app.renderer.stats.simulation_skipped_step_count;
+        app.frame_stats.light_bin_time += app.renderer.stats.lighting.bin_time;
+        app.frame_stats.light_index_count +=
+            app.renderer.stats.lighting.index_count;
+        app.frame_stats.shadow_rect_count +=
+            app.renderer.stats.shadow.rect_count;
+        app.frame_stats.shadow_draw_count +=
+            app.renderer.stats.shadow.draw_count;
+        app.frame_stats.shadow_texel_count +=
+            app.renderer.stats.shadow.texel_count;
+        frame_stats_add_gpu_sync(&app.frame_stats,
+                                 &app.renderer.gpu_sync.stats);
+        frame_stats_end_frame(&app.frame_stats, &app.renderer);
+
+        // The GPU time is from a few frames ago, but the load changes slowly
+        // compared to the governor's window.
+        struct clock_governor* governor = &app.clock_governor;
+        if (clock_governor_add_frame(governor, cpu_time,
+                                     gpu_timer_read(&app.gpu_timer))) {
+            info("clock levels: cpu %d, gpu %d (average cpu time %.2f ms, gpu "
+                 "time %.2f ms)",
+                 governor->levels[CLOCK_CPU], governor->levels[CLOCK_GPU],
+                 governor->average_times[CLOCK_CPU] * 1000.0,
+                 governor->average_times[CLOCK_GPU] * 1000.0);
+            vrapi_SetClockLevels(app.ovr, governor->levels[CLOCK_CPU],
+                                 governor->levels[CLOCK_GPU]);
+        }
+
+#ifndef NDEBUG
+        memory_get_stats(&memory_stats);
+        if (app.frame_index > STEADY_STATE_FRAME_INDEX &&
+            memory_stats.alloc_count != alloc_count) {
+            error("frame %llu made %llu heap allocations",
+                  (unsigned long long)app.frame_index,
+                  (unsigned long long)(memory_stats.alloc_count - alloc_count));
+            abort();
+        }
+#endif // NDEBUG
     }
 
     app_destroy(&app);
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include "job.h"
+#include "memory.h"
+#include <android/log.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#ifndef NDEBUG
+#define info(...) __android_log_print(ANDROID_LOG_VERBOSE, TAG, __VA_ARGS__)
+#else
+#define info(...) ((void)0)
+#endif // NDEBUG
+
+static const char* TAG = "job";
+
+static __thread struct worker* current_worker;
+
+static void
+deque_push(struct job_deque* deque, struct job* job)
+{
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->jobs[bottom & (MAX_JOBS_PER_WORKER - 1)], job,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+}
+
+static struct job*
+deque_pop(struct job_deque* deque)
+{
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+    if (top > bottom) {
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    struct job* job = __atomic_load_n(
+        &deque->jobs[bottom & (MAX_JOBS_PER_WORKER - 1)], __ATOMIC_RELAXED);
+    if (top == bottom) {
+        // Last job; race against stealers for it.
+        if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+            job = NULL;
+        }
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+static struct job*
+deque_steal(struct job_deque* deque)
+{
+    int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom) {
+        return NULL;
+    }
+    struct job* job = __atomic_load_n(
+        &deque->jobs[top & (MAX_JOBS_PER_WORKER - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    return job;
+}
+
+static struct job*
+worker_get_job(struct worker* worker)
+{
+    struct job* job = deque_pop(&worker->deque);
+    if (job != NULL) {
+        return job;
+    }
+    struct job_system* job_system = worker->job_system;
+    worker->steal_seed = worker->steal_seed * 1664525 + 1013904223;
+    int first_victim = (worker->steal_seed >> 16) % job_system->worker_count;
+    for (int i = 0; i < job_system->worker_count; ++i) {
+        int victim = (first_victim + i) % job_system->worker_count;
+        if (victim == worker->index) {
+            continue;
+        }
+        job = deque_steal(&job_system->workers[victim].deque);
+        if (job != NULL) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void
+job_finish(struct job* job)
+{
+    if (__atomic_sub_fetch(&job->unfinished, 1, __ATOMIC_ACQ_REL) == 0 &&
+        job->parent != NULL) {
+        job_finish(job->parent);
+    }
+}
+
+static void
+job_execute(struct job_system* job_system, struct job* job)
+{
+    __atomic_sub_fetch(&job_system->queued_job_count, 1, __ATOMIC_SEQ_CST);
+    job->function(job->data);
+    job_finish(job);
+}
+
+static void*
+worker_main(void* data)
+{
+    struct worker* worker = data;
+    struct job_system* job_system = worker->job_system;
+    current_worker = worker;
+    for (;;) {
+        struct job* job = worker_get_job(worker);
+        if (job != NULL) {
+            job_execute(job_system, job);
+            continue;
+        }
+        pthread_mutex_lock(&job_system->mutex);
+        __atomic_add_fetch(&job_system->sleeping_worker_count, 1,
+                           __ATOMIC_SEQ_CST);
+        while (!job_system->stopping &&
+               __atomic_load_n(&job_system->queued_job_count,
+                               __ATOMIC_SEQ_CST) == 0) {
+            pthread_cond_wait(&job_system->cond, &job_system->mutex);
+        }
+        __atomic_sub_fetch(&job_system->sleeping_worker_count, 1,
+                           __ATOMIC_SEQ_CST);
+        bool stopping = job_system->stopping;
+        pthread_mutex_unlock(&job_system->mutex);
+        if (stopping) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+// The big cores are the ones with the highest maximum frequency. CPUs that
+// are offline may have no cpufreq directory, so they are skipped rather
+// than ending the search. Returns the number of big cores found, or 0 if
+// cpufreq isn't readable for any CPU.
+static int
+get_big_cores(cpu_set_t* big_cores)
+{
+    CPU_ZERO(big_cores);
+    long cpu_count = sysconf(_SC_NPROCESSORS_CONF);
+    if (cpu_count > CPU_SETSIZE) {
+        cpu_count = CPU_SETSIZE;
+    }
+    long max_frequencies[CPU_SETSIZE];
+    long max_frequency = 0;
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        max_frequencies[cpu] = 0;
+        char path[128];
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq",
+                 cpu);
+        FILE* file = fopen(path, "r");
+        if (file == NULL) {
+            continue;
+        }
+        if (fscanf(file, "%ld", &max_frequencies[cpu]) != 1) {
+            max_frequencies[cpu] = 0;
+        }
+        fclose(file);
+        if (max_frequencies[cpu] > max_frequency) {
+            max_frequency = max_frequencies[cpu];
+        }
+    }
+    int big_core_count = 0;
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        if (max_frequency > 0 && max_frequencies[cpu] == max_frequency) {
+            CPU_SET(cpu, big_cores);
+            ++big_core_count;
+        }
+    }
+    return big_core_count;
+}
+
+void
+job_system_create(struct job_system* job_system, int worker_count,
+                  bool pin_to_big_cores)
+{
+    cpu_set_t big_cores;
+    int big_core_count = get_big_cores(&big_cores);
+    info("found %d big cores", big_core_count);
+    if (worker_count == 0) {
+        worker_count = big_core_count > 0 ? big_core_count : 1;
+    }
+    if (worker_count > MAX_WORKERS) {
+        worker_count = MAX_WORKERS;
+    }
+    if (big_core_count == 0) {
+        pin_to_big_cores = false;
+    }
+
+    job_system->worker_count = worker_count;
+    job_system->workers = memory_alloc_aligned(
+        worker_count * sizeof(struct worker), _Alignof(struct worker));
+    memset(job_system->workers, 0, worker_count * sizeof(struct worker));
+    pthread_mutex_init(&job_system->mutex, NULL);
+    pthread_cond_init(&job_system->cond, NULL);
+    job_system->queued_job_count = 0;
+    job_system->sleeping_worker_count = 0;
+    job_system->stopping = false;
+
+    for (int i = 0; i < worker_count; ++i) {
+        struct worker* worker = &job_system->workers[i];
+        worker->job_system = job_system;
+        worker->index = i;
+        worker->steal_seed = i + 1;
+    }
+
+    if (pin_to_big_cores) {
+        info("pin main thread to big cores");
+        if (sched_setaffinity(0, sizeof(big_cores), &big_cores) != 0) {
+            error("can't pin main thread to big cores");
+        }
+    }
+    current_worker = &job_system->workers[0];
+    job_system->workers[0].thread = pthread_self();
+
+    // Threads inherit the affinity of the thread that creates them.
+    for (int i = 1; i < worker_count; ++i) {
+        info("create worker %d", i);
+        struct worker* worker = &job_system->workers[i];
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            error("can't create worker %d", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void
+job_system_destroy(struct job_system* job_system)
+{
+    pthread_mutex_lock(&job_system->mutex);
+    job_system->stopping = true;
+    pthread_cond_broadcast(&job_system->cond);
+    pthread_mutex_unlock(&job_system->mutex);
+    for (int i = 1; i < job_system->worker_count; ++i) {
+        info("join worker %d", i);
+        pthread_join(job_system->workers[i].thread, NULL);
+    }
+    current_worker = NULL;
+    pthread_cond_destroy(&job_system->cond);
+    pthread_mutex_destroy(&job_system->mutex);
+    memory_free(job_system->workers);
+}
+
+struct job*
+job_create(struct job_system* job_system, job_function function, void* data,
+           struct job* parent)
+{
+    struct worker* worker = current_worker;
+    if (worker == NULL || worker->job_system != job_system) {
+        error("can't create job outside of a worker thread");
+        exit(EXIT_FAILURE);
+    }
+    struct job* job =
+        &worker->jobs[worker->job_index++ & (MAX_JOBS_PER_WORKER - 1)];
+    job->function = function;
+    job->data = data;
+    job->parent = parent;
+    job->unfinished = 1;
+    if (parent != NULL) {
+        __atomic_add_fetch(&parent->unfinished, 1, __ATOMIC_RELAXED);
+    }
+    return job;
+}
+
+void
+job_run(struct job_system* job_system, struct job* job)
+{
+    deque_push(&current_worker->deque, job);
+    __atomic_add_fetch(&job_system->queued_job_count, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&job_system->sleeping_worker_count,
+                        __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&job_system->mutex);
+        pthread_cond_signal(&job_system->cond);
+        pthread_mutex_unlock(&job_system->mutex);
+    }
+}
+
+void
+job_wait(struct job_system* job_system, struct job* job)
+{
+    while (__atomic_load_n(&job->unfinished, __ATOMIC_ACQUIRE) > 0) {
+        struct job* other_job = worker_get_job(current_worker);
+        if (other_job != NULL) {
+            job_execute(job_system, other_job);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+static void
+parallel_for_job(void* data)
+{
+    struct job* job = data;
+    struct job_system* job_system = current_worker->job_system;
+    // Keep splitting the range in half, handing one half to other workers,
+    // until what is left fits in the grain size.
+    int begin = job->begin;
+    int end = job->end;
+    while (end - begin > job->grain_size) {
+        int middle = begin + (end - begin) / 2;
+        struct job* child =
+            job_create(job_system, parallel_for_job, NULL, job);
+        child->data = child;
+        child->for_function = job->for_function;
+        child->for_data = job->for_data;
+        child->begin = middle;
+        child->end = end;
+        child->grain_size = job->grain_size;
+        job_run(job_system, child);
+        end = middle;
+    }
+    job->for_function(job->for_data, begin, end);
+}
+
+void
+job_parallel_for(struct job_system* job_system, int begin, int end,
+                 int grain_size, parallel_for_function function, void* data)
+{
+    if (end <= begin) {
+        return;
+    }
+    struct job* job = job_create(job_system, parallel_for_job, NULL, NULL);
+    job->data = job;
+    job->for_function = function;
+    job->for_data = data;
+    job->begin = begin;
+    job->end = end;
+    job->grain_size = grain_size > 0 ? grain_size : 1;
+    job_run(job_system, job);
+    job_wait(job_system, job);
+}
@@ -0,0 +1,90 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+enum
+{
+    MAX_WORKERS = 8,
+    MAX_JOBS_PER_WORKER = 4096,
+};
+
+typedef void (*job_function)(void* data);
+
+typedef void (*parallel_for_function)(void* data, int begin, int end);
+
+struct job
+{
+    job_function function;
+    void* data;
+    struct job* parent;
+    int32_t unfinished;
+    // Only used by job_parallel_for.
+    parallel_for_function for_function;
+    void* for_data;
+    int begin;
+    int end;
+    int grain_size;
+} __attribute__((aligned(64)));
+
+// Chase-Lev deque. Only the owning worker pushes and pops at the bottom;
+// other workers steal from the top.
+struct job_deque
+{
+    int64_t top;
+    int64_t bottom;
+    struct job* jobs[MAX_JOBS_PER_WORKER];
+};
+
+struct worker
+{
+    struct job_system* job_system;
+    int index;
+    pthread_t thread;
+    struct job_deque deque;
+    // Jobs are allocated round-robin from here, so a worker must never
+    // have more than MAX_JOBS_PER_WORKER jobs alive at once.
+    struct job jobs[MAX_JOBS_PER_WORKER];
+    uint32_t job_index;
+    uint32_t steal_seed;
+} __attribute__((aligned(64)));
+
+struct job_system
+{
+    int worker_count;
+    struct worker* workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int32_t queued_job_count;
+    int32_t sleeping_worker_count;
+    bool stopping;
+};
+
+// Creates a job system with worker_count workers, including the calling
+// thread, which becomes worker 0. If worker_count is 0, one worker is
+// created per big core. If pin_to_big_cores is true, every worker,
+// including the calling thread, is restricted to the big cores.
+void job_system_create(struct job_system* job_system, int worker_count,
+                       bool pin_to_big_cores);
+
+void job_system_destroy(struct job_system* job_system);
+
+// Must be called from a worker thread. If parent is not NULL, the parent
+// isn't finished until this job is.
+struct job* job_create(struct job_system* job_system, job_function function,
+                       void* data, struct job* parent);
+
+void job_run(struct job_system* job_system, struct job* job);
+
+// Runs other jobs on the calling thread until job is finished.
+void job_wait(struct job_system* job_system, struct job* job);
+
+// Splits [begin, end) into ranges of at most grain_size indices, runs them
+// on all workers and waits for them to finish.
+void job_parallel_for(struct job_system* job_system, int begin, int end,
+                      int grain_size, parallel_for_function function,
+                      void* data);
+
+#endif // JOB_H
@@ -0,0 +1,173 @@
+#include "layer.h"
+#include "VrApi_Helpers.h"
+#include <android/log.h>
+#include <stdlib.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#ifndef NDEBUG
+#define info(...) __android_log_print(ANDROID_LOG_VERBOSE, TAG, __VA_ARGS__)
+#else
+#define info(...) ((void)0)
+#endif // NDEBUG
+
+static const char* TAG = "layer";
+
+void
+layer_manager_create(struct layer_manager* manager)
+{
+    manager->layer_count = 0;
+    manager->stats.pixels_rendered = 0;
+    manager->stats.pixels_reused = 0;
+}
+
+void
+layer_manager_destroy(struct layer_manager* manager)
+{
+    for (int i = 0; i < manager->layer_count; ++i) {
+        struct layer* layer = &manager->layers[i];
+        info("destroy layer %d", i);
+        glDeleteFramebuffers(LAYER_SWAP_CHAIN_LENGTH, layer->framebuffers);
+        vrapi_DestroyTextureSwapChain(layer->color_texture_swap_chain);
+    }
+    manager->layer_count = 0;
+}
+
+int
+layer_manager_add_layer(struct layer_manager* manager, enum layer_type type,
+                        GLsizei width, GLsizei height,
+                        layer_render_function render, void* data)
+{
+    if (manager->layer_count == MAX_LAYERS) {
+        error("can't add layer: all %d layers in use", MAX_LAYERS);
+        exit(EXIT_FAILURE);
+    }
+    int index = manager->layer_count++;
+    struct layer* layer = &manager->layers[index];
+    layer->type = type;
+    layer->width = width;
+    layer->height = height;
+    layer->swap_chain_index = 0;
+    layer->model_matrix = ovrMatrix4f_CreateTranslation(0.0, 0.0, -1.0);
+    layer->render = render;
+    layer->data = data;
+    layer->dirty = true;
+
+    info("create layer %d color texture swap chain", index);
+    layer->color_texture_swap_chain =
+        vrapi_CreateTextureSwapChain3(VRAPI_TEXTURE_TYPE_2D, GL_RGBA8, width,
+                                      height, 1, LAYER_SWAP_CHAIN_LENGTH);
+    if (layer->color_texture_swap_chain == NULL) {
+        error("can't create layer %d color texture swap chain", index);
+        exit(EXIT_FAILURE);
+    }
+
+    glGenFramebuffers(LAYER_SWAP_CHAIN_LENGTH, layer->framebuffers);
+    for (int i = 0; i < LAYER_SWAP_CHAIN_LENGTH; ++i) {
+        info("create layer %d framebuffer %d", index, i);
+        GLuint color_texture =
+            vrapi_GetTextureSwapChainHandle(layer->color_texture_swap_chain, i);
+        glBindTexture(GL_TEXTURE_2D, color_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, layer->framebuffers[i]);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, color_texture, 0);
+        if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) !=
+            GL_FRAMEBUFFER_COMPLETE) {
+            error("can't create layer %d framebuffer %d", index, i);
+            exit(EXIT_FAILURE);
+        }
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    }
+
+    if (type == LAYER_TYPE_QUAD) {
+        layer->ovr_layer.Projection = vrapi_DefaultLayerProjection2();
+    } else {
+        layer->ovr_layer.Cylinder = vrapi_DefaultLayerCylinder2();
+    }
+    layer->ovr_layer.Header.SrcBlend = VRAPI_FRAME_LAYER_BLEND_SRC_ALPHA;
+    layer->ovr_layer.Header.DstBlend =
+        VRAPI_FRAME_LAYER_BLEND_ONE_MINUS_SRC_ALPHA;
+    return index;
+}
+
+void
+layer_manager_set_model_matrix(struct layer_manager* manager, int index,
+                               const ovrMatrix4f* model_matrix)
+{
+    // Moving a layer doesn't change its content, so it doesn't need to be
+    // rendered again.
+    manager->layers[index].model_matrix = *model_matrix;
+}
+
+void
+layer_manager_invalidate(struct layer_manager* manager, int index)
+{
+    manager->layers[index].dirty = true;
+}
+
+static void
+layer_render(struct layer* layer)
+{
+    layer->swap_chain_index =
+        (layer->swap_chain_index + 1) % LAYER_SWAP_CHAIN_LENGTH;
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER,
+                      layer->framebuffers[layer->swap_chain_index]);
+    glViewport(0, 0, layer->width, layer->height);
+    layer->render(layer->data, layer->width, layer->height);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    layer->dirty = false;
+}
+
+int
+layer_manager_update(struct layer_manager* manager,
+                     const ovrTracking2* tracking,
+                     const ovrLayerHeader2** layers)
+{
+    manager->stats.pixels_rendered = 0;
+    manager->stats.pixels_reused = 0;
+    for (int i = 0; i < manager->layer_count; ++i) {
+        struct layer* layer = &manager->layers[i];
+        uint64_t pixel_count = (uint64_t)layer->width * layer->height;
+        if (layer->dirty) {
+            layer_render(layer);
+            manager->stats.pixels_rendered += pixel_count;
+        } else {
+            manager->stats.pixels_reused += pixel_count;
+        }
+
+        // The compositor reprojects the layer every frame, so only the
+        // mapping from tan angles to texture coordinates has to be updated.
+        for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; ++eye) {
+            ovrMatrix4f model_view_matrix = ovrMatrix4f_Multiply(
+                &tracking->Eye[eye].ViewMatrix, &layer->model_matrix);
+            if (layer->type == LAYER_TYPE_QUAD) {
+                ovrLayerProjection2* projection = &layer->ovr_layer.Projection;
+                projection->HeadPose = tracking->HeadPose;
+                projection->Textures[eye].ColorSwapChain =
+                    layer->color_texture_swap_chain;
+                projection->Textures[eye].SwapChainIndex =
+                    layer->swap_chain_index;
+                projection->Textures[eye].TexCoordsFromTanAngles =
+                    ovrMatrix4f_TanAngleMatrixFromUnitSquare(
+                        &model_view_matrix);
+            } else {
+                ovrLayerCylinder2* cylinder = &layer->ovr_layer.Cylinder;
+                cylinder->HeadPose = tracking->HeadPose;
+                cylinder->Textures[eye].ColorSwapChain =
+                    layer->color_texture_swap_chain;
+                cylinder->Textures[eye].SwapChainIndex =
+                    layer->swap_chain_index;
+                cylinder->Textures[eye].TexCoordsFromTanAngles =
+                    ovrMatrix4f_Inverse(&model_view_matrix);
+            }
+        }
+        layers[i] = &layer->ovr_layer.Header;
+    }
+    return manager->layer_count;
+}
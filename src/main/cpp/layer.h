@@ -0,0 +1,86 @@
+#ifndef LAYER_H
+#define LAYER_H
+
+#include "VrApi.h"
+#include <GLES3/gl3.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Quad and cylinder layers are composited by VrApi at display rate from
+// their own swap chains. Their content is only rendered again when it has
+// been invalidated, so static or slowly changing content such as HUDs and
+// menus costs nothing on frames where it doesn't change.
+
+enum
+{
+    MAX_LAYERS = 8,
+    LAYER_SWAP_CHAIN_LENGTH = 2,
+};
+
+enum layer_type
+{
+    LAYER_TYPE_QUAD,
+    LAYER_TYPE_CYLINDER,
+};
+
+// Called with the layer's framebuffer bound and the viewport set to the
+// whole layer.
+typedef void (*layer_render_function)(void* data, GLsizei width,
+                                      GLsizei height);
+
+struct layer
+{
+    enum layer_type type;
+    GLsizei width;
+    GLsizei height;
+    ovrTextureSwapChain* color_texture_swap_chain;
+    int swap_chain_index;
+    GLuint framebuffers[LAYER_SWAP_CHAIN_LENGTH];
+    // Maps the unit square (quad) or the unit cylinder (cylinder), with its
+    // axis along y, to world space.
+    ovrMatrix4f model_matrix;
+    layer_render_function render;
+    void* data;
+    bool dirty;
+    ovrLayer_Union2 ovr_layer;
+};
+
+struct layer_stats
+{
+    uint64_t pixels_rendered;
+    uint64_t pixels_reused;
+};
+
+struct layer_manager
+{
+    int layer_count;
+    struct layer layers[MAX_LAYERS];
+    // Pixels rendered and reused during the last update.
+    struct layer_stats stats;
+};
+
+void layer_manager_create(struct layer_manager* manager);
+
+void layer_manager_destroy(struct layer_manager* manager);
+
+// Returns the index of the new layer. Its content is rendered on the next
+// call to layer_manager_update.
+int layer_manager_add_layer(struct layer_manager* manager,
+                            enum layer_type type, GLsizei width,
+                            GLsizei height, layer_render_function render,
+                            void* data);
+
+void layer_manager_set_model_matrix(struct layer_manager* manager, int index,
+                                    const ovrMatrix4f* model_matrix);
+
+// Makes the layer render its content again on the next update.
+void layer_manager_invalidate(struct layer_manager* manager, int index);
+
+// Renders the content of invalidated layers and appends the layers to
+// layers, which must have room for MAX_LAYERS more headers. Returns the
+// number of headers appended.
+int layer_manager_update(struct layer_manager* manager,
+                         const ovrTracking2* tracking,
+                         const ovrLayerHeader2** layers);
+
+#endif // LAYER_H
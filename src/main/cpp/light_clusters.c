@@ -0,0 +1,236 @@
+#include "light_clusters.h"
+#include "memory.h"
+#include "vec4.h"
+#include <math.h>
+#include <string.h>
+
+void
+cluster_frustum_init(struct cluster_frustum* frustum,
+                     const float* view_matrix, const float* projection_matrix,
+                     float far)
+{
+    memcpy(frustum->view_matrix, view_matrix, sizeof(frustum->view_matrix));
+    // With depth = -z, the projection takes x to
+    // m[0] * x / depth - m[2] in normalized device coordinates, and the
+    // tiles divide [-1, 1] into CLUSTER_GRID_WIDTH columns. The same goes
+    // for y.
+    static const int TILE_COUNTS[2] = { CLUSTER_GRID_WIDTH,
+                                        CLUSTER_GRID_HEIGHT };
+    for (int i = 0; i < 2; ++i) {
+        const float* row = projection_matrix + 4 * i;
+        frustum->tile_scales[i] = 0.5 * TILE_COUNTS[i] * row[i];
+        frustum->tile_biases[i] = 0.5 * TILE_COUNTS[i] * (1.0 - row[2]);
+    }
+    // Holds for finite and infinite far planes alike.
+    float near = projection_matrix[11] / (projection_matrix[10] - 1.0);
+    frustum->near = near;
+    for (int i = 0; i < CLUSTER_GRID_DEPTH; ++i) {
+        frustum->slice_depths[i] =
+            near * powf(far / near, (float)i / CLUSTER_GRID_DEPTH);
+    }
+    frustum->slice_scale = CLUSTER_GRID_DEPTH / log2f(far / near);
+    frustum->slice_bias = -log2f(near) * frustum->slice_scale;
+}
+
+void
+light_clusters_create(struct light_clusters* light_clusters,
+                      int light_capacity)
+{
+    light_clusters->clusters =
+        memory_alloc(CLUSTER_COUNT * sizeof(struct cluster));
+    light_clusters->index_count = 0;
+    // Every light could overlap every cluster. Binning runs every frame,
+    // and the lights move, so a new maximum can show up at any time; room
+    // for the worst case means binning never allocates.
+    light_clusters->indices =
+        memory_alloc(light_capacity * CLUSTER_COUNT * sizeof(uint32_t));
+    light_clusters->light_capacity = light_capacity;
+    light_clusters->bounds =
+        memory_alloc(light_capacity * sizeof(struct cluster_bounds));
+}
+
+void
+light_clusters_destroy(struct light_clusters* light_clusters)
+{
+    memory_free(light_clusters->bounds);
+    memory_free(light_clusters->indices);
+    memory_free(light_clusters->clusters);
+}
+
+// The slice that depth is in: how many of the slices after the first start
+// at or before it.
+static vec4
+get_slices(const struct cluster_frustum* frustum, vec4 depth)
+{
+    vec4 slice = vec4_splat(0.0);
+    for (int i = 1; i < CLUSTER_GRID_DEPTH; ++i) {
+        slice = vec4_add(
+            slice, vec4_step(vec4_splat(frustum->slice_depths[i]), depth));
+    }
+    return slice;
+}
+
+static uint8_t
+clamp_tile(float tile, int tile_count)
+{
+    if (tile < 0.0) {
+        return 0;
+    }
+    if (tile > tile_count - 1) {
+        return tile_count - 1;
+    }
+    return tile;
+}
+
+// Computes the bounds of every light, four lights at a time. The bounds are
+// those of the light's box in view space, projected conservatively: the
+// extremes of x / depth are at the corners of the box.
+static void
+compute_bounds(struct light_clusters* light_clusters,
+               const struct cluster_frustum* frustum,
+               const struct point_light* lights, int light_count)
+{
+    const float* m = frustum->view_matrix;
+    vec4 near = vec4_splat(frustum->near);
+    for (int first = 0; first < light_count; first += 4) {
+        // Loads the positions of four lights, and transposes them into the x,
+        // y, z and radius of each. Repeats the first light if there are
+        // fewer than four left.
+        vec4 x = vec4_load(lights[first].position_radius);
+        vec4 y = vec4_load(
+            lights[first + 1 < light_count ? first + 1 : first]
+                .position_radius);
+        vec4 z = vec4_load(
+            lights[first + 2 < light_count ? first + 2 : first]
+                .position_radius);
+        vec4 radius = vec4_load(
+            lights[first + 3 < light_count ? first + 3 : first]
+                .position_radius);
+        vec4_transpose(&x, &y, &z, &radius);
+
+        vec4 view_x = vec4_splat(m[3]);
+        view_x = vec4_madd(view_x, x, vec4_splat(m[0]));
+        view_x = vec4_madd(view_x, y, vec4_splat(m[1]));
+        view_x = vec4_madd(view_x, z, vec4_splat(m[2]));
+        vec4 view_y = vec4_splat(m[7]);
+        view_y = vec4_madd(view_y, x, vec4_splat(m[4]));
+        view_y = vec4_madd(view_y, y, vec4_splat(m[5]));
+        view_y = vec4_madd(view_y, z, vec4_splat(m[6]));
+        vec4 depth = vec4_splat(-m[11]);
+        depth = vec4_madd(depth, x, vec4_splat(-m[8]));
+        depth = vec4_madd(depth, y, vec4_splat(-m[9]));
+        depth = vec4_madd(depth, z, vec4_splat(-m[10]));
+
+        vec4 min_depth = vec4_max(vec4_sub(depth, radius), near);
+        vec4 max_depth = vec4_add(depth, radius);
+        vec4 tiles[2][2];
+        vec4 view[2] = { view_x, view_y };
+        for (int i = 0; i < 2; ++i) {
+            vec4 scale = vec4_splat(frustum->tile_scales[i]);
+            vec4 bias = vec4_splat(frustum->tile_biases[i]);
+            vec4 low = vec4_sub(view[i], radius);
+            vec4 high = vec4_add(view[i], radius);
+            tiles[i][0] = vec4_madd(
+                bias, scale,
+                vec4_min(vec4_div(low, min_depth), vec4_div(low, max_depth)));
+            tiles[i][1] = vec4_madd(
+                bias, scale,
+                vec4_max(vec4_div(high, min_depth),
+                         vec4_div(high, max_depth)));
+        }
+
+        float values[7][4] __attribute__((aligned(16)));
+        vec4_store(values[0], tiles[0][0]);
+        vec4_store(values[1], tiles[0][1]);
+        vec4_store(values[2], tiles[1][0]);
+        vec4_store(values[3], tiles[1][1]);
+        vec4_store(values[4], get_slices(frustum, min_depth));
+        vec4_store(values[5], get_slices(frustum, max_depth));
+        vec4_store(values[6], max_depth);
+        int count = light_count - first < 4 ? light_count - first : 4;
+        for (int i = 0; i < count; ++i) {
+            struct cluster_bounds* bounds = &light_clusters->bounds[first + i];
+            if (values[6][i] < frustum->near || values[1][i] < 0.0 ||
+                values[0][i] >= CLUSTER_GRID_WIDTH || values[3][i] < 0.0 ||
+                values[2][i] >= CLUSTER_GRID_HEIGHT) {
+                memset(bounds->min, 1, sizeof(bounds->min));
+                memset(bounds->max, 0, sizeof(bounds->max));
+                continue;
+            }
+            bounds->min[0] = clamp_tile(values[0][i], CLUSTER_GRID_WIDTH);
+            bounds->max[0] = clamp_tile(values[1][i], CLUSTER_GRID_WIDTH);
+            bounds->min[1] = clamp_tile(values[2][i], CLUSTER_GRID_HEIGHT);
+            bounds->max[1] = clamp_tile(values[3][i], CLUSTER_GRID_HEIGHT);
+            bounds->min[2] = values[4][i];
+            bounds->max[2] = values[5][i];
+        }
+    }
+}
+
+void
+light_clusters_bin(struct light_clusters* light_clusters,
+                   const struct cluster_frustum* frustum,
+                   const struct point_light* lights, int light_count)
+{
+    compute_bounds(light_clusters, frustum, lights, light_count);
+
+    // A counting sort: count the lights of every cluster, give each
+    // cluster its range of indices, then fill the ranges in light order.
+    struct cluster* clusters = light_clusters->clusters;
+    for (int i = 0; i < CLUSTER_COUNT; ++i) {
+        clusters[i].count = 0;
+    }
+    for (int light = 0; light < light_count; ++light) {
+        const struct cluster_bounds* bounds = &light_clusters->bounds[light];
+        for (int z = bounds->min[2]; z <= bounds->max[2]; ++z) {
+            for (int y = bounds->min[1]; y <= bounds->max[1]; ++y) {
+                struct cluster* row =
+                    &clusters[(z * CLUSTER_GRID_HEIGHT + y) *
+                              CLUSTER_GRID_WIDTH];
+                for (int x = bounds->min[0]; x <= bounds->max[0]; ++x) {
+                    ++row[x].count;
+                }
+            }
+        }
+    }
+    uint32_t index_count = 0;
+    for (int i = 0; i < CLUSTER_COUNT; ++i) {
+        clusters[i].offset = index_count;
+        index_count += clusters[i].count;
+        clusters[i].count = 0;
+    }
+    light_clusters->index_count = index_count;
+
+    uint32_t* indices = light_clusters->indices;
+    for (int light = 0; light < light_count; ++light) {
+        const struct cluster_bounds* bounds = &light_clusters->bounds[light];
+        for (int z = bounds->min[2]; z <= bounds->max[2]; ++z) {
+            for (int y = bounds->min[1]; y <= bounds->max[1]; ++y) {
+                struct cluster* row =
+                    &clusters[(z * CLUSTER_GRID_HEIGHT + y) *
+                              CLUSTER_GRID_WIDTH];
+                for (int x = bounds->min[0]; x <= bounds->max[0]; ++x) {
+                    indices[row[x].offset + row[x].count++] = light;
+                }
+            }
+        }
+    }
+}
+
+size_t
+light_clusters_get_size(const struct light_clusters* light_clusters)
+{
+    return CLUSTER_COUNT * sizeof(struct cluster) +
+           light_clusters->index_count * sizeof(uint32_t);
+}
+
+void
+light_clusters_write(const struct light_clusters* light_clusters,
+                     void* output)
+{
+    memcpy(output, light_clusters->clusters,
+           CLUSTER_COUNT * sizeof(struct cluster));
+    memcpy((char*)output + CLUSTER_COUNT * sizeof(struct cluster),
+           light_clusters->indices,
+           light_clusters->index_count * sizeof(uint32_t));
+}
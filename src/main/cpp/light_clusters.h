@@ -0,0 +1,110 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Clustered forward lighting. An eye's view frustum is split into a grid of
+// clusters: CLUSTER_GRID_WIDTH x CLUSTER_GRID_HEIGHT tiles of the eye
+// buffer, each cut into CLUSTER_GRID_DEPTH slices whose depth grows
+// exponentially, so that clusters far away aren't much longer than they
+// are wide. Every light is binned into the clusters that its bounds
+// overlap, and the fragment shader only shades with the lights of its
+// fragment's cluster, instead of with every light.
+//
+// Matrices are 16 floats, row-major with column vectors, the same layout as
+// ovrMatrix4f.
+
+enum
+{
+    CLUSTER_GRID_WIDTH = 16,
+    CLUSTER_GRID_HEIGHT = 16,
+    CLUSTER_GRID_DEPTH = 16,
+    CLUSTER_COUNT =
+        CLUSTER_GRID_WIDTH * CLUSTER_GRID_HEIGHT * CLUSTER_GRID_DEPTH,
+};
+
+// Must match the layout of Light in the fragment shader.
+struct point_light
+{
+    // Position in world space, and the distance at which the light has
+    // faded out.
+    float position_radius[4];
+    // The last component is padding.
+    float color[4];
+} __attribute__((aligned(16)));
+
+struct cluster_frustum
+{
+    // From world space to view space.
+    float view_matrix[16];
+    // A point at x, y and depth in view space is in the tile at
+    // tile_scales * (x, y) / depth + tile_biases.
+    float tile_scales[2];
+    float tile_biases[2];
+    float near;
+    // Depth at which each slice starts. The first starts at near, and the
+    // last goes on past far.
+    float slice_depths[CLUSTER_GRID_DEPTH];
+    // A point at depth is in slice log2(depth) * slice_scale + slice_bias,
+    // which is what the fragment shader computes.
+    float slice_scale;
+    float slice_bias;
+};
+
+// Builds the grid of an eye from its view and projection matrices. far is
+// where the slices stop growing, since the projection's far plane is
+// usually at infinity.
+void cluster_frustum_init(struct cluster_frustum* frustum,
+                          const float* view_matrix,
+                          const float* projection_matrix, float far);
+
+// Must match the layout of the clusters in the fragment shader.
+struct cluster
+{
+    // Range of the cluster's lights in the light indices.
+    uint32_t offset;
+    uint32_t count;
+};
+
+// The clusters a light overlaps, from min to max inclusive. min is greater
+// than max if the light is outside the frustum.
+struct cluster_bounds
+{
+    uint8_t min[3];
+    uint8_t max[3];
+};
+
+struct light_clusters
+{
+    // x first, then y, then the slice, like the fragment shader indexes
+    // them.
+    struct cluster* clusters;
+    int index_count;
+    // Room for light_capacity * CLUSTER_COUNT indices.
+    uint32_t* indices;
+    int light_capacity;
+    struct cluster_bounds* bounds;
+};
+
+void light_clusters_create(struct light_clusters* light_clusters,
+                           int light_capacity);
+
+void light_clusters_destroy(struct light_clusters* light_clusters);
+
+// Bins light_count lights, at most light_capacity, into the clusters of
+// frustum. lights must be aligned to 16 bytes. Can be called on different
+// light_clusters from several threads at once.
+void light_clusters_bin(struct light_clusters* light_clusters,
+                        const struct cluster_frustum* frustum,
+                        const struct point_light* lights, int light_count);
+
+// Size in bytes of what light_clusters_write writes.
+size_t light_clusters_get_size(const struct light_clusters* light_clusters);
+
+// Writes the clusters followed by the light indices, as the fragment shader
+// reads them.
+void light_clusters_write(const struct light_clusters* light_clusters,
+                          void* output);
+
+#endif // LIGHT_CLUSTERS_H
@@ -0,0 +1,222 @@
+#include "loader.h"
+#include <android/log.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#ifndef NDEBUG
+#define info(...) __android_log_print(ANDROID_LOG_VERBOSE, TAG, __VA_ARGS__)
+#else
+#define info(...) ((void)0)
+#endif // NDEBUG
+
+static const char* TAG = "loader";
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Returns the number of bytes uploaded.
+static size_t
+upload_buffer(struct upload* upload)
+{
+    glGenBuffers(1, &upload->name);
+    glBindBuffer(upload->target, upload->name);
+    glBufferData(upload->target, upload->size, upload->data, GL_STATIC_DRAW);
+    glBindBuffer(upload->target, 0);
+    return upload->size;
+}
+
+static void*
+loader_main(void* data)
+{
+    struct loader* loader = data;
+    if (eglMakeCurrent(loader->display, loader->surface, loader->surface,
+                       loader->context) == EGL_FALSE) {
+        error("can't make loader EGL context current: %#x", eglGetError());
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    while (true) {
+        while (!loader->stopping &&
+               loader->uploaded_count == loader->queued_count) {
+            pthread_cond_wait(&loader->cond, &loader->mutex);
+        }
+        if (loader->stopping) {
+            break;
+        }
+        // The render thread doesn't touch queued uploads, so the upload
+        // can be done without holding the mutex.
+        struct upload upload =
+            loader->uploads[loader->uploaded_count % MAX_UPLOADS];
+        pthread_mutex_unlock(&loader->mutex);
+
+        double start_time = get_time();
+        size_t size = upload_buffer(&upload);
+        upload.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        // Until it is flushed, the fence is only visible to this context,
+        // so the render thread could never see it signal.
+        glFlush();
+        double time = get_time() - start_time;
+
+        pthread_mutex_lock(&loader->mutex);
+        struct upload* slot =
+            &loader->uploads[loader->uploaded_count % MAX_UPLOADS];
+        slot->name = upload.name;
+        slot->fence = upload.fence;
+        ++loader->uploaded_count;
+        loader->stats.upload_time += time;
+        ++loader->stats.upload_count;
+        loader->stats.uploaded_size += size;
+    }
+    pthread_mutex_unlock(&loader->mutex);
+
+    eglMakeCurrent(loader->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                   EGL_NO_CONTEXT);
+    return NULL;
+}
+
+void
+loader_create(struct loader* loader, EGLDisplay display, EGLConfig config,
+              EGLContext share_context)
+{
+    loader->display = display;
+
+    info("create loader EGL context");
+    static const EGLint CONTEXT_ATTRIBS[] = { EGL_CONTEXT_CLIENT_VERSION, 3,
+                                              EGL_NONE };
+    loader->context =
+        eglCreateContext(display, config, share_context, CONTEXT_ATTRIBS);
+    if (loader->context == EGL_NO_CONTEXT) {
+        error("can't create loader EGL context: %#x", eglGetError());
+        exit(EXIT_FAILURE);
+    }
+
+    info("create loader EGL surface");
+    static const EGLint SURFACE_ATTRIBS[] = {
+        EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE,
+    };
+    loader->surface =
+        eglCreatePbufferSurface(display, config, SURFACE_ATTRIBS);
+    if (loader->surface == EGL_NO_SURFACE) {
+        error("can't create loader EGL pixel buffer surface: %#x",
+              eglGetError());
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_init(&loader->mutex, NULL);
+    pthread_cond_init(&loader->cond, NULL);
+    loader->stopping = false;
+    loader->queued_count = 0;
+    loader->uploaded_count = 0;
+    loader->handed_count = 0;
+    loader->stats.upload_time = 0.0;
+    loader->stats.upload_count = 0;
+    loader->stats.uploaded_size = 0;
+
+    info("create loader thread");
+    if (pthread_create(&loader->thread, NULL, loader_main, loader) != 0) {
+        error("can't create loader thread");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void
+loader_destroy(struct loader* loader)
+{
+    pthread_mutex_lock(&loader->mutex);
+    loader->stopping = true;
+    pthread_cond_signal(&loader->cond);
+    pthread_mutex_unlock(&loader->mutex);
+    info("join loader thread");
+    pthread_join(loader->thread, NULL);
+
+    // The objects are shared, so they can be deleted from this context.
+    for (uint64_t id = loader->handed_count; id < loader->uploaded_count;
+         ++id) {
+        const struct upload* upload = &loader->uploads[id % MAX_UPLOADS];
+        glDeleteSync(upload->fence);
+        glDeleteBuffers(1, &upload->name);
+    }
+    pthread_cond_destroy(&loader->cond);
+    pthread_mutex_destroy(&loader->mutex);
+
+    info("destroy loader EGL surface");
+    eglDestroySurface(loader->display, loader->surface);
+
+    info("destroy loader EGL context");
+    eglDestroyContext(loader->display, loader->context);
+}
+
+// Must be called while holding the mutex.
+static struct upload*
+queue_upload(struct loader* loader)
+{
+    if (loader->queued_count - loader->handed_count == MAX_UPLOADS) {
+        error("can't queue upload: all %d uploads in use", MAX_UPLOADS);
+        exit(EXIT_FAILURE);
+    }
+    struct upload* upload = &loader->uploads[loader->queued_count % MAX_UPLOADS];
+    upload->id = loader->queued_count;
+    upload->name = 0;
+    upload->fence = NULL;
+    return upload;
+}
+
+uint64_t
+loader_upload_buffer(struct loader* loader, GLenum target, const void* data,
+                     size_t size)
+{
+    pthread_mutex_lock(&loader->mutex);
+    struct upload* upload = queue_upload(loader);
+    upload->data = data;
+    upload->target = target;
+    upload->size = size;
+    uint64_t id = loader->queued_count++;
+    pthread_cond_signal(&loader->cond);
+    pthread_mutex_unlock(&loader->mutex);
+    return id;
+}
+
+int
+loader_poll(struct loader* loader, struct upload* uploads, int max_count)
+{
+    int count = 0;
+    pthread_mutex_lock(&loader->mutex);
+    while (count < max_count &&
+           loader->handed_count < loader->uploaded_count) {
+        struct upload* upload =
+            &loader->uploads[loader->handed_count % MAX_UPLOADS];
+        // Fences signal in order, so the later ones can't have signaled
+        // either.
+        GLenum result = glClientWaitSync(upload->fence, 0, 0);
+        if (result == GL_WAIT_FAILED) {
+            error("can't wait for fence of upload %llu",
+                  (unsigned long long)upload->id);
+            exit(EXIT_FAILURE);
+        }
+        if (result == GL_TIMEOUT_EXPIRED) {
+            break;
+        }
+        glDeleteSync(upload->fence);
+        upload->fence = NULL;
+        uploads[count++] = *upload;
+        ++loader->handed_count;
+    }
+    pthread_mutex_unlock(&loader->mutex);
+    return count;
+}
+
+void
+loader_get_stats(struct loader* loader, struct loader_stats* stats)
+{
+    pthread_mutex_lock(&loader->mutex);
+    *stats = loader->stats;
+    pthread_mutex_unlock(&loader->mutex);
+}
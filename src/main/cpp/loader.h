@@ -0,0 +1,87 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Uploads buffers on a thread of its own, with an EGL context that shares
+// objects with the render thread's context, so that uploads never stall a
+// frame. Every upload is followed by a fence, and is only handed to the
+// render thread by loader_poll once that fence has signaled, so the render
+// thread never sees a partially uploaded buffer. Vertex array objects
+// aren't shared between contexts, so they must be created on the render
+// thread, once their buffers have been handed over.
+
+enum
+{
+    MAX_UPLOADS = 512,
+};
+
+struct upload
+{
+    // Returned by the call that queued the upload.
+    uint64_t id;
+    // Must stay valid until the upload is handed back by loader_poll.
+    const void* data;
+    GLenum target;
+    size_t size;
+    // Set by the loader thread.
+    GLuint name;
+    GLsync fence;
+};
+
+// Totals since the loader was created.
+struct loader_stats
+{
+    // Seconds that the loader thread spent uploading.
+    double upload_time;
+    int upload_count;
+    size_t uploaded_size;
+};
+
+struct loader
+{
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool stopping;
+    // A ring of uploads, indexed by id. Uploads from handed_count to
+    // uploaded_count are done but not yet handed back, and uploads from
+    // uploaded_count to queued_count are waiting for the loader thread.
+    struct upload uploads[MAX_UPLOADS];
+    uint64_t queued_count;
+    uint64_t uploaded_count;
+    uint64_t handed_count;
+    struct loader_stats stats;
+};
+
+// Creates the loader's context, sharing objects with share_context, which
+// must have been created with config, and starts the loader thread.
+void loader_create(struct loader* loader, EGLDisplay display,
+                   EGLConfig config, EGLContext share_context);
+
+// Stops the loader thread and destroys its context. Uploads that weren't
+// handed back yet are deleted.
+void loader_destroy(struct loader* loader);
+
+// Queues the upload of size bytes of data to a new buffer, and returns its
+// id. Exits if MAX_UPLOADS uploads are already in flight.
+uint64_t loader_upload_buffer(struct loader* loader, GLenum target,
+                              const void* data, size_t size);
+
+// Hands back up to max_count finished uploads, in the order they were
+// queued, and returns how many. Doesn't block. Must be called from the
+// render thread, which then owns the uploaded objects.
+int loader_poll(struct loader* loader, struct upload* uploads,
+                int max_count);
+
+void loader_get_stats(struct loader* loader, struct loader_stats* stats);
+
+#endif // LOADER_H
@@ -0,0 +1,174 @@
+#include "memory.h"
+#include <android/log.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+static const char* TAG = "memory";
+
+// Every allocation is prefixed with its size, so memory_free can keep the
+// byte counters up to date, and with its offset from the start of the
+// block, so memory_free can find the block of an aligned allocation. The
+// header is 16 bytes to keep the returned pointer aligned for any type.
+struct alloc_header
+{
+    size_t size;
+    size_t offset;
+};
+
+static struct memory_stats stats;
+
+static void*
+finish_alloc(char* block, size_t offset, size_t size)
+{
+    struct alloc_header* header =
+        (struct alloc_header*)(block + offset) - 1;
+    header->size = size;
+    header->offset = offset;
+    __atomic_add_fetch(&stats.alloc_count, 1, __ATOMIC_RELAXED);
+    size_t bytes_in_use =
+        __atomic_add_fetch(&stats.bytes_in_use, size, __ATOMIC_RELAXED);
+    size_t peak_bytes_in_use =
+        __atomic_load_n(&stats.peak_bytes_in_use, __ATOMIC_RELAXED);
+    while (bytes_in_use > peak_bytes_in_use &&
+           !__atomic_compare_exchange_n(&stats.peak_bytes_in_use,
+                                        &peak_bytes_in_use, bytes_in_use, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    return block + offset;
+}
+
+void*
+memory_alloc(size_t size)
+{
+    char* block = malloc(sizeof(struct alloc_header) + size);
+    if (block == NULL) {
+        error("can't allocate %zu bytes", size);
+        exit(EXIT_FAILURE);
+    }
+    return finish_alloc(block, sizeof(struct alloc_header), size);
+}
+
+void*
+memory_alloc_aligned(size_t size, size_t alignment)
+{
+    if (alignment <= sizeof(struct alloc_header)) {
+        return memory_alloc(size);
+    }
+    // The header goes at the end of the first alignment bytes, so that the
+    // memory after it is aligned. aligned_alloc needs API level 28, so
+    // this uses posix_memalign.
+    void* block = NULL;
+    if (posix_memalign(&block, alignment, alignment + size) != 0) {
+        error("can't allocate %zu bytes aligned to %zu bytes", size,
+              alignment);
+        exit(EXIT_FAILURE);
+    }
+    return finish_alloc(block, alignment, size);
+}
+
+void
+memory_free(void* pointer)
+{
+    if (pointer == NULL) {
+        return;
+    }
+    struct alloc_header* header = (struct alloc_header*)pointer - 1;
+    __atomic_add_fetch(&stats.free_count, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stats.bytes_in_use, header->size, __ATOMIC_RELAXED);
+    free((char*)pointer - header->offset);
+}
+
+void
+memory_get_stats(struct memory_stats* out_stats)
+{
+    out_stats->alloc_count =
+        __atomic_load_n(&stats.alloc_count, __ATOMIC_RELAXED);
+    out_stats->free_count = __atomic_load_n(&stats.free_count, __ATOMIC_RELAXED);
+    out_stats->bytes_in_use =
+        __atomic_load_n(&stats.bytes_in_use, __ATOMIC_RELAXED);
+    out_stats->peak_bytes_in_use =
+        __atomic_load_n(&stats.peak_bytes_in_use, __ATOMIC_RELAXED);
+}
+
+void
+arena_create(struct arena* arena, size_t capacity)
+{
+    arena->memory = memory_alloc(capacity);
+    arena->capacity = capacity;
+    arena->offset = 0;
+    arena->peak_offset = 0;
+}
+
+void
+arena_destroy(struct arena* arena)
+{
+    memory_free(arena->memory);
+}
+
+void*
+arena_alloc(struct arena* arena, size_t size, size_t alignment)
+{
+    size_t offset = (arena->offset + alignment - 1) & ~(alignment - 1);
+    if (offset + size > arena->capacity) {
+        error("can't allocate %zu bytes from arena: %zu of %zu bytes in use",
+              size, arena->offset, arena->capacity);
+        exit(EXIT_FAILURE);
+    }
+    arena->offset = offset + size;
+    if (arena->offset > arena->peak_offset) {
+        arena->peak_offset = arena->offset;
+    }
+    return arena->memory + offset;
+}
+
+void
+arena_reset(struct arena* arena)
+{
+    arena->offset = 0;
+}
+
+void
+pool_create(struct pool* pool, size_t object_size, int capacity)
+{
+    pool->memory = memory_alloc(object_size * capacity);
+    pool->object_size = object_size;
+    pool->capacity = capacity;
+    pool->count = 0;
+    pool->next_free_indices = memory_alloc(capacity * sizeof(int));
+    for (int i = 0; i < capacity; ++i) {
+        pool->next_free_indices[i] = i + 1 < capacity ? i + 1 : -1;
+    }
+    pool->free_index = capacity > 0 ? 0 : -1;
+}
+
+void
+pool_destroy(struct pool* pool)
+{
+    memory_free(pool->next_free_indices);
+    memory_free(pool->memory);
+}
+
+void*
+pool_alloc(struct pool* pool)
+{
+    if (pool->free_index < 0) {
+        error("can't allocate object from pool: all %d objects in use",
+              pool->capacity);
+        exit(EXIT_FAILURE);
+    }
+    int index = pool->free_index;
+    pool->free_index = pool->next_free_indices[index];
+    pool->count++;
+    return pool->memory + index * pool->object_size;
+}
+
+void
+pool_free(struct pool* pool, void* object)
+{
+    int index = ((char*)object - pool->memory) / pool->object_size;
+    pool->next_free_indices[index] = pool->free_index;
+    pool->free_index = index;
+    pool->count--;
+}
@@ -0,0 +1,95 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Heap allocation for the app. Everything that the app allocates itself
+// goes through memory_alloc, which counts allocations and bytes, so that
+// the frame loop can check that it doesn't touch the heap once it reaches
+// a steady state. Memory that only lives for a frame comes from an arena,
+// and objects that come and go come from a pool, both of which get their
+// memory from memory_alloc once, up front.
+//
+// The counters only see memory_alloc: raw malloc calls, and allocations
+// made by the GL driver or VrApi, aren't counted.
+
+struct memory_stats
+{
+    uint64_t alloc_count;
+    uint64_t free_count;
+    size_t bytes_in_use;
+    size_t peak_bytes_in_use;
+};
+
+// Returns memory aligned to 16 bytes. Never returns NULL: if the memory
+// can't be allocated, logs an error and exits. Thread-safe.
+void* memory_alloc(size_t size);
+
+// Like memory_alloc, but the memory is aligned to alignment bytes, which
+// must be a power of two. Use it for types declared with a larger
+// alignment than 16, such as ones padded to a cache line.
+void* memory_alloc_aligned(size_t size, size_t alignment);
+
+// pointer must come from memory_alloc or memory_alloc_aligned, or be NULL.
+// Thread-safe.
+void memory_free(void* pointer);
+
+// Copies the counters since the app started. Each counter is read
+// atomically, but not all of them at once, so they may not match exactly
+// while other threads allocate.
+void memory_get_stats(struct memory_stats* stats);
+
+// A bump allocator: allocations are carved out of a single block one after
+// the other, and are all freed at once by resetting the arena. Not
+// thread-safe.
+struct arena
+{
+    char* memory;
+    size_t capacity;
+    size_t offset;
+    // Highest offset since the arena was created, to size its capacity.
+    size_t peak_offset;
+};
+
+void arena_create(struct arena* arena, size_t capacity);
+
+void arena_destroy(struct arena* arena);
+
+// alignment must be a power of two, at most 16. If the arena doesn't have
+// size bytes left, logs an error and exits, rather than falling back to the
+// heap, so capacity must cover the worst case.
+void* arena_alloc(struct arena* arena, size_t size, size_t alignment);
+
+// Frees every allocation from the arena. Pointers to them must not be used
+// afterwards.
+void arena_reset(struct arena* arena);
+
+// Fixed-size objects, with a free list threaded through an array of
+// indices, so that allocating and freeing them never touches the heap. Not
+// thread-safe.
+struct pool
+{
+    char* memory;
+    size_t object_size;
+    int capacity;
+    // Number of objects in use.
+    int count;
+    // First free object, or -1 if the pool is full.
+    int free_index;
+    int* next_free_indices;
+};
+
+// object_size must be a multiple of the alignment the objects need, up to
+// 16 bytes. The pool holds at most capacity objects, and never grows.
+void pool_create(struct pool* pool, size_t object_size, int capacity);
+
+void pool_destroy(struct pool* pool);
+
+// If all capacity objects are in use, logs an error and exits.
+void* pool_alloc(struct pool* pool);
+
+// object must come from pool_alloc on the same pool, and not be freed yet.
+void pool_free(struct pool* pool, void* object);
+
+#endif // MEMORY_H
@@ -0,0 +1,30 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <stdint.h>
+
+// Layout of the mesh files written by the offline mesh optimizer in
+// src/tools. The vertices and indices are stored in the order in which they
+// should be uploaded, so geometry_create can use them as-is.
+
+#define MESH_MAGIC 0x4853454D // "MESH"
+
+struct vertex
+{
+    float position[4];
+    float color[4];
+};
+
+struct mesh_header
+{
+    uint32_t magic;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    // 2 or 4 bytes per index.
+    uint32_t index_size;
+    // Byte offsets from the start of the file.
+    uint32_t vertices_offset;
+    uint32_t indices_offset;
+};
+
+#endif // MESH_H
@@ -0,0 +1,236 @@
+#include "pipeline.h"
+#include <android/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+static const char* TAG = "pipeline";
+
+void
+vertex_layout_apply(const struct vertex_layout* layout)
+{
+    vertex_layout_apply_at(layout, 0);
+}
+
+void
+vertex_layout_apply_at(const struct vertex_layout* layout, size_t offset)
+{
+    for (int i = 0; i < layout->attrib_count; ++i) {
+        const struct vertex_attrib* attrib = &layout->attribs[i];
+        glEnableVertexAttribArray(attrib->location);
+        glVertexAttribPointer(attrib->location, attrib->size, attrib->type,
+                              attrib->normalized, attrib->stride,
+                              (const GLvoid*)(offset + attrib->offset));
+    }
+}
+
+void
+pipeline_desc_init(struct pipeline_desc* desc)
+{
+    memset(desc, 0, sizeof(*desc));
+    desc->cull_mode = CULL_MODE_BACK;
+    desc->depth_test = true;
+    desc->depth_write = true;
+    desc->depth_func = GL_LESS;
+    desc->blend_mode = BLEND_MODE_OPAQUE;
+    desc->color_write = true;
+    desc->scissor_test = false;
+    desc->color_format = GL_NONE;
+    desc->depth_format = GL_NONE;
+}
+
+// FNV-1a.
+static uint32_t
+hash_bytes(const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void
+validate_desc(const struct pipeline_desc* desc)
+{
+    GLint status = GL_FALSE;
+    glGetProgramiv(desc->program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        error("can't create pipeline: program %u isn't linked", desc->program);
+        exit(EXIT_FAILURE);
+    }
+    GLint attrib_count = 0;
+    glGetProgramiv(desc->program, GL_ACTIVE_ATTRIBUTES, &attrib_count);
+    for (GLint i = 0; i < attrib_count; ++i) {
+        char name[64];
+        GLint size = 0;
+        GLenum type = GL_NONE;
+        glGetActiveAttrib(desc->program, i, sizeof(name), NULL, &size, &type,
+                          name);
+        GLint location = glGetAttribLocation(desc->program, name);
+        // Built-in inputs such as gl_InstanceID have no location.
+        if (location < 0) {
+            continue;
+        }
+        bool found = false;
+        for (int j = 0; j < desc->vertex_layout.attrib_count; ++j) {
+            if (desc->vertex_layout.attribs[j].location == (GLuint)location) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            error("can't create pipeline: attribute %s of program %u isn't "
+                  "in the vertex layout",
+                  name, desc->program);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void
+pipeline_cache_create(struct pipeline_cache* cache)
+{
+    cache->pipeline_count = 0;
+    cache->locked = false;
+}
+
+void
+pipeline_cache_destroy(struct pipeline_cache* cache)
+{
+    cache->pipeline_count = 0;
+}
+
+const struct pipeline*
+pipeline_cache_get_pipeline(struct pipeline_cache* cache,
+                            const struct pipeline_desc* desc)
+{
+    if (cache->locked) {
+        error("can't create pipeline: pipeline cache is locked");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t hash = hash_bytes(desc, sizeof(*desc));
+    for (int i = 0; i < cache->pipeline_count; ++i) {
+        const struct pipeline* pipeline = &cache->pipelines[i];
+        if (pipeline->hash == hash &&
+            memcmp(&pipeline->desc, desc, sizeof(*desc)) == 0) {
+            return pipeline;
+        }
+    }
+    if (cache->pipeline_count == MAX_PIPELINES) {
+        error("can't create pipeline: all %d pipelines in use",
+              MAX_PIPELINES);
+        exit(EXIT_FAILURE);
+    }
+    validate_desc(desc);
+    struct pipeline* pipeline = &cache->pipelines[cache->pipeline_count++];
+    pipeline->desc = *desc;
+    pipeline->hash = hash;
+    return pipeline;
+}
+
+void
+pipeline_cache_lock(struct pipeline_cache* cache)
+{
+    cache->locked = true;
+}
+
+void
+pipeline_state_reset(struct pipeline_state* state)
+{
+    state->valid = false;
+    state->pipeline = NULL;
+}
+
+static void
+set_capability(GLenum capability, bool enabled)
+{
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+static void
+apply_blend_mode(enum blend_mode blend_mode)
+{
+    switch (blend_mode) {
+        case BLEND_MODE_OPAQUE:
+            break;
+        case BLEND_MODE_ALPHA:
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            break;
+        case BLEND_MODE_ADDITIVE:
+            glBlendFunc(GL_ONE, GL_ONE);
+            break;
+    }
+}
+
+void
+pipeline_state_apply(struct pipeline_state* state,
+                     const struct pipeline* pipeline)
+{
+    if (state->valid && state->pipeline == pipeline) {
+        return;
+    }
+    const struct pipeline_desc* desc = &pipeline->desc;
+    if (!state->valid) {
+        glUseProgram(desc->program);
+        set_capability(GL_CULL_FACE, desc->cull_mode != CULL_MODE_NONE);
+        if (desc->cull_mode != CULL_MODE_NONE) {
+            glCullFace(desc->cull_mode == CULL_MODE_BACK ? GL_BACK : GL_FRONT);
+        }
+        set_capability(GL_DEPTH_TEST, desc->depth_test);
+        glDepthMask(desc->depth_write);
+        glDepthFunc(desc->depth_func);
+        set_capability(GL_BLEND, desc->blend_mode != BLEND_MODE_OPAQUE);
+        apply_blend_mode(desc->blend_mode);
+        GLboolean color_write = desc->color_write;
+        glColorMask(color_write, color_write, color_write, color_write);
+        set_capability(GL_SCISSOR_TEST, desc->scissor_test);
+        state->valid = true;
+        state->pipeline = pipeline;
+        return;
+    }
+
+    const struct pipeline_desc* old = &state->pipeline->desc;
+    if (desc->program != old->program) {
+        glUseProgram(desc->program);
+    }
+    if ((desc->cull_mode != CULL_MODE_NONE) !=
+        (old->cull_mode != CULL_MODE_NONE)) {
+        set_capability(GL_CULL_FACE, desc->cull_mode != CULL_MODE_NONE);
+    }
+    // The cull face is left alone while culling is off, so it may still be
+    // the one from before.
+    if (desc->cull_mode != CULL_MODE_NONE && desc->cull_mode != old->cull_mode) {
+        glCullFace(desc->cull_mode == CULL_MODE_BACK ? GL_BACK : GL_FRONT);
+    }
+    if (desc->depth_test != old->depth_test) {
+        set_capability(GL_DEPTH_TEST, desc->depth_test);
+    }
+    if (desc->depth_write != old->depth_write) {
+        glDepthMask(desc->depth_write);
+    }
+    if (desc->depth_func != old->depth_func) {
+        glDepthFunc(desc->depth_func);
+    }
+    if ((desc->blend_mode != BLEND_MODE_OPAQUE) !=
+        (old->blend_mode != BLEND_MODE_OPAQUE)) {
+        set_capability(GL_BLEND, desc->blend_mode != BLEND_MODE_OPAQUE);
+    }
+    if (desc->blend_mode != old->blend_mode) {
+        apply_blend_mode(desc->blend_mode);
+    }
+    if (desc->color_write != old->color_write) {
+        GLboolean color_write = desc->color_write;
+        glColorMask(color_write, color_write, color_write, color_write);
+    }
+    if (desc->scissor_test != old->scissor_test) {
+        set_capability(GL_SCISSOR_TEST, desc->scissor_test);
+    }
+    state->pipeline = pipeline;
+}
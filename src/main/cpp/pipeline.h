@@ -0,0 +1,120 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <GLES3/gl3.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A pipeline bundles a program, the vertex layout it expects, and the
+// raster state it is drawn with. Pipelines are created and validated by a
+// pipeline cache at load time, after which the cache is locked, so no
+// pipeline is ever created during a frame. Binding a pipeline only makes
+// the GL calls for the state that differs from the bound one.
+
+enum
+{
+    MAX_VERTEX_ATTRIBS = 8,
+    MAX_PIPELINES = 32,
+};
+
+struct vertex_attrib
+{
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    GLsizei stride;
+    GLsizei offset;
+};
+
+struct vertex_layout
+{
+    int attrib_count;
+    struct vertex_attrib attribs[MAX_VERTEX_ATTRIBS];
+};
+
+// Sets up the attributes of the bound vertex array object to read from the
+// bound array buffer.
+void vertex_layout_apply(const struct vertex_layout* layout);
+
+// Like vertex_layout_apply, for vertices that start offset bytes into the
+// buffer.
+void vertex_layout_apply_at(const struct vertex_layout* layout,
+                            size_t offset);
+
+enum cull_mode
+{
+    CULL_MODE_NONE,
+    CULL_MODE_BACK,
+    CULL_MODE_FRONT,
+};
+
+enum blend_mode
+{
+    BLEND_MODE_OPAQUE,
+    BLEND_MODE_ALPHA,
+    BLEND_MODE_ADDITIVE,
+};
+
+struct pipeline_desc
+{
+    GLuint program;
+    struct vertex_layout vertex_layout;
+    enum cull_mode cull_mode;
+    bool depth_test;
+    bool depth_write;
+    GLenum depth_func;
+    enum blend_mode blend_mode;
+    bool color_write;
+    bool scissor_test;
+    // Formats of the attachments the pipeline renders to, or GL_NONE.
+    GLenum color_format;
+    GLenum depth_format;
+};
+
+// Zeroes the whole description, padding included, so that it hashes
+// consistently, and sets the default state: back face culling, depth test
+// and write with GL_LESS, no blending, color write and no scissor test.
+void pipeline_desc_init(struct pipeline_desc* desc);
+
+struct pipeline
+{
+    struct pipeline_desc desc;
+    uint32_t hash;
+};
+
+struct pipeline_cache
+{
+    int pipeline_count;
+    struct pipeline pipelines[MAX_PIPELINES];
+    bool locked;
+};
+
+void pipeline_cache_create(struct pipeline_cache* cache);
+
+void pipeline_cache_destroy(struct pipeline_cache* cache);
+
+// Returns the pipeline for desc, creating it if no equal pipeline exists
+// yet. Exits if the program isn't linked, or if one of its active
+// attributes is missing from the vertex layout.
+const struct pipeline* pipeline_cache_get_pipeline(
+    struct pipeline_cache* cache, const struct pipeline_desc* desc);
+
+// After this, pipeline_cache_get_pipeline can't be called anymore.
+void pipeline_cache_lock(struct pipeline_cache* cache);
+
+struct pipeline_state
+{
+    // False if the GL state is unknown, in which case the next apply sets
+    // all of it.
+    bool valid;
+    const struct pipeline* pipeline;
+};
+
+void pipeline_state_reset(struct pipeline_state* state);
+
+void pipeline_state_apply(struct pipeline_state* state,
+                          const struct pipeline* pipeline);
+
+#endif // PIPELINE_H
@@ -0,0 +1,187 @@
+#include "pose_channel.h"
+#include <math.h>
+#include <stddef.h>
+
+// Snapshots are copied a word at a time with atomic loads and stores, so
+// that a reader racing with the writer gets a torn copy, which the
+// sequence check then rejects, rather than undefined behavior.
+_Static_assert(sizeof(struct pose_snapshot) % sizeof(uint32_t) == 0,
+               "snapshots must be a whole number of words");
+
+enum
+{
+    SNAPSHOT_WORD_COUNT = sizeof(struct pose_snapshot) / sizeof(uint32_t),
+};
+
+void
+pose_channel_create(struct pose_channel* channel)
+{
+    for (int i = 0; i < POSE_HISTORY_LENGTH; ++i) {
+        channel->slots[i].sequence = 0;
+    }
+    channel->publish_count = 0;
+}
+
+void
+pose_channel_publish(struct pose_channel* channel,
+                     const struct pose_snapshot* snapshot)
+{
+    uint64_t index = __atomic_load_n(&channel->publish_count, __ATOMIC_RELAXED);
+    struct pose_slot* slot = &channel->slots[index % POSE_HISTORY_LENGTH];
+    struct pose_snapshot copy = *snapshot;
+    copy.index = index;
+
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    // Makes the odd sequence visible before any of the new words.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    const uint32_t* source = (const uint32_t*)&copy;
+    uint32_t* destination = (uint32_t*)&slot->snapshot;
+    for (int i = 0; i < SNAPSHOT_WORD_COUNT; ++i) {
+        __atomic_store_n(&destination[i], source[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&channel->publish_count, index + 1, __ATOMIC_RELEASE);
+}
+
+// Returns false if the slot was being written, or no longer holds the
+// snapshot with the given index.
+static bool
+read_snapshot(const struct pose_channel* channel, uint64_t index,
+              struct pose_snapshot* snapshot)
+{
+    const struct pose_slot* slot = &channel->slots[index % POSE_HISTORY_LENGTH];
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (sequence % 2 != 0) {
+        return false;
+    }
+    const uint32_t* source = (const uint32_t*)&slot->snapshot;
+    uint32_t* destination = (uint32_t*)snapshot;
+    for (int i = 0; i < SNAPSHOT_WORD_COUNT; ++i) {
+        destination[i] = __atomic_load_n(&source[i], __ATOMIC_RELAXED);
+    }
+    // Keeps the second load of the sequence after the copy.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != sequence) {
+        return false;
+    }
+    // The writer may have lapped the ring since the caller read
+    // publish_count.
+    return snapshot->index == index;
+}
+
+bool
+pose_channel_read_latest(const struct pose_channel* channel,
+                         struct pose_snapshot* snapshot)
+{
+    while (true) {
+        uint64_t count =
+            __atomic_load_n(&channel->publish_count, __ATOMIC_ACQUIRE);
+        if (count == 0) {
+            return false;
+        }
+        // The writer only writes the latest slot once it has gone around
+        // the whole ring, so this rarely fails.
+        if (read_snapshot(channel, count - 1, snapshot)) {
+            return true;
+        }
+    }
+}
+
+void
+pose_interpolate(const struct pose* a, const struct pose* b, float t,
+                 struct pose* pose)
+{
+    for (int i = 0; i < 3; ++i) {
+        pose->position[i] =
+            a->position[i] + (b->position[i] - a->position[i]) * t;
+    }
+
+    // Take the shorter way around.
+    float cos_angle = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        cos_angle += a->orientation[i] * b->orientation[i];
+    }
+    float sign = 1.0;
+    if (cos_angle < 0.0) {
+        cos_angle = -cos_angle;
+        sign = -1.0;
+    }
+    float weight_a = 1.0 - t;
+    float weight_b = t;
+    // Nearly equal orientations would divide by almost 0, and a linear
+    // interpolation is just as accurate there.
+    if (cos_angle < 0.9995) {
+        float angle = acosf(cos_angle);
+        float sin_angle = sinf(angle);
+        weight_a = sinf((1.0 - t) * angle) / sin_angle;
+        weight_b = sinf(t * angle) / sin_angle;
+    }
+    float length_squared = 0.0;
+    for (int i = 0; i < 4; ++i) {
+        pose->orientation[i] = weight_a * a->orientation[i] +
+                               sign * weight_b * b->orientation[i];
+        length_squared += pose->orientation[i] * pose->orientation[i];
+    }
+    float inverse_length = 1.0 / sqrtf(length_squared);
+    for (int i = 0; i < 4; ++i) {
+        pose->orientation[i] *= inverse_length;
+    }
+}
+
+static void
+interpolate_snapshots(const struct pose_snapshot* a,
+                      const struct pose_snapshot* b, double time,
+                      struct pose_snapshot* snapshot)
+{
+    double duration = b->time - a->time;
+    float t = duration > 0.0 ? (time - a->time) / duration : 1.0;
+    snapshot->index = b->index;
+    snapshot->frame_index = b->frame_index;
+    snapshot->time = time;
+    pose_interpolate(&a->head, &b->head, t, &snapshot->head);
+    for (int i = 0; i < POSE_EYE_COUNT; ++i) {
+        pose_interpolate(&a->eyes[i], &b->eyes[i], t, &snapshot->eyes[i]);
+    }
+    // A controller that is only tracked in one of the snapshots keeps the
+    // pose from that one.
+    snapshot->controller_mask = a->controller_mask | b->controller_mask;
+    for (int i = 0; i < MAX_CONTROLLERS; ++i) {
+        uint32_t bit = 1u << i;
+        if ((a->controller_mask & b->controller_mask & bit) != 0) {
+            pose_interpolate(&a->controllers[i], &b->controllers[i], t,
+                             &snapshot->controllers[i]);
+        } else if ((b->controller_mask & bit) != 0) {
+            snapshot->controllers[i] = b->controllers[i];
+        } else {
+            snapshot->controllers[i] = a->controllers[i];
+        }
+    }
+}
+
+bool
+pose_channel_sample(const struct pose_channel* channel, double time,
+                    struct pose_snapshot* snapshot)
+{
+    struct pose_snapshot later;
+    if (!pose_channel_read_latest(channel, &later)) {
+        return false;
+    }
+    uint64_t latest_index = later.index;
+    // The oldest slot in the ring is the next one the writer overwrites,
+    // so stop before it.
+    while (later.time > time && later.index > 0 &&
+           latest_index - later.index + 2 < POSE_HISTORY_LENGTH) {
+        struct pose_snapshot earlier;
+        if (!read_snapshot(channel, later.index - 1, &earlier)) {
+            break;
+        }
+        if (earlier.time <= time) {
+            interpolate_snapshots(&earlier, &later, time, snapshot);
+            return true;
+        }
+        later = earlier;
+    }
+    *snapshot = later;
+    return true;
+}
@@ -0,0 +1,77 @@
+#ifndef POSE_CHANNEL_H
+#define POSE_CHANNEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Publishes the predicted poses of each frame from the frame loop to any
+// number of reader threads, without locks. Snapshots go into a ring, and
+// each slot is guarded by a sequence lock: the writer makes the sequence
+// odd while it writes the slot, and readers retry if the sequence was odd
+// or changed while they copied it. Readers never block the writer, and the
+// writer never waits for readers.
+
+enum
+{
+    POSE_HISTORY_LENGTH = 16,
+    MAX_CONTROLLERS = 2,
+    POSE_EYE_COUNT = 2,
+};
+
+struct pose
+{
+    // A unit quaternion, x, y, z, w.
+    float orientation[4];
+    float position[3];
+};
+
+struct pose_snapshot
+{
+    // Index of the snapshot in the order it was published, starting at 0.
+    uint64_t index;
+    uint64_t frame_index;
+    // Time the poses were predicted for, in seconds.
+    double time;
+    struct pose head;
+    struct pose eyes[POSE_EYE_COUNT];
+    // Bit i is set if controller i is tracked.
+    uint32_t controller_mask;
+    struct pose controllers[MAX_CONTROLLERS];
+};
+
+struct pose_slot
+{
+    uint32_t sequence;
+    struct pose_snapshot snapshot;
+} __attribute__((aligned(64)));
+
+struct pose_channel
+{
+    struct pose_slot slots[POSE_HISTORY_LENGTH];
+    // Number of snapshots published so far.
+    uint64_t publish_count __attribute__((aligned(64)));
+};
+
+void pose_channel_create(struct pose_channel* channel);
+
+// Must only be called from one thread at a time. The snapshot's index is
+// set by the channel.
+void pose_channel_publish(struct pose_channel* channel,
+                          const struct pose_snapshot* snapshot);
+
+// Copies the latest snapshot. Returns false if none was published yet.
+bool pose_channel_read_latest(const struct pose_channel* channel,
+                              struct pose_snapshot* snapshot);
+
+// Interpolates the poses between the two published snapshots around time.
+// Times outside the history get the closest snapshot, without
+// extrapolation. Returns false if no snapshot was published yet.
+bool pose_channel_sample(const struct pose_channel* channel, double time,
+                         struct pose_snapshot* snapshot);
+
+// Interpolates linearly between the positions and spherically between the
+// orientations.
+void pose_interpolate(const struct pose* a, const struct pose* b, float t,
+                      struct pose* pose);
+
+#endif // POSE_CHANNEL_H
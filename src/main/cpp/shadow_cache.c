@@ -0,0 +1,145 @@
+#include "shadow_cache.h"
+#include "memory.h"
+#include <string.h>
+
+void
+shadow_cache_create(struct shadow_cache* cache, int caster_capacity)
+{
+    shadow_cache_invalidate(cache);
+    cache->caster_capacity = caster_capacity;
+    cache->caster_count = 0;
+    cache->caster_bounds = memory_alloc(caster_capacity * sizeof(float[4]));
+}
+
+void
+shadow_cache_destroy(struct shadow_cache* cache)
+{
+    memory_free(cache->caster_bounds);
+}
+
+// Clamps before converting, since converting a float that is out of the
+// range of int, or NaN, is undefined. NaN goes to cell 0.
+static int
+get_cell(float coordinate)
+{
+    if (!(coordinate > 0.0)) {
+        return 0;
+    }
+    if (coordinate >= 1.0) {
+        return SHADOW_CELL_GRID_SIZE - 1;
+    }
+    int cell = coordinate * SHADOW_CELL_GRID_SIZE;
+    return cell < SHADOW_CELL_GRID_SIZE - 1 ? cell : SHADOW_CELL_GRID_SIZE - 1;
+}
+
+// Stores the range of cells under bounds, inclusive, in min_cell and
+// max_cell. Returns false if bounds are outside the atlas.
+static bool
+get_cells(const float* bounds, int* min_cell, int* max_cell)
+{
+    if (bounds[2] < 0.0 || bounds[3] < 0.0 || bounds[0] > 1.0 ||
+        bounds[1] > 1.0) {
+        return false;
+    }
+    for (int i = 0; i < 2; ++i) {
+        min_cell[i] = get_cell(bounds[i]);
+        max_cell[i] = get_cell(bounds[2 + i]);
+    }
+    return true;
+}
+
+// Bits first to last, inclusive.
+static uint32_t
+get_mask(int first, int last)
+{
+    return (((uint32_t)2 << last) - 1) & ~(((uint32_t)1 << first) - 1);
+}
+
+int
+shadow_cache_add_caster(struct shadow_cache* cache, const float* bounds)
+{
+    if (cache->caster_count == cache->caster_capacity) {
+        return -1;
+    }
+    int caster = cache->caster_count++;
+    memcpy(cache->caster_bounds[caster], bounds, sizeof(float[4]));
+    shadow_cache_mark_dirty(cache, bounds);
+    return caster;
+}
+
+void
+shadow_cache_move_caster(struct shadow_cache* cache, int caster,
+                         const float* bounds)
+{
+    // Even if the caster stays in the same cells, its shadow moved within
+    // them.
+    shadow_cache_mark_dirty(cache, cache->caster_bounds[caster]);
+    memcpy(cache->caster_bounds[caster], bounds, sizeof(float[4]));
+    shadow_cache_mark_dirty(cache, bounds);
+}
+
+void
+shadow_cache_mark_dirty(struct shadow_cache* cache, const float* bounds)
+{
+    int min_cell[2];
+    int max_cell[2];
+    if (!get_cells(bounds, min_cell, max_cell)) {
+        return;
+    }
+    uint32_t mask = get_mask(min_cell[0], max_cell[0]);
+    for (int y = min_cell[1]; y <= max_cell[1]; ++y) {
+        cache->dirty_rows[y] |= mask;
+    }
+}
+
+void
+shadow_cache_invalidate(struct shadow_cache* cache)
+{
+    for (int y = 0; y < SHADOW_CELL_GRID_SIZE; ++y) {
+        cache->dirty_rows[y] = get_mask(0, SHADOW_CELL_GRID_SIZE - 1);
+    }
+}
+
+int
+shadow_cache_take_dirty_rects(struct shadow_cache* cache,
+                              struct shadow_rect* rects)
+{
+    // Greedily takes the first run of dirty cells in a row, and grows it
+    // down for as long as the rows below have the whole run dirty.
+    int rect_count = 0;
+    uint32_t* rows = cache->dirty_rows;
+    for (int y = 0; y < SHADOW_CELL_GRID_SIZE; ++y) {
+        while (rows[y] != 0) {
+            int x = __builtin_ctz(rows[y]);
+            int width = __builtin_ctz(~(rows[y] >> x));
+            uint32_t run = get_mask(x, x + width - 1);
+            int height = 1;
+            while (y + height < SHADOW_CELL_GRID_SIZE &&
+                   (rows[y + height] & run) == run) {
+                ++height;
+            }
+            for (int i = 0; i < height; ++i) {
+                rows[y + i] &= ~run;
+            }
+            struct shadow_rect* rect = &rects[rect_count++];
+            rect->x = x;
+            rect->y = y;
+            rect->width = width;
+            rect->height = height;
+        }
+    }
+    return rect_count;
+}
+
+bool
+shadow_cache_caster_overlaps(const struct shadow_cache* cache, int caster,
+                             const struct shadow_rect* rect)
+{
+    int min_cell[2];
+    int max_cell[2];
+    if (!get_cells(cache->caster_bounds[caster], min_cell, max_cell)) {
+        return false;
+    }
+    return min_cell[0] < rect->x + rect->width && max_cell[0] >= rect->x &&
+           min_cell[1] < rect->y + rect->height && max_cell[1] >= rect->y;
+}
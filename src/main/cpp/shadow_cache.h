@@ -0,0 +1,72 @@
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Tracks which parts of a cached shadow atlas need to be rendered again.
+// The atlas is split into SHADOW_CELL_GRID_SIZE x SHADOW_CELL_GRID_SIZE
+// cells. Every shadow caster has bounds in the atlas, and when a caster
+// moves, the cells under its old and new bounds become dirty. Each frame,
+// the dirty cells are merged into rectangles, and only those are cleared
+// and rendered again, with the casters that overlap them.
+//
+// Bounds are min x, min y, max x and max y, with the atlas going from 0 to
+// 1 on both axes.
+
+enum
+{
+    // At most 31, since a row of cells is a mask in 32 bits.
+    SHADOW_CELL_GRID_SIZE = 16,
+    SHADOW_CELL_COUNT = SHADOW_CELL_GRID_SIZE * SHADOW_CELL_GRID_SIZE,
+};
+
+// In cells.
+struct shadow_rect
+{
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+struct shadow_cache
+{
+    // Bit x of row y is set if the cell at x, y is dirty.
+    uint32_t dirty_rows[SHADOW_CELL_GRID_SIZE];
+    int caster_capacity;
+    int caster_count;
+    // Bounds of each caster as of its last move.
+    float (*caster_bounds)[4];
+};
+
+// Starts with every cell dirty, since nothing has been rendered yet.
+void shadow_cache_create(struct shadow_cache* cache, int caster_capacity);
+
+void shadow_cache_destroy(struct shadow_cache* cache);
+
+// Returns the index of the new caster, or -1 if the cache is full.
+int shadow_cache_add_caster(struct shadow_cache* cache, const float* bounds);
+
+// Marks the cells under the caster's old and new bounds dirty.
+void shadow_cache_move_caster(struct shadow_cache* cache, int caster,
+                              const float* bounds);
+
+// Marks the cells under bounds dirty, for casters that change shape without
+// moving, such as animated ones.
+void shadow_cache_mark_dirty(struct shadow_cache* cache, const float* bounds);
+
+// Marks every cell dirty.
+void shadow_cache_invalidate(struct shadow_cache* cache);
+
+// Merges the dirty cells into rectangles and writes them to rects, which
+// must have room for SHADOW_CELL_COUNT of them. Returns how many there are.
+// Every cell is clean afterwards.
+int shadow_cache_take_dirty_rects(struct shadow_cache* cache,
+                                  struct shadow_rect* rects);
+
+// Whether the caster has to be rendered when rect is.
+bool shadow_cache_caster_overlaps(const struct shadow_cache* cache,
+                                  int caster, const struct shadow_rect* rect);
+
+#endif // SHADOW_CACHE_H
@@ -0,0 +1,114 @@
+#include "simulation.h"
+#include "memory.h"
+#include <math.h>
+#include <string.h>
+
+void
+simulation_create(struct simulation* simulation, int capacity, double step,
+                  int max_steps)
+{
+    struct simulation_clock* clock = &simulation->clock;
+    clock->step = step;
+    clock->max_steps = max_steps;
+    clock->started = false;
+    clock->start_time = 0.0;
+    clock->step_index = 0;
+    simulation->capacity = capacity;
+    simulation->body_count = 0;
+    simulation->bodies = memory_alloc(capacity * sizeof(struct body));
+    simulation->previous_positions = memory_alloc(capacity * sizeof(float[3]));
+    simulation->stats.step_count = 0;
+    simulation->stats.skipped_step_count = 0;
+}
+
+void
+simulation_destroy(struct simulation* simulation)
+{
+    memory_free(simulation->previous_positions);
+    memory_free(simulation->bodies);
+}
+
+int
+simulation_add_body(struct simulation* simulation, const struct body* body)
+{
+    if (simulation->body_count == simulation->capacity) {
+        return -1;
+    }
+    int index = simulation->body_count++;
+    simulation->bodies[index] = *body;
+    memcpy(simulation->previous_positions[index], body->position,
+           sizeof(float[3]));
+    return index;
+}
+
+static double
+simulation_clock_get_time(const struct simulation_clock* clock)
+{
+    return clock->start_time + clock->step_index * clock->step;
+}
+
+// Semi-implicit Euler, which keeps the energy of a spring from growing.
+static void
+simulation_step(struct simulation* simulation)
+{
+    float dt = simulation->clock.step;
+    for (int i = 0; i < simulation->body_count; ++i) {
+        struct body* body = &simulation->bodies[i];
+        for (int j = 0; j < 3; ++j) {
+            float offset = body->position[j] - body->anchor[j];
+            body->velocity[j] -= body->stiffness * offset * dt;
+            body->position[j] += body->velocity[j] * dt;
+        }
+    }
+}
+
+void
+simulation_advance(struct simulation* simulation, double time)
+{
+    struct simulation_clock* clock = &simulation->clock;
+    if (!clock->started) {
+        clock->started = true;
+        clock->start_time = time;
+        return;
+    }
+    int step_count = 0;
+    while (simulation_clock_get_time(clock) < time) {
+        if (step_count == clock->max_steps) {
+            uint64_t skipped_step_count =
+                ceil((time - simulation_clock_get_time(clock)) / clock->step);
+            // Moves the clock forward without changing the state, so the
+            // simulation time falls behind by the skipped steps.
+            clock->start_time += skipped_step_count * clock->step;
+            simulation->stats.skipped_step_count += skipped_step_count;
+            break;
+        }
+        for (int i = 0; i < simulation->body_count; ++i) {
+            memcpy(simulation->previous_positions[i],
+                   simulation->bodies[i].position, sizeof(float[3]));
+        }
+        simulation_step(simulation);
+        ++clock->step_index;
+        ++step_count;
+    }
+    simulation->stats.step_count += step_count;
+}
+
+void
+simulation_get_position(const struct simulation* simulation, int body,
+                        double time, float* position)
+{
+    const struct simulation_clock* clock = &simulation->clock;
+    double previous_time = simulation_clock_get_time(clock) - clock->step;
+    float t = (time - previous_time) / clock->step;
+    if (t < 0.0) {
+        t = 0.0;
+    } else if (t > 1.0) {
+        t = 1.0;
+    }
+    const float* previous_position = simulation->previous_positions[body];
+    const float* latest_position = simulation->bodies[body].position;
+    for (int i = 0; i < 3; ++i) {
+        position[i] = previous_position[i] +
+                      (latest_position[i] - previous_position[i]) * t;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Advances the scene in steps of a fixed length, independent of the display
+// rate, so that it behaves the same at every refresh rate and can run at a
+// lower rate than the display. The simulation runs until its latest step is
+// at or past the time it is advanced to, and keeps the positions of the step
+// before, so that a frame can interpolate between the two to its display
+// time instead of showing the state of whichever step came last.
+
+struct simulation_clock
+{
+    // Length of a step, in seconds.
+    double step;
+    // Most steps run by a single advance.
+    int max_steps;
+    bool started;
+    // The latest step is at start_time + step_index * step, in seconds,
+    // which doesn't drift the way adding up steps would.
+    double start_time;
+    uint64_t step_index;
+};
+
+// A point pulled towards its anchor by a spring.
+struct body
+{
+    float position[3];
+    float velocity[3];
+    float anchor[3];
+    // Acceleration per meter away from the anchor.
+    float stiffness;
+};
+
+struct simulation_stats
+{
+    uint64_t step_count;
+    // Steps dropped because the simulation fell more than max_steps behind.
+    uint64_t skipped_step_count;
+};
+
+struct simulation
+{
+    struct simulation_clock clock;
+    int capacity;
+    int body_count;
+    struct body* bodies;
+    // Positions at the step before the latest one.
+    float (*previous_positions)[3];
+    struct simulation_stats stats;
+};
+
+void simulation_create(struct simulation* simulation, int capacity,
+                       double step, int max_steps);
+
+void simulation_destroy(struct simulation* simulation);
+
+// Returns the index of the new body, or -1 if the simulation is full.
+int simulation_add_body(struct simulation* simulation,
+                        const struct body* body);
+
+// Runs the steps needed to reach time, in seconds. The first call only
+// starts the clock. If more than max_steps are needed, the rest are dropped,
+// so that a long stall slows the simulation down for a moment instead of
+// making every following frame run too many steps.
+void simulation_advance(struct simulation* simulation, double time);
+
+// Interpolates the position of a body between the last two steps. time
+// should be at most one step before the last advance.
+void simulation_get_position(const struct simulation* simulation, int body,
+                             double time, float* position);
+
+#endif // SIMULATION_H
@@ -0,0 +1,106 @@
+#include "stream_buffer.h"
+#include <android/log.h>
+#include <stdlib.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+static const char* TAG = "stream_buffer";
+
+// The buffer is only ever bound to this target here, so that mapping it
+// doesn't disturb the array and element array buffer bindings.
+static const GLenum TARGET = GL_COPY_WRITE_BUFFER;
+
+void
+stream_buffer_create(struct stream_buffer* stream_buffer,
+                     struct gpu_sync* gpu_sync, size_t region_size)
+{
+    stream_buffer->gpu_sync = gpu_sync;
+    stream_buffer->region_size = region_size;
+    stream_buffer->region_count = gpu_sync->max_frames_in_flight;
+    glGenBuffers(1, &stream_buffer->buffer);
+    glBindBuffer(TARGET, stream_buffer->buffer);
+    glBufferData(TARGET, region_size * stream_buffer->region_count, NULL,
+                 GL_STREAM_DRAW);
+    glBindBuffer(TARGET, 0);
+    stream_buffer->region_offset = 0;
+    stream_buffer->offset = 0;
+    stream_buffer->mapped = false;
+    stream_buffer->stats.allocated_size = 0;
+    stream_buffer->stats.peak_allocated_size = 0;
+}
+
+void
+stream_buffer_destroy(struct stream_buffer* stream_buffer)
+{
+    gpu_sync_delete(stream_buffer->gpu_sync, GPU_OBJECT_BUFFER,
+                    stream_buffer->buffer);
+}
+
+void
+stream_buffer_begin_frame(struct stream_buffer* stream_buffer)
+{
+    if (stream_buffer->mapped) {
+        error("can't begin frame: an allocation is still mapped");
+        exit(EXIT_FAILURE);
+    }
+    // gpu_sync has finished frame_index - max_frames_in_flight, which is
+    // the last frame that used this region.
+    int region =
+        stream_buffer->gpu_sync->frame_index % stream_buffer->region_count;
+    stream_buffer->region_offset = region * stream_buffer->region_size;
+    stream_buffer->offset = stream_buffer->region_offset;
+    stream_buffer->stats.allocated_size = 0;
+}
+
+void*
+stream_buffer_map(struct stream_buffer* stream_buffer, size_t size,
+                  size_t alignment, size_t* offset)
+{
+    if (stream_buffer->mapped) {
+        error("can't map allocation: the last one is still mapped");
+        exit(EXIT_FAILURE);
+    }
+    size_t aligned_offset =
+        (stream_buffer->offset + alignment - 1) & ~(alignment - 1);
+    size_t region_end =
+        stream_buffer->region_offset + stream_buffer->region_size;
+    if (aligned_offset + size > region_end) {
+        error("can't allocate %zu bytes from stream buffer: %zu of %zu bytes "
+              "in use",
+              size, stream_buffer->offset - stream_buffer->region_offset,
+              stream_buffer->region_size);
+        exit(EXIT_FAILURE);
+    }
+    glBindBuffer(TARGET, stream_buffer->buffer);
+    void* pointer = glMapBufferRange(
+        TARGET, aligned_offset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+            GL_MAP_UNSYNCHRONIZED_BIT);
+    if (pointer == NULL) {
+        error("can't map %zu bytes of stream buffer", size);
+        exit(EXIT_FAILURE);
+    }
+    stream_buffer->mapped = true;
+    stream_buffer->offset = aligned_offset + size;
+    stream_buffer->stats.allocated_size =
+        stream_buffer->offset - stream_buffer->region_offset;
+    if (stream_buffer->stats.allocated_size >
+        stream_buffer->stats.peak_allocated_size) {
+        stream_buffer->stats.peak_allocated_size =
+            stream_buffer->stats.allocated_size;
+    }
+    *offset = aligned_offset;
+    return pointer;
+}
+
+void
+stream_buffer_unmap(struct stream_buffer* stream_buffer)
+{
+    if (glUnmapBuffer(TARGET) == GL_FALSE) {
+        // The contents were lost, which only happens in rare cases such as
+        // a mode change. The frame draws garbage, but the next one is fine.
+        error("stream buffer contents lost while mapped");
+    }
+    glBindBuffer(TARGET, 0);
+    stream_buffer->mapped = false;
+}
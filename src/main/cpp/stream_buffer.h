@@ -0,0 +1,59 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include "gpu_sync.h"
+#include <GLES3/gl3.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// A buffer for geometry that changes every frame. It is split into one
+// region per frame in flight, and the region for a frame is only written
+// after gpu_sync_begin_frame has waited for the frame that used it before,
+// so allocations are mapped unsynchronized, without the driver ever having
+// to stall or copy. Allocations return an offset into the buffer that
+// draw calls can use directly. The buffer can't be drawn from while an
+// allocation is mapped.
+
+struct stream_buffer_stats
+{
+    // Bytes allocated during the current frame, and the most allocated
+    // during any frame.
+    size_t allocated_size;
+    size_t peak_allocated_size;
+};
+
+struct stream_buffer
+{
+    GLuint buffer;
+    struct gpu_sync* gpu_sync;
+    size_t region_size;
+    int region_count;
+    // Start of the current frame's region, and offset of the next
+    // allocation in the buffer.
+    size_t region_offset;
+    size_t offset;
+    bool mapped;
+    struct stream_buffer_stats stats;
+};
+
+// Creates a buffer with region_size bytes for each of gpu_sync's frames in
+// flight.
+void stream_buffer_create(struct stream_buffer* stream_buffer,
+                          struct gpu_sync* gpu_sync, size_t region_size);
+
+void stream_buffer_destroy(struct stream_buffer* stream_buffer);
+
+// Starts allocating from the current frame's region. Must be called after
+// gpu_sync_begin_frame.
+void stream_buffer_begin_frame(struct stream_buffer* stream_buffer);
+
+// Allocates size bytes, aligned to alignment, which must be a power of two,
+// and maps them for writing. Returns a pointer to them, and stores their
+// offset in the buffer in offset. Exits if the frame's region is full.
+void* stream_buffer_map(struct stream_buffer* stream_buffer, size_t size,
+                        size_t alignment, size_t* offset);
+
+// Unmaps the last allocation, which must be done before drawing from it.
+void stream_buffer_unmap(struct stream_buffer* stream_buffer);
+
+#endif // STREAM_BUFFER_H
@@ -0,0 +1,316 @@
+#include "text.h"
+#include "memory.h"
+#include <android/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+static const char* TAG = "text";
+
+void
+font_create(struct font* font, const void* data, size_t size)
+{
+    struct font_header* header = &font->header;
+    if (size < sizeof(*header)) {
+        error("can't create font: data too small");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(header, data, sizeof(*header));
+    if (header->magic != FONT_MAGIC) {
+        error("can't create font: not a font atlas");
+        exit(EXIT_FAILURE);
+    }
+    if (header->texels_offset +
+            (size_t)header->atlas_width * header->atlas_height >
+        size) {
+        error("can't create font: atlas texels out of bounds");
+        exit(EXIT_FAILURE);
+    }
+    glGenTextures(1, &font->texture);
+    glBindTexture(GL_TEXTURE_2D, font->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Rows are tightly packed.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, header->atlas_width,
+                 header->atlas_height, 0, GL_RED, GL_UNSIGNED_BYTE,
+                 (const uint8_t*)data + header->texels_offset);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void
+font_destroy(struct font* font)
+{
+    glDeleteTextures(1, &font->texture);
+}
+
+void
+text_batch_create(struct text_batch* batch, const struct font* font)
+{
+    batch->font = font;
+    batch->cached_texts =
+        memory_alloc(MAX_CACHED_TEXTS * sizeof(struct cached_text));
+    for (int i = 0; i < MAX_CACHED_TEXTS; ++i) {
+        struct cached_text* cached_text = &batch->cached_texts[i];
+        cached_text->hash = 0;
+        cached_text->text[0] = '\0';
+        cached_text->batch_index = 0;
+        cached_text->quad_count = 0;
+    }
+    batch->batch_index = 0;
+    batch->text_count = 0;
+    batch->rect_count = 0;
+    batch->quad_count = 0;
+    batch->stats.layout_count = 0;
+    batch->stats.cached_count = 0;
+    batch->stats.quad_count = 0;
+
+    // Every quad is two triangles, so the indices never change.
+    uint16_t* indices = memory_alloc(6 * MAX_BATCH_QUADS * sizeof(uint16_t));
+    for (int i = 0; i < MAX_BATCH_QUADS; ++i) {
+        uint16_t first_vertex = 4 * i;
+        indices[6 * i + 0] = first_vertex + 0;
+        indices[6 * i + 1] = first_vertex + 1;
+        indices[6 * i + 2] = first_vertex + 2;
+        indices[6 * i + 3] = first_vertex + 0;
+        indices[6 * i + 4] = first_vertex + 2;
+        indices[6 * i + 5] = first_vertex + 3;
+    }
+    glGenVertexArrays(1, &batch->vertex_array);
+    glBindVertexArray(batch->vertex_array);
+    glGenBuffers(1, &batch->index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 6 * MAX_BATCH_QUADS * sizeof(uint16_t), indices,
+                 GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    memory_free(indices);
+}
+
+void
+text_batch_destroy(struct text_batch* batch)
+{
+    glDeleteBuffers(1, &batch->index_buffer);
+    glDeleteVertexArrays(1, &batch->vertex_array);
+    memory_free(batch->cached_texts);
+}
+
+void
+text_batch_begin(struct text_batch* batch)
+{
+    ++batch->batch_index;
+    batch->text_count = 0;
+    batch->rect_count = 0;
+    batch->quad_count = 0;
+    batch->stats.layout_count = 0;
+    batch->stats.cached_count = 0;
+}
+
+// FNV-1a.
+static uint32_t
+hash_bytes(uint32_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Vertices go clockwise from the top left corner.
+static void
+write_quad(struct text_vertex* vertices, float x, float y, float width,
+           float height, float s0, float t0, float s1, float t1,
+           uint32_t color)
+{
+    const float positions[4][2] = {
+        { x, y },
+        { x + width, y },
+        { x + width, y + height },
+        { x, y + height },
+    };
+    const float tex_coords[4][2] = {
+        { s0, t0 },
+        { s1, t0 },
+        { s1, t1 },
+        { s0, t1 },
+    };
+    for (int i = 0; i < 4; ++i) {
+        struct text_vertex* vertex = &vertices[i];
+        vertex->position[0] = positions[i][0];
+        vertex->position[1] = positions[i][1];
+        vertex->tex_coord[0] = tex_coords[i][0];
+        vertex->tex_coord[1] = tex_coords[i][1];
+        vertex->color[0] = color >> 24;
+        vertex->color[1] = color >> 16;
+        vertex->color[2] = color >> 8;
+        vertex->color[3] = color;
+    }
+}
+
+static void
+layout_text(const struct font* font, struct cached_text* cached_text)
+{
+    const struct font_header* header = &font->header;
+    float scale = cached_text->size / header->size;
+    float s_scale = 1.0 / header->atlas_width;
+    float t_scale = 1.0 / header->atlas_height;
+    float pen_x = cached_text->x;
+    float baseline = cached_text->y + header->ascender * scale;
+    cached_text->quad_count = 0;
+    for (const char* c = cached_text->text; *c != '\0'; ++c) {
+        if (*c == '\n') {
+            pen_x = cached_text->x;
+            baseline += header->line_height * scale;
+            continue;
+        }
+        int index = (unsigned char)*c - FONT_FIRST_CHARACTER;
+        if (index < 0 || index >= FONT_CHARACTER_COUNT) {
+            index = '?' - FONT_FIRST_CHARACTER;
+        }
+        const struct font_glyph* glyph = &header->glyphs[index];
+        if (glyph->width > 0) {
+            write_quad(&cached_text->vertices[4 * cached_text->quad_count++],
+                       pen_x + glyph->bearing_x * scale,
+                       baseline - glyph->bearing_y * scale,
+                       glyph->width * scale, glyph->height * scale,
+                       glyph->x * s_scale, glyph->y * t_scale,
+                       (glyph->x + glyph->width) * s_scale,
+                       (glyph->y + glyph->height) * t_scale,
+                       cached_text->color);
+        }
+        pen_x += glyph->advance * scale;
+    }
+}
+
+void
+text_batch_add_text(struct text_batch* batch, const char* text, float x,
+                    float y, float size, uint32_t color)
+{
+    size_t length = strlen(text);
+    if (length >= MAX_TEXT_LENGTH) {
+        error("can't add text: %zu characters long, at most %d allowed",
+              length, MAX_TEXT_LENGTH - 1);
+        exit(EXIT_FAILURE);
+    }
+    if (batch->text_count == MAX_BATCH_TEXTS) {
+        error("can't add text: all %d texts in use", MAX_BATCH_TEXTS);
+        exit(EXIT_FAILURE);
+    }
+    uint32_t hash = hash_bytes(2166136261u, text, length);
+    hash = hash_bytes(hash, &x, sizeof(x));
+    hash = hash_bytes(hash, &y, sizeof(y));
+    hash = hash_bytes(hash, &size, sizeof(size));
+    hash = hash_bytes(hash, &color, sizeof(color));
+
+    // Look for the text in the cache, and for the least recently used text
+    // that isn't in this batch, in case it needs to be laid out.
+    int index = -1;
+    int oldest_index = -1;
+    for (int i = 0; i < MAX_CACHED_TEXTS; ++i) {
+        const struct cached_text* cached_text = &batch->cached_texts[i];
+        if (cached_text->hash == hash && cached_text->x == x &&
+            cached_text->y == y && cached_text->size == size &&
+            cached_text->color == color &&
+            strcmp(cached_text->text, text) == 0) {
+            index = i;
+            break;
+        }
+        if (cached_text->batch_index != batch->batch_index &&
+            (oldest_index < 0 ||
+             cached_text->batch_index <
+                 batch->cached_texts[oldest_index].batch_index)) {
+            oldest_index = i;
+        }
+    }
+    struct cached_text* cached_text = NULL;
+    if (index >= 0) {
+        cached_text = &batch->cached_texts[index];
+        ++batch->stats.cached_count;
+    } else {
+        if (oldest_index < 0) {
+            error("can't add text: all %d cached texts in use",
+                  MAX_CACHED_TEXTS);
+            exit(EXIT_FAILURE);
+        }
+        index = oldest_index;
+        cached_text = &batch->cached_texts[index];
+        cached_text->hash = hash;
+        memcpy(cached_text->text, text, length + 1);
+        cached_text->x = x;
+        cached_text->y = y;
+        cached_text->size = size;
+        cached_text->color = color;
+        layout_text(batch->font, cached_text);
+        ++batch->stats.layout_count;
+    }
+    if (batch->quad_count + cached_text->quad_count > MAX_BATCH_QUADS) {
+        error("can't add text: all %d quads in use", MAX_BATCH_QUADS);
+        exit(EXIT_FAILURE);
+    }
+    cached_text->batch_index = batch->batch_index;
+    batch->texts[batch->text_count++] = index;
+    batch->quad_count += cached_text->quad_count;
+}
+
+void
+text_batch_add_rect(struct text_batch* batch, float x, float y, float width,
+                    float height, uint32_t color)
+{
+    if (batch->rect_count == MAX_BATCH_RECTS) {
+        error("can't add rect: all %d rects in use", MAX_BATCH_RECTS);
+        exit(EXIT_FAILURE);
+    }
+    if (batch->quad_count == MAX_BATCH_QUADS) {
+        error("can't add rect: all %d quads in use", MAX_BATCH_QUADS);
+        exit(EXIT_FAILURE);
+    }
+    const struct font_header* header = &batch->font->header;
+    float s = header->solid_x / header->atlas_width;
+    float t = header->solid_y / header->atlas_height;
+    write_quad(&batch->rect_vertices[4 * batch->rect_count++], x, y, width,
+               height, s, t, s, t, color);
+    ++batch->quad_count;
+}
+
+void
+text_batch_draw(struct text_batch* batch, struct stream_buffer* stream_buffer,
+                const struct vertex_layout* layout)
+{
+    batch->stats.quad_count = batch->quad_count;
+    if (batch->quad_count == 0) {
+        return;
+    }
+    size_t offset = 0;
+    struct text_vertex* vertices = stream_buffer_map(
+        stream_buffer, 4 * batch->quad_count * sizeof(struct text_vertex),
+        sizeof(float), &offset);
+    size_t rect_vertex_count = 4 * batch->rect_count;
+    memcpy(vertices, batch->rect_vertices,
+           rect_vertex_count * sizeof(struct text_vertex));
+    vertices += rect_vertex_count;
+    for (int i = 0; i < batch->text_count; ++i) {
+        const struct cached_text* cached_text =
+            &batch->cached_texts[batch->texts[i]];
+        size_t vertex_count = 4 * cached_text->quad_count;
+        memcpy(vertices, cached_text->vertices,
+               vertex_count * sizeof(struct text_vertex));
+        vertices += vertex_count;
+    }
+    stream_buffer_unmap(stream_buffer);
+
+    glBindVertexArray(batch->vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, stream_buffer->buffer);
+    vertex_layout_apply_at(layout, offset);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, batch->font->texture);
+    glDrawElements(GL_TRIANGLES, 6 * batch->quad_count, GL_UNSIGNED_SHORT,
+                   NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
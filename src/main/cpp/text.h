@@ -0,0 +1,106 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include "font.h"
+#include "pipeline.h"
+#include "stream_buffer.h"
+#include <GLES3/gl3.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Text and rectangles are collected into a batch, streamed into a single
+// vertex range, and drawn with one draw call per font atlas. Laying out a
+// string is cached, so text that doesn't change between batches is only
+// copied, not laid out again. Positions are in pixels, from the top left
+// corner of the viewport, with y pointing down.
+
+enum
+{
+    MAX_TEXT_LENGTH = 128,
+    MAX_CACHED_TEXTS = 32,
+    MAX_BATCH_TEXTS = 32,
+    MAX_BATCH_RECTS = 16,
+    // Quads are indexed with 16 bits.
+    MAX_BATCH_QUADS = 4096,
+};
+
+struct font
+{
+    GLuint texture;
+    struct font_header header;
+};
+
+// data must be in the layout described in font.h.
+void font_create(struct font* font, const void* data, size_t size);
+
+void font_destroy(struct font* font);
+
+struct text_vertex
+{
+    float position[2];
+    float tex_coord[2];
+    uint8_t color[4];
+};
+
+struct cached_text
+{
+    uint32_t hash;
+    char text[MAX_TEXT_LENGTH];
+    float x;
+    float y;
+    float size;
+    uint32_t color;
+    // Batch in which the text was last used.
+    uint64_t batch_index;
+    int quad_count;
+    struct text_vertex vertices[4 * MAX_TEXT_LENGTH];
+};
+
+struct text_batch_stats
+{
+    // Texts laid out, and texts found in the cache, during the last batch.
+    int layout_count;
+    int cached_count;
+    int quad_count;
+};
+
+struct text_batch
+{
+    const struct font* font;
+    GLuint vertex_array;
+    GLuint index_buffer;
+    struct cached_text* cached_texts;
+    uint64_t batch_index;
+    int text_count;
+    // Indices into cached_texts, in the order the texts were added.
+    int texts[MAX_BATCH_TEXTS];
+    int rect_count;
+    struct text_vertex rect_vertices[4 * MAX_BATCH_RECTS];
+    int quad_count;
+    struct text_batch_stats stats;
+};
+
+void text_batch_create(struct text_batch* batch, const struct font* font);
+
+void text_batch_destroy(struct text_batch* batch);
+
+void text_batch_begin(struct text_batch* batch);
+
+// Adds a string, at most MAX_TEXT_LENGTH - 1 characters long, whose first
+// line has its top at y. Characters that aren't in the font are drawn as
+// '?'. color is RGBA, with red in the most significant byte.
+void text_batch_add_text(struct text_batch* batch, const char* text, float x,
+                         float y, float size, uint32_t color);
+
+// Adds a filled rectangle. Rectangles are drawn before any text, so that
+// they can serve as backgrounds.
+void text_batch_add_rect(struct text_batch* batch, float x, float y,
+                         float width, float height, uint32_t color);
+
+// Streams the batch into stream_buffer and draws it. Expects a program that
+// takes the vertices through layout to be bound, and uses texture unit 0.
+void text_batch_draw(struct text_batch* batch,
+                     struct stream_buffer* stream_buffer,
+                     const struct vertex_layout* layout);
+
+#endif // TEXT_H
@@ -0,0 +1,335 @@
+#include "texture.h"
+#include <android/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define error(...) __android_log_print(ANDROID_LOG_ERROR, TAG, __VA_ARGS__)
+
+#ifndef NDEBUG
+#define info(...) __android_log_print(ANDROID_LOG_VERBOSE, TAG, __VA_ARGS__)
+#else
+#define info(...) ((void)0)
+#endif // NDEBUG
+
+#ifndef GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR 0x93B0
+#endif // GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+
+#ifndef GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR 0x93D0
+#endif // GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR
+
+static const char* TAG = "texture";
+
+static const uint8_t KTX2_IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n',
+};
+
+struct ktx2_header
+{
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+
+struct ktx2_level
+{
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+enum
+{
+    VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK = 147,
+    VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK = 148,
+    VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK = 149,
+    VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK = 150,
+    VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK = 151,
+    VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK = 152,
+    VK_FORMAT_ASTC_4x4_UNORM_BLOCK = 157,
+    VK_FORMAT_ASTC_12x12_SRGB_BLOCK = 184,
+};
+
+static GLenum
+get_internal_format(uint32_t vk_format)
+{
+    switch (vk_format) {
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+            return GL_COMPRESSED_RGB8_ETC2;
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+            return GL_COMPRESSED_SRGB8_ETC2;
+        case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+            return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+        case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+            return GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+            return GL_COMPRESSED_RGBA8_ETC2_EAC;
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+            return GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC;
+        default:
+            break;
+    }
+    // The ASTC formats come in UNORM/SRGB pairs, in the same block size
+    // order as the GL formats.
+    if (vk_format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK &&
+        vk_format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+        uint32_t index = vk_format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+        return (index % 2 == 0 ? GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+                               : GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR) +
+               index / 2;
+    }
+    return GL_NONE;
+}
+
+static GLsizei
+get_level_size(GLsizei size, int level)
+{
+    size >>= level;
+    return size > 0 ? size : 1;
+}
+
+static void
+texture_upload_level(struct texture* texture, int level)
+{
+    const struct texture_level* texture_level = &texture->levels[level];
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, texture->internal_format,
+                           get_level_size(texture->width, level),
+                           get_level_size(texture->height, level), 0,
+                           texture_level->size,
+                           texture->data + texture_level->offset);
+    texture->resident_size += texture_level->size;
+}
+
+// Creates a new GL texture that holds the levels from first_level down to
+// the coarsest one.
+static void
+texture_create_gl_texture(struct texture* texture, int first_level)
+{
+    glGenTextures(1, &texture->texture);
+    glBindTexture(GL_TEXTURE_2D, texture->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                    texture->level_count - 1);
+    texture->resident_size = 0;
+    for (int level = texture->level_count - 1; level >= first_level;
+         --level) {
+        texture_upload_level(texture, level);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, first_level);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    texture->resident_level = first_level;
+}
+
+void
+texture_manager_create(struct texture_manager* manager,
+                       struct gpu_sync* gpu_sync, size_t upload_budget,
+                       size_t memory_cap)
+{
+    manager->texture_count = 0;
+    manager->gpu_sync = gpu_sync;
+    manager->upload_budget = upload_budget;
+    manager->memory_cap = memory_cap;
+    manager->resident_size = 0;
+    manager->uploaded_size = 0;
+    manager->evicted_size = 0;
+}
+
+void
+texture_manager_destroy(struct texture_manager* manager)
+{
+    for (int i = 0; i < manager->texture_count; ++i) {
+        glDeleteTextures(1, &manager->textures[i].texture);
+    }
+    manager->texture_count = 0;
+    manager->resident_size = 0;
+}
+
+int
+texture_manager_load_ktx2(struct texture_manager* manager, const void* data,
+                          size_t size)
+{
+    if (manager->texture_count == MAX_TEXTURES) {
+        error("can't load texture: all %d textures in use", MAX_TEXTURES);
+        exit(EXIT_FAILURE);
+    }
+
+    struct ktx2_header header;
+    if (size < sizeof(header)) {
+        error("can't load texture: KTX2 data too small");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) !=
+        0) {
+        error("can't load texture: not a KTX2 file");
+        exit(EXIT_FAILURE);
+    }
+    if (header.supercompression_scheme != 0) {
+        error("can't load texture: unsupported supercompression scheme %u",
+              header.supercompression_scheme);
+        exit(EXIT_FAILURE);
+    }
+    if (header.pixel_depth > 1 || header.layer_count > 1 ||
+        header.face_count != 1) {
+        error("can't load texture: only 2D textures are supported");
+        exit(EXIT_FAILURE);
+    }
+    GLenum internal_format = get_internal_format(header.vk_format);
+    if (internal_format == GL_NONE) {
+        error("can't load texture: unsupported format %u", header.vk_format);
+        exit(EXIT_FAILURE);
+    }
+    int level_count = header.level_count > 0 ? header.level_count : 1;
+    if (level_count > MAX_TEXTURE_LEVELS ||
+        sizeof(header) + level_count * sizeof(struct ktx2_level) > size) {
+        error("can't load texture: invalid level count %d", level_count);
+        exit(EXIT_FAILURE);
+    }
+
+    int index = manager->texture_count++;
+    struct texture* texture = &manager->textures[index];
+    texture->internal_format = internal_format;
+    texture->width = header.pixel_width;
+    texture->height = header.pixel_height;
+    texture->level_count = level_count;
+    texture->data = data;
+    for (int level = 0; level < level_count; ++level) {
+        struct ktx2_level ktx2_level;
+        memcpy(&ktx2_level,
+               (const uint8_t*)data + sizeof(header) +
+                   level * sizeof(ktx2_level),
+               sizeof(ktx2_level));
+        // Compared this way, so that huge values can't wrap around.
+        if (ktx2_level.byte_offset > size ||
+            ktx2_level.byte_length > size - ktx2_level.byte_offset) {
+            error("can't load texture: level %d out of bounds", level);
+            exit(EXIT_FAILURE);
+        }
+        texture->levels[level].offset = ktx2_level.byte_offset;
+        texture->levels[level].size = ktx2_level.byte_length;
+    }
+    texture->requested_level = 0;
+
+    info("load texture %d: %dx%d, %d levels, format 0x%x", index,
+         texture->width, texture->height, level_count, internal_format);
+    texture_create_gl_texture(texture, level_count - 1);
+    manager->resident_size += texture->resident_size;
+    return index;
+}
+
+void
+texture_manager_request_level(struct texture_manager* manager, int index,
+                              int level)
+{
+    struct texture* texture = &manager->textures[index];
+    if (level >= texture->level_count) {
+        level = texture->level_count - 1;
+    }
+    texture->requested_level = level > 0 ? level : 0;
+}
+
+// Returns the texture whose next level to stream in is the coarsest, or
+// NULL if there is nothing left to stream in.
+static struct texture*
+texture_manager_find_next_upload(struct texture_manager* manager)
+{
+    struct texture* next_texture = NULL;
+    for (int i = 0; i < manager->texture_count; ++i) {
+        struct texture* texture = &manager->textures[i];
+        if (texture->resident_level <= texture->requested_level) {
+            continue;
+        }
+        if (next_texture == NULL ||
+            texture->resident_level > next_texture->resident_level) {
+            next_texture = texture;
+        }
+    }
+    return next_texture;
+}
+
+// Returns the texture with the largest finest resident level that still
+// has levels it can give up, or NULL if there is none.
+static struct texture*
+texture_manager_find_next_eviction(struct texture_manager* manager)
+{
+    struct texture* next_texture = NULL;
+    size_t next_size = 0;
+    for (int i = 0; i < manager->texture_count; ++i) {
+        struct texture* texture = &manager->textures[i];
+        if (texture->resident_level == texture->level_count - 1) {
+            continue;
+        }
+        size_t size = texture->levels[texture->resident_level].size;
+        if (size > next_size) {
+            next_texture = texture;
+            next_size = size;
+        }
+    }
+    return next_texture;
+}
+
+void
+texture_manager_update(struct texture_manager* manager)
+{
+    manager->uploaded_size = 0;
+    manager->evicted_size = 0;
+
+    // Always allow at least one upload per frame, so that levels bigger than
+    // the budget still get streamed in eventually.
+    for (;;) {
+        struct texture* texture = texture_manager_find_next_upload(manager);
+        if (texture == NULL) {
+            break;
+        }
+        int level = texture->resident_level - 1;
+        size_t size = texture->levels[level].size;
+        if (manager->uploaded_size > 0 &&
+            manager->uploaded_size + size > manager->upload_budget) {
+            break;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture->texture);
+        texture_upload_level(texture, level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        texture->resident_level = level;
+        manager->uploaded_size += size;
+        manager->resident_size += size;
+    }
+
+    // Levels of a texture can't be freed one at a time, so evicting means
+    // recreating the texture without its finest level. The remaining levels
+    // are at most a third of the size of the evicted one.
+    while (manager->resident_size > manager->memory_cap) {
+        struct texture* texture = texture_manager_find_next_eviction(manager);
+        if (texture == NULL) {
+            break;
+        }
+        size_t old_resident_size = texture->resident_size;
+        gpu_sync_delete(manager->gpu_sync, GPU_OBJECT_TEXTURE,
+                        texture->texture);
+        texture_create_gl_texture(texture, texture->resident_level + 1);
+        // Don't stream the evicted level back in until it is requested
+        // again.
+        texture->requested_level = texture->resident_level;
+        manager->evicted_size += old_resident_size - texture->resident_size;
+        manager->resident_size -= old_resident_size - texture->resident_size;
+    }
+}
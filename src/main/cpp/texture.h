@@ -0,0 +1,77 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "gpu_sync.h"
+#include <GLES3/gl3.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Textures are loaded from KTX2 containers with ASTC or ETC2 payloads. Only
+// the coarsest mip level is uploaded when a texture is loaded. Finer levels
+// are streamed in coarse-to-fine, across all textures, under a per-frame
+// upload budget. When the resident texture memory exceeds the cap, the
+// finest levels of the largest textures are evicted until it fits again.
+
+enum
+{
+    MAX_TEXTURES = 256,
+    MAX_TEXTURE_LEVELS = 16,
+};
+
+struct texture_level
+{
+    size_t offset;
+    size_t size;
+};
+
+struct texture
+{
+    GLuint texture;
+    GLenum internal_format;
+    GLsizei width;
+    GLsizei height;
+    int level_count;
+    // Points into the KTX2 data, which must outlive the texture.
+    const uint8_t* data;
+    struct texture_level levels[MAX_TEXTURE_LEVELS];
+    // Finest level that is uploaded. All coarser levels are uploaded too.
+    int resident_level;
+    // Finest level that should be streamed in.
+    int requested_level;
+    size_t resident_size;
+};
+
+struct texture_manager
+{
+    int texture_count;
+    struct texture textures[MAX_TEXTURES];
+    // Evicted textures may still be in use by frames in flight, so they are
+    // deleted through gpu_sync.
+    struct gpu_sync* gpu_sync;
+    size_t upload_budget;
+    size_t memory_cap;
+    size_t resident_size;
+    // Bytes uploaded and evicted during the last update.
+    size_t uploaded_size;
+    size_t evicted_size;
+};
+
+void texture_manager_create(struct texture_manager* manager,
+                            struct gpu_sync* gpu_sync, size_t upload_budget,
+                            size_t memory_cap);
+
+void texture_manager_destroy(struct texture_manager* manager);
+
+// Returns the index of the new texture. data must stay valid until the
+// manager is destroyed.
+int texture_manager_load_ktx2(struct texture_manager* manager,
+                              const void* data, size_t size);
+
+// Sets the finest level that should be streamed in for the texture.
+void texture_manager_request_level(struct texture_manager* manager, int index,
+                                   int level);
+
+// Streams in and evicts levels. Call once per frame.
+void texture_manager_update(struct texture_manager* manager);
+
+#endif // TEXTURE_H
@@ -0,0 +1,158 @@
+#include "transform.h"
+#include "memory.h"
+#include <string.h>
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+void
+transform_hierarchy_create(struct transform_hierarchy* hierarchy,
+                           int capacity)
+{
+    hierarchy->capacity = capacity;
+    hierarchy->count = 0;
+    hierarchy->parents = memory_alloc(capacity * sizeof(int));
+    // memory_alloc returns memory aligned to 16 bytes, so every matrix row
+    // can be loaded into a single vector register.
+    hierarchy->local_matrices = memory_alloc(capacity * sizeof(float[16]));
+    hierarchy->world_matrices = memory_alloc(capacity * sizeof(float[16]));
+    hierarchy->dirty = memory_alloc(capacity * sizeof(bool));
+    hierarchy->first_dirty = 0;
+    hierarchy->update_indices = memory_alloc(capacity * sizeof(int));
+    hierarchy->stats.updated_count = 0;
+}
+
+void
+transform_hierarchy_destroy(struct transform_hierarchy* hierarchy)
+{
+    memory_free(hierarchy->update_indices);
+    memory_free(hierarchy->dirty);
+    memory_free(hierarchy->world_matrices);
+    memory_free(hierarchy->local_matrices);
+    memory_free(hierarchy->parents);
+}
+
+int
+transform_hierarchy_add_node(struct transform_hierarchy* hierarchy,
+                             int parent, const float* local_matrix)
+{
+    if (hierarchy->count == hierarchy->capacity) {
+        return -1;
+    }
+    int node = hierarchy->count++;
+    hierarchy->parents[node] = parent;
+    memcpy(hierarchy->local_matrices[node], local_matrix, sizeof(float[16]));
+    hierarchy->dirty[node] = true;
+    if (node < hierarchy->first_dirty) {
+        hierarchy->first_dirty = node;
+    }
+    return node;
+}
+
+void
+transform_hierarchy_set_local_matrix(struct transform_hierarchy* hierarchy,
+                                     int node, const float* local_matrix)
+{
+    memcpy(hierarchy->local_matrices[node], local_matrix, sizeof(float[16]));
+    hierarchy->dirty[node] = true;
+    if (node < hierarchy->first_dirty) {
+        hierarchy->first_dirty = node;
+    }
+}
+
+// c = a * b. c must not alias a or b.
+static void
+multiply_matrices(float* restrict c, const float* restrict a,
+                  const float* restrict b)
+{
+#if defined(__aarch64__)
+    float32x4_t b0 = vld1q_f32(b + 0);
+    float32x4_t b1 = vld1q_f32(b + 4);
+    float32x4_t b2 = vld1q_f32(b + 8);
+    float32x4_t b3 = vld1q_f32(b + 12);
+    for (int i = 0; i < 4; ++i) {
+        float32x4_t a_row = vld1q_f32(a + 4 * i);
+        float32x4_t c_row = vmulq_laneq_f32(b0, a_row, 0);
+        c_row = vfmaq_laneq_f32(c_row, b1, a_row, 1);
+        c_row = vfmaq_laneq_f32(c_row, b2, a_row, 2);
+        c_row = vfmaq_laneq_f32(c_row, b3, a_row, 3);
+        vst1q_f32(c + 4 * i, c_row);
+    }
+#elif defined(__SSE__)
+    __m128 b0 = _mm_load_ps(b + 0);
+    __m128 b1 = _mm_load_ps(b + 4);
+    __m128 b2 = _mm_load_ps(b + 8);
+    __m128 b3 = _mm_load_ps(b + 12);
+    for (int i = 0; i < 4; ++i) {
+        __m128 c_row = _mm_mul_ps(_mm_set1_ps(a[4 * i + 0]), b0);
+        c_row = _mm_add_ps(c_row, _mm_mul_ps(_mm_set1_ps(a[4 * i + 1]), b1));
+        c_row = _mm_add_ps(c_row, _mm_mul_ps(_mm_set1_ps(a[4 * i + 2]), b2));
+        c_row = _mm_add_ps(c_row, _mm_mul_ps(_mm_set1_ps(a[4 * i + 3]), b3));
+        _mm_store_ps(c + 4 * i, c_row);
+    }
+#else
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            c[4 * i + j] = a[4 * i + 0] * b[0 + j] + a[4 * i + 1] * b[4 + j] +
+                           a[4 * i + 2] * b[8 + j] + a[4 * i + 3] * b[12 + j];
+        }
+    }
+#endif
+}
+
+void
+transform_hierarchy_update(struct transform_hierarchy* hierarchy)
+{
+    // First propagate the dirty flags down to the descendants, gathering the
+    // nodes to recompute, then recompute them in one tight loop. Parents
+    // come before their children in both passes.
+    const int* parents = hierarchy->parents;
+    bool* dirty = hierarchy->dirty;
+    int* update_indices = hierarchy->update_indices;
+    int update_count = 0;
+    for (int node = hierarchy->first_dirty; node < hierarchy->count; ++node) {
+        int parent = parents[node];
+        if (parent >= 0 && dirty[parent]) {
+            dirty[node] = true;
+        }
+        if (dirty[node]) {
+            update_indices[update_count++] = node;
+        }
+    }
+
+    for (int i = 0; i < update_count; ++i) {
+        int node = update_indices[i];
+        int parent = parents[node];
+        if (parent < 0) {
+            memcpy(hierarchy->world_matrices[node],
+                   hierarchy->local_matrices[node], sizeof(float[16]));
+        } else {
+            multiply_matrices(hierarchy->world_matrices[node],
+                              hierarchy->world_matrices[parent],
+                              hierarchy->local_matrices[node]);
+        }
+    }
+
+    for (int i = 0; i < update_count; ++i) {
+        dirty[update_indices[i]] = false;
+    }
+    hierarchy->first_dirty = hierarchy->count;
+    hierarchy->stats.updated_count = update_count;
+}
+
+const float*
+transform_hierarchy_get_world_matrix(
+    const struct transform_hierarchy* hierarchy, int node)
+{
+    return hierarchy->world_matrices[node];
+}
+
+const int*
+transform_hierarchy_get_updated_nodes(
+    const struct transform_hierarchy* hierarchy, int* count)
+{
+    *count = hierarchy->stats.updated_count;
+    return hierarchy->update_indices;
+}
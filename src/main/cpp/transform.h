@@ -0,0 +1,62 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A hierarchy of transforms, stored as one array per field. A node's parent
+// always comes before it, so world matrices can be computed in a single
+// pass in index order. Only the nodes whose local matrix changed since the
+// last update, and their descendants, get their world matrix recomputed.
+//
+// Matrices are 16 floats, row-major with column vectors, the same layout as
+// ovrMatrix4f.
+
+struct transform_stats
+{
+    // World matrices recomputed during the last update.
+    int updated_count;
+};
+
+struct transform_hierarchy
+{
+    int capacity;
+    int count;
+    int* parents;
+    float (*local_matrices)[16];
+    float (*world_matrices)[16];
+    bool* dirty;
+    // Lowest index of a dirty node, or count if there is none.
+    int first_dirty;
+    // Scratch space for the nodes recomputed during an update.
+    int* update_indices;
+    struct transform_stats stats;
+};
+
+void transform_hierarchy_create(struct transform_hierarchy* hierarchy,
+                                int capacity);
+
+void transform_hierarchy_destroy(struct transform_hierarchy* hierarchy);
+
+// parent must be an existing node, or -1 for a root. Returns the index of
+// the new node, or -1 if the hierarchy is full.
+int transform_hierarchy_add_node(struct transform_hierarchy* hierarchy,
+                                 int parent, const float* local_matrix);
+
+void transform_hierarchy_set_local_matrix(
+    struct transform_hierarchy* hierarchy, int node, const float* local_matrix);
+
+// Recomputes the world matrices of every node that changed since the last
+// update.
+void transform_hierarchy_update(struct transform_hierarchy* hierarchy);
+
+// Only valid after an update.
+const float* transform_hierarchy_get_world_matrix(
+    const struct transform_hierarchy* hierarchy, int node);
+
+// Returns the nodes whose world matrix the last update recomputed, and
+// stores their count in count.
+const int* transform_hierarchy_get_updated_nodes(
+    const struct transform_hierarchy* hierarchy, int* count);
+
+#endif // TRANSFORM_H
@@ -0,0 +1,243 @@
+#ifndef VEC4_H
+#define VEC4_H
+
+#include <string.h>
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// Four floats in a vector register, with NEON on the headset, SSE on the
+// build machine, and plain C anywhere else.
+
+#if defined(__aarch64__)
+typedef float32x4_t vec4;
+#elif defined(__SSE__)
+typedef __m128 vec4;
+#else
+typedef struct
+{
+    float v[4];
+} vec4;
+#endif
+
+// p must be aligned to 16 bytes.
+static inline vec4
+vec4_load(const float* p)
+{
+#if defined(__aarch64__)
+    return vld1q_f32(p);
+#elif defined(__SSE__)
+    return _mm_load_ps(p);
+#else
+    vec4 v;
+    memcpy(v.v, p, sizeof(v.v));
+    return v;
+#endif
+}
+
+static inline void
+vec4_store(float* p, vec4 v)
+{
+#if defined(__aarch64__)
+    vst1q_f32(p, v);
+#elif defined(__SSE__)
+    _mm_store_ps(p, v);
+#else
+    memcpy(p, v.v, sizeof(v.v));
+#endif
+}
+
+static inline void
+vec4_store_unaligned(float* p, vec4 v)
+{
+#if defined(__aarch64__)
+    vst1q_f32(p, v);
+#elif defined(__SSE__)
+    _mm_storeu_ps(p, v);
+#else
+    memcpy(p, v.v, sizeof(v.v));
+#endif
+}
+
+static inline vec4
+vec4_splat(float s)
+{
+#if defined(__aarch64__)
+    return vdupq_n_f32(s);
+#elif defined(__SSE__)
+    return _mm_set1_ps(s);
+#else
+    vec4 v = { { s, s, s, s } };
+    return v;
+#endif
+}
+
+static inline vec4
+vec4_sub(vec4 a, vec4 b)
+{
+#if defined(__aarch64__)
+    return vsubq_f32(a, b);
+#elif defined(__SSE__)
+    return _mm_sub_ps(a, b);
+#else
+    for (int i = 0; i < 4; ++i) {
+        a.v[i] -= b.v[i];
+    }
+    return a;
+#endif
+}
+
+static inline vec4
+vec4_mul(vec4 a, vec4 b)
+{
+#if defined(__aarch64__)
+    return vmulq_f32(a, b);
+#elif defined(__SSE__)
+    return _mm_mul_ps(a, b);
+#else
+    for (int i = 0; i < 4; ++i) {
+        a.v[i] *= b.v[i];
+    }
+    return a;
+#endif
+}
+
+// a + b * c.
+static inline vec4
+vec4_madd(vec4 a, vec4 b, vec4 c)
+{
+#if defined(__aarch64__)
+    return vfmaq_f32(a, b, c);
+#elif defined(__SSE__)
+    return _mm_add_ps(a, _mm_mul_ps(b, c));
+#else
+    for (int i = 0; i < 4; ++i) {
+        a.v[i] += b.v[i] * c.v[i];
+    }
+    return a;
+#endif
+}
+
+static inline vec4
+vec4_add(vec4 a, vec4 b)
+{
+#if defined(__aarch64__)
+    return vaddq_f32(a, b);
+#elif defined(__SSE__)
+    return _mm_add_ps(a, b);
+#else
+    for (int i = 0; i < 4; ++i) {
+        a.v[i] += b.v[i];
+    }
+    return a;
+#endif
+}
+
+static inline vec4
+vec4_div(vec4 a, vec4 b)
+{
+#if defined(__aarch64__)
+    return vdivq_f32(a, b);
+#elif defined(__SSE__)
+    return _mm_div_ps(a, b);
+#else
+    for (int i = 0; i < 4; ++i) {
+        a.v[i] /= b.v[i];
+    }
+    return a;
+#endif
+}
+
+static inline vec4
+vec4_min(vec4 a, vec4 b)
+{
+#if defined(__aarch64__)
+    return vminq_f32(a, b);
+#elif defined(__SSE__)
+    return _mm_min_ps(a, b);
+#else
+    for (int i = 0; i < 4; ++i) {
+        a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+    }
+    return a;
+#endif
+}
+
+static inline vec4
+vec4_max(vec4 a, vec4 b)
+{
+#if defined(__aarch64__)
+    return vmaxq_f32(a, b);
+#elif defined(__SSE__)
+    return _mm_max_ps(a, b);
+#else
+    for (int i = 0; i < 4; ++i) {
+        a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+    }
+    return a;
+#endif
+}
+
+// 1 where x >= edge, 0 elsewhere.
+static inline vec4
+vec4_step(vec4 edge, vec4 x)
+{
+#if defined(__aarch64__)
+    return vreinterpretq_f32_u32(
+        vandq_u32(vcgeq_f32(x, edge), vreinterpretq_u32_f32(vdupq_n_f32(1.0))));
+#elif defined(__SSE__)
+    return _mm_and_ps(_mm_cmpge_ps(x, edge), _mm_set1_ps(1.0));
+#else
+    for (int i = 0; i < 4; ++i) {
+        x.v[i] = x.v[i] >= edge.v[i] ? 1.0 : 0.0;
+    }
+    return x;
+#endif
+}
+
+static inline float
+vec4_dot(vec4 a, vec4 b)
+{
+#if defined(__aarch64__)
+    return vaddvq_f32(vmulq_f32(a, b));
+#elif defined(__SSE__)
+    __m128 products = _mm_mul_ps(a, b);
+    __m128 swapped =
+        _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(products, swapped);
+    swapped = _mm_movehl_ps(swapped, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, swapped));
+#else
+    return a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2] +
+           a.v[3] * b.v[3];
+#endif
+}
+
+// Turns the rows r0 to r3 of a 4x4 matrix into its columns.
+static inline void
+vec4_transpose(vec4* r0, vec4* r1, vec4* r2, vec4* r3)
+{
+#if defined(__aarch64__)
+    float32x4x2_t t01 = vtrnq_f32(*r0, *r1);
+    float32x4x2_t t23 = vtrnq_f32(*r2, *r3);
+    *r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    *r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    *r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    *r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+#elif defined(__SSE__)
+    _MM_TRANSPOSE4_PS(*r0, *r1, *r2, *r3);
+#else
+    vec4* rows[4] = { r0, r1, r2, r3 };
+    for (int i = 0; i < 4; ++i) {
+        for (int j = i + 1; j < 4; ++j) {
+            float t = rows[i]->v[j];
+            rows[i]->v[j] = rows[j]->v[i];
+            rows[j]->v[i] = t;
+        }
+    }
+#endif
+}
+
+#endif // VEC4_H
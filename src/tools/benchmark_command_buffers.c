@@ -0,0 +1,274 @@
+// Benchmark for the command buffers in src/main/cpp/command_buffer.c.
+// Records a frame of mixed commands, shaped like the app's draws: a
+// vertex array bind every few draws, and a model matrix, a color and a
+// draw for each object. Measures how long recording takes on one thread
+// and split into chunks across the workers of the job system, and how long
+// replaying takes through command_buffer_execute. GL calls go to stubs
+// that only count them and fold their arguments into a checksum, so replay
+// measures the cost of walking the buffer, not of the driver. Also checks
+// that every way of recording replays the same calls.
+//
+// Usage:
+//
+//     benchmark_command_buffers [command_count] [worker_count]
+
+#include "../main/cpp/command_buffer.h"
+#include "../main/cpp/job.h"
+#include "../main/cpp/memory.h"
+#include <GLES3/gl3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static const int DEFAULT_COMMAND_COUNT = 100000;
+static const int FRAME_COUNT = 100;
+// Each object records a matrix, a color and a draw, and every
+// OBJECTS_PER_VERTEX_ARRAY objects also bind a vertex array first.
+static const int COMMANDS_PER_OBJECT = 3;
+static const int OBJECTS_PER_VERTEX_ARRAY = 8;
+// Same as the app. A multiple of OBJECTS_PER_VERTEX_ARRAY, so that every
+// chunk records the same commands as the single buffer does.
+static const int DRAWS_PER_COMMAND_BUFFER = 256;
+
+// command_buffer_execute replays into these. Every argument goes into the
+// checksum.
+
+static uint64_t gl_call_count;
+static uint64_t gl_checksum;
+
+static void
+gl_call(uint64_t value)
+{
+    ++gl_call_count;
+    gl_checksum = gl_checksum * 31 + value;
+}
+
+void GL_APIENTRY
+glUseProgram(GLuint program)
+{
+    gl_call(program);
+}
+
+void GL_APIENTRY
+glBindVertexArray(GLuint array)
+{
+    gl_call(array);
+}
+
+void GL_APIENTRY
+glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose,
+                   const GLfloat* value)
+{
+    gl_call(location + count + transpose + (uint64_t)value[12]);
+}
+
+void GL_APIENTRY
+glUniform4fv(GLint location, GLsizei count, const GLfloat* value)
+{
+    gl_call(location + count + (uint64_t)value[0]);
+}
+
+void GL_APIENTRY
+glDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+    gl_call(mode + count + type + (uintptr_t)indices);
+}
+
+void GL_APIENTRY
+glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type,
+                        const void* indices, GLsizei instance_count)
+{
+    gl_call(mode + count + type + (uintptr_t)indices + instance_count);
+}
+
+void GL_APIENTRY
+glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    gl_call(mode + first + count);
+}
+
+struct record_data
+{
+    int object_count;
+    struct command_buffer* command_buffers;
+};
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+record_objects(struct command_buffer* command_buffer, int begin, int end)
+{
+    for (int i = begin; i < end; ++i) {
+        if (i % OBJECTS_PER_VERTEX_ARRAY == 0) {
+            command_buffer_bind_vertex_array(command_buffer,
+                                             1 + i / OBJECTS_PER_VERTEX_ARRAY);
+        }
+        float model_matrix[16] = { 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0,
+                                   0.0, 0.0, 1.0, 0.0, i,   0.0, 0.0, 1.0 };
+        command_buffer_set_uniform_matrix4(command_buffer, 0, model_matrix);
+        float color[4] = { i % 7, 0.0, 0.0, 1.0 };
+        command_buffer_set_uniform_vector4(command_buffer, 1, color);
+        if (i % 4 == 0) {
+            command_buffer_draw_arrays(command_buffer, PRIMITIVE_LINES, 0,
+                                       24);
+        } else {
+            command_buffer_draw_elements(command_buffer, PRIMITIVE_TRIANGLES,
+                                         INDEX_TYPE_UINT16, 36, 0,
+                                         1 + i % 2);
+        }
+    }
+}
+
+static void
+record_chunks(void* data, int begin, int end)
+{
+    const struct record_data* record_data = data;
+    for (int chunk = begin; chunk < end; ++chunk) {
+        int first_object = chunk * DRAWS_PER_COMMAND_BUFFER;
+        int last_object = first_object + DRAWS_PER_COMMAND_BUFFER;
+        if (last_object > record_data->object_count) {
+            last_object = record_data->object_count;
+        }
+        record_objects(&record_data->command_buffers[chunk], first_object,
+                       last_object);
+    }
+}
+
+// Upper bound of the bytes that count objects record.
+static size_t
+get_capacity(int count)
+{
+    return count * (sizeof(struct command_bind_vertex_array) +
+                    sizeof(struct command_set_uniform_matrix4) +
+                    sizeof(struct command_set_uniform_vector4) +
+                    sizeof(struct command_draw_elements));
+}
+
+static void
+replay(const struct command_buffer* command_buffers, int count,
+       uint64_t* call_count, uint64_t* checksum)
+{
+    gl_call_count = 0;
+    gl_checksum = 0;
+    for (int i = 0; i < count; ++i) {
+        command_buffer_execute(&command_buffers[i]);
+    }
+    *call_count = gl_call_count;
+    *checksum = gl_checksum;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 3) {
+        fprintf(stderr, "usage: %s [command_count] [worker_count]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    int command_count = argc > 1 ? atoi(argv[1]) : DEFAULT_COMMAND_COUNT;
+    int worker_count =
+        argc > 2 ? atoi(argv[2]) : sysconf(_SC_NPROCESSORS_ONLN);
+    // A group of OBJECTS_PER_VERTEX_ARRAY objects records one command more
+    // than COMMANDS_PER_OBJECT each.
+    int commands_per_group = OBJECTS_PER_VERTEX_ARRAY * COMMANDS_PER_OBJECT + 1;
+    int object_count =
+        command_count / commands_per_group * OBJECTS_PER_VERTEX_ARRAY;
+    if (object_count < 1) {
+        fprintf(stderr, "need at least %d commands\n", commands_per_group);
+        return EXIT_FAILURE;
+    }
+    if (worker_count < 1 || worker_count > MAX_WORKERS) {
+        fprintf(stderr, "need 1 to %d workers\n", MAX_WORKERS);
+        return EXIT_FAILURE;
+    }
+    int chunk_count = (object_count + DRAWS_PER_COMMAND_BUFFER - 1) /
+                      DRAWS_PER_COMMAND_BUFFER;
+
+    struct arena arena;
+    // Enough for the chunks, which is also enough for the single buffer.
+    arena_create(&arena,
+                 chunk_count * (get_capacity(DRAWS_PER_COMMAND_BUFFER) +
+                                sizeof(struct command_buffer) + 16));
+    struct job_system job_system;
+    job_system_create(&job_system, worker_count, false);
+
+    // Recorded on one thread, into a single buffer.
+    double record_time = 0.0;
+    double replay_time = 0.0;
+    uint64_t call_count = 0;
+    uint64_t checksum = 0;
+    int recorded_command_count = 0;
+    size_t recorded_size = 0;
+    for (int frame = 0; frame < FRAME_COUNT; ++frame) {
+        arena_reset(&arena);
+        double start_time = get_time();
+        struct command_buffer command_buffer;
+        command_buffer_create(&command_buffer, &arena,
+                              get_capacity(object_count));
+        record_objects(&command_buffer, 0, object_count);
+        double end_time = get_time();
+        record_time += end_time - start_time;
+        replay(&command_buffer, 1, &call_count, &checksum);
+        replay_time += get_time() - end_time;
+        recorded_command_count = command_buffer.command_count;
+        recorded_size = command_buffer.size;
+    }
+
+    // Recorded in chunks of DRAWS_PER_COMMAND_BUFFER objects across the
+    // workers, like the app does.
+    double parallel_record_time = 0.0;
+    double parallel_replay_time = 0.0;
+    uint64_t parallel_call_count = 0;
+    uint64_t parallel_checksum = 0;
+    for (int frame = 0; frame < FRAME_COUNT; ++frame) {
+        arena_reset(&arena);
+        double start_time = get_time();
+        struct record_data record_data;
+        record_data.object_count = object_count;
+        record_data.command_buffers = arena_alloc(
+            &arena, chunk_count * sizeof(struct command_buffer),
+            _Alignof(struct command_buffer));
+        for (int i = 0; i < chunk_count; ++i) {
+            command_buffer_create(&record_data.command_buffers[i], &arena,
+                                  get_capacity(DRAWS_PER_COMMAND_BUFFER));
+        }
+        job_parallel_for(&job_system, 0, chunk_count, 1, record_chunks,
+                         &record_data);
+        double end_time = get_time();
+        parallel_record_time += end_time - start_time;
+        replay(record_data.command_buffers, chunk_count, &parallel_call_count,
+               &parallel_checksum);
+        parallel_replay_time += get_time() - end_time;
+    }
+    job_system_destroy(&job_system);
+    arena_destroy(&arena);
+
+    printf("%d commands, %zu bytes, %d objects, %d frames\n",
+           recorded_command_count, recorded_size, object_count, FRAME_COUNT);
+    printf("record, 1 thread:    %7.3f ms/frame, %6.1f M commands/s\n",
+           record_time * 1000.0 / FRAME_COUNT,
+           recorded_command_count * FRAME_COUNT / record_time * 1e-6);
+    printf("record, %d workers:   %7.3f ms/frame, %6.1f M commands/s\n",
+           worker_count, parallel_record_time * 1000.0 / FRAME_COUNT,
+           recorded_command_count * FRAME_COUNT / parallel_record_time * 1e-6);
+    printf("replay:              %7.3f ms/frame, %6.1f M commands/s\n",
+           replay_time * 1000.0 / FRAME_COUNT,
+           call_count * FRAME_COUNT / replay_time * 1e-6);
+    printf("replay, %d chunks:  %7.3f ms/frame, %6.1f M commands/s\n",
+           chunk_count, parallel_replay_time * 1000.0 / FRAME_COUNT,
+           parallel_call_count * FRAME_COUNT / parallel_replay_time * 1e-6);
+    if (call_count != (uint64_t)recorded_command_count ||
+        parallel_call_count != call_count || parallel_checksum != checksum) {
+        fprintf(stderr, "the chunks replayed different calls\n");
+        return EXIT_FAILURE;
+    }
+    printf("both ways of recording replayed the same calls\n");
+    return EXIT_SUCCESS;
+}
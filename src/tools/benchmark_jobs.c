@@ -0,0 +1,151 @@
+// Benchmark for the job system in src/main/cpp/job.c. Runs frames of a
+// synthetic workload through job_parallel_for with 1 to N workers, and
+// reports the time per frame and the speedup over a single worker. A frame
+// is shaped like the app's: many small items, like the objects whose draws
+// get recorded, a few dozen medium ones, like the characters whose
+// animations get sampled, and two big ones, like the eyes whose lights get
+// binned. Also checks that every worker count computes the same results.
+//
+// Usage:
+//
+//     benchmark_jobs [max_worker_count]
+//
+// The speedup is bounded by the cores of the machine it runs on.
+
+#include "../main/cpp/job.h"
+#include "../main/cpp/memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const int FRAME_COUNT = 200;
+static const int WARMUP_FRAME_COUNT = 10;
+
+struct stage
+{
+    int item_count;
+    int grain_size;
+    // Iterations of the inner loop per item, to set its cost.
+    int iteration_count;
+};
+
+static const struct stage STAGES[] = {
+    { 10000, 256, 20 },
+    { 64, 8, 2000 },
+    { 2, 1, 40000 },
+};
+
+enum
+{
+    STAGE_COUNT = sizeof(STAGES) / sizeof(STAGES[0]),
+};
+
+struct stage_data
+{
+    const struct stage* stage;
+    float* results;
+    int frame;
+};
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Iterates a rotation, so that every item costs the same, and the result
+// depends on every iteration.
+static void
+run_items(void* data, int begin, int end)
+{
+    const struct stage_data* stage_data = data;
+    for (int i = begin; i < end; ++i) {
+        float x = 1.0 + 0.001 * i + 0.01 * stage_data->frame;
+        float y = 0.0;
+        for (int j = 0; j < stage_data->stage->iteration_count; ++j) {
+            float next_x = 0.99995 * x - 0.0099998 * y;
+            y = 0.0099998 * x + 0.99995 * y;
+            x = next_x;
+        }
+        stage_data->results[i] = x + y;
+    }
+}
+
+static void
+run_frame(struct job_system* job_system, float** results, int frame)
+{
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        struct stage_data stage_data = { &STAGES[i], results[i], frame };
+        job_parallel_for(job_system, 0, STAGES[i].item_count,
+                         STAGES[i].grain_size, run_items, &stage_data);
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [max_worker_count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_worker_count = argc > 1 ? atoi(argv[1]) : cpu_count;
+    if (max_worker_count < 1 || max_worker_count > MAX_WORKERS) {
+        fprintf(stderr, "need 1 to %d workers\n", MAX_WORKERS);
+        return EXIT_FAILURE;
+    }
+
+    float* results[STAGE_COUNT];
+    float* expected_results[STAGE_COUNT];
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        results[i] = memory_alloc(STAGES[i].item_count * sizeof(float));
+        expected_results[i] =
+            memory_alloc(STAGES[i].item_count * sizeof(float));
+    }
+
+    printf("%ld cores online, %d frames\n", cpu_count, FRAME_COUNT);
+    double single_worker_time = 0.0;
+    for (int worker_count = 1; worker_count <= max_worker_count;
+         ++worker_count) {
+        struct job_system job_system;
+        job_system_create(&job_system, worker_count, false);
+        for (int frame = 0; frame < WARMUP_FRAME_COUNT; ++frame) {
+            run_frame(&job_system, results, frame);
+        }
+        double start_time = get_time();
+        for (int frame = 0; frame < FRAME_COUNT; ++frame) {
+            run_frame(&job_system, results, frame);
+        }
+        double time = (get_time() - start_time) / FRAME_COUNT;
+        job_system_destroy(&job_system);
+
+        // The results of the last frame only depend on the items, not on
+        // which worker computed them.
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            size_t size = STAGES[i].item_count * sizeof(float);
+            if (worker_count == 1) {
+                memcpy(expected_results[i], results[i], size);
+            } else if (memcmp(expected_results[i], results[i], size) != 0) {
+                fprintf(stderr, "%d workers computed different results\n",
+                        worker_count);
+                return EXIT_FAILURE;
+            }
+        }
+        if (worker_count == 1) {
+            single_worker_time = time;
+        }
+        printf("%d workers: %7.3f ms/frame, speedup %.2fx\n", worker_count,
+               time * 1000.0, single_worker_time / time);
+    }
+    printf("every worker count computed the same results\n");
+
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        memory_free(expected_results[i]);
+        memory_free(results[i]);
+    }
+    return EXIT_SUCCESS;
+}
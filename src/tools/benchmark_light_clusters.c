@@ -0,0 +1,285 @@
+// Benchmark for the light binning in src/main/cpp/light_clusters.c. For 1 to
+// 1024 point lights scattered through a room, measures on one thread how
+// long binning the lights into the clusters of both eyes takes per frame.
+// Also checks that every point of every light falls in a cluster that
+// lists the light.
+//
+// Usage:
+//
+//     benchmark_light_clusters [max_radius]
+
+#include "../main/cpp/light_clusters.h"
+#include "../main/cpp/memory.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const float DEFAULT_MAX_RADIUS = 1.0;
+static const float MIN_RADIUS = 0.25;
+// Tangents of the half angles of the left eye's field of view, left, right,
+// down and up, roughly those of a Quest 2. The right eye's are mirrored.
+static const float EYE_TAN_ANGLES[4] = { 1.0, 0.85, 1.15, 0.9 };
+static const float NEAR = 0.1;
+static const float CLUSTER_FAR = 20.0;
+static const float IPD = 0.064;
+// The lights are in a box in front of the eyes.
+static const float ROOM_MIN[3] = { -5.0, -1.5, -10.0 };
+static const float ROOM_MAX[3] = { 5.0, 1.5, 1.0 };
+static const int FRAME_COUNT = 100;
+static const int LIGHT_COUNTS[] = { 1, 4, 16, 64, 256, 1024 };
+static const int CHECKED_POINTS_PER_LIGHT = 256;
+
+enum
+{
+    EYE_COUNT = 2,
+    MAX_LIGHT_COUNT = 1024,
+};
+
+// light_clusters.c allocates with memory_alloc, but memory.c logs through
+// Android, so the benchmark provides its own.
+void*
+memory_alloc(size_t size)
+{
+    void* pointer = aligned_alloc(16, (size + 15) / 16 * 16);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+void
+memory_free(void* pointer)
+{
+    free(pointer);
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float
+random_float(float min, float max)
+{
+    return min + (max - min) * rand() / RAND_MAX;
+}
+
+// Like ovrMatrix4f_CreateProjectionFov, with the far plane at infinity.
+static void
+make_projection_matrix(float* matrix, const float* tan_angles)
+{
+    float width = tan_angles[0] + tan_angles[1];
+    float height = tan_angles[2] + tan_angles[3];
+    memset(matrix, 0, sizeof(float[16]));
+    matrix[0] = 2.0 / width;
+    matrix[2] = (tan_angles[1] - tan_angles[0]) / width;
+    matrix[5] = 2.0 / height;
+    matrix[6] = (tan_angles[3] - tan_angles[2]) / height;
+    matrix[10] = -1.0;
+    matrix[11] = -2.0 * NEAR;
+    matrix[14] = -1.0;
+}
+
+// The cluster that the fragment shader would shade point with, or -1 if the
+// point is outside the frustum.
+static int
+get_cluster(const struct cluster_frustum* frustum,
+            const float* projection_matrix, const float* point)
+{
+    const float* v = frustum->view_matrix;
+    float view[3];
+    for (int i = 0; i < 3; ++i) {
+        view[i] = v[4 * i + 0] * point[0] + v[4 * i + 1] * point[1] +
+                  v[4 * i + 2] * point[2] + v[4 * i + 3];
+    }
+    float depth = -view[2];
+    if (depth <= NEAR) {
+        return -1;
+    }
+    const float* p = projection_matrix;
+    float ndc_x = (p[0] * view[0] + p[2] * view[2]) / depth;
+    float ndc_y = (p[5] * view[1] + p[6] * view[2]) / depth;
+    if (fabsf(ndc_x) >= 1.0 || fabsf(ndc_y) >= 1.0) {
+        return -1;
+    }
+    int x = (0.5 * ndc_x + 0.5) * CLUSTER_GRID_WIDTH;
+    int y = (0.5 * ndc_y + 0.5) * CLUSTER_GRID_HEIGHT;
+    int slice = floorf(log2f(depth) * frustum->slice_scale +
+                       frustum->slice_bias);
+    if (slice < 0) {
+        slice = 0;
+    } else if (slice > CLUSTER_GRID_DEPTH - 1) {
+        slice = CLUSTER_GRID_DEPTH - 1;
+    }
+    return (slice * CLUSTER_GRID_HEIGHT + y) * CLUSTER_GRID_WIDTH + x;
+}
+
+static bool
+cluster_has_light(const struct light_clusters* light_clusters, int cluster,
+                  int light)
+{
+    const struct cluster* c = &light_clusters->clusters[cluster];
+    for (uint32_t i = 0; i < c->count; ++i) {
+        if (light_clusters->indices[c->offset + i] == (uint32_t)light) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns how many points inside the lights fall in a cluster that doesn't
+// list their light.
+static int
+check_clusters(const struct light_clusters* light_clusters,
+               const struct cluster_frustum* frustum,
+               const float* projection_matrix,
+               const struct point_light* lights, int light_count)
+{
+    int missed_count = 0;
+    for (int light = 0; light < light_count; ++light) {
+        const float* position_radius = lights[light].position_radius;
+        for (int i = 0; i < CHECKED_POINTS_PER_LIGHT; ++i) {
+            float offset[3];
+            do {
+                for (int j = 0; j < 3; ++j) {
+                    offset[j] = random_float(-1.0, 1.0);
+                }
+            } while (offset[0] * offset[0] + offset[1] * offset[1] +
+                         offset[2] * offset[2] >
+                     1.0);
+            float point[3];
+            for (int j = 0; j < 3; ++j) {
+                point[j] = position_radius[j] + offset[j] * position_radius[3];
+            }
+            int cluster = get_cluster(frustum, projection_matrix, point);
+            if (cluster >= 0 &&
+                !cluster_has_light(light_clusters, cluster, light)) {
+                ++missed_count;
+            }
+        }
+    }
+    return missed_count;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [max_radius]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    float max_radius = argc > 1 ? atof(argv[1]) : DEFAULT_MAX_RADIUS;
+    if (max_radius < MIN_RADIUS) {
+        fprintf(stderr, "max radius must be at least %.2f\n", MIN_RADIUS);
+        return EXIT_FAILURE;
+    }
+
+    struct cluster_frustum frustums[EYE_COUNT];
+    float projection_matrices[EYE_COUNT][16];
+    for (int eye = 0; eye < EYE_COUNT; ++eye) {
+        float tan_angles[4];
+        memcpy(tan_angles, EYE_TAN_ANGLES, sizeof(tan_angles));
+        if (eye == 1) {
+            tan_angles[0] = EYE_TAN_ANGLES[1];
+            tan_angles[1] = EYE_TAN_ANGLES[0];
+        }
+        make_projection_matrix(projection_matrices[eye], tan_angles);
+        float view_matrix[16] = {
+            1.0, 0.0, 0.0, (eye == 0 ? 0.5 : -0.5) * IPD, //
+            0.0, 1.0, 0.0, 0.0,                           //
+            0.0, 0.0, 1.0, 0.0,                           //
+            0.0, 0.0, 0.0, 1.0,                           //
+        };
+        cluster_frustum_init(&frustums[eye], view_matrix,
+                             projection_matrices[eye], CLUSTER_FAR);
+    }
+    struct light_clusters light_clusters[EYE_COUNT];
+    for (int eye = 0; eye < EYE_COUNT; ++eye) {
+        light_clusters_create(&light_clusters[eye], MAX_LIGHT_COUNT);
+    }
+    struct point_light* lights =
+        memory_alloc(MAX_LIGHT_COUNT * sizeof(struct point_light));
+    for (int i = 0; i < MAX_LIGHT_COUNT; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            lights[i].position_radius[j] =
+                random_float(ROOM_MIN[j], ROOM_MAX[j]);
+            lights[i].color[j] = random_float(0.0, 1.0);
+        }
+        lights[i].position_radius[3] = random_float(MIN_RADIUS, max_radius);
+        lights[i].color[3] = 0.0;
+    }
+    // Large enough for any light to be in every cluster.
+    void* output = memory_alloc(CLUSTER_COUNT * sizeof(struct cluster) +
+                                (size_t)MAX_LIGHT_COUNT * CLUSTER_COUNT *
+                                    sizeof(uint32_t));
+
+    // Check every light count before timing anything.
+    for (size_t i = 0; i < sizeof(LIGHT_COUNTS) / sizeof(int); ++i) {
+        for (int eye = 0; eye < EYE_COUNT; ++eye) {
+            light_clusters_bin(&light_clusters[eye], &frustums[eye], lights,
+                               LIGHT_COUNTS[i]);
+            int missed_count = check_clusters(
+                &light_clusters[eye], &frustums[eye],
+                projection_matrices[eye], lights, LIGHT_COUNTS[i]);
+            if (missed_count > 0) {
+                fprintf(stderr,
+                        "%d lights, eye %d: %d points in clusters that don't "
+                        "list their light\n",
+                        LIGHT_COUNTS[i], eye, missed_count);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    printf("every point is in a cluster that lists its light\n");
+
+    printf("%dx%dx%d clusters per eye, radius %.2f to %.2f m, %d frames\n",
+           CLUSTER_GRID_WIDTH, CLUSTER_GRID_HEIGHT, CLUSTER_GRID_DEPTH,
+           MIN_RADIUS, max_radius, FRAME_COUNT);
+    for (size_t i = 0; i < sizeof(LIGHT_COUNTS) / sizeof(int); ++i) {
+        int light_count = LIGHT_COUNTS[i];
+        double bin_time = 0.0;
+        double write_time = 0.0;
+        int index_count = 0;
+        uint32_t max_cluster_light_count = 0;
+        for (int frame = 0; frame < FRAME_COUNT; ++frame) {
+            for (int eye = 0; eye < EYE_COUNT; ++eye) {
+                double start_time = get_time();
+                light_clusters_bin(&light_clusters[eye], &frustums[eye],
+                                   lights, light_count);
+                double binned_time = get_time();
+                light_clusters_write(&light_clusters[eye], output);
+                bin_time += binned_time - start_time;
+                write_time += get_time() - binned_time;
+            }
+        }
+        for (int eye = 0; eye < EYE_COUNT; ++eye) {
+            index_count += light_clusters[eye].index_count;
+            for (int j = 0; j < CLUSTER_COUNT; ++j) {
+                uint32_t count = light_clusters[eye].clusters[j].count;
+                if (count > max_cluster_light_count) {
+                    max_cluster_light_count = count;
+                }
+            }
+        }
+        printf("%5d lights: %7.3f ms/frame binning, %7.3f ms/frame writing, "
+               "%6.2f lights/cluster, at most %u\n",
+               light_count, bin_time * 1000.0 / FRAME_COUNT,
+               write_time * 1000.0 / FRAME_COUNT,
+               (double)index_count / (EYE_COUNT * CLUSTER_COUNT),
+               max_cluster_light_count);
+    }
+
+    memory_free(output);
+    memory_free(lights);
+    for (int eye = 0; eye < EYE_COUNT; ++eye) {
+        light_clusters_destroy(&light_clusters[eye]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+// Benchmark for the animation sampler and CPU skinning in
+// src/main/cpp/animation.c. For each number of characters, measures on one
+// thread what a frame costs on the CPU with GPU skinning, which only samples
+// the palettes, and with CPU skinning, which also skins the vertices. Also
+// checks the skinned vertices against a plain implementation.
+//
+// Usage:
+//
+//     benchmark_skinning [vertex_count]
+
+#include "../main/cpp/animation.h"
+#include "../main/cpp/memory.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const int DEFAULT_VERTEX_COUNT = 297;
+static const int JOINT_COUNT = 8;
+static const int CLIP_FRAME_COUNT = 32;
+static const float CLIP_FRAME_RATE = 16.0;
+static const int FRAME_COUNT = 100;
+static const int CHARACTER_COUNTS[] = { 10, 50, 100, 250, 500 };
+
+// animation.c allocates with memory_alloc, but memory.c logs through
+// Android, so the benchmark provides its own.
+void*
+memory_alloc(size_t size)
+{
+    void* pointer = aligned_alloc(16, (size + 15) / 16 * 16);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+void
+memory_free(void* pointer)
+{
+    free(pointer);
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float
+random_float(float min, float max)
+{
+    return min + (max - min) * rand() / RAND_MAX;
+}
+
+// A rotation by a random angle around a random axis, and a translation of
+// 0.05 along y, like a joint in a chain.
+static struct joint_pose
+random_pose(void)
+{
+    float axis[3] = { random_float(-1.0, 1.0), random_float(-1.0, 1.0),
+                      random_float(-1.0, 1.0) };
+    float length =
+        sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    float angle = random_float(-0.5, 0.5);
+    struct joint_pose pose;
+    for (int i = 0; i < 3; ++i) {
+        pose.rotation[i] = axis[i] / length * sinf(0.5 * angle);
+    }
+    pose.rotation[3] = cosf(0.5 * angle);
+    pose.translation[0] = 0.0;
+    pose.translation[1] = 0.05;
+    pose.translation[2] = 0.0;
+    pose.translation[3] = 0.0;
+    return pose;
+}
+
+// Blends the matrices and transforms the position, one float at a time.
+static void
+skin_vertex_reference(const struct skinned_vertex* vertex,
+                      const float (*palette)[16], float* position)
+{
+    float matrix[16] = { 0.0 };
+    for (int i = 0; i < 4; ++i) {
+        float weight = vertex->joint_weights[i] / 255.0;
+        for (int j = 0; j < 16; ++j) {
+            matrix[j] += weight * palette[vertex->joint_indices[i]][j];
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        position[i] = matrix[4 * i + 0] * vertex->position[0] +
+                      matrix[4 * i + 1] * vertex->position[1] +
+                      matrix[4 * i + 2] * vertex->position[2] +
+                      matrix[4 * i + 3];
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [vertex_count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int vertex_count = argc > 1 ? atoi(argv[1]) : DEFAULT_VERTEX_COUNT;
+    if (vertex_count < 1) {
+        fprintf(stderr, "need at least 1 vertex\n");
+        return EXIT_FAILURE;
+    }
+
+    static struct skeleton skeleton;
+    skeleton.joint_count = JOINT_COUNT;
+    struct joint_pose bind_pose[JOINT_COUNT];
+    for (int i = 0; i < JOINT_COUNT; ++i) {
+        skeleton.parents[i] = i - 1;
+        bind_pose[i] = random_pose();
+    }
+    skeleton_set_bind_pose(&skeleton, bind_pose);
+    struct animation_clip clips[2];
+    for (int i = 0; i < 2; ++i) {
+        animation_clip_create(&clips[i], JOINT_COUNT, CLIP_FRAME_COUNT,
+                              CLIP_FRAME_RATE);
+        for (int frame = 0; frame < CLIP_FRAME_COUNT; ++frame) {
+            struct joint_pose* poses =
+                animation_clip_get_frame(&clips[i], frame);
+            for (int joint = 0; joint < JOINT_COUNT; ++joint) {
+                poses[joint] = random_pose();
+            }
+        }
+    }
+
+    struct skinned_vertex* vertices =
+        memory_alloc(vertex_count * sizeof(struct skinned_vertex));
+    for (int i = 0; i < vertex_count; ++i) {
+        struct skinned_vertex* vertex = &vertices[i];
+        for (int j = 0; j < 3; ++j) {
+            vertex->position[j] = random_float(-0.1, 0.4);
+        }
+        vertex->position[3] = 1.0;
+        for (int j = 0; j < 4; ++j) {
+            vertex->color[j] = random_float(0.0, 1.0);
+        }
+        int remaining_weight = 255;
+        for (int j = 0; j < 4; ++j) {
+            vertex->joint_indices[j] = rand() % JOINT_COUNT;
+            vertex->joint_weights[j] =
+                j < 3 ? rand() % (remaining_weight + 1) : remaining_weight;
+            remaining_weight -= vertex->joint_weights[j];
+        }
+    }
+
+    int max_character_count = 0;
+    for (size_t i = 0; i < sizeof(CHARACTER_COUNTS) / sizeof(int); ++i) {
+        if (CHARACTER_COUNTS[i] > max_character_count) {
+            max_character_count = CHARACTER_COUNTS[i];
+        }
+    }
+    float(*palettes)[MAX_JOINTS][16] =
+        memory_alloc(max_character_count * sizeof(float[MAX_JOINTS][16]));
+    struct vertex* skinned_vertices = memory_alloc(
+        (size_t)max_character_count * vertex_count * sizeof(struct vertex));
+
+    // Check a few characters before timing anything.
+    double max_error = 0.0;
+    for (int character = 0; character < 10; ++character) {
+        struct animation_layer layers[2] = {
+            { &clips[0], 0.13 * character, 0.3 },
+            { &clips[1], 0.29 * character, 0.7 },
+        };
+        animation_sample(&skeleton, layers, 2, palettes[0]);
+        skin_vertices(vertices, vertex_count, JOINT_COUNT,
+                      (const float(*)[16])palettes[0], skinned_vertices);
+        for (int i = 0; i < vertex_count; ++i) {
+            float position[3];
+            skin_vertex_reference(&vertices[i],
+                                  (const float(*)[16])palettes[0], position);
+            for (int j = 0; j < 3; ++j) {
+                float error = position[j] - skinned_vertices[i].position[j];
+                max_error = fmax(max_error, fabs(error));
+            }
+        }
+    }
+    printf("max error against the reference: %g\n", max_error);
+    if (max_error > 1e-5) {
+        fprintf(stderr, "skinned vertices don't match the reference\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("%d joints, %d vertices per character, %d frames\n", JOINT_COUNT,
+           vertex_count, FRAME_COUNT);
+    for (size_t i = 0; i < sizeof(CHARACTER_COUNTS) / sizeof(int); ++i) {
+        int character_count = CHARACTER_COUNTS[i];
+        double sample_time = 0.0;
+        double skin_time = 0.0;
+        for (int frame = 0; frame < FRAME_COUNT; ++frame) {
+            double start_time = get_time();
+            for (int character = 0; character < character_count;
+                 ++character) {
+                float time = frame / 72.0 + 0.37 * character;
+                struct animation_layer layers[2] = {
+                    { &clips[0], time, 0.5 + 0.5 * sinf(time) },
+                    { &clips[1], time, 0.5 - 0.5 * sinf(time) },
+                };
+                animation_sample(&skeleton, layers, 2, palettes[character]);
+            }
+            double sampled_time = get_time();
+            for (int character = 0; character < character_count;
+                 ++character) {
+                skin_vertices(vertices, vertex_count, JOINT_COUNT,
+                              (const float(*)[16])palettes[character],
+                              &skinned_vertices[(size_t)character *
+                                                vertex_count]);
+            }
+            sample_time += sampled_time - start_time;
+            skin_time += get_time() - sampled_time;
+        }
+        printf("%4d characters: gpu skinning %7.3f ms/frame, cpu skinning "
+               "%7.3f ms/frame\n",
+               character_count, sample_time * 1000.0 / FRAME_COUNT,
+               (sample_time + skin_time) * 1000.0 / FRAME_COUNT);
+    }
+
+    memory_free(skinned_vertices);
+    memory_free(palettes);
+    memory_free(vertices);
+    for (int i = 0; i < 2; ++i) {
+        animation_clip_destroy(&clips[i]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+// Benchmark for the transform hierarchy in src/main/cpp/transform.c. Builds
+// a hierarchy of node_count nodes and measures how long an update takes
+// when 1%, 10% and 100% of the nodes change every frame.
+//
+// Usage:
+//
+//     benchmark_transforms [node_count]
+
+#include "../main/cpp/memory.h"
+#include "../main/cpp/transform.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const int DEFAULT_NODE_COUNT = 100000;
+// Every node has this many children, so the hierarchy is
+// log(node_count) / log(BRANCHING_FACTOR) levels deep.
+static const int BRANCHING_FACTOR = 4;
+static const int FRAME_COUNT = 100;
+static const float CHANGED_FRACTIONS[] = { 0.01, 0.1, 1.0 };
+
+// transform.c allocates with memory_alloc, but memory.c logs through
+// Android, so the benchmark provides its own.
+void*
+memory_alloc(size_t size)
+{
+    void* pointer = aligned_alloc(16, (size + 15) / 16 * 16);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+void
+memory_free(void* pointer)
+{
+    free(pointer);
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+make_local_matrix(float* matrix, float angle)
+{
+    float c = cosf(angle);
+    float s = sinf(angle);
+    const float m[16] = {
+        c,   0.0, s,   0.1, //
+        0.0, 1.0, 0.0, 0.2, //
+        -s,  0.0, c,   0.0, //
+        0.0, 0.0, 0.0, 1.0, //
+    };
+    for (int i = 0; i < 16; ++i) {
+        matrix[i] = m[i];
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    int node_count = argc == 2 ? atoi(argv[1]) : DEFAULT_NODE_COUNT;
+    if (argc > 2 || node_count <= 0) {
+        fprintf(stderr, "usage: %s [node_count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct transform_hierarchy hierarchy;
+    transform_hierarchy_create(&hierarchy, node_count);
+    float local_matrix[16];
+    make_local_matrix(local_matrix, 0.0);
+    for (int i = 0; i < node_count; ++i) {
+        int parent = i == 0 ? -1 : (i - 1) / BRANCHING_FACTOR;
+        transform_hierarchy_add_node(&hierarchy, parent, local_matrix);
+    }
+    transform_hierarchy_update(&hierarchy);
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(CHANGED_FRACTIONS) / sizeof(float); ++i) {
+        int changed_count = CHANGED_FRACTIONS[i] * node_count;
+        double total_time = 0.0;
+        long updated_count = 0;
+        for (int frame = 0; frame < FRAME_COUNT; ++frame) {
+            make_local_matrix(local_matrix, 0.01 * frame);
+            for (int j = 0; j < changed_count; ++j) {
+                int node = changed_count == node_count ? j : rand() % node_count;
+                transform_hierarchy_set_local_matrix(&hierarchy, node,
+                                                     local_matrix);
+            }
+            double start_time = get_time();
+            transform_hierarchy_update(&hierarchy);
+            total_time += get_time() - start_time;
+            updated_count += hierarchy.stats.updated_count;
+        }
+        printf("%d nodes, %.0f%% changed: %.3f ms per update, %ld world "
+               "matrices recomputed per update\n",
+               node_count, 100.0 * CHANGED_FRACTIONS[i],
+               1000.0 * total_time / FRAME_COUNT, updated_count / FRAME_COUNT);
+    }
+
+    transform_hierarchy_destroy(&hierarchy);
+    return EXIT_SUCCESS;
+}
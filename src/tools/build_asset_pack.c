@@ -0,0 +1,348 @@
+// Asset pack builder. Packs files into an asset pack in the layout described
+// in src/main/cpp/asset_pack.h, each one named after the last component of
+// its path.
+//
+// Usage:
+//
+//     build_asset_pack output.pak input...
+//     build_asset_pack --benchmark entry_count
+//
+// With --benchmark, a pack of entry_count small assets is built in a
+// temporary file instead, and the time taken to map it and to locate every
+// asset in it is reported, along with the time taken to read the whole file
+// for comparison.
+
+#include "../main/cpp/asset_pack.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const size_t BENCHMARK_MIN_ASSET_SIZE = 16;
+static const size_t BENCHMARK_MAX_ASSET_SIZE = 4096;
+static const int BENCHMARK_OPEN_COUNT = 100;
+static const int BENCHMARK_LOCATE_ROUNDS = 10;
+
+enum
+{
+    MAX_NAME_SIZE = 64,
+};
+
+struct asset
+{
+    char name[MAX_NAME_SIZE];
+    size_t name_size;
+    const void* data;
+    size_t size;
+};
+
+static void*
+allocate(size_t size)
+{
+    void* pointer = malloc(size > 0 ? size : 1);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t
+align(size_t offset)
+{
+    return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT *
+           ASSET_PACK_ALIGNMENT;
+}
+
+// Lays out the assets into a pack, and returns it. Stores its size in
+// pack_size. Exits if two assets have the same name.
+static char*
+build_pack(const struct asset* assets, int asset_count, size_t* pack_size)
+{
+    uint32_t slot_count = 1;
+    while (slot_count < 2 * (uint32_t)asset_count) {
+        slot_count *= 2;
+    }
+    size_t slots_offset = sizeof(struct asset_pack_header);
+    size_t names_offset =
+        slots_offset + slot_count * sizeof(struct asset_pack_entry);
+    size_t size = names_offset;
+    for (int i = 0; i < asset_count; ++i) {
+        size += assets[i].name_size;
+    }
+    for (int i = 0; i < asset_count; ++i) {
+        size = align(size) + assets[i].size;
+    }
+    if (size > UINT32_MAX) {
+        fprintf(stderr, "can't pack %zu bytes: offsets are 32 bits\n", size);
+        exit(EXIT_FAILURE);
+    }
+
+    char* pack = allocate(size);
+    memset(pack, 0, size);
+    struct asset_pack_header* header = (struct asset_pack_header*)pack;
+    header->magic = ASSET_PACK_MAGIC;
+    header->entry_count = asset_count;
+    header->slot_count = slot_count;
+    header->slots_offset = slots_offset;
+    struct asset_pack_entry* slots =
+        (struct asset_pack_entry*)(pack + slots_offset);
+    size_t name_offset = names_offset;
+    size_t data_offset = names_offset;
+    for (int i = 0; i < asset_count; ++i) {
+        data_offset += assets[i].name_size;
+    }
+    for (int i = 0; i < asset_count; ++i) {
+        const struct asset* asset = &assets[i];
+        uint32_t hash = asset_pack_hash(asset->name, asset->name_size);
+        uint32_t slot = hash & (slot_count - 1);
+        while (slots[slot].name_size != 0) {
+            if (slots[slot].hash == hash &&
+                slots[slot].name_size == asset->name_size &&
+                memcmp(pack + slots[slot].name_offset, asset->name,
+                       asset->name_size) == 0) {
+                fprintf(stderr, "can't pack two assets named %s\n",
+                        asset->name);
+                exit(EXIT_FAILURE);
+            }
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        data_offset = align(data_offset);
+        struct asset_pack_entry* entry = &slots[slot];
+        entry->hash = hash;
+        entry->name_offset = name_offset;
+        entry->name_size = asset->name_size;
+        entry->data_offset = data_offset;
+        entry->data_size = asset->size;
+        memcpy(pack + name_offset, asset->name, asset->name_size);
+        memcpy(pack + data_offset, asset->data, asset->size);
+        name_offset += asset->name_size;
+        data_offset += asset->size;
+    }
+    *pack_size = size;
+    return pack;
+}
+
+static void
+write_file(const char* path, const void* data, size_t size)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (fwrite(data, 1, size, file) != size || fclose(file) != 0) {
+        fprintf(stderr, "can't write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void*
+read_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (length < 0) {
+        fprintf(stderr, "can't get the size of %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    void* data = allocate(length);
+    if (fread(data, 1, length, file) != (size_t)length) {
+        fprintf(stderr, "can't read %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    *size = length;
+    return data;
+}
+
+static int
+pack_files(const char* output_path, char** input_paths, int input_count)
+{
+    struct asset* assets = allocate(input_count * sizeof(struct asset));
+    for (int i = 0; i < input_count; ++i) {
+        const char* slash = strrchr(input_paths[i], '/');
+        const char* name = slash != NULL ? slash + 1 : input_paths[i];
+        assets[i].name_size = strlen(name);
+        if (assets[i].name_size == 0 ||
+            assets[i].name_size >= MAX_NAME_SIZE) {
+            fprintf(stderr, "can't pack %s: name must be 1 to %d bytes\n",
+                    input_paths[i], MAX_NAME_SIZE - 1);
+            return EXIT_FAILURE;
+        }
+        memcpy(assets[i].name, name, assets[i].name_size + 1);
+        assets[i].data = read_file(input_paths[i], &assets[i].size);
+    }
+    size_t pack_size = 0;
+    char* pack = build_pack(assets, input_count, &pack_size);
+    write_file(output_path, pack, pack_size);
+    printf("packed %d assets into %zu bytes\n", input_count, pack_size);
+    free(pack);
+    for (int i = 0; i < input_count; ++i) {
+        free((void*)assets[i].data);
+    }
+    free(assets);
+    return EXIT_SUCCESS;
+}
+
+static int
+benchmark(int entry_count)
+{
+    struct asset* assets = allocate(entry_count * sizeof(struct asset));
+    char* data = allocate(BENCHMARK_MAX_ASSET_SIZE);
+    for (size_t i = 0; i < BENCHMARK_MAX_ASSET_SIZE; ++i) {
+        data[i] = i;
+    }
+    for (int i = 0; i < entry_count; ++i) {
+        assets[i].name_size = snprintf(assets[i].name, MAX_NAME_SIZE,
+                                       "meshes/asset_%06d.mesh", i);
+        // Every asset starts at a different byte of data, so that finding
+        // the wrong one is caught.
+        assets[i].size =
+            BENCHMARK_MIN_ASSET_SIZE +
+            rand() % (BENCHMARK_MAX_ASSET_SIZE - BENCHMARK_MIN_ASSET_SIZE);
+        assets[i].data = data + i % 256;
+        if (i % 256 + assets[i].size > BENCHMARK_MAX_ASSET_SIZE) {
+            assets[i].size = BENCHMARK_MAX_ASSET_SIZE - i % 256;
+        }
+    }
+    size_t pack_size = 0;
+    char* pack = build_pack(assets, entry_count, &pack_size);
+    char path[] = "/tmp/asset_pack_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "can't create a temporary file\n");
+        return EXIT_FAILURE;
+    }
+    close(fd);
+    write_file(path, pack, pack_size);
+    free(pack);
+
+    // Locates the assets in a shuffled order, so that consecutive lookups
+    // don't hit neighboring slots.
+    int* order = allocate(entry_count * sizeof(int));
+    for (int i = 0; i < entry_count; ++i) {
+        order[i] = i;
+    }
+    for (int i = entry_count - 1; i > 0; --i) {
+        int j = rand() % (i + 1);
+        int swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+
+    const char** found_data = allocate(entry_count * sizeof(char*));
+    size_t* found_sizes = allocate(entry_count * sizeof(size_t));
+    double open_time = 0.0;
+    double first_locate_time = 0.0;
+    for (int i = 0; i < BENCHMARK_OPEN_COUNT; ++i) {
+        struct asset_pack asset_pack;
+        double start_time = get_time();
+        if (!asset_pack_map_file(&asset_pack, path)) {
+            fprintf(stderr, "can't map %s\n", path);
+            return EXIT_FAILURE;
+        }
+        double opened_time = get_time();
+        for (int j = 0; j < entry_count; ++j) {
+            found_sizes[j] = 0;
+            found_data[j] = asset_pack_find(
+                &asset_pack, assets[order[j]].name, &found_sizes[j]);
+        }
+        open_time += opened_time - start_time;
+        first_locate_time += get_time() - opened_time;
+        for (int j = 0; j < entry_count; ++j) {
+            const struct asset* asset = &assets[order[j]];
+            if (found_data[j] == NULL || found_sizes[j] != asset->size ||
+                (uintptr_t)found_data[j] % ASSET_PACK_ALIGNMENT != 0 ||
+                memcmp(found_data[j], asset->data, asset->size) != 0) {
+                fprintf(stderr, "can't find %s\n", asset->name);
+                return EXIT_FAILURE;
+            }
+        }
+        asset_pack_unmap_file(&asset_pack);
+    }
+    printf("every asset was found with the right size and data\n");
+
+    struct asset_pack asset_pack;
+    asset_pack_map_file(&asset_pack, path);
+    size_t missing_size = 0;
+    if (asset_pack_find(&asset_pack, "missing.mesh", &missing_size) != NULL) {
+        fprintf(stderr, "found an asset that isn't in the pack\n");
+        return EXIT_FAILURE;
+    }
+    double start_time = get_time();
+    size_t total_size = 0;
+    for (int round = 0; round < BENCHMARK_LOCATE_ROUNDS; ++round) {
+        for (int i = 0; i < entry_count; ++i) {
+            size_t size = 0;
+            asset_pack_find(&asset_pack, assets[order[i]].name, &size);
+            total_size += size;
+        }
+    }
+    double locate_time = get_time() - start_time;
+    asset_pack_unmap_file(&asset_pack);
+
+    start_time = get_time();
+    for (int i = 0; i < BENCHMARK_OPEN_COUNT; ++i) {
+        size_t size = 0;
+        free(read_file(path, &size));
+    }
+    double read_time = get_time() - start_time;
+    unlink(path);
+
+    printf("%d assets, %zu bytes\n", entry_count, pack_size);
+    printf("open: %.3f ms\n", open_time * 1000.0 / BENCHMARK_OPEN_COUNT);
+    printf("locate every asset, first time after opening: %.3f ms\n",
+           first_locate_time * 1000.0 / BENCHMARK_OPEN_COUNT);
+    printf("locate every asset, warm: %.3f ms, %.1f ns/asset (%zu bytes)\n",
+           locate_time * 1000.0 / BENCHMARK_LOCATE_ROUNDS,
+           locate_time * 1e9 / ((double)BENCHMARK_LOCATE_ROUNDS * entry_count),
+           total_size / BENCHMARK_LOCATE_ROUNDS);
+    printf("read the whole pack instead: %.3f ms\n",
+           read_time * 1000.0 / BENCHMARK_OPEN_COUNT);
+
+    free(found_sizes);
+    free(found_data);
+    free(order);
+    free(data);
+    free(assets);
+    return EXIT_SUCCESS;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc == 3 && strcmp(argv[1], "--benchmark") == 0) {
+        int entry_count = atoi(argv[2]);
+        if (entry_count <= 0) {
+            fprintf(stderr, "entry count must be positive\n");
+            return EXIT_FAILURE;
+        }
+        return benchmark(entry_count);
+    }
+    if (argc < 3) {
+        fprintf(stderr,
+                "usage: %s output.pak input...\n"
+                "       %s --benchmark entry_count\n",
+                argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    return pack_files(argv[1], argv + 2, argc - 2);
+}
@@ -0,0 +1,285 @@
+// Font atlas generator. Renders the printable ASCII characters of a TrueType
+// font with FreeType, turns each of them into a signed distance field, packs
+// them into an atlas in the layout described in src/main/cpp/font.h, and
+// writes the atlas as a C source file that defines FONT_DATA.
+//
+// Usage:
+//
+//     generate_font_atlas font.ttf output.c
+//
+// Each glyph is rendered at SUPERSAMPLING times the atlas size, and the
+// distance of each atlas texel to the outline is the distance to the
+// nearest supersampled pixel on the other side of it.
+
+#include "../main/cpp/font.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Size of the em square in the atlas, in texels.
+static const int GLYPH_SIZE = 32;
+static const int SUPERSAMPLING = 8;
+// Texels around each outline that the distance field spans.
+static const int DISTANCE_RANGE = 4;
+static const int ATLAS_WIDTH = 512;
+// Texels between glyphs, so that filtering never bleeds between them.
+static const int GLYPH_SPACING = 1;
+static const int SOLID_SIZE = 4;
+
+struct bitmap
+{
+    int width;
+    int height;
+    // One byte per pixel, nonzero inside the outline.
+    uint8_t* pixels;
+};
+
+struct field
+{
+    int width;
+    int height;
+    uint8_t* texels;
+};
+
+static void*
+allocate(size_t size)
+{
+    void* pointer = calloc(size > 0 ? size : 1, 1);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool
+bitmap_is_inside(const struct bitmap* bitmap, int x, int y)
+{
+    if (x < 0 || x >= bitmap->width || y < 0 || y >= bitmap->height) {
+        return false;
+    }
+    return bitmap->pixels[y * bitmap->width + x] != 0;
+}
+
+// The field covers the bitmap, scaled down by SUPERSAMPLING, plus
+// DISTANCE_RANGE texels on each side.
+static void
+field_create(struct field* field, const struct bitmap* bitmap)
+{
+    field->width = (bitmap->width + SUPERSAMPLING - 1) / SUPERSAMPLING +
+                   2 * DISTANCE_RANGE;
+    field->height = (bitmap->height + SUPERSAMPLING - 1) / SUPERSAMPLING +
+                    2 * DISTANCE_RANGE;
+    field->texels = allocate((size_t)field->width * field->height);
+    int radius = DISTANCE_RANGE * SUPERSAMPLING;
+    for (int y = 0; y < field->height; ++y) {
+        for (int x = 0; x < field->width; ++x) {
+            int center_x = (x - DISTANCE_RANGE) * SUPERSAMPLING +
+                           SUPERSAMPLING / 2;
+            int center_y = (y - DISTANCE_RANGE) * SUPERSAMPLING +
+                           SUPERSAMPLING / 2;
+            bool inside = bitmap_is_inside(bitmap, center_x, center_y);
+            int min_distance_squared = radius * radius;
+            for (int dy = -radius; dy <= radius; ++dy) {
+                for (int dx = -radius; dx <= radius; ++dx) {
+                    int distance_squared = dx * dx + dy * dy;
+                    if (distance_squared < min_distance_squared &&
+                        bitmap_is_inside(bitmap, center_x + dx,
+                                         center_y + dy) != inside) {
+                        min_distance_squared = distance_squared;
+                    }
+                }
+            }
+            float distance =
+                sqrtf(min_distance_squared) / SUPERSAMPLING / DISTANCE_RANGE;
+            float value = 0.5 + 0.5 * (inside ? distance : -distance);
+            if (value < 0.0) {
+                value = 0.0;
+            } else if (value > 1.0) {
+                value = 1.0;
+            }
+            field->texels[y * field->width + x] = lrintf(value * 255.0);
+        }
+    }
+}
+
+struct packer
+{
+    int x;
+    int y;
+    int row_height;
+};
+
+static void
+packer_add(struct packer* packer, int width, int height, int* x, int* y)
+{
+    if (packer->x + width > ATLAS_WIDTH) {
+        packer->x = 0;
+        packer->y += packer->row_height + GLYPH_SPACING;
+        packer->row_height = 0;
+    }
+    *x = packer->x;
+    *y = packer->y;
+    packer->x += width + GLYPH_SPACING;
+    if (height > packer->row_height) {
+        packer->row_height = height;
+    }
+}
+
+static void
+write_source(const char* path, const uint8_t* data, size_t size)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(file,
+            "// Generated by generate_font_atlas. Do not edit.\n"
+            "\n"
+            "#include \"font.h\"\n"
+            "\n"
+            "const uint8_t FONT_DATA[] __attribute__((aligned(8))) = {");
+    for (size_t i = 0; i < size; ++i) {
+        fprintf(file, "%s%u,", i % 16 == 0 ? "\n    " : " ", data[i]);
+    }
+    fprintf(file, "\n};\n"
+                  "\n"
+                  "const size_t FONT_DATA_SIZE = sizeof(FONT_DATA);\n");
+    if (fclose(file) != 0) {
+        fprintf(stderr, "can't write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s font.ttf output.c\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    double start_time = get_time();
+
+    FT_Library library;
+    if (FT_Init_FreeType(&library) != 0) {
+        fprintf(stderr, "can't initialize FreeType\n");
+        return EXIT_FAILURE;
+    }
+    FT_Face face;
+    if (FT_New_Face(library, argv[1], 0, &face) != 0) {
+        fprintf(stderr, "can't open font %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    if (FT_Set_Pixel_Sizes(face, 0, GLYPH_SIZE * SUPERSAMPLING) != 0) {
+        fprintf(stderr, "can't set font size\n");
+        return EXIT_FAILURE;
+    }
+
+    struct font_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = FONT_MAGIC;
+    header.atlas_width = ATLAS_WIDTH;
+    header.size = GLYPH_SIZE;
+    header.distance_range = DISTANCE_RANGE;
+    header.ascender =
+        face->size->metrics.ascender / 64.0 / SUPERSAMPLING;
+    header.line_height =
+        face->size->metrics.height / 64.0 / SUPERSAMPLING;
+
+    struct packer packer = { 0, 0, 0 };
+    int solid_x = 0;
+    int solid_y = 0;
+    packer_add(&packer, SOLID_SIZE, SOLID_SIZE, &solid_x, &solid_y);
+    header.solid_x = solid_x + 0.5 * SOLID_SIZE;
+    header.solid_y = solid_y + 0.5 * SOLID_SIZE;
+
+    struct field fields[FONT_CHARACTER_COUNT];
+    for (int i = 0; i < FONT_CHARACTER_COUNT; ++i) {
+        int character = FONT_FIRST_CHARACTER + i;
+        if (FT_Load_Char(face, character, FT_LOAD_RENDER) != 0) {
+            fprintf(stderr, "can't render character %d\n", character);
+            return EXIT_FAILURE;
+        }
+        FT_GlyphSlot slot = face->glyph;
+        struct font_glyph* glyph = &header.glyphs[i];
+        glyph->advance = slot->advance.x / 64.0 / SUPERSAMPLING;
+        struct field* field = &fields[i];
+        if (slot->bitmap.width == 0 || slot->bitmap.rows == 0) {
+            field->width = 0;
+            field->height = 0;
+            field->texels = NULL;
+            continue;
+        }
+
+        struct bitmap bitmap;
+        bitmap.width = slot->bitmap.width;
+        bitmap.height = slot->bitmap.rows;
+        bitmap.pixels = allocate((size_t)bitmap.width * bitmap.height);
+        for (int y = 0; y < bitmap.height; ++y) {
+            for (int x = 0; x < bitmap.width; ++x) {
+                bitmap.pixels[y * bitmap.width + x] =
+                    slot->bitmap.buffer[y * slot->bitmap.pitch + x] >= 128;
+            }
+        }
+        field_create(field, &bitmap);
+        free(bitmap.pixels);
+
+        int x = 0;
+        int y = 0;
+        packer_add(&packer, field->width, field->height, &x, &y);
+        glyph->x = x;
+        glyph->y = y;
+        glyph->width = field->width;
+        glyph->height = field->height;
+        glyph->bearing_x =
+            (float)slot->bitmap_left / SUPERSAMPLING - DISTANCE_RANGE;
+        glyph->bearing_y =
+            (float)slot->bitmap_top / SUPERSAMPLING + DISTANCE_RANGE;
+    }
+    FT_Done_Face(face);
+    FT_Done_FreeType(library);
+
+    uint32_t atlas_height = 1;
+    while (atlas_height < (uint32_t)(packer.y + packer.row_height)) {
+        atlas_height *= 2;
+    }
+    header.atlas_height = atlas_height;
+    header.texels_offset = sizeof(header);
+    size_t size = sizeof(header) + (size_t)ATLAS_WIDTH * atlas_height;
+    uint8_t* data = allocate(size);
+    memcpy(data, &header, sizeof(header));
+    uint8_t* texels = data + header.texels_offset;
+    for (int y = 0; y < SOLID_SIZE; ++y) {
+        memset(texels + (solid_y + y) * ATLAS_WIDTH + solid_x, 255,
+               SOLID_SIZE);
+    }
+    for (int i = 0; i < FONT_CHARACTER_COUNT; ++i) {
+        const struct font_glyph* glyph = &header.glyphs[i];
+        const struct field* field = &fields[i];
+        for (int y = 0; y < field->height; ++y) {
+            memcpy(texels + (glyph->y + y) * ATLAS_WIDTH + glyph->x,
+                   field->texels + y * field->width, field->width);
+        }
+        free(field->texels);
+    }
+    write_source(argv[2], data, size);
+    free(data);
+
+    printf("%d glyphs in a %dx%u atlas in %.2f s\n", FONT_CHARACTER_COUNT,
+           ATLAS_WIDTH, atlas_height, get_time() - start_time);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,36 @@
+#ifndef ANDROID_LOG_H
+#define ANDROID_LOG_H
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// Stand-in for the NDK's <android/log.h>, so that modules in src/main/cpp
+// that log can be built for the tools in src/tools, by adding src/tools/host
+// to the include path. Warnings and errors go to stderr, and the rest is
+// dropped, so that it doesn't get mixed with the tools' output.
+
+enum
+{
+    ANDROID_LOG_VERBOSE = 2,
+    ANDROID_LOG_DEBUG = 3,
+    ANDROID_LOG_INFO = 4,
+    ANDROID_LOG_WARN = 5,
+    ANDROID_LOG_ERROR = 6,
+};
+
+static inline int
+__android_log_print(int priority, const char* tag, const char* format, ...)
+{
+    if (priority < ANDROID_LOG_WARN) {
+        return 0;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s: ", tag);
+    int result = vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+    return result;
+}
+
+#endif // ANDROID_LOG_H
@@ -0,0 +1,806 @@
+#include "fake_gl.h"
+#include <EGL/egl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+static const char* const TYPE_NAMES[FAKE_GL_OBJECT_TYPE_COUNT] = {
+    "none",         "buffer", "texture", "vertex array", "framebuffer",
+    "renderbuffer", "fence",  "context", "surface",
+};
+
+enum
+{
+    MAX_LEVELS = 16,
+};
+
+struct object
+{
+    enum fake_gl_object_type type;
+    // Only used by buffers. The storage comes from mmap rather than malloc,
+    // so that, like a real driver's, it doesn't show up in heap allocation
+    // counts.
+    void* data;
+    size_t size;
+    bool mapped;
+    // Only used by textures.
+    size_t level_sizes[MAX_LEVELS];
+    // Only used by fences.
+    double signal_time;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+// Indexed by name. Name 0 is never used.
+static struct object objects[FAKE_GL_MAX_OBJECTS];
+static GLuint next_name = 1;
+static int live_counts[FAKE_GL_OBJECT_TYPE_COUNT];
+static double fence_latency;
+static uint64_t draw_count;
+static struct fake_gl_texture_upload
+    texture_uploads[FAKE_GL_MAX_TEXTURE_UPLOADS];
+static int texture_upload_count;
+
+// Per thread, like the bindings of a context.
+static _Thread_local GLuint array_buffer;
+static _Thread_local GLuint element_array_buffer;
+static _Thread_local GLuint copy_read_buffer;
+static _Thread_local GLuint copy_write_buffer;
+static _Thread_local GLuint uniform_buffer;
+static _Thread_local GLuint bound_texture;
+
+static void
+fail(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "fake GL: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(EXIT_FAILURE);
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Must be called while holding the mutex. Names are handed out in a cycle,
+// so that a deleted name isn't reused right away.
+static GLuint
+create_object(enum fake_gl_object_type type)
+{
+    for (int i = 1; i < FAKE_GL_MAX_OBJECTS; ++i) {
+        GLuint name = next_name;
+        next_name = next_name + 1 < FAKE_GL_MAX_OBJECTS ? next_name + 1 : 1;
+        struct object* object = &objects[name];
+        if (object->type == FAKE_GL_NONE) {
+            memset(object, 0, sizeof(*object));
+            object->type = type;
+            ++live_counts[type];
+            return name;
+        }
+    }
+    fail("can't create %s: all %d objects in use", TYPE_NAMES[type],
+         FAKE_GL_MAX_OBJECTS - 1);
+    return 0;
+}
+
+// Must be called while holding the mutex.
+static struct object*
+get_object(enum fake_gl_object_type type, GLuint name)
+{
+    if (name == 0 || name >= FAKE_GL_MAX_OBJECTS ||
+        objects[name].type != type) {
+        fail("%u is not a %s", name, TYPE_NAMES[type]);
+    }
+    return &objects[name];
+}
+
+static void
+create_objects(enum fake_gl_object_type type, GLsizei count, GLuint* names)
+{
+    pthread_mutex_lock(&mutex);
+    for (GLsizei i = 0; i < count; ++i) {
+        names[i] = create_object(type);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+// Name 0 is ignored, like GL does.
+static void
+delete_objects(enum fake_gl_object_type type, GLsizei count,
+               const GLuint* names)
+{
+    pthread_mutex_lock(&mutex);
+    for (GLsizei i = 0; i < count; ++i) {
+        if (names[i] == 0) {
+            continue;
+        }
+        struct object* object = get_object(type, names[i]);
+        if (object->data != NULL) {
+            munmap(object->data, object->size);
+        }
+        object->type = FAKE_GL_NONE;
+        --live_counts[type];
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+static GLuint*
+get_buffer_binding(GLenum target)
+{
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return &array_buffer;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return &element_array_buffer;
+        case GL_COPY_READ_BUFFER:
+            return &copy_read_buffer;
+        case GL_COPY_WRITE_BUFFER:
+            return &copy_write_buffer;
+        case GL_UNIFORM_BUFFER:
+            return &uniform_buffer;
+        default:
+            fail("unsupported buffer target 0x%x", target);
+            return NULL;
+    }
+}
+
+// Must be called while holding the mutex.
+static struct object*
+get_bound_buffer(GLenum target)
+{
+    GLuint name = *get_buffer_binding(target);
+    if (name == 0) {
+        fail("no buffer bound to 0x%x", target);
+    }
+    return get_object(FAKE_GL_BUFFER, name);
+}
+
+static size_t
+get_texel_size(GLenum format)
+{
+    switch (format) {
+        case GL_RED:
+            return 1;
+        case GL_RG:
+            return 2;
+        case GL_RGB:
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+static void
+upload_texture_level(GLint level, GLsizei width, GLsizei height,
+                     size_t size)
+{
+    if (level < 0 || level >= MAX_LEVELS) {
+        fail("texture level %d out of range", level);
+    }
+    pthread_mutex_lock(&mutex);
+    struct object* object = get_object(FAKE_GL_TEXTURE, bound_texture);
+    object->level_sizes[level] = size;
+    if (texture_upload_count < FAKE_GL_MAX_TEXTURE_UPLOADS) {
+        struct fake_gl_texture_upload* upload =
+            &texture_uploads[texture_upload_count];
+        upload->texture = bound_texture;
+        upload->level = level;
+        upload->width = width;
+        upload->height = height;
+        upload->size = size;
+    }
+    ++texture_upload_count;
+    pthread_mutex_unlock(&mutex);
+}
+
+void
+fake_gl_set_fence_latency(double latency)
+{
+    pthread_mutex_lock(&mutex);
+    fence_latency = latency;
+    pthread_mutex_unlock(&mutex);
+}
+
+int
+fake_gl_get_live_count(enum fake_gl_object_type type)
+{
+    pthread_mutex_lock(&mutex);
+    int count = live_counts[type];
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+size_t
+fake_gl_get_texture_memory(void)
+{
+    size_t size = 0;
+    pthread_mutex_lock(&mutex);
+    for (int name = 1; name < FAKE_GL_MAX_OBJECTS; ++name) {
+        if (objects[name].type != FAKE_GL_TEXTURE) {
+            continue;
+        }
+        for (int level = 0; level < MAX_LEVELS; ++level) {
+            size += objects[name].level_sizes[level];
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+    return size;
+}
+
+uint64_t
+fake_gl_get_draw_count(void)
+{
+    return __atomic_load_n(&draw_count, __ATOMIC_RELAXED);
+}
+
+int
+fake_gl_take_texture_uploads(struct fake_gl_texture_upload* uploads,
+                             int max_count)
+{
+    pthread_mutex_lock(&mutex);
+    int count = texture_upload_count;
+    int kept_count = count < FAKE_GL_MAX_TEXTURE_UPLOADS
+                         ? count
+                         : FAKE_GL_MAX_TEXTURE_UPLOADS;
+    if (max_count > 0) {
+        memcpy(uploads, texture_uploads,
+               (kept_count < max_count ? kept_count : max_count) *
+                   sizeof(*uploads));
+    }
+    texture_upload_count = 0;
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
+
+// EGL. Contexts and surfaces are objects too, so that leaks show up.
+
+EGLContext
+eglCreateContext(EGLDisplay display, EGLConfig config,
+                 EGLContext share_context, const EGLint* attribs)
+{
+    (void)display;
+    (void)config;
+    (void)share_context;
+    (void)attribs;
+    pthread_mutex_lock(&mutex);
+    GLuint name = create_object(FAKE_GL_CONTEXT);
+    pthread_mutex_unlock(&mutex);
+    return (EGLContext)(uintptr_t)name;
+}
+
+EGLBoolean
+eglDestroyContext(EGLDisplay display, EGLContext context)
+{
+    (void)display;
+    GLuint name = (uintptr_t)context;
+    delete_objects(FAKE_GL_CONTEXT, 1, &name);
+    return EGL_TRUE;
+}
+
+EGLSurface
+eglCreatePbufferSurface(EGLDisplay display, EGLConfig config,
+                        const EGLint* attribs)
+{
+    (void)display;
+    (void)config;
+    (void)attribs;
+    pthread_mutex_lock(&mutex);
+    GLuint name = create_object(FAKE_GL_SURFACE);
+    pthread_mutex_unlock(&mutex);
+    return (EGLSurface)(uintptr_t)name;
+}
+
+EGLBoolean
+eglDestroySurface(EGLDisplay display, EGLSurface surface)
+{
+    (void)display;
+    GLuint name = (uintptr_t)surface;
+    delete_objects(FAKE_GL_SURFACE, 1, &name);
+    return EGL_TRUE;
+}
+
+EGLBoolean
+eglMakeCurrent(EGLDisplay display, EGLSurface draw, EGLSurface read,
+               EGLContext context)
+{
+    (void)display;
+    (void)draw;
+    (void)read;
+    (void)context;
+    return EGL_TRUE;
+}
+
+EGLint
+eglGetError(void)
+{
+    return EGL_SUCCESS;
+}
+
+// Buffers.
+
+void GL_APIENTRY
+glGenBuffers(GLsizei count, GLuint* buffers)
+{
+    create_objects(FAKE_GL_BUFFER, count, buffers);
+}
+
+void GL_APIENTRY
+glDeleteBuffers(GLsizei count, const GLuint* buffers)
+{
+    delete_objects(FAKE_GL_BUFFER, count, buffers);
+}
+
+void GL_APIENTRY
+glBindBuffer(GLenum target, GLuint buffer)
+{
+    *get_buffer_binding(target) = buffer;
+}
+
+void GL_APIENTRY
+glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+    (void)usage;
+    pthread_mutex_lock(&mutex);
+    struct object* object = get_bound_buffer(target);
+    if (object->data != NULL) {
+        munmap(object->data, object->size);
+        object->data = NULL;
+    }
+    object->size = size;
+    if (size > 0) {
+        object->data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (object->data == MAP_FAILED) {
+            fail("can't map %zu bytes of buffer storage", (size_t)size);
+        }
+    }
+    void* storage = object->data;
+    pthread_mutex_unlock(&mutex);
+    // Copied without holding the mutex, so that uploads on one thread don't
+    // stall calls on another.
+    if (data != NULL && size > 0) {
+        memcpy(storage, data, size);
+    }
+}
+
+void* GL_APIENTRY
+glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length,
+                 GLbitfield access)
+{
+    (void)access;
+    pthread_mutex_lock(&mutex);
+    struct object* object = get_bound_buffer(target);
+    if (object->mapped) {
+        fail("buffer %u is already mapped", *get_buffer_binding(target));
+    }
+    if (offset < 0 || length < 0 || (size_t)offset > object->size ||
+        (size_t)length > object->size - offset) {
+        fail("can't map %zd bytes at %zd of a buffer of %zu bytes",
+             (ssize_t)length, (ssize_t)offset, object->size);
+    }
+    object->mapped = true;
+    void* pointer = (uint8_t*)object->data + offset;
+    pthread_mutex_unlock(&mutex);
+    return pointer;
+}
+
+GLboolean GL_APIENTRY
+glUnmapBuffer(GLenum target)
+{
+    pthread_mutex_lock(&mutex);
+    struct object* object = get_bound_buffer(target);
+    if (!object->mapped) {
+        fail("buffer %u isn't mapped", *get_buffer_binding(target));
+    }
+    object->mapped = false;
+    pthread_mutex_unlock(&mutex);
+    return GL_TRUE;
+}
+
+// Textures.
+
+void GL_APIENTRY
+glGenTextures(GLsizei count, GLuint* textures)
+{
+    create_objects(FAKE_GL_TEXTURE, count, textures);
+}
+
+void GL_APIENTRY
+glDeleteTextures(GLsizei count, const GLuint* textures)
+{
+    delete_objects(FAKE_GL_TEXTURE, count, textures);
+}
+
+void GL_APIENTRY
+glActiveTexture(GLenum texture)
+{
+    (void)texture;
+}
+
+// Swap chain textures come from VrApi, so they aren't objects here.
+void GL_APIENTRY
+glBindTexture(GLenum target, GLuint texture)
+{
+    (void)target;
+    bound_texture = texture;
+}
+
+void GL_APIENTRY
+glTexParameteri(GLenum target, GLenum name, GLint value)
+{
+    (void)target;
+    (void)name;
+    (void)value;
+}
+
+void GL_APIENTRY
+glPixelStorei(GLenum name, GLint value)
+{
+    (void)name;
+    (void)value;
+}
+
+void GL_APIENTRY
+glTexImage2D(GLenum target, GLint level, GLint internal_format,
+             GLsizei width, GLsizei height, GLint border, GLenum format,
+             GLenum type, const void* data)
+{
+    (void)target;
+    (void)internal_format;
+    (void)border;
+    (void)type;
+    (void)data;
+    upload_texture_level(level, width, height,
+                         (size_t)width * height * get_texel_size(format));
+}
+
+void GL_APIENTRY
+glCompressedTexImage2D(GLenum target, GLint level, GLenum internal_format,
+                       GLsizei width, GLsizei height, GLint border,
+                       GLsizei size, const void* data)
+{
+    (void)target;
+    (void)internal_format;
+    (void)border;
+    (void)data;
+    upload_texture_level(level, width, height, size);
+}
+
+// Vertex arrays, framebuffers and renderbuffers.
+
+void GL_APIENTRY
+glGenVertexArrays(GLsizei count, GLuint* arrays)
+{
+    create_objects(FAKE_GL_VERTEX_ARRAY, count, arrays);
+}
+
+void GL_APIENTRY
+glDeleteVertexArrays(GLsizei count, const GLuint* arrays)
+{
+    delete_objects(FAKE_GL_VERTEX_ARRAY, count, arrays);
+}
+
+void GL_APIENTRY
+glBindVertexArray(GLuint array)
+{
+    (void)array;
+}
+
+void GL_APIENTRY
+glEnableVertexAttribArray(GLuint index)
+{
+    (void)index;
+}
+
+void GL_APIENTRY
+glVertexAttribPointer(GLuint index, GLint size, GLenum type,
+                      GLboolean normalized, GLsizei stride,
+                      const void* pointer)
+{
+    (void)index;
+    (void)size;
+    (void)type;
+    (void)normalized;
+    (void)stride;
+    (void)pointer;
+}
+
+void GL_APIENTRY
+glGenFramebuffers(GLsizei count, GLuint* framebuffers)
+{
+    create_objects(FAKE_GL_FRAMEBUFFER, count, framebuffers);
+}
+
+void GL_APIENTRY
+glDeleteFramebuffers(GLsizei count, const GLuint* framebuffers)
+{
+    delete_objects(FAKE_GL_FRAMEBUFFER, count, framebuffers);
+}
+
+void GL_APIENTRY
+glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    (void)target;
+    (void)framebuffer;
+}
+
+void GL_APIENTRY
+glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum texture_target,
+                       GLuint texture, GLint level)
+{
+    (void)target;
+    (void)attachment;
+    (void)texture_target;
+    (void)texture;
+    (void)level;
+}
+
+GLenum GL_APIENTRY
+glCheckFramebufferStatus(GLenum target)
+{
+    (void)target;
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+void GL_APIENTRY
+glGenRenderbuffers(GLsizei count, GLuint* renderbuffers)
+{
+    create_objects(FAKE_GL_RENDERBUFFER, count, renderbuffers);
+}
+
+void GL_APIENTRY
+glDeleteRenderbuffers(GLsizei count, const GLuint* renderbuffers)
+{
+    delete_objects(FAKE_GL_RENDERBUFFER, count, renderbuffers);
+}
+
+// Programs aren't created here, so deleting one does nothing. Any program
+// is linked, and has no attributes.
+void GL_APIENTRY
+glDeleteProgram(GLuint program)
+{
+    (void)program;
+}
+
+void GL_APIENTRY
+glGetProgramiv(GLuint program, GLenum name, GLint* value)
+{
+    (void)program;
+    *value = name == GL_LINK_STATUS ? GL_TRUE : 0;
+}
+
+void GL_APIENTRY
+glGetActiveAttrib(GLuint program, GLuint index, GLsizei buffer_size,
+                  GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+{
+    (void)program;
+    (void)index;
+    (void)size;
+    (void)type;
+    if (length != NULL) {
+        *length = 0;
+    }
+    if (buffer_size > 0) {
+        name[0] = '\0';
+    }
+}
+
+GLint GL_APIENTRY
+glGetAttribLocation(GLuint program, const GLchar* name)
+{
+    (void)program;
+    (void)name;
+    return -1;
+}
+
+// Fences.
+
+GLsync GL_APIENTRY
+glFenceSync(GLenum condition, GLbitfield flags)
+{
+    (void)condition;
+    (void)flags;
+    double time = get_time();
+    pthread_mutex_lock(&mutex);
+    GLuint name = create_object(FAKE_GL_FENCE);
+    objects[name].signal_time = time + fence_latency;
+    pthread_mutex_unlock(&mutex);
+    return (GLsync)(uintptr_t)name;
+}
+
+void GL_APIENTRY
+glDeleteSync(GLsync sync)
+{
+    GLuint name = (uintptr_t)sync;
+    delete_objects(FAKE_GL_FENCE, 1, &name);
+}
+
+// Blocks for up to timeout nanoseconds, like a driver does.
+GLenum GL_APIENTRY
+glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+    (void)flags;
+    pthread_mutex_lock(&mutex);
+    double signal_time =
+        get_object(FAKE_GL_FENCE, (uintptr_t)sync)->signal_time;
+    pthread_mutex_unlock(&mutex);
+    double time = get_time();
+    if (time >= signal_time) {
+        return GL_ALREADY_SIGNALED;
+    }
+    double wait_time = signal_time - time;
+    if (wait_time > timeout * 1e-9) {
+        wait_time = timeout * 1e-9;
+    }
+    struct timespec ts;
+    ts.tv_sec = wait_time;
+    ts.tv_nsec = (wait_time - ts.tv_sec) * 1e9;
+    nanosleep(&ts, NULL);
+    return get_time() >= signal_time ? GL_CONDITION_SATISFIED
+                                     : GL_TIMEOUT_EXPIRED;
+}
+
+void GL_APIENTRY
+glFlush(void)
+{
+}
+
+void GL_APIENTRY
+glFinish(void)
+{
+}
+
+// State and draws. Draws are only counted.
+
+void GL_APIENTRY
+glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+}
+
+void GL_APIENTRY
+glScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+}
+
+void GL_APIENTRY
+glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    (void)red;
+    (void)green;
+    (void)blue;
+    (void)alpha;
+}
+
+void GL_APIENTRY
+glClear(GLbitfield mask)
+{
+    (void)mask;
+}
+
+void GL_APIENTRY
+glEnable(GLenum capability)
+{
+    (void)capability;
+}
+
+void GL_APIENTRY
+glDisable(GLenum capability)
+{
+    (void)capability;
+}
+
+void GL_APIENTRY
+glBlendFunc(GLenum source_factor, GLenum destination_factor)
+{
+    (void)source_factor;
+    (void)destination_factor;
+}
+
+void GL_APIENTRY
+glColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+    (void)red;
+    (void)green;
+    (void)blue;
+    (void)alpha;
+}
+
+void GL_APIENTRY
+glCullFace(GLenum mode)
+{
+    (void)mode;
+}
+
+void GL_APIENTRY
+glDepthFunc(GLenum function)
+{
+    (void)function;
+}
+
+void GL_APIENTRY
+glDepthMask(GLboolean flag)
+{
+    (void)flag;
+}
+
+void GL_APIENTRY
+glUseProgram(GLuint program)
+{
+    (void)program;
+}
+
+void GL_APIENTRY
+glUniform2f(GLint location, GLfloat x, GLfloat y)
+{
+    (void)location;
+    (void)x;
+    (void)y;
+}
+
+void GL_APIENTRY
+glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose,
+                   const GLfloat* value)
+{
+    (void)location;
+    (void)count;
+    (void)transpose;
+    (void)value;
+}
+
+void GL_APIENTRY
+glUniform4fv(GLint location, GLsizei count, const GLfloat* value)
+{
+    (void)location;
+    (void)count;
+    (void)value;
+}
+
+void GL_APIENTRY
+glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+    (void)mode;
+    (void)first;
+    (void)count;
+    __atomic_add_fetch(&draw_count, 1, __ATOMIC_RELAXED);
+}
+
+void GL_APIENTRY
+glDrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+{
+    (void)mode;
+    (void)count;
+    (void)type;
+    (void)indices;
+    __atomic_add_fetch(&draw_count, 1, __ATOMIC_RELAXED);
+}
+
+void GL_APIENTRY
+glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type,
+                        const void* indices, GLsizei instance_count)
+{
+    (void)mode;
+    (void)count;
+    (void)type;
+    (void)indices;
+    (void)instance_count;
+    __atomic_add_fetch(&draw_count, 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,66 @@
+#ifndef FAKE_GL_H
+#define FAKE_GL_H
+
+#include <GLES3/gl3.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A stand-in for the GL and EGL driver, so that tools can run the modules in
+// src/main/cpp on the build machine. Objects get names the way a driver
+// hands them out, and deleting a name that isn't a live object of that type
+// exits, so that tests catch double deletions as well as leaks. Buffers keep
+// their data, so that they can be mapped. Fences signal a set time after
+// they were inserted. Nothing is ever drawn.
+//
+// Calls may come from any thread, as they do on the loader thread. Buffer
+// and texture bindings are kept per thread, like they are per context, and
+// there is a single texture unit.
+
+enum
+{
+    FAKE_GL_MAX_OBJECTS = 4096,
+    FAKE_GL_MAX_TEXTURE_UPLOADS = 1024,
+};
+
+enum fake_gl_object_type
+{
+    FAKE_GL_NONE,
+    FAKE_GL_BUFFER,
+    FAKE_GL_TEXTURE,
+    FAKE_GL_VERTEX_ARRAY,
+    FAKE_GL_FRAMEBUFFER,
+    FAKE_GL_RENDERBUFFER,
+    FAKE_GL_FENCE,
+    FAKE_GL_CONTEXT,
+    FAKE_GL_SURFACE,
+    FAKE_GL_OBJECT_TYPE_COUNT,
+};
+
+// A level uploaded with glTexImage2D or glCompressedTexImage2D.
+struct fake_gl_texture_upload
+{
+    GLuint texture;
+    GLint level;
+    GLsizei width;
+    GLsizei height;
+    size_t size;
+};
+
+// Sets how many seconds fences take to signal after glFenceSync. It is 0
+// until set.
+void fake_gl_set_fence_latency(double latency);
+
+int fake_gl_get_live_count(enum fake_gl_object_type type);
+
+// Bytes of texture levels that live textures hold.
+size_t fake_gl_get_texture_memory(void);
+
+uint64_t fake_gl_get_draw_count(void);
+
+// Copies the texture level uploads since the last call, oldest first, and
+// returns how many there were. Only the first FAKE_GL_MAX_TEXTURE_UPLOADS
+// are kept, and only max_count of those are copied.
+int fake_gl_take_texture_uploads(struct fake_gl_texture_upload* uploads,
+                                 int max_count);
+
+#endif // FAKE_GL_H
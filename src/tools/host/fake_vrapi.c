@@ -0,0 +1,70 @@
+#include "fake_vrapi.h"
+#include "VrApi.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+enum
+{
+    MAX_SWAP_CHAIN_LENGTH = 4,
+};
+
+struct ovrTextureSwapChain
+{
+    int length;
+    unsigned textures[MAX_SWAP_CHAIN_LENGTH];
+};
+
+static unsigned next_texture = FAKE_VRAPI_FIRST_TEXTURE;
+static int swap_chain_count;
+
+int
+fake_vrapi_get_swap_chain_count(void)
+{
+    return swap_chain_count;
+}
+
+ovrTextureSwapChain*
+vrapi_CreateTextureSwapChain3(ovrTextureType type, int64_t format, int width,
+                              int height, int level_count, int buffer_count)
+{
+    (void)type;
+    (void)format;
+    if (width < 1 || height < 1 || level_count < 1 || buffer_count < 1 ||
+        buffer_count > MAX_SWAP_CHAIN_LENGTH) {
+        return NULL;
+    }
+    ovrTextureSwapChain* swap_chain = malloc(sizeof(*swap_chain));
+    swap_chain->length = buffer_count;
+    for (int i = 0; i < buffer_count; ++i) {
+        swap_chain->textures[i] = next_texture++;
+    }
+    ++swap_chain_count;
+    return swap_chain;
+}
+
+int
+vrapi_GetTextureSwapChainLength(ovrTextureSwapChain* swap_chain)
+{
+    return swap_chain->length;
+}
+
+unsigned int
+vrapi_GetTextureSwapChainHandle(ovrTextureSwapChain* swap_chain, int index)
+{
+    if (index < 0 || index >= swap_chain->length) {
+        fprintf(stderr, "fake VrApi: swap chain index %d out of range\n",
+                index);
+        exit(EXIT_FAILURE);
+    }
+    return swap_chain->textures[index];
+}
+
+void
+vrapi_DestroyTextureSwapChain(ovrTextureSwapChain* swap_chain)
+{
+    if (swap_chain == NULL) {
+        return;
+    }
+    --swap_chain_count;
+    free(swap_chain);
+}
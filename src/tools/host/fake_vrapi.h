@@ -0,0 +1,20 @@
+#ifndef FAKE_VRAPI_H
+#define FAKE_VRAPI_H
+
+// A stand-in for the texture swap chains of VrApi, so that tools can run
+// the modules in src/main/cpp that render into them on the build machine.
+// The rest of VrApi isn't faked. The helpers in VrApi_Helpers.h are inline,
+// so tools still build against the VrApi headers from the Oculus Mobile
+// SDK.
+//
+// The textures of a swap chain are named from FAKE_VRAPI_FIRST_TEXTURE up,
+// so that they can't be mistaken for objects of the fake GL driver.
+
+enum
+{
+    FAKE_VRAPI_FIRST_TEXTURE = 0x10000,
+};
+
+int fake_vrapi_get_swap_chain_count(void);
+
+#endif // FAKE_VRAPI_H
@@ -0,0 +1,72 @@
+#include "ktx2_builder.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t KTX2_IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n',
+};
+
+static int
+get_level_size(int size, int level)
+{
+    size >>= level;
+    return size > 0 ? size : 1;
+}
+
+static size_t
+get_level_byte_size(int width, int height, int level)
+{
+    return (size_t)(get_level_size(width, level) + 3) / 4 *
+           ((get_level_size(height, level) + 3) / 4) * 16;
+}
+
+void
+ktx2_create(struct ktx2* ktx2, uint32_t vk_format, int width, int height)
+{
+    int level_count = 1;
+    while ((width | height) >> level_count != 0) {
+        ++level_count;
+    }
+    size_t header_size = KTX2_LEVEL_INDEX + level_count * KTX2_LEVEL_SIZE;
+    size_t size = header_size;
+    for (int level = 0; level < level_count; ++level) {
+        ktx2->level_sizes[level] = get_level_byte_size(width, height, level);
+        size += ktx2->level_sizes[level];
+    }
+    ktx2->data = calloc(size, 1);
+    ktx2->size = size;
+    ktx2->level_count = level_count;
+    memcpy(ktx2->data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    ktx2_write_u32(ktx2, KTX2_VK_FORMAT, vk_format);
+    ktx2_write_u32(ktx2, KTX2_PIXEL_WIDTH, width);
+    ktx2_write_u32(ktx2, KTX2_PIXEL_HEIGHT, height);
+    ktx2_write_u32(ktx2, KTX2_FACE_COUNT, 1);
+    ktx2_write_u32(ktx2, KTX2_LEVEL_COUNT, level_count);
+    size_t offset = header_size;
+    for (int level = level_count - 1; level >= 0; --level) {
+        size_t index = KTX2_LEVEL_INDEX + level * KTX2_LEVEL_SIZE;
+        ktx2_write_u64(ktx2, index, offset);
+        ktx2_write_u64(ktx2, index + 8, ktx2->level_sizes[level]);
+        ktx2_write_u64(ktx2, index + 16, ktx2->level_sizes[level]);
+        memset(ktx2->data + offset, level, ktx2->level_sizes[level]);
+        offset += ktx2->level_sizes[level];
+    }
+}
+
+void
+ktx2_destroy(struct ktx2* ktx2)
+{
+    free(ktx2->data);
+}
+
+void
+ktx2_write_u32(struct ktx2* ktx2, size_t offset, uint32_t value)
+{
+    memcpy(ktx2->data + offset, &value, sizeof(value));
+}
+
+void
+ktx2_write_u64(struct ktx2* ktx2, size_t offset, uint64_t value)
+{
+    memcpy(ktx2->data + offset, &value, sizeof(value));
+}
@@ -0,0 +1,61 @@
+#ifndef KTX2_BUILDER_H
+#define KTX2_BUILDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Builds KTX2 files in memory, for tools that load textures with the
+// texture manager in src/main/cpp/texture.c without reading assets.
+
+enum
+{
+    // Same as MAX_TEXTURE_LEVELS in texture.h.
+    KTX2_MAX_LEVELS = 16,
+};
+
+// Byte offsets in a KTX2 file.
+enum
+{
+    KTX2_VK_FORMAT = 12,
+    KTX2_PIXEL_WIDTH = 20,
+    KTX2_PIXEL_HEIGHT = 24,
+    KTX2_PIXEL_DEPTH = 28,
+    KTX2_LAYER_COUNT = 32,
+    KTX2_FACE_COUNT = 36,
+    KTX2_LEVEL_COUNT = 40,
+    KTX2_SUPERCOMPRESSION_SCHEME = 44,
+    KTX2_LEVEL_INDEX = 80,
+    KTX2_LEVEL_SIZE = 24,
+};
+
+enum
+{
+    VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK = 147,
+    VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK = 152,
+    VK_FORMAT_ASTC_4x4_UNORM_BLOCK = 157,
+    VK_FORMAT_ASTC_4x4_SRGB_BLOCK = 158,
+    VK_FORMAT_ASTC_12x12_SRGB_BLOCK = 184,
+    VK_FORMAT_R8G8B8A8_UNORM = 37,
+};
+
+struct ktx2
+{
+    uint8_t* data;
+    size_t size;
+    int level_count;
+    size_t level_sizes[KTX2_MAX_LEVELS];
+};
+
+// Builds a file with a full mip chain, with the levels stored coarsest
+// first, as KTX2 recommends. Levels are sized in 4x4 blocks of 16 bytes,
+// like ASTC 4x4 and, for the size checks of the tools, close enough for the
+// other formats. Every byte of a level holds its level number.
+void ktx2_create(struct ktx2* ktx2, uint32_t vk_format, int width,
+                 int height);
+void ktx2_destroy(struct ktx2* ktx2);
+
+// Overwrite a field of the file, to break it.
+void ktx2_write_u32(struct ktx2* ktx2, size_t offset, uint32_t value);
+void ktx2_write_u64(struct ktx2* ktx2, size_t offset, uint64_t value);
+
+#endif // KTX2_BUILDER_H
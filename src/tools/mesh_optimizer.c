@@ -0,0 +1,295 @@
+#include "mesh_optimizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void*
+allocate(size_t size)
+{
+    void* pointer = malloc(size > 0 ? size : 1);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+void
+mesh_analyze_vertex_cache(struct mesh_statistics* statistics,
+                          const uint32_t* indices, size_t index_count,
+                          size_t vertex_count, int cache_size)
+{
+    // A vertex is in the cache if it was inserted less than cache_size
+    // insertions ago.
+    uint32_t* insertion_times = allocate(vertex_count * sizeof(uint32_t));
+    memset(insertion_times, 0, vertex_count * sizeof(uint32_t));
+    uint32_t time = cache_size + 1;
+    size_t miss_count = 0;
+    for (size_t i = 0; i < index_count; ++i) {
+        uint32_t vertex = indices[i];
+        if (time - insertion_times[vertex] > (uint32_t)cache_size) {
+            insertion_times[vertex] = time++;
+            ++miss_count;
+        }
+    }
+    free(insertion_times);
+    statistics->acmr =
+        index_count > 0 ? (float)miss_count / (index_count / 3) : 0.0f;
+    statistics->atvr =
+        vertex_count > 0 ? (float)miss_count / vertex_count : 0.0f;
+}
+
+struct adjacency
+{
+    uint32_t* offsets;
+    uint32_t* triangles;
+};
+
+static void
+adjacency_create(struct adjacency* adjacency, const uint32_t* indices,
+                 size_t index_count, size_t vertex_count)
+{
+    adjacency->offsets = allocate((vertex_count + 1) * sizeof(uint32_t));
+    adjacency->triangles = allocate(index_count * sizeof(uint32_t));
+    memset(adjacency->offsets, 0, (vertex_count + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < index_count; ++i) {
+        adjacency->offsets[indices[i] + 1]++;
+    }
+    for (size_t i = 0; i < vertex_count; ++i) {
+        adjacency->offsets[i + 1] += adjacency->offsets[i];
+    }
+    uint32_t* fill = allocate(vertex_count * sizeof(uint32_t));
+    memcpy(fill, adjacency->offsets, vertex_count * sizeof(uint32_t));
+    for (size_t i = 0; i < index_count; ++i) {
+        adjacency->triangles[fill[indices[i]]++] = i / 3;
+    }
+    free(fill);
+}
+
+static void
+adjacency_destroy(struct adjacency* adjacency)
+{
+    free(adjacency->triangles);
+    free(adjacency->offsets);
+}
+
+struct cluster
+{
+    uint32_t first_triangle;
+    uint32_t triangle_count;
+    float sort_key;
+};
+
+static int
+compare_clusters(const void* a, const void* b)
+{
+    float key_a = ((const struct cluster*)a)->sort_key;
+    float key_b = ((const struct cluster*)b)->sort_key;
+    return key_a < key_b ? 1 : key_a > key_b ? -1 : 0;
+}
+
+static const float*
+get_position(const float* positions, size_t position_stride, uint32_t vertex)
+{
+    return (const float*)((const char*)positions + vertex * position_stride);
+}
+
+// Sorts clusters so that those whose average normal points away from the
+// center of the mesh come first. This is the view-independent overdraw
+// heuristic from the Tipsify paper.
+static void
+sort_clusters(struct cluster* clusters, size_t cluster_count,
+              const uint32_t* indices, size_t index_count,
+              const float* positions, size_t position_stride)
+{
+    float mesh_center[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t i = 0; i < index_count; ++i) {
+        const float* position =
+            get_position(positions, position_stride, indices[i]);
+        for (int j = 0; j < 3; ++j) {
+            mesh_center[j] += position[j] / index_count;
+        }
+    }
+    for (size_t i = 0; i < cluster_count; ++i) {
+        struct cluster* cluster = &clusters[i];
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        for (uint32_t t = 0; t < cluster->triangle_count; ++t) {
+            const uint32_t* triangle =
+                &indices[(cluster->first_triangle + t) * 3];
+            const float* p0 =
+                get_position(positions, position_stride, triangle[0]);
+            const float* p1 =
+                get_position(positions, position_stride, triangle[1]);
+            const float* p2 =
+                get_position(positions, position_stride, triangle[2]);
+            float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            // Not normalized, so bigger triangles weigh more.
+            normal[0] += e1[1] * e2[2] - e1[2] * e2[1];
+            normal[1] += e1[2] * e2[0] - e1[0] * e2[2];
+            normal[2] += e1[0] * e2[1] - e1[1] * e2[0];
+            for (int j = 0; j < 3; ++j) {
+                center[j] += (p0[j] + p1[j] + p2[j]) /
+                             (3.0f * cluster->triangle_count);
+            }
+        }
+        cluster->sort_key = (center[0] - mesh_center[0]) * normal[0] +
+                            (center[1] - mesh_center[1]) * normal[1] +
+                            (center[2] - mesh_center[2]) * normal[2];
+    }
+    qsort(clusters, cluster_count, sizeof(*clusters), compare_clusters);
+}
+
+void
+mesh_optimize_vertex_cache(uint32_t* indices, size_t index_count,
+                           size_t vertex_count, const float* positions,
+                           size_t position_stride, int cache_size)
+{
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+
+    struct adjacency adjacency;
+    adjacency_create(&adjacency, indices, index_count, vertex_count);
+
+    uint32_t* live_triangle_counts = allocate(vertex_count * sizeof(uint32_t));
+    uint32_t max_live_triangle_count = 0;
+    for (size_t i = 0; i < vertex_count; ++i) {
+        live_triangle_counts[i] =
+            adjacency.offsets[i + 1] - adjacency.offsets[i];
+        if (live_triangle_counts[i] > max_live_triangle_count) {
+            max_live_triangle_count = live_triangle_counts[i];
+        }
+    }
+    uint32_t* cache_times = allocate(vertex_count * sizeof(uint32_t));
+    memset(cache_times, 0, vertex_count * sizeof(uint32_t));
+    char* emitted = allocate(triangle_count);
+    memset(emitted, 0, triangle_count);
+    // Each emitted index is pushed onto the dead-end stack at most once.
+    uint32_t* dead_ends = allocate(index_count * sizeof(uint32_t));
+    size_t dead_end_count = 0;
+    uint32_t* candidates =
+        allocate(3 * (max_live_triangle_count + 1) * sizeof(uint32_t));
+    uint32_t* output = allocate(index_count * sizeof(uint32_t));
+    size_t output_count = 0;
+    struct cluster* clusters = allocate(triangle_count * sizeof(*clusters));
+    size_t cluster_count = 0;
+
+    uint32_t time = cache_size + 1;
+    size_t next_vertex = 0;
+    int64_t fanning_vertex = 0;
+    clusters[0].first_triangle = 0;
+    while (fanning_vertex >= 0) {
+        // Emit all live triangles around the fanning vertex.
+        size_t candidate_count = 0;
+        for (uint32_t i = adjacency.offsets[fanning_vertex];
+             i < adjacency.offsets[fanning_vertex + 1]; ++i) {
+            uint32_t triangle = adjacency.triangles[i];
+            if (emitted[triangle]) {
+                continue;
+            }
+            for (int j = 0; j < 3; ++j) {
+                uint32_t vertex = indices[triangle * 3 + j];
+                output[output_count++] = vertex;
+                dead_ends[dead_end_count++] = vertex;
+                candidates[candidate_count++] = vertex;
+                live_triangle_counts[vertex]--;
+                if (time - cache_times[vertex] > (uint32_t)cache_size) {
+                    cache_times[vertex] = time++;
+                }
+            }
+            emitted[triangle] = 1;
+        }
+
+        // Pick the candidate that will still be in the cache after its
+        // remaining triangles are emitted and has been in it the longest.
+        int64_t best_vertex = -1;
+        int64_t best_priority = -1;
+        for (size_t i = 0; i < candidate_count; ++i) {
+            uint32_t vertex = candidates[i];
+            if (live_triangle_counts[vertex] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cache_times[vertex] + 2 * live_triangle_counts[vertex] <=
+                (uint32_t)cache_size) {
+                priority = time - cache_times[vertex];
+            }
+            if (priority > best_priority) {
+                best_priority = priority;
+                best_vertex = vertex;
+            }
+        }
+        if (best_vertex >= 0) {
+            fanning_vertex = best_vertex;
+            continue;
+        }
+
+        // Dead end. Everything after this point starts a new cluster.
+        if (output_count / 3 > clusters[cluster_count].first_triangle) {
+            clusters[cluster_count].triangle_count =
+                output_count / 3 - clusters[cluster_count].first_triangle;
+            ++cluster_count;
+            clusters[cluster_count].first_triangle = output_count / 3;
+        }
+        fanning_vertex = -1;
+        while (dead_end_count > 0) {
+            uint32_t vertex = dead_ends[--dead_end_count];
+            if (live_triangle_counts[vertex] > 0) {
+                fanning_vertex = vertex;
+                break;
+            }
+        }
+        while (fanning_vertex < 0 && next_vertex < vertex_count) {
+            if (live_triangle_counts[next_vertex] > 0) {
+                fanning_vertex = next_vertex;
+            }
+            ++next_vertex;
+        }
+    }
+
+    sort_clusters(clusters, cluster_count, output, output_count, positions,
+                  position_stride);
+    size_t index = 0;
+    for (size_t i = 0; i < cluster_count; ++i) {
+        memcpy(&indices[index], &output[clusters[i].first_triangle * 3],
+               clusters[i].triangle_count * 3 * sizeof(uint32_t));
+        index += clusters[i].triangle_count * 3;
+    }
+
+    free(clusters);
+    free(output);
+    free(candidates);
+    free(dead_ends);
+    free(emitted);
+    free(cache_times);
+    free(live_triangle_counts);
+    adjacency_destroy(&adjacency);
+}
+
+size_t
+mesh_optimize_vertex_fetch(void* vertices, size_t vertex_count,
+                           size_t vertex_size, uint32_t* indices,
+                           size_t index_count)
+{
+    uint32_t* remap = allocate(vertex_count * sizeof(uint32_t));
+    memset(remap, 0xFF, vertex_count * sizeof(uint32_t));
+    char* old_vertices = allocate(vertex_count * vertex_size);
+    memcpy(old_vertices, vertices, vertex_count * vertex_size);
+    uint32_t new_vertex_count = 0;
+    for (size_t i = 0; i < index_count; ++i) {
+        uint32_t vertex = indices[i];
+        if (remap[vertex] == UINT32_MAX) {
+            remap[vertex] = new_vertex_count;
+            memcpy((char*)vertices + new_vertex_count * vertex_size,
+                   old_vertices + vertex * vertex_size, vertex_size);
+            ++new_vertex_count;
+        }
+        indices[i] = remap[vertex];
+    }
+    free(old_vertices);
+    free(remap);
+    return new_vertex_count;
+}
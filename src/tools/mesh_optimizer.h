@@ -0,0 +1,37 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct mesh_statistics
+{
+    // Average cache miss ratio: vertex shader invocations per triangle.
+    float acmr;
+    // Average transformed vertex ratio: vertex shader invocations per
+    // vertex.
+    float atvr;
+};
+
+// Simulates a FIFO post-transform vertex cache with cache_size entries.
+void mesh_analyze_vertex_cache(struct mesh_statistics* statistics,
+                               const uint32_t* indices, size_t index_count,
+                               size_t vertex_count, int cache_size);
+
+// Reorders triangles for vertex cache locality with Tipsify (Sander et al.,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"), then
+// sorts the resulting clusters so that clusters facing away from the center
+// of the mesh, which are more likely to occlude the rest, are drawn first.
+// positions has position_stride bytes between vertices.
+void mesh_optimize_vertex_cache(uint32_t* indices, size_t index_count,
+                                size_t vertex_count, const float* positions,
+                                size_t position_stride, int cache_size);
+
+// Reorders vertices in the order in which they are first used by indices,
+// remapping indices to match. Unused vertices are dropped. Returns the new
+// vertex count.
+size_t mesh_optimize_vertex_fetch(void* vertices, size_t vertex_count,
+                                  size_t vertex_size, uint32_t* indices,
+                                  size_t index_count);
+
+#endif // MESH_OPTIMIZER_H
@@ -0,0 +1,248 @@
+// Offline mesh optimizer. Reads a triangulated Wavefront OBJ file, reorders
+// its triangles and vertices for the post-transform vertex cache, overdraw
+// and vertex fetch, and writes a mesh file in the layout described in
+// src/main/cpp/mesh.h.
+//
+// Usage:
+//
+//     optimize_mesh input.obj output.mesh
+//     optimize_mesh --benchmark grid_size
+//
+// With --benchmark, a shuffled grid_size x grid_size grid is optimized
+// instead, and the time taken by each stage is reported.
+
+#include "../main/cpp/mesh.h"
+#include "mesh_optimizer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const int CACHE_SIZE = 16;
+
+struct mesh
+{
+    struct vertex* vertices;
+    size_t vertex_count;
+    size_t vertex_capacity;
+    uint32_t* indices;
+    size_t index_count;
+    size_t index_capacity;
+};
+
+static void*
+reallocate(void* pointer, size_t size)
+{
+    pointer = realloc(pointer, size);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+static void
+mesh_add_vertex(struct mesh* mesh, const struct vertex* vertex)
+{
+    if (mesh->vertex_count == mesh->vertex_capacity) {
+        mesh->vertex_capacity =
+            mesh->vertex_capacity > 0 ? 2 * mesh->vertex_capacity : 1024;
+        mesh->vertices = reallocate(
+            mesh->vertices, mesh->vertex_capacity * sizeof(struct vertex));
+    }
+    mesh->vertices[mesh->vertex_count++] = *vertex;
+}
+
+static void
+mesh_add_index(struct mesh* mesh, uint32_t index)
+{
+    if (mesh->index_count == mesh->index_capacity) {
+        mesh->index_capacity =
+            mesh->index_capacity > 0 ? 2 * mesh->index_capacity : 1024;
+        mesh->indices =
+            reallocate(mesh->indices, mesh->index_capacity * sizeof(uint32_t));
+    }
+    mesh->indices[mesh->index_count++] = index;
+}
+
+// Only positions, optional vertex colors and faces are read. Faces with more
+// than three vertices are triangulated as fans.
+static void
+mesh_read_obj(struct mesh* mesh, const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (line[0] == 'v' && line[1] == ' ') {
+            struct vertex vertex = {
+                { 0.0f, 0.0f, 0.0f, 1.0f },
+                { 1.0f, 1.0f, 1.0f, 1.0f },
+            };
+            sscanf(line + 2, "%f %f %f %f %f %f", &vertex.position[0],
+                   &vertex.position[1], &vertex.position[2], &vertex.color[0],
+                   &vertex.color[1], &vertex.color[2]);
+            mesh_add_vertex(mesh, &vertex);
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            long face[64];
+            int face_count = 0;
+            char* token = strtok(line + 2, " \t\r\n");
+            while (token != NULL && face_count < 64) {
+                long index = strtol(token, NULL, 10);
+                face[face_count++] =
+                    index < 0 ? (long)mesh->vertex_count + index : index - 1;
+                token = strtok(NULL, " \t\r\n");
+            }
+            for (int i = 0; i < face_count; ++i) {
+                if (face[i] < 0 || (size_t)face[i] >= mesh->vertex_count) {
+                    fprintf(stderr, "invalid face in %s\n", path);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            for (int i = 2; i < face_count; ++i) {
+                mesh_add_index(mesh, face[0]);
+                mesh_add_index(mesh, face[i - 1]);
+                mesh_add_index(mesh, face[i]);
+            }
+        }
+    }
+    fclose(file);
+}
+
+static void
+mesh_write(const struct mesh* mesh, const char* path)
+{
+    struct mesh_header header;
+    header.magic = MESH_MAGIC;
+    header.vertex_count = mesh->vertex_count;
+    header.index_count = mesh->index_count;
+    header.index_size = mesh->vertex_count <= 65536 ? 2 : 4;
+    header.vertices_offset = sizeof(header);
+    header.indices_offset =
+        header.vertices_offset + mesh->vertex_count * sizeof(struct vertex);
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(mesh->vertices, sizeof(struct vertex), mesh->vertex_count, file);
+    for (size_t i = 0; i < mesh->index_count; ++i) {
+        if (header.index_size == 2) {
+            uint16_t index = mesh->indices[i];
+            fwrite(&index, sizeof(index), 1, file);
+        } else {
+            fwrite(&mesh->indices[i], sizeof(uint32_t), 1, file);
+        }
+    }
+    if (fclose(file) != 0) {
+        fprintf(stderr, "can't write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+mesh_create_grid(struct mesh* mesh, int size)
+{
+    for (int y = 0; y <= size; ++y) {
+        for (int x = 0; x <= size; ++x) {
+            struct vertex vertex = {
+                { (float)x / size, (float)y / size, 0.0f, 1.0f },
+                { 1.0f, 1.0f, 1.0f, 1.0f },
+            };
+            mesh_add_vertex(mesh, &vertex);
+        }
+    }
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            uint32_t i = y * (size + 1) + x;
+            mesh_add_index(mesh, i);
+            mesh_add_index(mesh, i + 1);
+            mesh_add_index(mesh, i + size + 1);
+            mesh_add_index(mesh, i + 1);
+            mesh_add_index(mesh, i + size + 2);
+            mesh_add_index(mesh, i + size + 1);
+        }
+    }
+    // Shuffle the triangles, as an exporter that doesn't care about order
+    // might.
+    srand(1);
+    size_t triangle_count = mesh->index_count / 3;
+    for (size_t i = triangle_count - 1; i > 0; --i) {
+        size_t j = ((size_t)rand() * RAND_MAX + rand()) % (i + 1);
+        for (int k = 0; k < 3; ++k) {
+            uint32_t index = mesh->indices[i * 3 + k];
+            mesh->indices[i * 3 + k] = mesh->indices[j * 3 + k];
+            mesh->indices[j * 3 + k] = index;
+        }
+    }
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+print_statistics(const char* label, const struct mesh* mesh)
+{
+    struct mesh_statistics statistics;
+    mesh_analyze_vertex_cache(&statistics, mesh->indices, mesh->index_count,
+                              mesh->vertex_count, CACHE_SIZE);
+    printf("%s: %zu vertices, %zu triangles, ACMR %.3f, ATVR %.3f\n", label,
+           mesh->vertex_count, mesh->index_count / 3, statistics.acmr,
+           statistics.atvr);
+}
+
+int
+main(int argc, char** argv)
+{
+    struct mesh mesh;
+    memset(&mesh, 0, sizeof(mesh));
+    bool benchmark = argc == 3 && strcmp(argv[1], "--benchmark") == 0;
+    if (benchmark) {
+        mesh_create_grid(&mesh, atoi(argv[2]));
+    } else if (argc == 3) {
+        mesh_read_obj(&mesh, argv[1]);
+    } else {
+        fprintf(stderr,
+                "usage: %s input.obj output.mesh\n"
+                "       %s --benchmark grid_size\n",
+                argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    print_statistics("before", &mesh);
+    double start_time = get_time();
+    mesh_optimize_vertex_cache(mesh.indices, mesh.index_count,
+                               mesh.vertex_count, mesh.vertices[0].position,
+                               sizeof(struct vertex), CACHE_SIZE);
+    double vertex_cache_time = get_time();
+    mesh.vertex_count =
+        mesh_optimize_vertex_fetch(mesh.vertices, mesh.vertex_count,
+                                   sizeof(struct vertex), mesh.indices,
+                                   mesh.index_count);
+    double vertex_fetch_time = get_time();
+    print_statistics("after", &mesh);
+    if (benchmark) {
+        printf("vertex cache optimization: %.1f ms\n",
+               (vertex_cache_time - start_time) * 1000.0);
+        printf("vertex fetch optimization: %.1f ms\n",
+               (vertex_fetch_time - vertex_cache_time) * 1000.0);
+    } else {
+        mesh_write(&mesh, argv[2]);
+    }
+
+    free(mesh.indices);
+    free(mesh.vertices);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+// Simulator for the clock governor in src/main/cpp/governor.c. Feeds it a
+// frame time trace and reports every level change, how many frames went
+// over budget, and the average levels.
+//
+// Usage:
+//
+//     simulate_governor [trace]
+//
+// Each line of the trace holds the CPU and GPU time of a frame in
+// milliseconds, as measured at the highest clock level. A negative GPU time
+// means it is unknown. Without a trace, a synthetic one is used, with light,
+// GPU bound, CPU bound and spiky phases.
+//
+// Frame times are scaled by the relative clock speed of the simulated
+// level, so the governor's decisions feed back into the times it sees.
+
+#include "../main/cpp/governor.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const double FRAME_BUDGET = 1.0 / 72.0;
+static const int MIN_LEVEL = 0;
+static const int MAX_LEVEL = 4;
+static const int INITIAL_CPU_LEVEL = 2;
+static const int INITIAL_GPU_LEVEL = 3;
+// Relative clock speed of each level.
+static const double LEVEL_SPEEDS[] = { 0.5, 0.62, 0.74, 0.87, 1.0 };
+
+static const int PHASE_FRAME_COUNT = 720;
+
+struct phase
+{
+    const char* name;
+    double cpu_time;
+    double gpu_time;
+    // Every spike_interval frames, the GPU time is multiplied by
+    // spike_scale.
+    int spike_interval;
+    double spike_scale;
+};
+
+static const struct phase PHASES[] = {
+    { "light", 4.0, 5.0, 0, 1.0 },
+    { "gpu bound", 5.0, 11.0, 0, 1.0 },
+    { "cpu bound", 11.0, 6.0, 0, 1.0 },
+    { "spiky", 5.0, 6.0, 20, 2.5 },
+    { "light", 4.0, 5.0, 0, 1.0 },
+};
+
+struct simulation
+{
+    struct clock_governor governor;
+    int frame_count;
+    int over_budget_count;
+    long total_levels[CLOCK_END];
+};
+
+static void
+simulate_frame(struct simulation* simulation, double cpu_work,
+               double gpu_work)
+{
+    struct clock_governor* governor = &simulation->governor;
+    double cpu_time = cpu_work * 0.001 /
+                      LEVEL_SPEEDS[governor->levels[CLOCK_CPU]] *
+                      LEVEL_SPEEDS[MAX_LEVEL];
+    double gpu_time = gpu_work < 0.0
+                          ? -1.0
+                          : gpu_work * 0.001 /
+                                LEVEL_SPEEDS[governor->levels[CLOCK_GPU]] *
+                                LEVEL_SPEEDS[MAX_LEVEL];
+    if (cpu_time > FRAME_BUDGET || gpu_time > FRAME_BUDGET) {
+        ++simulation->over_budget_count;
+    }
+    for (enum clock clock = CLOCK_BEGIN; clock != CLOCK_END; ++clock) {
+        simulation->total_levels[clock] += governor->levels[clock];
+    }
+    if (clock_governor_add_frame(governor, cpu_time, gpu_time)) {
+        printf("frame %d: cpu level %d, gpu level %d (average cpu time %.2f "
+               "ms, gpu time %.2f ms)\n",
+               simulation->frame_count, governor->levels[CLOCK_CPU],
+               governor->levels[CLOCK_GPU],
+               governor->average_times[CLOCK_CPU] * 1000.0,
+               governor->average_times[CLOCK_GPU] * 1000.0);
+    }
+    ++simulation->frame_count;
+}
+
+// Up to 10% of noise, so that the windows aren't all identical.
+static double
+add_noise(double time)
+{
+    return time * (0.95 + 0.1 * rand() / RAND_MAX);
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [trace]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    struct simulation simulation;
+    clock_governor_create(&simulation.governor, FRAME_BUDGET, MIN_LEVEL,
+                          MAX_LEVEL, INITIAL_CPU_LEVEL, INITIAL_GPU_LEVEL);
+    simulation.frame_count = 0;
+    simulation.over_budget_count = 0;
+    for (enum clock clock = CLOCK_BEGIN; clock != CLOCK_END; ++clock) {
+        simulation.total_levels[clock] = 0;
+    }
+
+    if (argc == 2) {
+        FILE* file = fopen(argv[1], "r");
+        if (file == NULL) {
+            fprintf(stderr, "can't open %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        double cpu_work = 0.0;
+        double gpu_work = 0.0;
+        while (fscanf(file, "%lf %lf", &cpu_work, &gpu_work) == 2) {
+            simulate_frame(&simulation, cpu_work, gpu_work);
+        }
+        fclose(file);
+    } else {
+        srand(1);
+        for (size_t i = 0; i < sizeof(PHASES) / sizeof(PHASES[0]); ++i) {
+            const struct phase* phase = &PHASES[i];
+            printf("frame %d: %s phase\n", simulation.frame_count,
+                   phase->name);
+            for (int j = 0; j < PHASE_FRAME_COUNT; ++j) {
+                double gpu_work = phase->gpu_time;
+                if (phase->spike_interval != 0 &&
+                    j % phase->spike_interval == 0) {
+                    gpu_work *= phase->spike_scale;
+                }
+                simulate_frame(&simulation, add_noise(phase->cpu_time),
+                               add_noise(gpu_work));
+            }
+        }
+    }
+
+    if (simulation.frame_count == 0) {
+        fprintf(stderr, "empty trace\n");
+        return EXIT_FAILURE;
+    }
+    printf("%d frames, %d over budget, average cpu level %.2f, average gpu "
+           "level %.2f\n",
+           simulation.frame_count, simulation.over_budget_count,
+           (double)simulation.total_levels[CLOCK_CPU] / simulation.frame_count,
+           (double)simulation.total_levels[CLOCK_GPU] /
+               simulation.frame_count);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+// Runs the fixed step simulation in src/main/cpp/simulation.c at the
+// display rates of the headset, and reports how far the positions that
+// frames would show are from the exact motion, with and without
+// interpolating between steps. The body bobs on a spring like the cube in
+// the app.
+//
+// Usage:
+//
+//     simulate_refresh_rates [step_rate] [seconds]
+
+#include "../main/cpp/memory.h"
+#include "../main/cpp/simulation.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const double DEFAULT_STEP_RATE = 30.0;
+static const double DEFAULT_DURATION = 10.0;
+static const double REFRESH_RATES[] = { 60.0, 72.0, 90.0, 120.0 };
+static const int MAX_STEPS = 4;
+static const float STIFFNESS = 4.0;
+static const float VELOCITY = 0.2;
+
+// simulation.c allocates with memory_alloc, but memory.c logs through
+// Android, so the tool provides its own.
+void*
+memory_alloc(size_t size)
+{
+    void* pointer = aligned_alloc(16, (size + 15) / 16 * 16);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+void
+memory_free(void* pointer)
+{
+    free(pointer);
+}
+
+// Height of the body at time, without any stepping.
+static double
+get_exact_height(double time)
+{
+    double frequency = sqrt(STIFFNESS);
+    return VELOCITY / frequency * sin(frequency * time);
+}
+
+static void
+run(double refresh_rate, double step_rate, double duration)
+{
+    struct simulation simulation;
+    simulation_create(&simulation, 1, 1.0 / step_rate, MAX_STEPS);
+    struct body body = {
+        { 0.0, 0.0, 0.0 }, { 0.0, VELOCITY, 0.0 }, { 0.0, 0.0, 0.0 },
+        STIFFNESS,
+    };
+    simulation_add_body(&simulation, &body);
+
+    int frame_count = duration * refresh_rate;
+    double max_error = 0.0;
+    double max_latest_error = 0.0;
+    double final_height = 0.0;
+    for (int i = 0; i <= frame_count; ++i) {
+        double time = i / refresh_rate;
+        simulation_advance(&simulation, time);
+        float position[3];
+        simulation_get_position(&simulation, 0, time, position);
+        // The state of the latest step is what a frame would show without
+        // interpolation.
+        float latest_height = simulation.bodies[0].position[1];
+        double exact_height = get_exact_height(time);
+        max_error = fmax(max_error, fabs(position[1] - exact_height));
+        max_latest_error =
+            fmax(max_latest_error, fabs(latest_height - exact_height));
+        final_height = position[1];
+    }
+    printf("%6.1f Hz: %5.2f steps/frame, max error %6.2f mm interpolated, "
+           "%6.2f mm latest step, height at %.1f s %+.6f m\n",
+           refresh_rate, (double)simulation.stats.step_count / frame_count,
+           max_error * 1000.0, max_latest_error * 1000.0,
+           frame_count / refresh_rate, final_height);
+    simulation_destroy(&simulation);
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 3) {
+        fprintf(stderr, "usage: %s [step_rate] [seconds]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    double step_rate = argc > 1 ? atof(argv[1]) : DEFAULT_STEP_RATE;
+    double duration = argc > 2 ? atof(argv[2]) : DEFAULT_DURATION;
+    if (step_rate <= 0.0 || duration <= 0.0) {
+        fprintf(stderr, "step rate and duration must be positive\n");
+        return EXIT_FAILURE;
+    }
+    printf("%.1f steps/s for %.1f s\n", step_rate, duration);
+    for (size_t i = 0; i < sizeof(REFRESH_RATES) / sizeof(REFRESH_RATES[0]);
+         ++i) {
+        run(REFRESH_RATES[i], step_rate, duration);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+// Simulation of the cached shadow atlas in src/main/cpp/shadow_cache.c. A
+// square of ground seen from a sun straight above holds static casters and
+// 0 to 64 moving ones. For each count of moving casters, counts the draws
+// and the texels that the shadow pass renders per frame, with the cache and
+// with the whole atlas rendered again every frame. Also checks that the
+// dirty rectangles cover exactly the dirty cells, without overlapping.
+//
+// Usage:
+//
+//     simulate_shadow_cache [static_caster_count]
+
+#include "../main/cpp/memory.h"
+#include "../main/cpp/shadow_cache.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const int DEFAULT_STATIC_CASTER_COUNT = 200;
+// Same as the app's atlas.
+static const int ATLAS_SIZE = 2048;
+// Side of the ground the atlas covers, in meters.
+static const float GROUND_SIZE = 8.0;
+static const float MIN_RADIUS = 0.05;
+static const float MAX_RADIUS = 0.3;
+// Moving casters go round circles at walking speed.
+static const float SPEED = 1.5;
+static const float FRAME_TIME = 1.0 / 72.0;
+static const int FRAME_COUNT = 1000;
+static const int MOVING_CASTER_COUNTS[] = { 0, 1, 4, 16, 64 };
+
+enum
+{
+    MAX_MOVING_CASTER_COUNT = 64,
+};
+
+// shadow_cache.c allocates with memory_alloc, but memory.c logs through
+// Android, so the tool provides its own.
+void*
+memory_alloc(size_t size)
+{
+    void* pointer = aligned_alloc(16, (size + 15) / 16 * 16);
+    if (pointer == NULL) {
+        fprintf(stderr, "can't allocate %zu bytes\n", size);
+        exit(EXIT_FAILURE);
+    }
+    return pointer;
+}
+
+void
+memory_free(void* pointer)
+{
+    free(pointer);
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float
+random_float(float min, float max)
+{
+    return min + (max - min) * rand() / RAND_MAX;
+}
+
+// A caster on the ground, at x and z in meters from its center.
+static void
+get_bounds(float x, float z, float radius, float* bounds)
+{
+    bounds[0] = (x - radius) / GROUND_SIZE + 0.5;
+    bounds[1] = (z - radius) / GROUND_SIZE + 0.5;
+    bounds[2] = (x + radius) / GROUND_SIZE + 0.5;
+    bounds[3] = (z + radius) / GROUND_SIZE + 0.5;
+}
+
+// Returns false if rects don't cover exactly the cells of dirty_rows, or
+// overlap.
+static bool
+check_rects(const uint32_t* dirty_rows, const struct shadow_rect* rects,
+            int rect_count)
+{
+    uint32_t covered_rows[SHADOW_CELL_GRID_SIZE] = { 0 };
+    for (int i = 0; i < rect_count; ++i) {
+        const struct shadow_rect* rect = &rects[i];
+        uint32_t mask = (((uint32_t)1 << rect->width) - 1) << rect->x;
+        for (int y = rect->y; y < rect->y + rect->height; ++y) {
+            if ((covered_rows[y] & mask) != 0) {
+                return false;
+            }
+            covered_rows[y] |= mask;
+        }
+    }
+    return memcmp(covered_rows, dirty_rows, sizeof(covered_rows)) == 0;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [static_caster_count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int static_caster_count =
+        argc > 1 ? atoi(argv[1]) : DEFAULT_STATIC_CASTER_COUNT;
+    if (static_caster_count < 0) {
+        fprintf(stderr, "static caster count can't be negative\n");
+        return EXIT_FAILURE;
+    }
+    int caster_capacity = static_caster_count + MAX_MOVING_CASTER_COUNT;
+    float* static_bounds = memory_alloc(static_caster_count * sizeof(float[4]));
+    for (int i = 0; i < static_caster_count; ++i) {
+        get_bounds(random_float(-0.5, 0.5) * GROUND_SIZE,
+                   random_float(-0.5, 0.5) * GROUND_SIZE,
+                   random_float(MIN_RADIUS, MAX_RADIUS), &static_bounds[4 * i]);
+    }
+    float centers[MAX_MOVING_CASTER_COUNT][2];
+    float circle_radii[MAX_MOVING_CASTER_COUNT];
+    float phases[MAX_MOVING_CASTER_COUNT];
+    float radii[MAX_MOVING_CASTER_COUNT];
+    for (int i = 0; i < MAX_MOVING_CASTER_COUNT; ++i) {
+        centers[i][0] = random_float(-0.3, 0.3) * GROUND_SIZE;
+        centers[i][1] = random_float(-0.3, 0.3) * GROUND_SIZE;
+        circle_radii[i] = random_float(0.2, 1.0);
+        phases[i] = random_float(0.0, 2.0 * M_PI);
+        radii[i] = random_float(MIN_RADIUS, MAX_RADIUS);
+    }
+    struct shadow_rect* rects =
+        memory_alloc(SHADOW_CELL_COUNT * sizeof(struct shadow_rect));
+    int cell_size = ATLAS_SIZE / SHADOW_CELL_GRID_SIZE;
+
+    printf("%d static casters, %dx%d cells of %dx%d texels, %d frames\n",
+           static_caster_count, SHADOW_CELL_GRID_SIZE, SHADOW_CELL_GRID_SIZE,
+           cell_size, cell_size, FRAME_COUNT);
+    for (size_t i = 0; i < sizeof(MOVING_CASTER_COUNTS) / sizeof(int); ++i) {
+        int moving_caster_count = MOVING_CASTER_COUNTS[i];
+        int caster_count = static_caster_count + moving_caster_count;
+        for (int cached = 1; cached >= 0; --cached) {
+            struct shadow_cache cache;
+            shadow_cache_create(&cache, caster_capacity);
+            for (int j = 0; j < static_caster_count; ++j) {
+                shadow_cache_add_caster(&cache, &static_bounds[4 * j]);
+            }
+            int first_moving_caster = cache.caster_count;
+            for (int j = 0; j < moving_caster_count; ++j) {
+                float bounds[4];
+                get_bounds(centers[j][0], centers[j][1], radii[j], bounds);
+                shadow_cache_add_caster(&cache, bounds);
+            }
+            // The first frame renders everything either way, so it isn't
+            // counted.
+            shadow_cache_take_dirty_rects(&cache, rects);
+
+            long rect_count = 0;
+            long draw_count = 0;
+            long texel_count = 0;
+            double time = 0.0;
+            for (int frame = 1; frame <= FRAME_COUNT; ++frame) {
+                double start_time = get_time();
+                for (int j = 0; j < moving_caster_count; ++j) {
+                    float angle = phases[j] + frame * FRAME_TIME * SPEED /
+                                                  circle_radii[j];
+                    float bounds[4];
+                    get_bounds(centers[j][0] + circle_radii[j] * cosf(angle),
+                               centers[j][1] + circle_radii[j] * sinf(angle),
+                               radii[j], bounds);
+                    shadow_cache_move_caster(&cache, first_moving_caster + j,
+                                             bounds);
+                }
+                if (!cached) {
+                    shadow_cache_invalidate(&cache);
+                }
+                uint32_t dirty_rows[SHADOW_CELL_GRID_SIZE];
+                memcpy(dirty_rows, cache.dirty_rows, sizeof(dirty_rows));
+                int frame_rect_count =
+                    shadow_cache_take_dirty_rects(&cache, rects);
+                for (int j = 0; j < frame_rect_count; ++j) {
+                    for (int caster = 0; caster < caster_count; ++caster) {
+                        draw_count += shadow_cache_caster_overlaps(
+                            &cache, caster, &rects[j]);
+                    }
+                    texel_count += (long)rects[j].width * rects[j].height *
+                                   cell_size * cell_size;
+                }
+                time += get_time() - start_time;
+                rect_count += frame_rect_count;
+                if (!check_rects(dirty_rows, rects, frame_rect_count)) {
+                    fprintf(stderr,
+                            "%d moving casters, frame %d: the rectangles "
+                            "don't cover exactly the dirty cells\n",
+                            moving_caster_count, frame);
+                    return EXIT_FAILURE;
+                }
+            }
+            shadow_cache_destroy(&cache);
+
+            printf("%2d moving casters, %-12s: %6.2f rects/frame, "
+                   "%7.1f draws/frame, %9.0f texels/frame, %6.3f ms/frame\n",
+                   moving_caster_count, cached ? "cached" : "full refresh",
+                   (double)rect_count / FRAME_COUNT,
+                   (double)draw_count / FRAME_COUNT,
+                   (double)texel_count / FRAME_COUNT,
+                   time * 1000.0 / FRAME_COUNT);
+        }
+    }
+    printf("the rectangles covered exactly the dirty cells every frame\n");
+
+    memory_free(rects);
+    memory_free(static_bounds);
+    return EXIT_SUCCESS;
+}
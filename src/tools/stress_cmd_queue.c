@@ -0,0 +1,229 @@
+// Stress test for the command queue in src/main/cpp/cmd_queue.c, which the
+// glue uses to send lifecycle commands to the app thread. Producer threads
+// push commands, in bursts with short pauses in between, while the
+// consumer sleeps in poll on the queue's eventfd and drains the queue every
+// time it wakes up, like the looper does.
+//
+// Usage:
+//
+//     stress_cmd_queue [producer_count] [commands_per_producer]
+//
+// Exits with a failure if any command was lost, duplicated or reordered
+// with respect to the other commands of its producer, or if the consumer
+// wasn't woken up while commands were queued. Also reports the latency from
+// push to pop.
+
+#include "../main/cpp/cmd_queue.h"
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const int DEFAULT_PRODUCER_COUNT = 4;
+static const int DEFAULT_COMMANDS_PER_PRODUCER = 100000;
+// The type of a command is the index of its producer.
+static const int MAX_PRODUCER_COUNT = 127;
+static const int MAX_BURST_SIZE = 16;
+// The consumer is considered not woken up if poll waits this long while
+// commands are still to come.
+static const int WAKE_TIMEOUT_MS = 1000;
+static const double PERCENTILES[] = { 50.0, 90.0, 99.0, 99.9, 100.0 };
+
+struct producer
+{
+    struct cmd_queue* queue;
+    int index;
+    pthread_t thread;
+    unsigned int seed;
+    int command_count;
+    // Time each command was pushed, read by the consumer once it pops the
+    // command.
+    double* push_times;
+    uint64_t full_count;
+    bool finished;
+};
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void*
+producer_main(void* data)
+{
+    struct producer* producer = data;
+    int index = 0;
+    while (index < producer->command_count) {
+        int burst_size = rand_r(&producer->seed) % MAX_BURST_SIZE + 1;
+        for (int i = 0; i < burst_size && index < producer->command_count;
+             ++i) {
+            struct cmd cmd;
+            cmd.type = producer->index;
+            cmd.payload = (void*)(uintptr_t)index;
+            producer->push_times[index] = get_time();
+            while (!cmd_queue_push(producer->queue, &cmd)) {
+                ++producer->full_count;
+                sched_yield();
+            }
+            ++index;
+        }
+        struct timespec pause = { 0, rand_r(&producer->seed) % 20000 };
+        nanosleep(&pause, NULL);
+    }
+    __atomic_store_n(&producer->finished, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static int
+compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 3) {
+        fprintf(stderr, "usage: %s [producer_count] [commands_per_producer]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    int producer_count = argc > 1 ? atoi(argv[1]) : DEFAULT_PRODUCER_COUNT;
+    int commands_per_producer =
+        argc > 2 ? atoi(argv[2]) : DEFAULT_COMMANDS_PER_PRODUCER;
+    if (producer_count < 1 || producer_count > MAX_PRODUCER_COUNT) {
+        fprintf(stderr, "need 1 to %d producers\n", MAX_PRODUCER_COUNT);
+        return EXIT_FAILURE;
+    }
+    if (commands_per_producer < 1) {
+        fprintf(stderr, "need at least 1 command per producer\n");
+        return EXIT_FAILURE;
+    }
+
+    static struct cmd_queue queue;
+    if (!cmd_queue_create(&queue)) {
+        fprintf(stderr, "can't create queue\n");
+        return EXIT_FAILURE;
+    }
+    long command_count = (long)producer_count * commands_per_producer;
+    struct producer* producers = calloc(producer_count, sizeof(*producers));
+    int* next_indices = calloc(producer_count, sizeof(int));
+    double* latencies = malloc(command_count * sizeof(double));
+    if (producers == NULL || next_indices == NULL || latencies == NULL) {
+        fprintf(stderr, "can't allocate producers\n");
+        return EXIT_FAILURE;
+    }
+    double start_time = get_time();
+    for (int i = 0; i < producer_count; ++i) {
+        struct producer* producer = &producers[i];
+        producer->queue = &queue;
+        producer->index = i;
+        producer->seed = i + 1;
+        producer->command_count = commands_per_producer;
+        producer->push_times = malloc(commands_per_producer * sizeof(double));
+        if (producer->push_times == NULL) {
+            fprintf(stderr, "can't allocate producers\n");
+            return EXIT_FAILURE;
+        }
+        if (pthread_create(&producer->thread, NULL, producer_main,
+                           producer) != 0) {
+            fprintf(stderr, "can't create producer %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    long pop_count = 0;
+    long wake_count = 0;
+    long missed_wake_count = 0;
+    long bad_command_count = 0;
+    while (pop_count < command_count) {
+        struct pollfd pollfd = { queue.fd, POLLIN, 0 };
+        int result = poll(&pollfd, 1, WAKE_TIMEOUT_MS);
+        if (result < 0) {
+            fprintf(stderr, "can't poll\n");
+            return EXIT_FAILURE;
+        }
+        if (result > 0) {
+            ++wake_count;
+        }
+        bool finished = true;
+        for (int i = 0; i < producer_count; ++i) {
+            finished = finished && __atomic_load_n(&producers[i].finished,
+                                                   __ATOMIC_ACQUIRE);
+        }
+        long drain_count = 0;
+        struct cmd cmd;
+        while (cmd_queue_pop(&queue, &cmd)) {
+            ++drain_count;
+            double pop_time = get_time();
+            int producer = cmd.type;
+            int index = (int)(uintptr_t)cmd.payload;
+            if (producer < 0 || producer >= producer_count ||
+                index != next_indices[producer]) {
+                ++bad_command_count;
+                continue;
+            }
+            ++next_indices[producer];
+            latencies[pop_count++] =
+                pop_time - producers[producer].push_times[index];
+        }
+        if (result == 0 && drain_count > 0) {
+            // Commands were queued, but the eventfd wasn't signaled.
+            ++missed_wake_count;
+        }
+        if (finished && drain_count == 0) {
+            // Every producer is done, so the rest of the commands are lost.
+            break;
+        }
+    }
+    double time = get_time() - start_time;
+
+    uint64_t full_count = 0;
+    for (int i = 0; i < producer_count; ++i) {
+        pthread_join(producers[i].thread, NULL);
+        full_count += producers[i].full_count;
+        free(producers[i].push_times);
+    }
+    // Nothing must be left once every producer has finished.
+    struct cmd cmd;
+    while (cmd_queue_pop(&queue, &cmd)) {
+        ++bad_command_count;
+    }
+    long lost_command_count = command_count - pop_count;
+    cmd_queue_destroy(&queue);
+
+    printf("%d producers, %ld commands in %.3f s: %ld wakeups, %.1f "
+           "commands per wakeup, queue full %llu times\n",
+           producer_count, command_count, time, wake_count,
+           (double)pop_count / (wake_count > 0 ? wake_count : 1),
+           (unsigned long long)full_count);
+    if (pop_count > 0) {
+        qsort(latencies, pop_count, sizeof(double), compare_doubles);
+        printf("push to pop latency:");
+        for (size_t i = 0; i < sizeof(PERCENTILES) / sizeof(double); ++i) {
+            long rank = PERCENTILES[i] / 100.0 * (pop_count - 1);
+            printf(" p%g %.1f us%s", PERCENTILES[i], latencies[rank] * 1e6,
+                   i + 1 < sizeof(PERCENTILES) / sizeof(double) ? "," : "\n");
+        }
+    }
+    // A duplicated or reordered command is both unexpected when it pops
+    // and lost from its producer's sequence.
+    printf("lost commands %ld, unexpected commands %ld, missed wakeups %ld\n",
+           lost_command_count, bad_command_count, missed_wake_count);
+
+    free(latencies);
+    free(next_indices);
+    free(producers);
+    return lost_command_count == 0 && bad_command_count == 0 &&
+                   missed_wake_count == 0
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+}
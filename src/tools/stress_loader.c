@@ -0,0 +1,357 @@
+// Stress test for the loader in src/main/cpp/loader.c, which uploads buffers
+// on a thread of its own. Runs frames at 90 Hz that hand back finished
+// uploads in batches, like renderer_finish_uploads does, and then queue
+// meshes until the loader's ring of MAX_UPLOADS uploads is full again, so
+// that hundreds of meshes are always loading and the ids wrap around the
+// ring many times. Reports how long the frames spend in loader calls, how
+// late they start, and how long uploads take to be handed back. GL and EGL
+// go to the fake driver in src/tools/host, whose fences signal
+// FENCE_LATENCY after they were inserted, as if the GPU had copied the data
+// by then.
+//
+// Also checks that queuing one upload more than fits exits, and that
+// loader_destroy deletes the uploads that are still in flight.
+//
+// Usage:
+//
+//     stress_loader [frame_count]
+//
+// Exits with a failure if an upload was handed back out of order, twice or
+// without its buffer, if any frame was late by more than a frame, or if
+// buffers, fences or EGL objects were leaked. With a single CPU, the loader
+// thread competes with the frames for it, so late frames are only
+// reported.
+
+#include "../main/cpp/frame_config.h"
+#include "../main/cpp/loader.h"
+#include "host/fake_gl.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static const int DEFAULT_FRAME_COUNT = 900;
+static const double FRAME_TIME = 1.0 / 90.0;
+static const double FENCE_LATENCY = 0.002;
+// About the size of the sphere in the app.
+static const size_t MESH_VERTEX_SIZE = 2048 * 32;
+static const size_t MESH_INDEX_SIZE = 12288 * 2;
+static const double PERCENTILES[] = { 50.0, 90.0, 99.0, 100.0 };
+
+struct pending_upload
+{
+    uint64_t id;
+    double queue_time;
+    bool pending;
+};
+
+struct stress
+{
+    struct loader loader;
+    const uint8_t* mesh;
+    // Indexed by id, like the loader's ring.
+    struct pending_upload uploads[MAX_UPLOADS];
+    uint64_t next_handed_id;
+    uint64_t handed_count;
+    uint64_t failure_count;
+    double* latencies;
+    size_t latency_count;
+    size_t latency_capacity;
+};
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+sleep_until(double time)
+{
+    struct timespec ts;
+    ts.tv_sec = time;
+    ts.tv_nsec = (time - ts.tv_sec) * 1e9;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int
+compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void
+print_percentiles(const char* label, double* values, size_t count)
+{
+    qsort(values, count, sizeof(double), compare_doubles);
+    printf("%s:", label);
+    for (size_t i = 0; i < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]);
+         ++i) {
+        size_t index = PERCENTILES[i] / 100.0 * (count - 1);
+        printf(" p%g %.2f ms", PERCENTILES[i], values[index] * 1000.0);
+    }
+    printf("\n");
+}
+
+static void
+queue_upload(struct stress* stress, GLenum target, size_t size)
+{
+    uint64_t id =
+        loader_upload_buffer(&stress->loader, target, stress->mesh, size);
+    struct pending_upload* upload = &stress->uploads[id % MAX_UPLOADS];
+    if (upload->pending) {
+        fprintf(stderr, "upload %llu reuses the slot of pending upload %llu\n",
+                (unsigned long long)id, (unsigned long long)upload->id);
+        ++stress->failure_count;
+    }
+    upload->id = id;
+    upload->queue_time = get_time();
+    upload->pending = true;
+}
+
+// Queues meshes until the ring is full. Uploads are only queued and handed
+// back on this thread, so the counts can be read without the loader's
+// mutex, like the app's render thread could.
+static void
+fill(struct stress* stress)
+{
+    const struct loader* loader = &stress->loader;
+    while (loader->queued_count - loader->handed_count + 2 <= MAX_UPLOADS) {
+        queue_upload(stress, GL_ARRAY_BUFFER, MESH_VERTEX_SIZE);
+        queue_upload(stress, GL_ELEMENT_ARRAY_BUFFER, MESH_INDEX_SIZE);
+    }
+}
+
+static void
+finish_upload(struct stress* stress, const struct upload* upload)
+{
+    struct pending_upload* pending_upload =
+        &stress->uploads[upload->id % MAX_UPLOADS];
+    if (upload->id != stress->next_handed_id || !pending_upload->pending ||
+        pending_upload->id != upload->id) {
+        fprintf(stderr, "upload %llu handed back, expected %llu\n",
+                (unsigned long long)upload->id,
+                (unsigned long long)stress->next_handed_id);
+        ++stress->failure_count;
+        return;
+    }
+    if (upload->name == 0 || upload->fence != NULL) {
+        fprintf(stderr, "upload %llu handed back without its buffer\n",
+                (unsigned long long)upload->id);
+        ++stress->failure_count;
+    }
+    ++stress->next_handed_id;
+    ++stress->handed_count;
+    pending_upload->pending = false;
+    glDeleteBuffers(1, &upload->name);
+    if (stress->latency_count < stress->latency_capacity) {
+        stress->latencies[stress->latency_count++] =
+            get_time() - pending_upload->queue_time;
+    }
+}
+
+// Like renderer_finish_uploads.
+static void
+finish_uploads(struct stress* stress)
+{
+    struct upload uploads[UPLOAD_BATCH_SIZE];
+    int count = 0;
+    do {
+        count = loader_poll(&stress->loader, uploads, UPLOAD_BATCH_SIZE);
+        for (int i = 0; i < count; ++i) {
+            finish_upload(stress, &uploads[i]);
+        }
+    } while (count == UPLOAD_BATCH_SIZE);
+}
+
+static void
+stress_create(struct stress* stress, const uint8_t* mesh,
+              size_t latency_capacity)
+{
+    loader_create(&stress->loader, EGL_NO_DISPLAY, NULL, EGL_NO_CONTEXT);
+    stress->mesh = mesh;
+    for (int i = 0; i < MAX_UPLOADS; ++i) {
+        stress->uploads[i].pending = false;
+    }
+    stress->next_handed_id = 0;
+    stress->handed_count = 0;
+    stress->failure_count = 0;
+    stress->latencies = malloc(latency_capacity * sizeof(double));
+    stress->latency_count = 0;
+    stress->latency_capacity = latency_capacity;
+}
+
+// Runs in a child process, which must exit with a failure once the ids
+// have wrapped around twice and one upload more than fits is queued.
+static void
+overflow_main(const uint8_t* mesh)
+{
+    struct stress stress;
+    stress_create(&stress, mesh, 0);
+    while (stress.loader.queued_count < 2 * MAX_UPLOADS) {
+        fill(&stress);
+        finish_uploads(&stress);
+    }
+    while (stress.loader.queued_count - stress.loader.handed_count <
+           MAX_UPLOADS) {
+        queue_upload(&stress, GL_ARRAY_BUFFER, MESH_VERTEX_SIZE);
+    }
+    printf("queuing upload %llu with %d uploads in flight, which must exit\n",
+           (unsigned long long)stress.loader.queued_count, MAX_UPLOADS);
+    fflush(stdout);
+    queue_upload(&stress, GL_ARRAY_BUFFER, MESH_VERTEX_SIZE);
+    exit(EXIT_SUCCESS);
+}
+
+static bool
+check_overflow(const uint8_t* mesh)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        overflow_main(mesh);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_FAILURE) {
+        fprintf(stderr, "queuing past MAX_UPLOADS didn't exit\n");
+        return false;
+    }
+    printf("queuing past MAX_UPLOADS exited\n");
+    return true;
+}
+
+static bool
+check_leaks(void)
+{
+    static const enum fake_gl_object_type TYPES[] = {
+        FAKE_GL_BUFFER,
+        FAKE_GL_FENCE,
+        FAKE_GL_CONTEXT,
+        FAKE_GL_SURFACE,
+    };
+    static const char* const NAMES[] = { "buffers", "fences", "contexts",
+                                         "surfaces" };
+    bool leaked = false;
+    for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); ++i) {
+        int count = fake_gl_get_live_count(TYPES[i]);
+        if (count != 0) {
+            fprintf(stderr, "%d %s leaked\n", count, NAMES[i]);
+            leaked = true;
+        }
+    }
+    return !leaked;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [frame_count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int frame_count = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAME_COUNT;
+    if (frame_count < 1) {
+        fprintf(stderr, "need at least 1 frame\n");
+        return EXIT_FAILURE;
+    }
+    size_t mesh_size = MESH_VERTEX_SIZE > MESH_INDEX_SIZE ? MESH_VERTEX_SIZE
+                                                          : MESH_INDEX_SIZE;
+    uint8_t* mesh = malloc(mesh_size);
+    for (size_t i = 0; i < mesh_size; ++i) {
+        mesh[i] = i * 7;
+    }
+    fake_gl_set_fence_latency(FENCE_LATENCY);
+
+    // Forked before the loader thread of this process exists.
+    bool passed = check_overflow(mesh);
+
+    // Every frame hands back at most what the ring holds.
+    struct stress stress;
+    stress_create(&stress, mesh, (size_t)frame_count * MAX_UPLOADS);
+    double* frame_delays = malloc(frame_count * sizeof(double));
+    double* loader_times = malloc(frame_count * sizeof(double));
+    int late_frame_count = 0;
+    fill(&stress);
+    double start_time = get_time();
+    for (int frame = 0; frame < frame_count; ++frame) {
+        double frame_start_time = start_time + frame * FRAME_TIME;
+        sleep_until(frame_start_time);
+        double delay = get_time() - frame_start_time;
+        frame_delays[frame] = delay;
+        if (delay > FRAME_TIME) {
+            ++late_frame_count;
+        }
+        double loader_start_time = get_time();
+        finish_uploads(&stress);
+        fill(&stress);
+        loader_times[frame] = get_time() - loader_start_time;
+    }
+    double run_time = get_time() - start_time;
+    int in_flight_count =
+        stress.loader.queued_count - stress.loader.handed_count;
+    struct loader_stats stats;
+    loader_get_stats(&stress.loader, &stats);
+    loader_destroy(&stress.loader);
+
+    printf("%d frames in %.2f s, %llu uploads queued (%.1f times around the "
+           "ring), %llu handed back, %d in flight at the end\n",
+           frame_count, run_time,
+           (unsigned long long)stress.loader.queued_count,
+           (double)stress.loader.queued_count / MAX_UPLOADS,
+           (unsigned long long)stress.handed_count, in_flight_count);
+    printf("loader thread: %d uploads, %.1f MB, %.3f ms/upload\n",
+           stats.upload_count, stats.uploaded_size / 1e6,
+           stats.upload_count > 0
+               ? stats.upload_time * 1000.0 / stats.upload_count
+               : 0.0);
+    print_percentiles("loader calls per frame", loader_times, frame_count);
+    print_percentiles("frame start delay", frame_delays, frame_count);
+    if (stress.latency_count > 0) {
+        print_percentiles("hand-back latency", stress.latencies,
+                          stress.latency_count);
+    }
+    if (stress.handed_count == 0) {
+        fprintf(stderr, "no upload was handed back\n");
+        passed = false;
+    }
+    if (late_frame_count > 0) {
+        if (sysconf(_SC_NPROCESSORS_ONLN) > 1) {
+            fprintf(stderr, "%d frames were late by more than a frame\n",
+                    late_frame_count);
+            passed = false;
+        } else {
+            printf("%d frames were late by more than a frame, with a single "
+                   "CPU\n",
+                   late_frame_count);
+        }
+    }
+    if (stress.failure_count > 0) {
+        fprintf(stderr, "%llu uploads were handed back wrong\n",
+                (unsigned long long)stress.failure_count);
+        passed = false;
+    }
+    if (!check_leaks()) {
+        passed = false;
+    }
+    free(loader_times);
+    free(frame_delays);
+    free(stress.latencies);
+    free(mesh);
+    if (!passed) {
+        return EXIT_FAILURE;
+    }
+    printf("every upload was handed back in order, and nothing was leaked\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+// Stress test for the pose channel in src/main/cpp/pose_channel.c. One
+// writer publishes snapshots as fast as it can while reader threads read
+// the latest snapshot and sample the history. Every field of a snapshot is
+// derived from its index, so a reader can tell if it got a torn copy.
+//
+// Usage:
+//
+//     stress_pose_channel [reader_count] [seconds]
+//
+// Exits with a failure if any reader saw a torn or out of order snapshot,
+// or a sample that doesn't match the poses around it.
+
+#include "../main/cpp/pose_channel.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const int DEFAULT_READER_COUNT = 8;
+static const double DEFAULT_DURATION = 2.0;
+// Seconds between snapshots.
+static const double SNAPSHOT_INTERVAL = 0.001;
+// Positions wrap around, so that they stay exact in a float.
+static const uint64_t POSITION_PERIOD = 65536;
+
+struct test
+{
+    struct pose_channel channel;
+    bool stopping;
+    uint64_t write_count;
+};
+
+struct reader
+{
+    struct test* test;
+    pthread_t thread;
+    unsigned int seed;
+    uint64_t read_count;
+    uint64_t sample_count;
+    uint64_t torn_count;
+    uint64_t out_of_order_count;
+    uint64_t bad_sample_count;
+};
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static float
+get_position(uint64_t index, int offset)
+{
+    return (float)((index + offset) % POSITION_PERIOD);
+}
+
+// A rotation around z by an angle that grows by SNAPSHOT_INTERVAL radians
+// per snapshot, so that interpolated orientations can be checked.
+static void
+set_pose(struct pose* pose, uint64_t index, int offset)
+{
+    float angle = index * SNAPSHOT_INTERVAL;
+    pose->orientation[0] = 0.0;
+    pose->orientation[1] = 0.0;
+    pose->orientation[2] = sinf(0.5 * angle);
+    pose->orientation[3] = cosf(0.5 * angle);
+    for (int i = 0; i < 3; ++i) {
+        pose->position[i] = get_position(index, offset + i);
+    }
+}
+
+static void
+make_snapshot(uint64_t index, struct pose_snapshot* snapshot)
+{
+    snapshot->frame_index = index + 1;
+    snapshot->time = index * SNAPSHOT_INTERVAL;
+    set_pose(&snapshot->head, index, 0);
+    for (int i = 0; i < POSE_EYE_COUNT; ++i) {
+        set_pose(&snapshot->eyes[i], index, 3 * (1 + i));
+    }
+    snapshot->controller_mask = (1u << MAX_CONTROLLERS) - 1;
+    for (int i = 0; i < MAX_CONTROLLERS; ++i) {
+        set_pose(&snapshot->controllers[i], index,
+                 3 * (1 + POSE_EYE_COUNT + i));
+    }
+}
+
+static bool
+poses_equal(const struct pose* a, const struct pose* b)
+{
+    for (int i = 0; i < 4; ++i) {
+        if (a->orientation[i] != b->orientation[i]) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (a->position[i] != b->position[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool
+is_consistent(const struct pose_snapshot* snapshot)
+{
+    struct pose_snapshot expected;
+    make_snapshot(snapshot->index, &expected);
+    if (snapshot->frame_index != expected.frame_index ||
+        snapshot->time != expected.time ||
+        snapshot->controller_mask != expected.controller_mask ||
+        !poses_equal(&snapshot->head, &expected.head)) {
+        return false;
+    }
+    for (int i = 0; i < POSE_EYE_COUNT; ++i) {
+        if (!poses_equal(&snapshot->eyes[i], &expected.eyes[i])) {
+            return false;
+        }
+    }
+    for (int i = 0; i < MAX_CONTROLLERS; ++i) {
+        if (!poses_equal(&snapshot->controllers[i],
+                         &expected.controllers[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Positions and angles grow linearly with time, so an interpolated sample
+// must match them, except where the positions wrap around.
+static bool
+is_sample_correct(const struct pose_snapshot* sample)
+{
+    double index = sample->time / SNAPSHOT_INTERVAL;
+    double position = fmod(index, POSITION_PERIOD);
+    if (position > POSITION_PERIOD - 1) {
+        return true;
+    }
+    if (fabs(sample->head.position[0] - position) > 0.01) {
+        return false;
+    }
+    float angle = 2.0 * atan2f(sample->head.orientation[2],
+                               sample->head.orientation[3]);
+    float expected_angle = remainder(sample->time, 2.0 * M_PI);
+    return fabs(remainderf(angle - expected_angle, 2.0 * M_PI)) < 0.001;
+}
+
+static void*
+reader_main(void* data)
+{
+    struct reader* reader = data;
+    struct pose_channel* channel = &reader->test->channel;
+    uint64_t last_index = 0;
+    while (!__atomic_load_n(&reader->test->stopping, __ATOMIC_RELAXED)) {
+        struct pose_snapshot snapshot;
+        if (!pose_channel_read_latest(channel, &snapshot)) {
+            continue;
+        }
+        ++reader->read_count;
+        if (!is_consistent(&snapshot)) {
+            ++reader->torn_count;
+        }
+        if (snapshot.index < last_index) {
+            ++reader->out_of_order_count;
+        }
+        last_index = snapshot.index;
+
+        // Sample somewhere within the last few snapshots.
+        double time = snapshot.time - (rand_r(&reader->seed) % 8 + 0.5) *
+                                          SNAPSHOT_INTERVAL;
+        if (time > 0.0) {
+            struct pose_snapshot sample;
+            pose_channel_sample(channel, time, &sample);
+            ++reader->sample_count;
+            if (sample.time == time && !is_sample_correct(&sample)) {
+                ++reader->bad_sample_count;
+            }
+        }
+    }
+    return NULL;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 3) {
+        fprintf(stderr, "usage: %s [reader_count] [seconds]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int reader_count = argc > 1 ? atoi(argv[1]) : DEFAULT_READER_COUNT;
+    double duration = argc > 2 ? atof(argv[2]) : DEFAULT_DURATION;
+    if (reader_count < 1) {
+        fprintf(stderr, "need at least 1 reader\n");
+        return EXIT_FAILURE;
+    }
+
+    static struct test test;
+    pose_channel_create(&test.channel);
+    test.stopping = false;
+    test.write_count = 0;
+    struct reader* readers = calloc(reader_count, sizeof(struct reader));
+    if (readers == NULL) {
+        fprintf(stderr, "can't allocate readers\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < reader_count; ++i) {
+        readers[i].test = &test;
+        readers[i].seed = i + 1;
+        if (pthread_create(&readers[i].thread, NULL, reader_main,
+                           &readers[i]) != 0) {
+            fprintf(stderr, "can't create reader %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    double start_time = get_time();
+    while (get_time() - start_time < duration) {
+        // Check the clock every so often, so that the writer spends its
+        // time publishing.
+        for (int i = 0; i < 1024; ++i) {
+            struct pose_snapshot snapshot;
+            make_snapshot(test.write_count++, &snapshot);
+            pose_channel_publish(&test.channel, &snapshot);
+        }
+    }
+    __atomic_store_n(&test.stopping, true, __ATOMIC_RELAXED);
+
+    uint64_t read_count = 0;
+    uint64_t sample_count = 0;
+    uint64_t torn_count = 0;
+    uint64_t out_of_order_count = 0;
+    uint64_t bad_sample_count = 0;
+    for (int i = 0; i < reader_count; ++i) {
+        pthread_join(readers[i].thread, NULL);
+        read_count += readers[i].read_count;
+        sample_count += readers[i].sample_count;
+        torn_count += readers[i].torn_count;
+        out_of_order_count += readers[i].out_of_order_count;
+        bad_sample_count += readers[i].bad_sample_count;
+    }
+    free(readers);
+
+    printf("%d readers, %.1f s: %llu snapshots published, %llu read, %llu "
+           "sampled\n",
+           reader_count, duration, (unsigned long long)test.write_count,
+           (unsigned long long)read_count, (unsigned long long)sample_count);
+    printf("torn reads %llu, out of order reads %llu, bad samples %llu\n",
+           (unsigned long long)torn_count,
+           (unsigned long long)out_of_order_count,
+           (unsigned long long)bad_sample_count);
+    return torn_count == 0 && out_of_order_count == 0 && bad_sample_count == 0
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+}
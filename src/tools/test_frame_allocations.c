@@ -0,0 +1,788 @@
+// Test that the CPU side of a frame doesn't touch the heap once it reaches
+// a steady state. Runs frames in the order of the app's frame loop, through
+// the modules in src/main/cpp and with the sizes and rates in
+// frame_config.h: publishing the predicted poses, stepping the simulation,
+// handing back finished uploads from the loader, streaming texture levels
+// in, updating the transform hierarchy, taking the dirty rectangles of the
+// shadow cache, sampling the characters' animations and binning the lights
+// on the job system, streaming the palettes, lights and clusters, recording
+// the draws in command buffers on all workers and replaying them for both
+// eyes, and updating the layers. Like the app's HUD, the quad layer's stats
+// change every FRAME_STATS_INTERVAL frames, and it is then laid out with a
+// text batch and rendered again.
+//
+// A mesh is queued on the loader every MESH_INTERVAL frames, and the
+// texture is only requested in full after the first
+// STEADY_STATE_FRAME_INDEX frames, so that handing back uploads and
+// streaming in levels also happen during the steady state.
+//
+// GL and EGL calls go to the fake driver in src/tools/host, and swap chains
+// to the fake VrApi there. The tool is linked with --wrap for malloc and
+// friends, so it counts every heap allocation made by the modules, on any
+// thread, whether through memory_alloc or not. It can't see allocations
+// made inside libc, the real GL driver or VrApi.
+//
+// Usage:
+//
+//     test_frame_allocations [frame_count]
+//
+// Exits with a failure if any frame after the first STEADY_STATE_FRAME_INDEX
+// allocates, if the texture or the uploads didn't make it in, or if GL
+// objects or swap chains were leaked.
+
+#include "../main/cpp/animation.h"
+#include "../main/cpp/command_buffer.h"
+#include "../main/cpp/font.h"
+#include "../main/cpp/frame_config.h"
+#include "../main/cpp/gpu_sync.h"
+#include "../main/cpp/job.h"
+#include "../main/cpp/layer.h"
+#include "../main/cpp/light_clusters.h"
+#include "../main/cpp/loader.h"
+#include "../main/cpp/memory.h"
+#include "../main/cpp/pipeline.h"
+#include "../main/cpp/pose_channel.h"
+#include "../main/cpp/shadow_cache.h"
+#include "../main/cpp/simulation.h"
+#include "../main/cpp/stream_buffer.h"
+#include "../main/cpp/text.h"
+#include "../main/cpp/texture.h"
+#include "../main/cpp/transform.h"
+#include "VrApi_Helpers.h"
+#include "host/fake_gl.h"
+#include "host/fake_vrapi.h"
+#include "host/ktx2_builder.h"
+#include <GLES3/gl3.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const int DEFAULT_FRAME_COUNT = 1000;
+// Display rate of the headset.
+static const double FRAME_TIME = 1.0 / 72.0;
+static const int WORKER_COUNT = 4;
+static const int JOINT_COUNT = 16;
+static const int CLIP_FRAME_COUNT = 32;
+static const float CLIP_FRAME_RATE = 30.0;
+static const float LIGHT_CLUSTER_FAR = 20.0;
+// The common GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT.
+static const size_t STORAGE_BUFFER_ALIGNMENT = 256;
+static const int MESH_INTERVAL = 30;
+// About the size of the sphere in the app.
+static const size_t MESH_VERTEX_SIZE = 2048 * 32;
+static const size_t MESH_INDEX_SIZE = 12288 * 2;
+static const int TEXTURE_SIZE = 2048;
+// The glyphs of the font are squares of this many texels, in rows of
+// FONT_COLUMN_COUNT.
+static const int GLYPH_SIZE = 8;
+static const int FONT_COLUMN_COUNT = 16;
+
+enum
+{
+    // As many objects as the app's stress scene.
+    OBJECT_COUNT = 1024,
+    GEOMETRY_COUNT = 3,
+};
+
+static uint64_t heap_alloc_count;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void* __real_aligned_alloc(size_t alignment, size_t size);
+int __real_posix_memalign(void** pointer, size_t alignment, size_t size);
+
+void*
+__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&heap_alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void*
+__wrap_calloc(size_t count, size_t size)
+{
+    __atomic_add_fetch(&heap_alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
+
+void*
+__wrap_realloc(void* pointer, size_t size)
+{
+    __atomic_add_fetch(&heap_alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_realloc(pointer, size);
+}
+
+void*
+__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+    __atomic_add_fetch(&heap_alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_aligned_alloc(alignment, size);
+}
+
+int
+__wrap_posix_memalign(void** pointer, size_t alignment, size_t size)
+{
+    __atomic_add_fetch(&heap_alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_posix_memalign(pointer, alignment, size);
+}
+
+static int failure_count;
+
+static void
+check(bool condition, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void
+check(bool condition, const char* format, ...)
+{
+    if (condition) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "failed: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    ++failure_count;
+}
+
+static double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Like the app's TEXT_VERTEX_LAYOUT. The fake driver's programs have no
+// attributes, so the locations don't matter.
+static const struct vertex_layout TEXT_VERTEX_LAYOUT = {
+    3,
+    {
+        { 0, 2, GL_FLOAT, GL_FALSE, sizeof(struct text_vertex),
+          offsetof(struct text_vertex, position) },
+        { 1, 2, GL_FLOAT, GL_FALSE, sizeof(struct text_vertex),
+          offsetof(struct text_vertex, tex_coord) },
+        { 2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct text_vertex),
+          offsetof(struct text_vertex, color) },
+    },
+};
+
+struct scene
+{
+    struct gpu_sync gpu_sync;
+    struct stream_buffer stream_buffer;
+    struct loader loader;
+    uint8_t* mesh;
+    GLuint vertex_arrays[GEOMETRY_COUNT];
+    struct texture_manager texture_manager;
+    struct ktx2 ktx2;
+    int texture;
+    struct pipeline_cache pipeline_cache;
+    struct pipeline_state pipeline_state;
+    const struct pipeline* pipeline;
+    const struct pipeline* text_pipeline;
+    uint8_t* font_data;
+    struct font font;
+    struct text_batch hud_text;
+    char hud_lines[HUD_LINE_COUNT][MAX_TEXT_LENGTH];
+    struct layer_manager layer_manager;
+    int hud_layer;
+    struct simulation simulation;
+    struct transform_hierarchy transforms;
+    int nodes[OBJECT_COUNT];
+    struct skeleton skeleton;
+    struct animation_clip clip;
+    float (*palettes)[16];
+    struct point_light lights[LIGHT_COUNT];
+    struct cluster_frustum frustums[VRAPI_FRAME_LAYER_EYE_MAX];
+    struct light_clusters light_clusters[VRAPI_FRAME_LAYER_EYE_MAX];
+    struct shadow_cache shadow_cache;
+    struct shadow_rect* shadow_rects;
+    struct pose_channel pose_channel;
+    struct arena frame_arena;
+    struct command_buffer* command_buffers;
+    uint64_t* triangle_counts;
+    ovrTracking2 tracking;
+    double time;
+    uint64_t shadow_rect_count;
+    int hud_render_count;
+    int handed_upload_count;
+};
+
+static float
+random_float(float min, float max)
+{
+    return min + (max - min) * rand() / RAND_MAX;
+}
+
+static void
+set_translation(float* matrix, const float* position)
+{
+    memset(matrix, 0, sizeof(float[16]));
+    for (int i = 0; i < 4; ++i) {
+        matrix[5 * i] = 1.0;
+    }
+    for (int i = 0; i < 3; ++i) {
+        matrix[4 * i + 3] = position[i];
+    }
+}
+
+// A font in the layout of font.h, with every glyph a square cell of an
+// empty atlas, and a solid block in the last row.
+static size_t
+create_font_data(uint8_t** data)
+{
+    int row_count =
+        (FONT_CHARACTER_COUNT + FONT_COLUMN_COUNT - 1) / FONT_COLUMN_COUNT;
+    struct font_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = FONT_MAGIC;
+    header.atlas_width = FONT_COLUMN_COUNT * GLYPH_SIZE;
+    header.atlas_height = (row_count + 1) * GLYPH_SIZE;
+    header.size = GLYPH_SIZE;
+    header.distance_range = 2.0;
+    header.ascender = GLYPH_SIZE;
+    header.line_height = 1.25 * GLYPH_SIZE;
+    header.solid_x = 0.5 * GLYPH_SIZE;
+    header.solid_y = (row_count + 0.5) * GLYPH_SIZE;
+    for (int i = 0; i < FONT_CHARACTER_COUNT; ++i) {
+        struct font_glyph* glyph = &header.glyphs[i];
+        glyph->x = i % FONT_COLUMN_COUNT * GLYPH_SIZE;
+        glyph->y = i / FONT_COLUMN_COUNT * GLYPH_SIZE;
+        // The space is empty.
+        glyph->width = i == 0 ? 0 : GLYPH_SIZE;
+        glyph->height = i == 0 ? 0 : GLYPH_SIZE;
+        glyph->bearing_x = 0.0;
+        glyph->bearing_y = GLYPH_SIZE;
+        glyph->advance = GLYPH_SIZE;
+    }
+    header.texels_offset = sizeof(header);
+    size_t size =
+        sizeof(header) + (size_t)header.atlas_width * header.atlas_height;
+    *data = calloc(size, 1);
+    memcpy(*data, &header, sizeof(header));
+    uint8_t* solid = *data + header.texels_offset +
+                     row_count * GLYPH_SIZE * header.atlas_width;
+    for (int y = 0; y < GLYPH_SIZE; ++y) {
+        memset(solid + y * header.atlas_width, 255, GLYPH_SIZE);
+    }
+    return size;
+}
+
+// Like the app's render_hud.
+static void
+render_hud(void* data, GLsizei width, GLsizei height)
+{
+    struct scene* scene = data;
+    pipeline_state_apply(&scene->pipeline_state, scene->text_pipeline);
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glUniform2f(0, width, height);
+
+    struct text_batch* batch = &scene->hud_text;
+    text_batch_begin(batch);
+    text_batch_add_rect(batch, 0.0, 0.0, width, height, HUD_BACKGROUND_COLOR);
+    float line_height =
+        scene->font.header.line_height * HUD_TEXT_SIZE /
+        scene->font.header.size;
+    for (int i = 0; i < HUD_LINE_COUNT; ++i) {
+        text_batch_add_text(batch, scene->hud_lines[i], HUD_MARGIN,
+                            HUD_MARGIN + i * line_height, HUD_TEXT_SIZE,
+                            HUD_TEXT_COLOR);
+    }
+    text_batch_draw(batch, &scene->stream_buffer, &TEXT_VERTEX_LAYOUT);
+    ++scene->hud_render_count;
+}
+
+static void
+scene_create_renderer(struct scene* scene)
+{
+    gpu_sync_create(&scene->gpu_sync, GPU_FRAMES_IN_FLIGHT);
+    stream_buffer_create(&scene->stream_buffer, &scene->gpu_sync,
+                         STREAM_BUFFER_REGION_SIZE);
+    loader_create(&scene->loader, EGL_NO_DISPLAY, NULL, EGL_NO_CONTEXT);
+    scene->mesh = calloc(MESH_VERTEX_SIZE, 1);
+    glGenVertexArrays(GEOMETRY_COUNT, scene->vertex_arrays);
+
+    texture_manager_create(&scene->texture_manager, &scene->gpu_sync,
+                           TEXTURE_UPLOAD_BUDGET, TEXTURE_MEMORY_CAP);
+    ktx2_create(&scene->ktx2, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, TEXTURE_SIZE,
+                TEXTURE_SIZE);
+    scene->texture = texture_manager_load_ktx2(
+        &scene->texture_manager, scene->ktx2.data, scene->ktx2.size);
+    texture_manager_request_level(&scene->texture_manager, scene->texture,
+                                  scene->ktx2.level_count - 1);
+
+    pipeline_cache_create(&scene->pipeline_cache);
+    struct pipeline_desc desc;
+    pipeline_desc_init(&desc);
+    desc.program = 1;
+    scene->pipeline =
+        pipeline_cache_get_pipeline(&scene->pipeline_cache, &desc);
+    pipeline_desc_init(&desc);
+    desc.program = 2;
+    desc.vertex_layout = TEXT_VERTEX_LAYOUT;
+    desc.cull_mode = CULL_MODE_NONE;
+    desc.depth_test = false;
+    desc.depth_write = false;
+    desc.blend_mode = BLEND_MODE_ALPHA;
+    scene->text_pipeline =
+        pipeline_cache_get_pipeline(&scene->pipeline_cache, &desc);
+    pipeline_cache_lock(&scene->pipeline_cache);
+    pipeline_state_reset(&scene->pipeline_state);
+
+    size_t font_size = create_font_data(&scene->font_data);
+    font_create(&scene->font, scene->font_data, font_size);
+    text_batch_create(&scene->hud_text, &scene->font);
+    for (int i = 0; i < HUD_LINE_COUNT; ++i) {
+        scene->hud_lines[i][0] = '\0';
+    }
+    layer_manager_create(&scene->layer_manager);
+    scene->hud_layer = layer_manager_add_layer(
+        &scene->layer_manager, LAYER_TYPE_QUAD, HUD_WIDTH, HUD_HEIGHT,
+        render_hud, scene);
+
+    memset(&scene->tracking, 0, sizeof(scene->tracking));
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        scene->tracking.Eye[i].ViewMatrix =
+            ovrMatrix4f_CreateTranslation(i == 0 ? 0.032 : -0.032, 0.0, 0.0);
+        scene->tracking.Eye[i].ProjectionMatrix =
+            ovrMatrix4f_CreateProjectionFov(90.0, 90.0, 0.0, 0.0, 0.1, 0.0);
+    }
+    scene->hud_render_count = 0;
+    scene->handed_upload_count = 0;
+}
+
+static void
+scene_create(struct scene* scene)
+{
+    scene_create_renderer(scene);
+    simulation_create(&scene->simulation, OBJECT_COUNT, SIMULATION_STEP,
+                      MAX_SIMULATION_STEPS);
+    transform_hierarchy_create(&scene->transforms, OBJECT_COUNT);
+    shadow_cache_create(&scene->shadow_cache, OBJECT_COUNT);
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        struct body body;
+        for (int j = 0; j < 3; ++j) {
+            body.anchor[j] = random_float(-4.0, 4.0);
+            body.position[j] = body.anchor[j] + random_float(-0.5, 0.5);
+            body.velocity[j] = 0.0;
+        }
+        body.stiffness = random_float(1.0, 10.0);
+        simulation_add_body(&scene->simulation, &body);
+        float matrix[16];
+        set_translation(matrix, body.position);
+        scene->nodes[i] =
+            transform_hierarchy_add_node(&scene->transforms, -1, matrix);
+        float bounds[4] = { 0.0, 0.0, 0.0, 0.0 };
+        shadow_cache_add_caster(&scene->shadow_cache, bounds);
+    }
+    scene->shadow_rects =
+        memory_alloc(SHADOW_CELL_COUNT * sizeof(struct shadow_rect));
+
+    scene->skeleton.joint_count = JOINT_COUNT;
+    struct joint_pose bind_pose[JOINT_COUNT];
+    for (int i = 0; i < JOINT_COUNT; ++i) {
+        scene->skeleton.parents[i] = i - 1;
+        memset(&bind_pose[i], 0, sizeof(bind_pose[i]));
+        bind_pose[i].rotation[3] = 1.0;
+        bind_pose[i].translation[1] = 0.1;
+    }
+    skeleton_set_bind_pose(&scene->skeleton, bind_pose);
+    animation_clip_create(&scene->clip, JOINT_COUNT, CLIP_FRAME_COUNT,
+                          CLIP_FRAME_RATE);
+    for (int frame = 0; frame < CLIP_FRAME_COUNT; ++frame) {
+        struct joint_pose* poses =
+            animation_clip_get_frame(&scene->clip, frame);
+        for (int joint = 0; joint < JOINT_COUNT; ++joint) {
+            float angle = 0.2 * sinf(2.0 * M_PI * frame / CLIP_FRAME_COUNT);
+            poses[joint] = bind_pose[joint];
+            poses[joint].rotation[2] = sinf(0.5 * angle);
+            poses[joint].rotation[3] = cosf(0.5 * angle);
+        }
+    }
+    scene->palettes =
+        memory_alloc(CHARACTER_COUNT * JOINT_COUNT * sizeof(float[16]));
+
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        light_clusters_create(&scene->light_clusters[i], LIGHT_COUNT);
+    }
+
+    pose_channel_create(&scene->pose_channel);
+    arena_create(&scene->frame_arena, get_frame_arena_capacity(OBJECT_COUNT));
+    scene->time = 0.0;
+    scene->shadow_rect_count = 0;
+}
+
+static void
+scene_destroy(struct scene* scene)
+{
+    arena_destroy(&scene->frame_arena);
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        light_clusters_destroy(&scene->light_clusters[i]);
+    }
+    memory_free(scene->palettes);
+    animation_clip_destroy(&scene->clip);
+    memory_free(scene->shadow_rects);
+    shadow_cache_destroy(&scene->shadow_cache);
+    transform_hierarchy_destroy(&scene->transforms);
+    simulation_destroy(&scene->simulation);
+
+    loader_destroy(&scene->loader);
+    free(scene->mesh);
+    layer_manager_destroy(&scene->layer_manager);
+    text_batch_destroy(&scene->hud_text);
+    font_destroy(&scene->font);
+    free(scene->font_data);
+    pipeline_cache_destroy(&scene->pipeline_cache);
+    texture_manager_destroy(&scene->texture_manager);
+    ktx2_destroy(&scene->ktx2);
+    glDeleteVertexArrays(GEOMETRY_COUNT, scene->vertex_arrays);
+    stream_buffer_destroy(&scene->stream_buffer);
+    gpu_sync_destroy(&scene->gpu_sync);
+}
+
+// Like renderer_finish_uploads. The buffers have no geometry to go to, so
+// they are deleted once the frames in flight are done with them.
+static void
+finish_uploads(struct scene* scene)
+{
+    struct upload uploads[UPLOAD_BATCH_SIZE];
+    int count = 0;
+    do {
+        count = loader_poll(&scene->loader, uploads, UPLOAD_BATCH_SIZE);
+        for (int i = 0; i < count; ++i) {
+            gpu_sync_delete(&scene->gpu_sync, GPU_OBJECT_BUFFER,
+                            uploads[i].name);
+        }
+        scene->handed_upload_count += count;
+    } while (count == UPLOAD_BATCH_SIZE);
+}
+
+static void
+animate_characters(void* data, int begin, int end)
+{
+    struct scene* scene = data;
+    for (int i = begin; i < end; ++i) {
+        struct animation_layer layer = { &scene->clip,
+                                         scene->time + 0.1 * i, 1.0 };
+        animation_sample(&scene->skeleton, &layer, 1,
+                         &scene->palettes[i * JOINT_COUNT]);
+    }
+}
+
+static void
+bin_lights(void* data, int begin, int end)
+{
+    struct scene* scene = data;
+    for (int i = begin; i < end; ++i) {
+        light_clusters_bin(&scene->light_clusters[i], &scene->frustums[i],
+                           scene->lights, LIGHT_COUNT);
+    }
+}
+
+// Like the app's lighting_update.
+static void
+update_lights(struct scene* scene, struct job_system* job_system)
+{
+    for (int i = 0; i < LIGHT_COUNT; ++i) {
+        float angle = 2.0 * M_PI * i / LIGHT_COUNT + scene->time;
+        float* position_radius = scene->lights[i].position_radius;
+        position_radius[0] = 3.0 * sinf(angle);
+        position_radius[1] = 1.0 + 0.25 * (i % 4);
+        position_radius[2] = -3.0 - 3.0 * cosf(angle);
+        position_radius[3] = 1.0;
+    }
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        cluster_frustum_init(
+            &scene->frustums[i],
+            (const float*)&scene->tracking.Eye[i].ViewMatrix,
+            (const float*)&scene->tracking.Eye[i].ProjectionMatrix,
+            LIGHT_CLUSTER_FAR);
+    }
+    job_parallel_for(job_system, 0, VRAPI_FRAME_LAYER_EYE_MAX, 1, bin_lights,
+                     scene);
+
+    size_t offset = 0;
+    void* data =
+        stream_buffer_map(&scene->stream_buffer, sizeof(scene->lights),
+                          STORAGE_BUFFER_ALIGNMENT, &offset);
+    memcpy(data, scene->lights, sizeof(scene->lights));
+    stream_buffer_unmap(&scene->stream_buffer);
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        const struct light_clusters* light_clusters =
+            &scene->light_clusters[i];
+        data = stream_buffer_map(&scene->stream_buffer,
+                                 light_clusters_get_size(light_clusters),
+                                 STORAGE_BUFFER_ALIGNMENT, &offset);
+        light_clusters_write(light_clusters, data);
+        stream_buffer_unmap(&scene->stream_buffer);
+    }
+}
+
+// Like the app's record_draws, with every draw binding its vertex array,
+// which is the most that get_draws_capacity allows for.
+static void
+record_draws(void* data, int begin, int end)
+{
+    struct scene* scene = data;
+    for (int chunk = begin; chunk < end; ++chunk) {
+        struct command_buffer* command_buffer =
+            &scene->command_buffers[chunk];
+        int first_draw = chunk * DRAWS_PER_COMMAND_BUFFER;
+        int last_draw = first_draw + DRAWS_PER_COMMAND_BUFFER;
+        if (last_draw > OBJECT_COUNT) {
+            last_draw = OBJECT_COUNT;
+        }
+        uint64_t triangle_count = 0;
+        for (int i = first_draw; i < last_draw; ++i) {
+            command_buffer_bind_vertex_array(
+                command_buffer, scene->vertex_arrays[i % GEOMETRY_COUNT]);
+            command_buffer_set_uniform_matrix4(
+                command_buffer, 0,
+                transform_hierarchy_get_world_matrix(&scene->transforms,
+                                                     scene->nodes[i]));
+            command_buffer_draw_elements(command_buffer, PRIMITIVE_TRIANGLES,
+                                         INDEX_TYPE_UINT16, 36, 0, 1);
+            triangle_count += 12;
+        }
+        scene->triangle_counts[chunk] = triangle_count;
+    }
+}
+
+// Like renderer_render_frame.
+static uint64_t
+scene_render(struct scene* scene, struct job_system* job_system)
+{
+    finish_uploads(scene);
+    stream_buffer_begin_frame(&scene->stream_buffer);
+    texture_manager_update(&scene->texture_manager);
+    transform_hierarchy_update(&scene->transforms);
+    scene->shadow_rect_count += shadow_cache_take_dirty_rects(
+        &scene->shadow_cache, scene->shadow_rects);
+
+    int command_buffer_count =
+        (OBJECT_COUNT + DRAWS_PER_COMMAND_BUFFER - 1) /
+        DRAWS_PER_COMMAND_BUFFER;
+    scene->command_buffers =
+        arena_alloc(&scene->frame_arena,
+                    command_buffer_count * sizeof(struct command_buffer),
+                    sizeof(void*));
+    scene->triangle_counts =
+        arena_alloc(&scene->frame_arena,
+                    command_buffer_count * sizeof(uint64_t), sizeof(uint64_t));
+    for (int i = 0; i < command_buffer_count; ++i) {
+        int draw_count = OBJECT_COUNT - i * DRAWS_PER_COMMAND_BUFFER;
+        if (draw_count > DRAWS_PER_COMMAND_BUFFER) {
+            draw_count = DRAWS_PER_COMMAND_BUFFER;
+        }
+        command_buffer_create(&scene->command_buffers[i], &scene->frame_arena,
+                              get_draws_capacity(draw_count));
+    }
+    job_parallel_for(job_system, 0, command_buffer_count, 1, record_draws,
+                     scene);
+    uint64_t triangle_count = 0;
+    for (int i = 0; i < command_buffer_count; ++i) {
+        triangle_count +=
+            VRAPI_FRAME_LAYER_EYE_MAX * scene->triangle_counts[i];
+    }
+
+    job_parallel_for(job_system, 0, CHARACTER_COUNT, CHARACTERS_PER_JOB,
+                     animate_characters, scene);
+    size_t palette_size = CHARACTER_COUNT * JOINT_COUNT * sizeof(float[16]);
+    size_t offset = 0;
+    void* data =
+        stream_buffer_map(&scene->stream_buffer, palette_size,
+                          STORAGE_BUFFER_ALIGNMENT, &offset);
+    memcpy(data, scene->palettes, palette_size);
+    stream_buffer_unmap(&scene->stream_buffer);
+    update_lights(scene, job_system);
+
+    pipeline_state_reset(&scene->pipeline_state);
+    for (int i = 0; i < VRAPI_FRAME_LAYER_EYE_MAX; ++i) {
+        ovrMatrix4f view_matrix =
+            ovrMatrix4f_Transpose(&scene->tracking.Eye[i].ViewMatrix);
+        ovrMatrix4f projection_matrix =
+            ovrMatrix4f_Transpose(&scene->tracking.Eye[i].ProjectionMatrix);
+        struct command_buffer eye_command_buffer;
+        command_buffer_create(&eye_command_buffer, &scene->frame_arena,
+                              EYE_COMMAND_BUFFER_CAPACITY);
+        command_buffer_set_uniform_matrix4(&eye_command_buffer, 1,
+                                           (const float*)&view_matrix);
+        command_buffer_set_uniform_matrix4(&eye_command_buffer, 2,
+                                           (const float*)&projection_matrix);
+        pipeline_state_apply(&scene->pipeline_state, scene->pipeline);
+        command_buffer_execute(&eye_command_buffer);
+        for (int j = 0; j < command_buffer_count; ++j) {
+            command_buffer_execute(&scene->command_buffers[j]);
+        }
+        glBindVertexArray(0);
+    }
+    return triangle_count;
+}
+
+// Like the app's frame loop, from publishing the poses to resetting the
+// frame arena.
+static void
+scene_run_frame(struct scene* scene, struct job_system* job_system,
+                uint64_t frame_index)
+{
+    scene->time = frame_index * FRAME_TIME;
+    struct pose_snapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.frame_index = frame_index;
+    snapshot.time = scene->time;
+    snapshot.head.orientation[3] = 1.0;
+    pose_channel_publish(&scene->pose_channel, &snapshot);
+
+    simulation_advance(&scene->simulation, scene->time);
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        float position[3];
+        simulation_get_position(&scene->simulation, i, scene->time,
+                                position);
+        float matrix[16];
+        set_translation(matrix, position);
+        transform_hierarchy_set_local_matrix(&scene->transforms,
+                                             scene->nodes[i], matrix);
+        float bounds[4] = { position[0] / 8.0 + 0.45, position[2] / 8.0 + 0.45,
+                            position[0] / 8.0 + 0.55,
+                            position[2] / 8.0 + 0.55 };
+        shadow_cache_move_caster(&scene->shadow_cache, i, bounds);
+    }
+
+    if (frame_index % MESH_INTERVAL == 0) {
+        loader_upload_buffer(&scene->loader, GL_ARRAY_BUFFER, scene->mesh,
+                             MESH_VERTEX_SIZE);
+        loader_upload_buffer(&scene->loader, GL_ELEMENT_ARRAY_BUFFER,
+                             scene->mesh, MESH_INDEX_SIZE);
+    }
+    if (frame_index == STEADY_STATE_FRAME_INDEX + 1) {
+        texture_manager_request_level(&scene->texture_manager,
+                                      scene->texture, 0);
+    }
+
+    gpu_sync_begin_frame(&scene->gpu_sync, frame_index);
+    scene_render(scene, job_system);
+    const ovrLayerHeader2* headers[MAX_LAYERS];
+    layer_manager_update(&scene->layer_manager, &scene->tracking, headers);
+    gpu_sync_end_frame(&scene->gpu_sync);
+    arena_reset(&scene->frame_arena);
+}
+
+// Like renderer_update_hud.
+static void
+scene_update_hud(struct scene* scene, double cpu_time,
+                 uint64_t heap_alloc_count)
+{
+    snprintf(scene->hud_lines[0], MAX_TEXT_LENGTH, "cpu %.2f ms/frame",
+             cpu_time * 1000.0 / FRAME_STATS_INTERVAL);
+    snprintf(scene->hud_lines[1], MAX_TEXT_LENGTH, "gpu wait %.2f ms",
+             scene->gpu_sync.stats.wait_time * 1000.0);
+    snprintf(scene->hud_lines[2], MAX_TEXT_LENGTH, "uploads %d",
+             scene->handed_upload_count);
+    snprintf(scene->hud_lines[3], MAX_TEXT_LENGTH, "heap allocations %llu",
+             (unsigned long long)heap_alloc_count);
+    layer_manager_invalidate(&scene->layer_manager, scene->hud_layer);
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [frame_count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int frame_count = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAME_COUNT;
+    if (frame_count <= (int)STEADY_STATE_FRAME_INDEX + MESH_INTERVAL) {
+        fprintf(stderr, "need more than %d frames\n",
+                (int)STEADY_STATE_FRAME_INDEX + MESH_INTERVAL);
+        return EXIT_FAILURE;
+    }
+
+    struct job_system job_system;
+    job_system_create(&job_system, WORKER_COUNT, false);
+    static struct scene scene;
+    scene_create(&scene);
+
+    int failed_frame_count = 0;
+    uint64_t total_heap_alloc_count = 0;
+    uint64_t total_memory_alloc_count = 0;
+    double cpu_time = 0.0;
+    for (int frame = 1; frame <= frame_count; ++frame) {
+        struct memory_stats before;
+        memory_get_stats(&before);
+        uint64_t heap_alloc_count_before =
+            __atomic_load_n(&heap_alloc_count, __ATOMIC_RELAXED);
+        double start_time = get_time();
+        scene_run_frame(&scene, &job_system, frame);
+        cpu_time += get_time() - start_time;
+        if (frame % FRAME_STATS_INTERVAL == 0) {
+            scene_update_hud(&scene, cpu_time, total_heap_alloc_count);
+            cpu_time = 0.0;
+        }
+        struct memory_stats after;
+        memory_get_stats(&after);
+        uint64_t frame_heap_alloc_count =
+            __atomic_load_n(&heap_alloc_count, __ATOMIC_RELAXED) -
+            heap_alloc_count_before;
+        uint64_t frame_memory_alloc_count =
+            after.alloc_count - before.alloc_count;
+        if (frame <= (int)STEADY_STATE_FRAME_INDEX) {
+            continue;
+        }
+        total_heap_alloc_count += frame_heap_alloc_count;
+        total_memory_alloc_count += frame_memory_alloc_count;
+        if (frame_heap_alloc_count > 0 && failed_frame_count++ < 10) {
+            fprintf(stderr,
+                    "frame %d made %llu heap allocations, %llu of them "
+                    "through memory_alloc\n",
+                    frame, (unsigned long long)frame_heap_alloc_count,
+                    (unsigned long long)frame_memory_alloc_count);
+        }
+    }
+    check(failed_frame_count == 0, "%d frames allocated", failed_frame_count);
+
+    const struct texture* texture =
+        &scene.texture_manager.textures[scene.texture];
+    check(texture->resident_level == 0,
+          "the texture only streamed in down to level %d",
+          texture->resident_level);
+    check(scene.handed_upload_count > 0, "no uploads were handed back");
+    check(scene.hud_render_count > 1, "the HUD was rendered %d times",
+          scene.hud_render_count);
+    printf("%d frames after %d warmup frames, %d workers: %llu heap "
+           "allocations, %llu through memory_alloc\n",
+           frame_count - (int)STEADY_STATE_FRAME_INDEX,
+           (int)STEADY_STATE_FRAME_INDEX, WORKER_COUNT,
+           (unsigned long long)total_heap_alloc_count,
+           (unsigned long long)total_memory_alloc_count);
+    printf("%llu shadow rectangles taken, %llu draws, %d uploads handed "
+           "back, %zu texture bytes resident, HUD rendered %d times\n",
+           (unsigned long long)scene.shadow_rect_count,
+           (unsigned long long)fake_gl_get_draw_count(),
+           scene.handed_upload_count, scene.texture_manager.resident_size,
+           scene.hud_render_count);
+
+    scene_destroy(&scene);
+    job_system_destroy(&job_system);
+    for (enum fake_gl_object_type type = FAKE_GL_BUFFER;
+         type != FAKE_GL_OBJECT_TYPE_COUNT; ++type) {
+        check(fake_gl_get_live_count(type) == 0,
+              "%d GL objects of type %d leaked",
+              fake_gl_get_live_count(type), type);
+    }
+    check(fake_vrapi_get_swap_chain_count() == 0, "%d swap chains leaked",
+          fake_vrapi_get_swap_chain_count());
+    if (failure_count > 0) {
+        fprintf(stderr, "%d checks failed\n", failure_count);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+// Test for the layers in src/main/cpp/layer.c, whose content is only
+// rendered again when it has been invalidated. Sets up a quad layer like
+// the app's HUD and a cylinder layer, and runs frames in which the HUD is
+// invalidated now and then, like the app does when its stats change, and
+// in which the cylinder is moved around. Checks that:
+//
+// - a layer's content is rendered once when it is added, and again only on
+//   the update after it was invalidated, at the size of the layer
+// - a layer that is only moved is reused, not rendered again
+// - pixels_rendered and pixels_reused add up the layers that were rendered
+//   and reused during the update
+// - a reused layer keeps submitting the swap chain image it was last
+//   rendered to, and a rendered one moves on to the next image
+// - destroying the layers frees their swap chains and framebuffers
+//
+// GL calls go to the fake driver in src/tools/host, and swap chains to the
+// fake VrApi there.
+//
+// Usage:
+//
+//     test_layers [frame_count]
+//
+// Exits with a failure if any check fails.
+
+#include "../main/cpp/frame_config.h"
+#include "../main/cpp/layer.h"
+#include "VrApi_Helpers.h"
+#include "host/fake_gl.h"
+#include "host/fake_vrapi.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int DEFAULT_FRAME_COUNT = 1000;
+static const GLsizei PANEL_WIDTH = 256;
+static const GLsizei PANEL_HEIGHT = 256;
+// The HUD is invalidated every FRAME_STATS_INTERVAL frames, like in the
+// app, and the panel is moved every PANEL_MOVE_INTERVAL frames.
+static const int PANEL_MOVE_INTERVAL = 5;
+
+enum
+{
+    HUD_LAYER,
+    PANEL_LAYER,
+    LAYER_COUNT,
+};
+
+struct content
+{
+    int render_count;
+    GLsizei width;
+    GLsizei height;
+};
+
+static int failure_count;
+
+static void
+check(bool condition, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void
+check(bool condition, const char* format, ...)
+{
+    if (condition) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "failed: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    ++failure_count;
+}
+
+static void
+render_content(void* data, GLsizei width, GLsizei height)
+{
+    struct content* content = data;
+    ++content->render_count;
+    content->width = width;
+    content->height = height;
+}
+
+static int
+get_swap_chain_index(const ovrLayerHeader2* header)
+{
+    if (header->Type == VRAPI_LAYER_TYPE_CYLINDER2) {
+        const ovrLayerCylinder2* cylinder = (const ovrLayerCylinder2*)header;
+        return cylinder->Textures[0].SwapChainIndex;
+    }
+    const ovrLayerProjection2* projection = (const ovrLayerProjection2*)header;
+    return projection->Textures[0].SwapChainIndex;
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [frame_count]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int frame_count = argc > 1 ? atoi(argv[1]) : DEFAULT_FRAME_COUNT;
+    if (frame_count < 1) {
+        fprintf(stderr, "need at least 1 frame\n");
+        return EXIT_FAILURE;
+    }
+
+    static const GLsizei SIZES[LAYER_COUNT][2] = {
+        { HUD_WIDTH, HUD_HEIGHT },
+        { PANEL_WIDTH, PANEL_HEIGHT },
+    };
+    struct layer_manager manager;
+    layer_manager_create(&manager);
+    struct content contents[LAYER_COUNT];
+    memset(contents, 0, sizeof(contents));
+    int hud_layer = layer_manager_add_layer(&manager, LAYER_TYPE_QUAD,
+                                            HUD_WIDTH, HUD_HEIGHT,
+                                            render_content, &contents[0]);
+    int panel_layer = layer_manager_add_layer(
+        &manager, LAYER_TYPE_CYLINDER, PANEL_WIDTH, PANEL_HEIGHT,
+        render_content, &contents[1]);
+    check(hud_layer == HUD_LAYER && panel_layer == PANEL_LAYER,
+          "layers added as %d and %d instead of 0 and 1", hud_layer,
+          panel_layer);
+    check(contents[0].render_count == 0 && contents[1].render_count == 0,
+          "layers rendered before the first update");
+
+    ovrTracking2 tracking;
+    memset(&tracking, 0, sizeof(tracking));
+    for (int eye = 0; eye < VRAPI_FRAME_LAYER_EYE_MAX; ++eye) {
+        tracking.Eye[eye].ViewMatrix =
+            ovrMatrix4f_CreateTranslation(eye == 0 ? 0.032 : -0.032, 0.0, 0.0);
+    }
+
+    int previous_swap_chain_indices[LAYER_COUNT] = { 0, 0 };
+    int render_counts[LAYER_COUNT] = { 0, 0 };
+    uint64_t pixels_rendered = 0;
+    uint64_t pixels_reused = 0;
+    for (int frame = 0; frame < frame_count; ++frame) {
+        bool dirty[LAYER_COUNT];
+        dirty[HUD_LAYER] = frame % FRAME_STATS_INTERVAL == 0;
+        dirty[PANEL_LAYER] = frame == 0;
+        if (dirty[HUD_LAYER] && frame > 0) {
+            layer_manager_invalidate(&manager, HUD_LAYER);
+        }
+        if (frame % PANEL_MOVE_INTERVAL == 0) {
+            ovrMatrix4f model_matrix =
+                ovrMatrix4f_CreateTranslation(0.001 * frame, 0.0, -1.0);
+            layer_manager_set_model_matrix(&manager, PANEL_LAYER,
+                                           &model_matrix);
+        }
+
+        const ovrLayerHeader2* headers[MAX_LAYERS];
+        int count = layer_manager_update(&manager, &tracking, headers);
+        check(count == LAYER_COUNT, "frame %d submitted %d layers", frame,
+              count);
+        uint64_t expected_rendered = 0;
+        uint64_t expected_reused = 0;
+        for (int i = 0; i < LAYER_COUNT && i < count; ++i) {
+            uint64_t pixel_count = (uint64_t)SIZES[i][0] * SIZES[i][1];
+            int swap_chain_index = get_swap_chain_index(headers[i]);
+            if (dirty[i]) {
+                ++render_counts[i];
+                expected_rendered += pixel_count;
+                check(swap_chain_index != previous_swap_chain_indices[i] ||
+                          frame == 0,
+                      "frame %d rendered layer %d into the swap chain image "
+                      "it submitted last",
+                      frame, i);
+            } else {
+                expected_reused += pixel_count;
+                check(swap_chain_index == previous_swap_chain_indices[i],
+                      "frame %d reused layer %d, but submitted swap chain "
+                      "image %d instead of %d",
+                      frame, i, swap_chain_index,
+                      previous_swap_chain_indices[i]);
+            }
+            previous_swap_chain_indices[i] = swap_chain_index;
+            check(contents[i].render_count == render_counts[i],
+                  "layer %d rendered %d times after frame %d instead of %d",
+                  i, contents[i].render_count, frame, render_counts[i]);
+        }
+        check(manager.stats.pixels_rendered == expected_rendered &&
+                  manager.stats.pixels_reused == expected_reused,
+              "frame %d counted %llu pixels rendered and %llu reused instead "
+              "of %llu and %llu",
+              frame, (unsigned long long)manager.stats.pixels_rendered,
+              (unsigned long long)manager.stats.pixels_reused,
+              (unsigned long long)expected_rendered,
+              (unsigned long long)expected_reused);
+        pixels_rendered += manager.stats.pixels_rendered;
+        pixels_reused += manager.stats.pixels_reused;
+    }
+    for (int i = 0; i < LAYER_COUNT; ++i) {
+        check(contents[i].width == SIZES[i][0] &&
+                  contents[i].height == SIZES[i][1],
+              "layer %d rendered at %dx%d instead of %dx%d", i,
+              contents[i].width, contents[i].height, SIZES[i][0],
+              SIZES[i][1]);
+    }
+    check(manager.layers[HUD_LAYER].ovr_layer.Header.Type ==
+                  VRAPI_LAYER_TYPE_PROJECTION2 &&
+              manager.layers[PANEL_LAYER].ovr_layer.Header.Type ==
+                  VRAPI_LAYER_TYPE_CYLINDER2,
+          "layers submitted as types %d and %d",
+          manager.layers[HUD_LAYER].ovr_layer.Header.Type,
+          manager.layers[PANEL_LAYER].ovr_layer.Header.Type);
+
+    layer_manager_destroy(&manager);
+    check(fake_vrapi_get_swap_chain_count() == 0, "%d swap chains leaked",
+          fake_vrapi_get_swap_chain_count());
+    check(fake_gl_get_live_count(FAKE_GL_FRAMEBUFFER) == 0,
+          "%d framebuffers leaked",
+          fake_gl_get_live_count(FAKE_GL_FRAMEBUFFER));
+
+    printf("%d frames: HUD rendered %d times, panel %d times; %llu pixels "
+           "rendered, %llu reused (%.1f%%)\n",
+           frame_count, render_counts[HUD_LAYER], render_counts[PANEL_LAYER],
+           (unsigned long long)pixels_rendered,
+           (unsigned long long)pixels_reused,
+           100.0 * pixels_reused / (pixels_rendered + pixels_reused));
+    if (failure_count > 0) {
+        fprintf(stderr, "%d checks failed\n", failure_count);
+        return EXIT_FAILURE;
+    }
+    printf("unchanged layers were reused, and invalidated ones rendered "
+           "again\n");
+    return EXIT_SUCCESS;
+}
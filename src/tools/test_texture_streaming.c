@@ -0,0 +1,545 @@
+// Test for the texture manager in src/main/cpp/texture.c, which loads KTX2
+// textures and streams their mip levels in under a per-frame budget. Builds
+// KTX2 files in memory, and checks:
+//
+// - that their headers and level indices are parsed, and that invalid ones,
+//   including level ranges that would wrap around, are rejected
+// - that loading uploads only the coarsest level
+// - that levels stream in coarsest first across all textures, one level at
+//   a time per texture
+// - that no frame uploads more than the budget, unless a single level is
+//   bigger than the budget, and that every frame with levels left uploads
+//   as much as fits
+// - that the finest levels of the largest textures are evicted until the
+//   resident size fits under the cap, and aren't streamed in again until
+//   they are requested again
+//
+// GL calls go to the fake driver in src/tools/host, which records every
+// texture level upload and checks the texture memory that the manager
+// accounts for against the levels that live textures actually hold.
+//
+// Usage:
+//
+//     test_texture_streaming
+//
+// Exits with a failure if any check fails.
+
+#include "../main/cpp/frame_config.h"
+#include "../main/cpp/gpu_sync.h"
+#include "../main/cpp/texture.h"
+#include "host/fake_gl.h"
+#include "host/ktx2_builder.h"
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR 0x93B0
+#endif // GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+
+#ifndef GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR 0x93D0
+#endif // GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR
+
+static int failure_count;
+
+static void
+check(bool condition, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void
+check(bool condition, const char* format, ...)
+{
+    if (condition) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "failed: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    ++failure_count;
+}
+
+// Checks that the texture manager accounts for what the fake driver's
+// textures hold. Textures that were evicted are only deleted once the
+// frames that may use them have finished, so this runs enough empty frames
+// first.
+static void
+check_texture_memory(struct texture_manager* manager,
+                     struct gpu_sync* gpu_sync, uint64_t* frame_index)
+{
+    for (int i = 0; i < GPU_FRAMES_IN_FLIGHT + 1; ++i) {
+        gpu_sync_begin_frame(gpu_sync, ++*frame_index);
+        gpu_sync_end_frame(gpu_sync);
+    }
+    size_t size = 0;
+    for (int i = 0; i < manager->texture_count; ++i) {
+        size += manager->textures[i].resident_size;
+    }
+    check(size == manager->resident_size,
+          "textures hold %zu bytes, but the manager counts %zu", size,
+          manager->resident_size);
+    check(fake_gl_get_texture_memory() == manager->resident_size,
+          "the driver holds %zu bytes of textures, but the manager counts "
+          "%zu",
+          fake_gl_get_texture_memory(), manager->resident_size);
+}
+
+static void
+check_parsing(void)
+{
+    struct gpu_sync gpu_sync;
+    gpu_sync_create(&gpu_sync, GPU_FRAMES_IN_FLIGHT);
+    struct texture_manager manager;
+    texture_manager_create(&manager, &gpu_sync, SIZE_MAX, SIZE_MAX);
+
+    struct ktx2 ktx2;
+    ktx2_create(&ktx2, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, 256, 128);
+    int index = texture_manager_load_ktx2(&manager, ktx2.data, ktx2.size);
+    const struct texture* texture = &manager.textures[index];
+    check(texture->width == 256 && texture->height == 128,
+          "256x128 texture loaded as %dx%d", texture->width, texture->height);
+    check(texture->level_count == 9, "9 levels loaded as %d",
+          texture->level_count);
+    check(texture->internal_format == GL_COMPRESSED_RGBA_ASTC_4x4_KHR,
+          "ASTC 4x4 loaded as format 0x%x", texture->internal_format);
+    size_t offset = KTX2_LEVEL_INDEX + ktx2.level_count * KTX2_LEVEL_SIZE;
+    for (int level = ktx2.level_count - 1; level >= 0; --level) {
+        check(texture->levels[level].offset == offset &&
+                  texture->levels[level].size == ktx2.level_sizes[level],
+              "level %d loaded at %zu, %zu bytes, instead of %zu, %zu bytes",
+              level, texture->levels[level].offset,
+              texture->levels[level].size, offset, ktx2.level_sizes[level]);
+        offset += ktx2.level_sizes[level];
+    }
+
+    // Only the 1x1 level is uploaded.
+    struct fake_gl_texture_upload uploads[FAKE_GL_MAX_TEXTURE_UPLOADS];
+    int upload_count =
+        fake_gl_take_texture_uploads(uploads, FAKE_GL_MAX_TEXTURE_UPLOADS);
+    check(upload_count == 1 && uploads[0].texture == texture->texture &&
+              uploads[0].level == 8 && uploads[0].width == 1 &&
+              uploads[0].height == 1 && uploads[0].size == 16,
+          "loading uploaded %d levels instead of the 1x1 level 8",
+          upload_count);
+    check(texture->resident_level == 8 && texture->resident_size == 16,
+          "level %d, %zu bytes resident after loading, instead of level 8, "
+          "16 bytes",
+          texture->resident_level, texture->resident_size);
+
+    static const struct
+    {
+        uint32_t vk_format;
+        GLenum internal_format;
+    } FORMATS[] = {
+        { VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, GL_COMPRESSED_RGB8_ETC2 },
+        { VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK,
+          GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC },
+        { VK_FORMAT_ASTC_4x4_SRGB_BLOCK,
+          GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR },
+        // The last ASTC format, 12x12.
+        { VK_FORMAT_ASTC_12x12_SRGB_BLOCK,
+          GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR + 13 },
+    };
+    struct ktx2 format_ktx2s[sizeof(FORMATS) / sizeof(FORMATS[0])];
+    for (size_t i = 0; i < sizeof(FORMATS) / sizeof(FORMATS[0]); ++i) {
+        ktx2_create(&format_ktx2s[i], FORMATS[i].vk_format, 16, 16);
+        int format_index = texture_manager_load_ktx2(
+            &manager, format_ktx2s[i].data, format_ktx2s[i].size);
+        GLenum internal_format =
+            manager.textures[format_index].internal_format;
+        check(internal_format == FORMATS[i].internal_format,
+              "format %u loaded as 0x%x instead of 0x%x",
+              FORMATS[i].vk_format, internal_format,
+              FORMATS[i].internal_format);
+    }
+    fake_gl_take_texture_uploads(uploads, 0);
+    uint64_t frame_index = 0;
+    check_texture_memory(&manager, &gpu_sync, &frame_index);
+
+    texture_manager_destroy(&manager);
+    gpu_sync_destroy(&gpu_sync);
+    for (size_t i = 0; i < sizeof(FORMATS) / sizeof(FORMATS[0]); ++i) {
+        ktx2_destroy(&format_ktx2s[i]);
+    }
+    ktx2_destroy(&ktx2);
+}
+
+// The ways a KTX2 file can be broken, which the texture manager must
+// reject. Each one changes a valid file.
+enum broken_ktx2
+{
+    BROKEN_KTX2_TRUNCATED_HEADER,
+    BROKEN_KTX2_IDENTIFIER,
+    BROKEN_KTX2_SUPERCOMPRESSION,
+    BROKEN_KTX2_VOLUME,
+    BROKEN_KTX2_CUBE_MAP,
+    BROKEN_KTX2_ARRAY,
+    BROKEN_KTX2_FORMAT,
+    BROKEN_KTX2_LEVEL_COUNT,
+    BROKEN_KTX2_TRUNCATED_LEVEL_INDEX,
+    BROKEN_KTX2_LEVEL_OFFSET,
+    BROKEN_KTX2_LEVEL_LENGTH,
+    // Offset plus length wraps around to within the file.
+    BROKEN_KTX2_LEVEL_WRAP,
+    BROKEN_KTX2_COUNT,
+};
+
+static const char* const BROKEN_KTX2_NAMES[BROKEN_KTX2_COUNT] = {
+    "truncated header",
+    "wrong identifier",
+    "supercompression",
+    "3D texture",
+    "cube map",
+    "array",
+    "uncompressed format",
+    "too many levels",
+    "truncated level index",
+    "level offset past the end",
+    "level length past the end",
+    "level range that wraps around",
+};
+
+static void
+break_ktx2(struct ktx2* ktx2, enum broken_ktx2 broken)
+{
+    size_t level_index = KTX2_LEVEL_INDEX;
+    switch (broken) {
+        case BROKEN_KTX2_TRUNCATED_HEADER:
+            ktx2->size = KTX2_LEVEL_INDEX - 1;
+            break;
+        case BROKEN_KTX2_IDENTIFIER:
+            ktx2->data[5] = '1';
+            break;
+        case BROKEN_KTX2_SUPERCOMPRESSION:
+            ktx2_write_u32(ktx2, KTX2_SUPERCOMPRESSION_SCHEME, 1);
+            break;
+        case BROKEN_KTX2_VOLUME:
+            ktx2_write_u32(ktx2, KTX2_PIXEL_DEPTH, 4);
+            break;
+        case BROKEN_KTX2_CUBE_MAP:
+            ktx2_write_u32(ktx2, KTX2_FACE_COUNT, 6);
+            break;
+        case BROKEN_KTX2_ARRAY:
+            ktx2_write_u32(ktx2, KTX2_LAYER_COUNT, 4);
+            break;
+        case BROKEN_KTX2_FORMAT:
+            ktx2_write_u32(ktx2, KTX2_VK_FORMAT, VK_FORMAT_R8G8B8A8_UNORM);
+            break;
+        case BROKEN_KTX2_LEVEL_COUNT:
+            ktx2_write_u32(ktx2, KTX2_LEVEL_COUNT, MAX_TEXTURE_LEVELS + 1);
+            break;
+        case BROKEN_KTX2_TRUNCATED_LEVEL_INDEX:
+            ktx2->size = KTX2_LEVEL_INDEX + KTX2_LEVEL_SIZE;
+            break;
+        case BROKEN_KTX2_LEVEL_OFFSET:
+            ktx2_write_u64(ktx2, level_index, ktx2->size + 1);
+            ktx2_write_u64(ktx2, level_index + 8, 0);
+            break;
+        case BROKEN_KTX2_LEVEL_LENGTH:
+            ktx2_write_u64(ktx2, level_index + 8, ktx2->size);
+            break;
+        case BROKEN_KTX2_LEVEL_WRAP:
+            ktx2_write_u64(ktx2, level_index, UINT64_MAX - 15);
+            ktx2_write_u64(ktx2, level_index + 8, 32);
+            break;
+        case BROKEN_KTX2_COUNT:
+            break;
+    }
+}
+
+// Loading exits on errors, so each broken file is loaded in a child
+// process, with its error message dropped.
+static void
+check_broken_ktx2s(void)
+{
+    for (enum broken_ktx2 broken = 0; broken < BROKEN_KTX2_COUNT; ++broken) {
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            freopen("/dev/null", "w", stderr);
+            struct gpu_sync gpu_sync;
+            gpu_sync_create(&gpu_sync, GPU_FRAMES_IN_FLIGHT);
+            struct texture_manager manager;
+            texture_manager_create(&manager, &gpu_sync, SIZE_MAX, SIZE_MAX);
+            struct ktx2 ktx2;
+            ktx2_create(&ktx2, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, 64, 64);
+            break_ktx2(&ktx2, broken);
+            texture_manager_load_ktx2(&manager, ktx2.data, ktx2.size);
+            exit(EXIT_SUCCESS);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        check(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE,
+              "loaded a KTX2 file with a %s", BROKEN_KTX2_NAMES[broken]);
+    }
+}
+
+// Runs frames until nothing is left to stream in, and checks the order and
+// the budget of the uploads. Returns the number of frames.
+static int
+stream_in(struct texture_manager* manager, struct gpu_sync* gpu_sync,
+          uint64_t* frame_index)
+{
+    int frame_count = 0;
+    int previous_level = MAX_TEXTURE_LEVELS;
+    for (;;) {
+        int resident_levels[MAX_TEXTURES];
+        bool done = true;
+        for (int i = 0; i < manager->texture_count; ++i) {
+            const struct texture* texture = &manager->textures[i];
+            resident_levels[i] = texture->resident_level;
+            done = done && texture->resident_level <= texture->requested_level;
+        }
+        if (done) {
+            break;
+        }
+
+        gpu_sync_begin_frame(gpu_sync, ++*frame_index);
+        texture_manager_update(manager);
+        gpu_sync_end_frame(gpu_sync);
+        ++frame_count;
+
+        struct fake_gl_texture_upload uploads[FAKE_GL_MAX_TEXTURE_UPLOADS];
+        int upload_count = fake_gl_take_texture_uploads(
+            uploads, FAKE_GL_MAX_TEXTURE_UPLOADS);
+        check(upload_count > 0, "frame %d uploaded nothing", frame_count);
+        size_t uploaded_size = 0;
+        for (int i = 0; i < upload_count; ++i) {
+            const struct fake_gl_texture_upload* upload = &uploads[i];
+            int index = 0;
+            while (index < manager->texture_count &&
+                   manager->textures[index].texture != upload->texture) {
+                ++index;
+            }
+            if (index == manager->texture_count) {
+                check(false, "uploaded to texture %u, which isn't loaded",
+                      upload->texture);
+                continue;
+            }
+            check(upload->level == resident_levels[index] - 1,
+                  "uploaded level %d of texture %d, whose finest level was "
+                  "%d",
+                  upload->level, index, resident_levels[index]);
+            check(upload->level <= previous_level,
+                  "uploaded level %d after level %d", upload->level,
+                  previous_level);
+            resident_levels[index] = upload->level;
+            previous_level = upload->level;
+            uploaded_size += upload->size;
+        }
+        check(uploaded_size == manager->uploaded_size,
+              "frame %d uploaded %zu bytes, but the manager counts %zu",
+              frame_count, uploaded_size, manager->uploaded_size);
+        check(upload_count == 1 || uploaded_size <= manager->upload_budget,
+              "frame %d uploaded %zu bytes in %d levels, over the budget of "
+              "%zu",
+              frame_count, uploaded_size, upload_count,
+              manager->upload_budget);
+
+        // The next level in line must not have fit.
+        const struct texture* next_texture = NULL;
+        for (int i = 0; i < manager->texture_count; ++i) {
+            const struct texture* texture = &manager->textures[i];
+            if (texture->resident_level > texture->requested_level &&
+                (next_texture == NULL ||
+                 texture->resident_level > next_texture->resident_level)) {
+                next_texture = texture;
+            }
+        }
+        if (next_texture != NULL) {
+            size_t next_size =
+                next_texture->levels[next_texture->resident_level - 1].size;
+            check(uploaded_size + next_size > manager->upload_budget,
+                  "frame %d stopped at %zu bytes, but %zu more would have "
+                  "fit in the budget of %zu",
+                  frame_count, uploaded_size, next_size,
+                  manager->upload_budget);
+        }
+    }
+    return frame_count;
+}
+
+static void
+check_streaming(void)
+{
+    struct gpu_sync gpu_sync;
+    gpu_sync_create(&gpu_sync, GPU_FRAMES_IN_FLIGHT);
+    uint64_t frame_index = 0;
+
+    // With no budget to speak of, one frame streams in everything, so the
+    // order is all that matters.
+    static const int SIZES[][2] = { { 256, 256 }, { 64, 64 }, { 128, 32 } };
+    enum
+    {
+        TEXTURE_COUNT = sizeof(SIZES) / sizeof(SIZES[0]),
+    };
+    struct ktx2 ktx2s[TEXTURE_COUNT];
+    struct texture_manager manager;
+    texture_manager_create(&manager, &gpu_sync, SIZE_MAX, SIZE_MAX);
+    for (int i = 0; i < TEXTURE_COUNT; ++i) {
+        ktx2_create(&ktx2s[i], VK_FORMAT_ASTC_4x4_UNORM_BLOCK, SIZES[i][0],
+                    SIZES[i][1]);
+        texture_manager_load_ktx2(&manager, ktx2s[i].data, ktx2s[i].size);
+    }
+    fake_gl_take_texture_uploads(NULL, 0);
+    int frame_count = stream_in(&manager, &gpu_sync, &frame_index);
+    check(frame_count == 1,
+          "streaming in without a budget took %d frames instead of 1",
+          frame_count);
+    size_t total_size = 0;
+    for (int i = 0; i < TEXTURE_COUNT; ++i) {
+        for (int level = 0; level < ktx2s[i].level_count; ++level) {
+            total_size += ktx2s[i].level_sizes[level];
+        }
+        check(manager.textures[i].resident_level == 0,
+              "texture %d streamed in down to level %d instead of 0", i,
+              manager.textures[i].resident_level);
+    }
+    check(manager.resident_size == total_size,
+          "%zu bytes resident after streaming in everything, instead of %zu",
+          manager.resident_size, total_size);
+    check_texture_memory(&manager, &gpu_sync, &frame_index);
+    texture_manager_destroy(&manager);
+
+    // Levels up to 4 KB, and then the two that are bigger than the budget,
+    // one per frame.
+    static const size_t UPLOAD_BUDGET = 8 * 1024;
+    texture_manager_create(&manager, &gpu_sync, UPLOAD_BUDGET, SIZE_MAX);
+    for (int i = 0; i < TEXTURE_COUNT; ++i) {
+        texture_manager_load_ktx2(&manager, ktx2s[i].data, ktx2s[i].size);
+    }
+    // Only down to level 1 for the second texture.
+    texture_manager_request_level(&manager, 1, 1);
+    fake_gl_take_texture_uploads(NULL, 0);
+    frame_count = stream_in(&manager, &gpu_sync, &frame_index);
+    check(manager.textures[1].resident_level == 1,
+          "texture 1 streamed in down to level %d instead of the requested "
+          "1",
+          manager.textures[1].resident_level);
+    printf("streamed in %zu bytes in %d frames with a budget of %zu bytes\n",
+           manager.resident_size, frame_count, UPLOAD_BUDGET);
+    check_texture_memory(&manager, &gpu_sync, &frame_index);
+    texture_manager_destroy(&manager);
+
+    gpu_sync_destroy(&gpu_sync);
+    for (int i = 0; i < TEXTURE_COUNT; ++i) {
+        ktx2_destroy(&ktx2s[i]);
+    }
+}
+
+static void
+check_eviction(void)
+{
+    struct gpu_sync gpu_sync;
+    gpu_sync_create(&gpu_sync, GPU_FRAMES_IN_FLIGHT);
+    uint64_t frame_index = 0;
+
+    struct ktx2 large;
+    struct ktx2 small;
+    ktx2_create(&large, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, 256, 256);
+    ktx2_create(&small, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, 128, 128);
+    // Only fits without level 0 of the large texture, which is the largest
+    // level of either.
+    size_t memory_cap = 64 * 1024;
+    struct texture_manager manager;
+    texture_manager_create(&manager, &gpu_sync, SIZE_MAX, memory_cap);
+    int large_index =
+        texture_manager_load_ktx2(&manager, large.data, large.size);
+    int small_index =
+        texture_manager_load_ktx2(&manager, small.data, small.size);
+    const struct texture* large_texture = &manager.textures[large_index];
+    const struct texture* small_texture = &manager.textures[small_index];
+    fake_gl_take_texture_uploads(NULL, 0);
+
+    gpu_sync_begin_frame(&gpu_sync, ++frame_index);
+    texture_manager_update(&manager);
+    gpu_sync_end_frame(&gpu_sync);
+    check(large_texture->resident_level == 1 &&
+              small_texture->resident_level == 0,
+          "evicted down to levels %d and %d instead of 1 and 0",
+          large_texture->resident_level, small_texture->resident_level);
+    check(manager.evicted_size == large.level_sizes[0],
+          "evicted %zu bytes instead of level 0, %zu bytes",
+          manager.evicted_size, large.level_sizes[0]);
+    check(manager.resident_size <= memory_cap,
+          "%zu bytes resident, over the cap of %zu", manager.resident_size,
+          memory_cap);
+    check_texture_memory(&manager, &gpu_sync, &frame_index);
+
+    // Evicted levels stay out until they are requested again.
+    fake_gl_take_texture_uploads(NULL, 0);
+    gpu_sync_begin_frame(&gpu_sync, ++frame_index);
+    texture_manager_update(&manager);
+    gpu_sync_end_frame(&gpu_sync);
+    check(fake_gl_take_texture_uploads(NULL, 0) == 0,
+          "streamed an evicted level in again");
+    texture_manager_request_level(&manager, large_index, 0);
+    gpu_sync_begin_frame(&gpu_sync, ++frame_index);
+    texture_manager_update(&manager);
+    gpu_sync_end_frame(&gpu_sync);
+    check(large_texture->resident_level == 1 &&
+              manager.resident_size <= memory_cap,
+          "streaming the evicted level in again left level %d, %zu bytes "
+          "resident",
+          large_texture->resident_level, manager.resident_size);
+    check_texture_memory(&manager, &gpu_sync, &frame_index);
+    texture_manager_destroy(&manager);
+
+    // With a cap that nothing fits under, every texture is evicted down to
+    // its coarsest level.
+    memory_cap = 16;
+    texture_manager_create(&manager, &gpu_sync, SIZE_MAX, memory_cap);
+    texture_manager_load_ktx2(&manager, large.data, large.size);
+    texture_manager_load_ktx2(&manager, small.data, small.size);
+    gpu_sync_begin_frame(&gpu_sync, ++frame_index);
+    texture_manager_update(&manager);
+    gpu_sync_end_frame(&gpu_sync);
+    for (int i = 0; i < manager.texture_count; ++i) {
+        const struct texture* texture = &manager.textures[i];
+        check(texture->resident_level == texture->level_count - 1,
+              "texture %d evicted down to level %d instead of its coarsest",
+              i, texture->resident_level);
+    }
+    check_texture_memory(&manager, &gpu_sync, &frame_index);
+    texture_manager_destroy(&manager);
+
+    gpu_sync_destroy(&gpu_sync);
+    ktx2_destroy(&small);
+    ktx2_destroy(&large);
+}
+
+int
+main(int argc, char** argv)
+{
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    check_parsing();
+    check_broken_ktx2s();
+    check_streaming();
+    check_eviction();
+    int leaked_count = fake_gl_get_live_count(FAKE_GL_TEXTURE);
+    check(leaked_count == 0, "%d textures leaked", leaked_count);
+    leaked_count = fake_gl_get_live_count(FAKE_GL_FENCE);
+    check(leaked_count == 0, "%d fences leaked", leaked_count);
+    if (failure_count > 0) {
+        fprintf(stderr, "%d checks failed\n", failure_count);
+        return EXIT_FAILURE;
+    }
+    printf("parsing, streaming order, budget and eviction are right\n");
+    return EXIT_SUCCESS;
+}
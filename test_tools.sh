@@ -0,0 +1,89 @@
+#!/bin/bash
+# Builds the tools in src/tools that run on the build machine, and runs the
+# tests, stress tests, simulations and benchmarks among them with short
+# parameters. Stops at the first tool that fails to build or fails its
+# checks. generate_font_atlas needs FreeType, and is built by build.sh.
+set -e
+
+MAIN=../../src/main/cpp
+TOOLS=../../src/tools
+# Must come before any other include path, so that its <android/log.h> is
+# the one that is found.
+HOST="-I $TOOLS/host"
+VRAPI="-I $OVR_HOME/VrApi/Include"
+# Counts every heap allocation, for test_frame_allocations.
+WRAP_ALLOC=-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+WRAP_ALLOC=$WRAP_ALLOC,--wrap=aligned_alloc,--wrap=posix_memalign
+
+rm -rf build/tools
+mkdir -p build/tools
+pushd build/tools > /dev/null
+cc -O2 -o optimize_mesh $TOOLS/mesh_optimizer.c $TOOLS/optimize_mesh.c
+cc -O2 -o build_asset_pack $MAIN/asset_pack.c $TOOLS/build_asset_pack.c
+cc -O2 $HOST -o benchmark_command_buffers $MAIN/command_buffer.c\
+    $MAIN/job.c $MAIN/memory.c $TOOLS/benchmark_command_buffers.c -lpthread
+cc -O2 $HOST -o benchmark_jobs $MAIN/job.c $MAIN/memory.c\
+    $TOOLS/benchmark_jobs.c -lpthread
+cc -O2 -o benchmark_transforms $MAIN/transform.c\
+    $TOOLS/benchmark_transforms.c -lm
+cc -O2 -o benchmark_skinning $MAIN/animation.c $TOOLS/benchmark_skinning.c\
+    -lm
+cc -O2 -o benchmark_light_clusters $MAIN/light_clusters.c\
+    $TOOLS/benchmark_light_clusters.c -lm
+cc -O2 -o simulate_governor $MAIN/governor.c $TOOLS/simulate_governor.c
+cc -O2 -o simulate_refresh_rates $MAIN/simulation.c\
+    $TOOLS/simulate_refresh_rates.c -lm
+cc -O2 -o simulate_shadow_cache $MAIN/shadow_cache.c\
+    $TOOLS/simulate_shadow_cache.c -lm
+cc -O2 -o stress_pose_channel $MAIN/pose_channel.c\
+    $TOOLS/stress_pose_channel.c -lm -lpthread
+cc -O2 -o stress_cmd_queue $MAIN/cmd_queue.c $TOOLS/stress_cmd_queue.c\
+    -lpthread
+cc -O2 $HOST $VRAPI -o stress_loader $MAIN/loader.c $TOOLS/host/fake_gl.c\
+    $TOOLS/stress_loader.c -lpthread
+cc -O2 $HOST $VRAPI -o test_texture_streaming $MAIN/gpu_sync.c\
+    $MAIN/texture.c $TOOLS/host/fake_gl.c $TOOLS/host/ktx2_builder.c\
+    $TOOLS/test_texture_streaming.c -lpthread
+cc -O2 $HOST $VRAPI -o test_layers $MAIN/layer.c $TOOLS/host/fake_gl.c\
+    $TOOLS/host/fake_vrapi.c $TOOLS/test_layers.c -lpthread
+cc -O2 $HOST $VRAPI -o test_frame_allocations\
+    $MAIN/animation.c\
+    $MAIN/command_buffer.c\
+    $MAIN/gpu_sync.c\
+    $MAIN/job.c\
+    $MAIN/layer.c\
+    $MAIN/light_clusters.c\
+    $MAIN/loader.c\
+    $MAIN/memory.c\
+    $MAIN/pipeline.c\
+    $MAIN/pose_channel.c\
+    $MAIN/shadow_cache.c\
+    $MAIN/simulation.c\
+    $MAIN/stream_buffer.c\
+    $MAIN/text.c\
+    $MAIN/texture.c\
+    $MAIN/transform.c\
+    $TOOLS/host/fake_gl.c\
+    $TOOLS/host/fake_vrapi.c\
+    $TOOLS/host/ktx2_builder.c\
+    $TOOLS/test_frame_allocations.c\
+    -lm -lpthread $WRAP_ALLOC
+
+./test_frame_allocations 300
+./test_texture_streaming
+./test_layers 300
+./stress_loader 180
+./stress_pose_channel 4 1
+./stress_cmd_queue 4 10000
+./simulate_governor
+./simulate_refresh_rates 30 2
+./simulate_shadow_cache 50
+./benchmark_command_buffers 10000 4
+./benchmark_jobs 4
+./benchmark_transforms 10000
+./benchmark_skinning 50
+./benchmark_light_clusters 1
+./optimize_mesh --benchmark 100
+./build_asset_pack --benchmark 1000
+popd > /dev/null
+echo "all tools passed"